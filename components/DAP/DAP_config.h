@@ -142,7 +142,8 @@ This information includes:
 /// This configuration settings is used to optimize the communication performance with the
 /// debugger and depends on the USB peripheral. For devices with limited RAM or USB buffer the
 /// setting can be reduced (valid range is 1 .. 255).
-#define DAP_PACKET_COUNT 255 ///< Specifies number of packets buffered.
+/// It is the depth of the request pipeline in DAP_handle.c, see DAP_PACKET_QUEUE_DEPTH.
+#define DAP_PACKET_COUNT DAP_PACKET_QUEUE_DEPTH ///< Specifies number of packets buffered.
 
 /// Indicates that the SWO function(UART SWO & Streaming Trace) is available
 #define SWO_FUNCTION_ENABLE 0 ///< SWO function:  1 = available, 0 = not available.
@@ -289,6 +289,8 @@ extern uint32_t JTAG_ReadIDCode (void);
 extern void     JTAG_WriteAbort (uint32_t data);
 extern uint8_t  JTAG_Transfer   (uint32_t request, uint32_t *data);
 extern uint8_t  SWD_Transfer    (uint32_t request, uint32_t *data);
+extern uint32_t SWD_TransferBlock (uint32_t request, const uint8_t *wdata, uint8_t *rdata,
+                                   uint32_t count, uint8_t *ack);
 
 extern void     Delayms         (uint32_t delay);
 
@@ -328,6 +330,8 @@ extern uint32_t DAP_ProcessVendorCommand (const uint8_t *request, uint8_t *respo
 extern uint32_t DAP_ProcessCommand       (const uint8_t *request, uint8_t *response);
 extern uint32_t DAP_ExecuteCommand       (const uint8_t *request, uint8_t *response);
 
+extern void     DAP_SetPacketSize (uint32_t size);
+extern void     DAP_SetPacketCount (uint32_t count);
 extern void     DAP_Setup (void);
 
 // Configurable delay for clock generation
@@ -335,7 +339,9 @@ extern void     DAP_Setup (void);
 #define DELAY_SLOW_CYCLES       3U      // Number of cycles for one iteration
 #endif
 
+#ifndef USE_ASSEMBLY
 #define USE_ASSEMBLY 1
+#endif
 
 #if (USE_ASSEMBLY == 0)
   __STATIC_FORCEINLINE void PIN_DELAY_SLOW(int32_t delay)
@@ -0,0 +1,82 @@
+#ifndef __DAP_STATS_H__
+#define __DAP_STATS_H__
+
+#include <stdint.h>
+
+#include "main/dap_configuration.h"
+
+#define DAP_STATS_BUCKETS     24U   // bucket n: 2^n <= value < 2^(n+1), last one is open ended
+#define DAP_STATS_CMD_NUM     0x21U // standard commands 0x00~0x1F, 0x20 = everything else
+
+// Timings taken outside of the DAP engine, in microseconds
+typedef enum {
+  DAP_STATS_WAIT_SLOT = 0, // network task waiting for a free request slot
+  DAP_STATS_WAIT_RESPONSE, // usbip IN URB waiting for DAP_Thread to finish its request
+  DAP_STATS_NET_SEND,      // one send call to the socket
+  DAP_STATS_EVENT_NUM
+} dap_stats_event_t;
+
+typedef struct {
+  uint32_t count;
+  uint32_t total;                       // sum of all values, wraps
+  uint32_t max;
+  uint32_t hist[DAP_STATS_BUCKETS];
+} dap_stats_hist_t;
+
+typedef struct {
+  dap_stats_hist_t cmd[DAP_STATS_CMD_NUM];     // DAP_ProcessCommand, CPU cycles
+  dap_stats_hist_t event[DAP_STATS_EVENT_NUM]; // dap_stats_event_t, us
+} dap_stats_t;
+
+#if (USE_DAP_STATS == 1)
+
+#if defined(ESP_PLATFORM)
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#define DAP_STATS_CYCLES()    ((uint32_t)esp_cpu_get_cycle_count())
+#define DAP_STATS_TIME_US()   ((uint32_t)esp_timer_get_time())
+#else
+#include "DAP_config.h" // a host port defines DAP_STATS_CYCLES and DAP_STATS_TIME_US
+#endif
+
+extern dap_stats_t DAP_Stats;
+
+static inline __attribute__((always_inline)) void DAP_Stats_Add(dap_stats_hist_t *h, uint32_t value)
+{
+  uint32_t bucket = 31U - (uint32_t)__builtin_clz(value | 1U);
+
+  if (bucket >= DAP_STATS_BUCKETS) {
+    bucket = DAP_STATS_BUCKETS - 1U;
+  }
+  h->count++;
+  h->total += value;
+  if (value > h->max) {
+    h->max = value;
+  }
+  h->hist[bucket]++;
+}
+
+static inline __attribute__((always_inline)) void DAP_Stats_Command(uint8_t id, uint32_t cycles)
+{
+  DAP_Stats_Add(&DAP_Stats.cmd[id < 0x20U ? id : 0x20U], cycles);
+}
+
+static inline __attribute__((always_inline)) void DAP_Stats_Event(dap_stats_event_t event, uint32_t us)
+{
+  DAP_Stats_Add(&DAP_Stats.event[event], us);
+}
+
+extern void DAP_Stats_Reset    (void);
+extern void DAP_Stats_Snapshot (dap_stats_t *stats);
+
+#define DAP_STATS_EVENT_BEGIN(var)      uint32_t var = DAP_STATS_TIME_US()
+#define DAP_STATS_EVENT_END(var, event) DAP_Stats_Event(event, DAP_STATS_TIME_US() - (var))
+
+#else
+
+#define DAP_STATS_EVENT_BEGIN(var)      do {} while (0)
+#define DAP_STATS_EVENT_END(var, event) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef __DAP_TRACE_H__
+#define __DAP_TRACE_H__
+
+#include <stdint.h>
+
+#include "main/dap_configuration.h"
+
+#define DAP_TRACE_MAGIC          0x43525444U // "DTRC"
+#define DAP_TRACE_VERSION        1U
+
+typedef enum {
+  DAP_TRACE_SWD_TRANSFER  = 1, // request: A[3:2] RnW APnDP, ack: ACK[2:0], data: DATA[31:0]
+  DAP_TRACE_SWJ_SEQUENCE  = 2, // request: bit count (0 = 256), data: first 32 bits
+  DAP_TRACE_JTAG_TRANSFER = 3, // same as SWD, index: JTAG device index
+  DAP_TRACE_JTAG_IR       = 4, // data: IR value, index: JTAG device index
+} dap_trace_type_t;
+
+// One wire event, 12 bytes
+typedef struct __attribute__((packed)) {
+  uint32_t timestamp; // TIMESTAMP_GET() at the end of the event
+  uint8_t  type;      // dap_trace_type_t
+  uint8_t  request;
+  uint8_t  ack;
+  uint8_t  index;
+  uint32_t data;
+} dap_trace_record_t;
+
+// Header of the exported file, followed by `count` records
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint8_t  version;
+  uint8_t  record_size;
+  uint16_t reserved;
+  uint32_t timestamp_clock; // TIMESTAMP_CLOCK in Hz
+  uint32_t first_seq;       // sequence number of the first record
+  uint32_t count;
+  uint32_t lost;            // records overwritten before they could be exported
+} dap_trace_file_hdr_t;
+
+typedef struct {
+  uint32_t head;     // total number of records written
+  uint32_t base;     // first record kept after the last clear
+  uint32_t capacity; // ring size in records
+  uint8_t  enabled;
+} dap_trace_status_t;
+
+#if (USE_DAP_TRACE == 1)
+
+extern void     DAP_Trace_Record (uint8_t type, uint8_t request, uint8_t ack, uint32_t data);
+extern void     DAP_Trace_Enable (uint8_t enable);
+extern void     DAP_Trace_Clear  (void);
+extern void     DAP_Trace_GetStatus (dap_trace_status_t *status);
+extern uint32_t DAP_Trace_Read   (uint32_t *seq, dap_trace_record_t *buf, uint32_t num);
+
+#define DAP_TRACE(type, request, ack, data) DAP_Trace_Record(type, request, ack, data)
+
+#else
+
+#define DAP_TRACE(type, request, ack, data) ((void)0)
+
+#endif
+
+#endif
@@ -15,14 +15,32 @@
 
 
 extern const uint8_t kParityByteTable[256];
+extern const uint8_t kSwdRequestByteTable[16];
 
 __STATIC_FORCEINLINE uint8_t ParityEvenUint32(uint32_t v)
 {
+#if defined(__riscv_zbb) || defined(__POPCNT__)
+    // single cpop/popcnt instruction
+    return __builtin_parity(v);
+#else
+    // none of the current Xtensa/RISC-V targets has a popcount instruction
     v ^= v >> 16;
     v ^= v >> 8;
     v ^= v >> 4;
     v &= 0xf;
     return (0x6996 >> v) & 1;
+#endif
+}
+
+/**
+ * @brief SWD packet request byte, LSB first:
+ * Start(1) APnDP RnW A2 A3 Parity Stop(0) Park(1)
+ *
+ * @param request A[3:2] RnW APnDP, higher bits are ignored
+ */
+__STATIC_FORCEINLINE uint8_t SwdRequestByte(uint32_t request)
+{
+    return kSwdRequestByteTable[request & 0xF];
 }
 
 __STATIC_FORCEINLINE uint8_t ParityEvenUint8(uint8_t v)
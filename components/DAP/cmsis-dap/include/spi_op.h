@@ -10,6 +10,8 @@ void DAP_SPI_ReadBits(const uint8_t count, uint8_t *buf);
 void DAP_SPI_Send_Header(const uint8_t packetHeaderData, uint8_t *ack, uint8_t TrnAfterACK);
 void DAP_SPI_Read_Data(uint32_t* resData, uint8_t* resParity);
 void DAP_SPI_Write_Data(uint32_t data, uint8_t parity);
+void DAP_SPI_Write_Data_Start(uint32_t data, uint8_t parity);
+void DAP_SPI_Wait_Done();
 
 void DAP_SPI_Generate_Cycle(uint8_t num);
 void DAP_SPI_Fast_Cycle();
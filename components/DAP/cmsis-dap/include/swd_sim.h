@@ -0,0 +1,28 @@
+#ifndef __SWD_SIM_H__
+#define __SWD_SIM_H__
+
+#include <stdint.h>
+
+#define SWD_SIM_IDCODE      0x2BA01477U // ARM CoreSight SW-DP (ADIv5)
+#define SWD_SIM_AP_IDR      0x24770011U // AHB-AP, MEM-AP class
+#define SWD_SIM_RAM_BASE    0x20000000U
+#define SWD_SIM_RAM_SIZE    (16U * 1024U)
+
+typedef struct {
+    uint32_t transfers; // number of SWD_Transfer calls served
+    uint32_t waits;     // number of injected WAIT responses
+    uint32_t faults;    // number of FAULT responses
+} swd_sim_stats_t;
+
+void SWD_Sim_Reset(void);
+void SWD_Sim_LineReset(void);
+void SWD_Sim_SetWaitInterval(uint32_t interval);
+void SWD_Sim_GetStats(swd_sim_stats_t *stats);
+
+uint8_t SWD_Sim_Transfer(uint32_t request, uint32_t *data);
+
+// the two phases of SWD_Sim_Transfer, for a model of the SPI backend
+uint8_t SWD_Sim_Request(uint32_t request);
+void SWD_Sim_Data(uint32_t request, uint32_t *data);
+
+#endif
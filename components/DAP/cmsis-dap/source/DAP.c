@@ -30,6 +30,8 @@
 #include "DAP_config.h"
 #include "cmsis-dap/include/DAP.h"
 #include "cmsis-dap/include/spi_switch.h"
+#include "cmsis-dap/include/swd_sim.h"
+#include "cmsis-dap/include/dap_stats.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -60,6 +62,9 @@
          DAP_Data_t DAP_Data;           // DAP Data
 volatile uint8_t    DAP_TransferAbort;  // Transfer Abort Flag
 
+static   uint16_t   DAP_PacketSize = DAP_PACKET_SIZE; // Packet Size of the current session
+static   uint8_t    DAP_PacketCount = DAP_PACKET_COUNT; // Packet Count of the current session
+
 
 static const char DAP_FW_Ver [] = DAP_FW_VER;
 
@@ -151,12 +156,12 @@ static uint8_t DAP_Info(uint8_t id, uint8_t *info) {
 #endif
       break;
     case DAP_ID_PACKET_SIZE:
-      info[0] = (uint8_t)(DAP_PACKET_SIZE >> 0);
-      info[1] = (uint8_t)(DAP_PACKET_SIZE >> 8);
+      info[0] = (uint8_t)(DAP_PacketSize >> 0);
+      info[1] = (uint8_t)(DAP_PacketSize >> 8);
       length = 2U;
       break;
     case DAP_ID_PACKET_COUNT:
-      info[0] = DAP_PACKET_COUNT;
+      info[0] = DAP_PacketCount;
       length = 1U;
       break;
     default:
@@ -1344,6 +1349,8 @@ static uint32_t DAP_SWD_TransferBlock(const uint8_t *request, uint8_t *response)
   uint8_t  *response_head;
   uint32_t  retry;
   uint32_t  data;
+  uint32_t  num;
+  uint8_t   ack;
 
   response_count = 0U;
   response_value = 0U;
@@ -1374,8 +1381,27 @@ static uint32_t DAP_SWD_TransferBlock(const uint8_t *request, uint8_t *response)
         goto end;
       }
     }
-    while (request_count--) {
-      // Read DP/AP register
+    while (request_count) {
+      // Stream the block, the last AP read is taken from RDBUFF below
+      num = request_count;
+      if ((request_value & DAP_TRANSFER_APnDP) != 0U) {
+        num--;
+      }
+      if (num != 0U) {
+        num = SWD_TransferBlock(request_value, NULL, response, num, &ack);
+        response_value  = ack;
+        response       += num * 4U;
+        response_count += num;
+        request_count  -= num;
+        if (((ack != DAP_TRANSFER_OK) && (ack != DAP_TRANSFER_WAIT)) || DAP_TransferAbort) {
+          goto end;
+        }
+        if (request_count == 0U) {
+          break;
+        }
+      }
+      request_count--;
+      // Read DP/AP register, retry on WAIT
       if ((request_count == 0U) && ((request_value & DAP_TRANSFER_APnDP) != 0U)) {
         // Last AP read
         request_value = DP_RDBUFF | DAP_TRANSFER_RnW;
@@ -1396,8 +1422,21 @@ static uint32_t DAP_SWD_TransferBlock(const uint8_t *request, uint8_t *response)
     }
   } else {
     // Write register block
-    while (request_count--) {
-      // Load data
+    while (request_count) {
+      // Stream the block
+      num = SWD_TransferBlock(request_value, request, NULL, request_count, &ack);
+      response_value  = ack;
+      request        += num * 4U;
+      response_count += num;
+      request_count  -= num;
+      if (((ack != DAP_TRANSFER_OK) && (ack != DAP_TRANSFER_WAIT)) || DAP_TransferAbort) {
+        goto end;
+      }
+      if (request_count == 0U) {
+        break;
+      }
+      request_count--;
+      // Load data, retry on WAIT
       data = (uint32_t)(*(request+0) <<  0) |
              (uint32_t)(*(request+1) <<  8) |
              (uint32_t)(*(request+2) << 16) |
@@ -1679,12 +1718,12 @@ __WEAK uint32_t DAP_ProcessVendorCommand(const uint8_t *request, uint8_t *respon
 }
 
 
-// Process DAP command request and prepare response
+// Process DAP command request and prepare response, without statistics
 //   request:  pointer to request data
 //   response: pointer to response data
 //   return:   number of bytes in response (lower 16 bits)
 //             number of bytes in request (upper 16 bits)
-uint32_t DAP_ProcessCommand(const uint8_t *request, uint8_t *response) {
+static uint32_t DAP_ProcessOneCommand(const uint8_t *request, uint8_t *response) {
   uint32_t num;
 
   if ((*request >= ID_DAP_Vendor0) && (*request <= ID_DAP_Vendor31)) {
@@ -1810,6 +1849,24 @@ uint32_t DAP_ProcessCommand(const uint8_t *request, uint8_t *response) {
 }
 
 
+// Process DAP command request and prepare response
+//   request:  pointer to request data
+//   response: pointer to response data
+//   return:   number of bytes in response (lower 16 bits)
+//             number of bytes in request (upper 16 bits)
+uint32_t DAP_ProcessCommand(const uint8_t *request, uint8_t *response) {
+#if (USE_DAP_STATS == 1)
+  uint32_t start = DAP_STATS_CYCLES();
+  uint32_t num = DAP_ProcessOneCommand(request, response);
+
+  DAP_Stats_Command(*request, DAP_STATS_CYCLES() - start);
+  return num;
+#else
+  return DAP_ProcessOneCommand(request, response);
+#endif
+}
+
+
 // Execute DAP command (process request and prepare response)
 //   request:  pointer to request data
 //   response: pointer to response data
@@ -1836,6 +1893,34 @@ uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response) {
 }
 
 
+// Set Packet Size reported by DAP_Info
+//   size:    packet size of the transport the following commands come from,
+//            the caller provides request and response buffers of this size
+void DAP_SetPacketSize(uint32_t size) {
+  if (size < 64U) {
+    size = 64U;
+  }
+  if (size > 32768U) {
+    size = 32768U;
+  }
+  DAP_PacketSize = (uint16_t)size;
+}
+
+
+// Set Packet Count reported by DAP_Info
+//   count:   number of packets the transport the following commands come from
+//            can hold, requests the host may have in flight
+void DAP_SetPacketCount(uint32_t count) {
+  if (count < 1U) {
+    count = 1U;
+  }
+  if (count > 255U) {
+    count = 255U;
+  }
+  DAP_PacketCount = (uint8_t)count;
+}
+
+
 // Setup DAP
 void DAP_Setup(void) {
 
@@ -1856,6 +1941,10 @@ void DAP_Setup(void) {
 #endif
 
   DAP_SETUP();  // Device specific setup
+
+#if (USE_SWD_SIM != 0)
+  SWD_Sim_Reset();
+#endif
 }
 
 void dap_os_delay(int ms)
@@ -27,6 +27,7 @@
 
 #include "DAP_config.h"
 #include "cmsis-dap/include/DAP.h"
+#include "cmsis-dap/include/dap_trace.h"
 
 
 // JTAG Macros
@@ -351,6 +352,7 @@ void JTAG_IR (uint32_t ir) {
   } else {
     JTAG_IR_Slow(ir);
   }
+  DAP_TRACE(DAP_TRACE_JTAG_IR, 0U, 0U, ir);
 }
 
 
@@ -359,11 +361,15 @@ void JTAG_IR (uint32_t ir) {
 //   data:    DATA[31:0]
 //   return:  ACK[2:0]
 uint8_t  JTAG_Transfer(uint32_t request, uint32_t *data) {
+  uint8_t ack;
+
   if (DAP_Data.fast_clock) {
-    return JTAG_TransferFast(request, data);
+    ack = JTAG_TransferFast(request, data);
   } else {
-    return JTAG_TransferSlow(request, data);
+    ack = JTAG_TransferSlow(request, data);
   }
+  DAP_TRACE(DAP_TRACE_JTAG_TRANSFER, (uint8_t)request, ack, data ? *data : 0U);
+  return ack;
 }
 
 
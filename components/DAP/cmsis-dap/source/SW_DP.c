@@ -26,12 +26,15 @@
  *---------------------------------------------------------------------------*/
 
 #include <stdio.h>
+#include <string.h>
 
 #include "DAP_config.h"
 #include "cmsis-dap/include/DAP.h"
 #include "cmsis-dap/include/spi_op.h"
 #include "cmsis-dap/include/spi_switch.h"
 #include "cmsis-dap/include/dap_utility.h"
+#include "cmsis-dap/include/swd_sim.h"
+#include "cmsis-dap/include/dap_trace.h"
 
 
 // Debug
@@ -91,6 +94,19 @@ void SWJ_Sequence (uint32_t count, const uint8_t *data) {
   //   return;
   // }
 
+#if (USE_DAP_TRACE == 1)
+  uint32_t first = 0U;
+  memcpy(&first, data, count >= 32U ? 4U : (count + 7U) / 8U);
+  DAP_TRACE(DAP_TRACE_SWJ_SEQUENCE, (uint8_t)count, 0U, first);
+#endif
+
+#if (USE_SWD_SIM == 1)
+  if (count >= 50U) {
+    SWD_Sim_LineReset();
+  }
+  return;
+#endif
+
   if(SWD_TransferSpeed == kTransfer_SPI) {
     SWJ_Sequence_SPI(count, data);
   } else {
@@ -136,6 +152,14 @@ void SWJ_Sequence_SPI (uint32_t count, const uint8_t *data) {
 //   return: none
 #if (DAP_SWD != 0)
 void SWD_Sequence (uint32_t info, const uint8_t *swdo, uint8_t *swdi) {
+#if (USE_SWD_SIM == 1)
+  if (info & SWD_SEQUENCE_DIN) {
+    uint32_t n = info & SWD_SEQUENCE_CLK;
+    memset(swdi, 0, ((n == 0U ? 64U : n) + 7U) / 8U);
+  }
+  return;
+#endif
+
   if (SWD_TransferSpeed == kTransfer_SPI) {
     SWD_Sequence_SPI(info, swdo, swdi);
   } else {
@@ -200,6 +224,9 @@ void SWD_Sequence_SPI (uint32_t info, const uint8_t *swdo, uint8_t *swdi) {
 #if (DAP_SWD != 0)
 
 
+// the simulated target of USE_SWD_SIM 1 replaces both wire backends
+#if (USE_SWD_SIM != 1)
+
 // SWD Transfer I/O
 //   request: A[3:2] RnW APnDP
 //   data:    DATA[31:0]
@@ -215,14 +242,12 @@ static uint8_t SWD_Transfer_SPI (uint32_t request, uint32_t *data) {
 
   uint32_t n;
 
-  const uint8_t constantBits = 0b10000001U; /* Start Bit  & Stop Bit & Park Bit is fixed. */
   uint8_t requestByte;  /* LSB */
 
 
   DAP_SPI_Enable();
 
-  requestByte = constantBits | (((uint8_t)(request & 0xFU)) << 1U) | (ParityEvenUint8(request & 0xFU) << 5U);
-  /* For 4bit, Parity can be equivalent to 8bit with all 0 high bits */
+  requestByte = SwdRequestByte(request);
 
 #if (PRINT_SWD_PROTOCOL == 1)
   switch (requestByte)
@@ -381,23 +406,11 @@ static uint8_t SWD_Transfer_GPIO (uint32_t request, uint32_t *data, uint8_t need
   uint32_t n;
 
   /* Packet Request */
-  parity = 0U;
-  SW_WRITE_BIT(1U);                     /* Start Bit */
-  bit = request >> 0;
-  SW_WRITE_BIT(bit);                    /* APnDP Bit */
-  parity += bit;
-  bit = request >> 1;
-  SW_WRITE_BIT(bit);                    /* RnW Bit */
-  parity += bit;
-  bit = request >> 2;
-  SW_WRITE_BIT(bit);                    /* A2 Bit */
-  parity += bit;
-  bit = request >> 3;
-  SW_WRITE_BIT(bit);                    /* A3 Bit */
-  parity += bit;
-  SW_WRITE_BIT(parity);                 /* Parity Bit */
-  SW_WRITE_BIT(0U);                     /* Stop Bit */
-  SW_WRITE_BIT(1U);                     /* Park Bit */
+  val = SwdRequestByte(request);        /* Start, APnDP, RnW, A2, A3, Parity, Stop, Park */
+  for (n = 8U; n; n--) {
+    SW_WRITE_BIT(val);
+    val >>= 1;
+  }
 
   /* Turnaround */
   PIN_SWDIO_OUT_DISABLE();
@@ -499,21 +512,210 @@ static uint8_t SWD_Transfer_GPIO (uint32_t request, uint32_t *data, uint8_t need
 }
 
 
+// SWD Transfer Block I/O (SPI)
+// The request byte and the SPI setup are shared by all words of the block,
+// header and data phases are issued back to back. SWCLK does not run between
+// the words, so the SPI is released once after the last one instead of per word.
+//   request: A[3:2] RnW APnDP
+//   wdata:   data to write, 4 bytes per word, LSB first (write)
+//   rdata:   captured data, 4 bytes per word, LSB first (read)
+//   count:   number of words
+//   ack:     ACK[2:0] of the last transfer
+//   return:  number of words transferred with ACK OK
+static uint32_t SWD_TransferBlock_SPI (uint32_t request, const uint8_t *wdata, uint8_t *rdata,
+                                       uint32_t count, uint8_t *ack) {
+  const uint8_t requestByte = SwdRequestByte(request);  /* LSB */
+  uint8_t parity;
+  uint32_t val;
+  uint32_t idle;
+  uint32_t n;
+
+  idle = DAP_Data.transfer.idle_cycles;
+  *ack = DAP_TRANSFER_OK;
+  if (count == 0U) {
+    return 0U;
+  }
+
+  DAP_SPI_Enable();
+
+  if (request & DAP_TRANSFER_RnW) {
+    /* Read data */
+    for (n = 0U; n < count; n++) {
+      if (DAP_TransferAbort) {
+        break;
+      }
+      DAP_SPI_Send_Header(requestByte, ack, 0); // 0 Trn After ACK
+      if (*ack != DAP_TRANSFER_OK) {
+        break;
+      }
+      DAP_SPI_Read_Data(&val, &parity);
+      if ((ParityEvenUint32(val) ^ parity) & 1U) {
+        *ack = DAP_TRANSFER_ERROR;
+        break;
+      }
+      *rdata++ = (uint8_t) val;
+      *rdata++ = (uint8_t)(val >>  8);
+      *rdata++ = (uint8_t)(val >> 16);
+      *rdata++ = (uint8_t)(val >> 24);
+      DAP_TRACE(DAP_TRACE_SWD_TRANSFER, (uint8_t)request, *ack, val);
+    }
+    if (n < count) {
+      DAP_TRACE(DAP_TRACE_SWD_TRANSFER, (uint8_t)request, *ack, 0U);
+    }
+
+    if ((*ack == DAP_TRANSFER_WAIT) || (*ack == DAP_TRANSFER_FAULT)) {
+#if defined CONFIG_IDF_TARGET_ESP8266 || defined CONFIG_IDF_TARGET_ESP32
+      DAP_SPI_Generate_Cycle(1);
+#elif defined CONFIG_IDF_TARGET_ESP32C3 || defined CONFIG_IDF_TARGET_ESP32S3
+      DAP_SPI_Fast_Cycle();
+#endif
+    }
+    else if ((*ack != DAP_TRANSFER_OK) && (*ack != DAP_TRANSFER_ERROR)) {
+      /* Protocol error */
+      DAP_SPI_Disable();
+      PIN_SWDIO_TMS_SET();
+
+      DAP_SPI_Enable();
+      DAP_SPI_Protocol_Error_Read();
+
+      DAP_SPI_Disable();
+      PIN_SWDIO_TMS_SET();
+    }
+  }
+  else {
+    /* Write data */
+    val = (uint32_t)(*(wdata+0) <<  0) |
+          (uint32_t)(*(wdata+1) <<  8) |
+          (uint32_t)(*(wdata+2) << 16) |
+          (uint32_t)(*(wdata+3) << 24);
+    parity = ParityEvenUint32(val);
+    for (n = 0U; n < count; n++) {
+      if (DAP_TransferAbort) {
+        break;
+      }
+      DAP_SPI_Send_Header(requestByte, ack, 1); // 1 Trn After ACK
+      DAP_TRACE(DAP_TRACE_SWD_TRANSFER, (uint8_t)request, *ack, val);
+      if (*ack != DAP_TRANSFER_OK) {
+        break;
+      }
+      DAP_SPI_Write_Data_Start(val, parity);
+      /* Prepare the next word while the data phase is on the wire */
+      if (n + 1U < count) {
+        wdata += 4;
+        val = (uint32_t)(*(wdata+0) <<  0) |
+              (uint32_t)(*(wdata+1) <<  8) |
+              (uint32_t)(*(wdata+2) << 16) |
+              (uint32_t)(*(wdata+3) << 24);
+        parity = ParityEvenUint32(val);
+      }
+      DAP_SPI_Wait_Done();
+      /* Idle cycles */
+      if (idle) { DAP_SPI_Generate_Cycle(idle); }
+    }
+
+    if (n != 0U) {
+      DAP_SPI_Disable();
+      PIN_SWDIO_TMS_SET();
+    }
+
+    if ((*ack != DAP_TRANSFER_OK) && (*ack != DAP_TRANSFER_WAIT) && (*ack != DAP_TRANSFER_FAULT)) {
+      /* Protocol error */
+      DAP_SPI_Disable();
+      PIN_SWDIO_TMS_SET();
+
+      DAP_SPI_Enable();
+      DAP_SPI_Protocol_Error_Write();
+
+      DAP_SPI_Disable();
+      PIN_SWDIO_TMS_SET();
+    }
+  }
+
+  return n;
+}
+
+#endif  /* (USE_SWD_SIM != 1) */
+
+
+// SWD Transfer Block I/O
+// Transfers words with the same request until all are done or an ACK other than OK
+// is received. There is no WAIT retry, the caller falls back to SWD_Transfer for that.
+// DAP_TransferAbort is checked before every word, an aborted block returns early with
+// ACK OK. Match value and timestamp requests are not supported.
+//   request: A[3:2] RnW APnDP
+//   wdata:   data to write, 4 bytes per word, LSB first (write)
+//   rdata:   captured data, 4 bytes per word, LSB first (read)
+//   count:   number of words
+//   ack:     ACK[2:0] of the last transfer
+//   return:  number of words transferred with ACK OK
+uint32_t SWD_TransferBlock(uint32_t request, const uint8_t *wdata, uint8_t *rdata,
+                           uint32_t count, uint8_t *ack) {
+  uint32_t val;
+  uint32_t n;
+
+#if (USE_SWD_SIM != 1)
+  if (SWD_TransferSpeed == kTransfer_SPI) {
+    return SWD_TransferBlock_SPI(request, wdata, rdata, count, ack);
+  }
+#endif
+
+  *ack = DAP_TRANSFER_OK;
+  for (n = 0U; n < count; n++) {
+    if (DAP_TransferAbort) {
+      break;
+    }
+    if (request & DAP_TRANSFER_RnW) {
+      *ack = SWD_Transfer(request, &val);
+      if (*ack != DAP_TRANSFER_OK) {
+        break;
+      }
+      *rdata++ = (uint8_t) val;
+      *rdata++ = (uint8_t)(val >>  8);
+      *rdata++ = (uint8_t)(val >> 16);
+      *rdata++ = (uint8_t)(val >> 24);
+    } else {
+      val = (uint32_t)(*(wdata+0) <<  0) |
+            (uint32_t)(*(wdata+1) <<  8) |
+            (uint32_t)(*(wdata+2) << 16) |
+            (uint32_t)(*(wdata+3) << 24);
+      wdata += 4;
+      *ack = SWD_Transfer(request, &val);
+      if (*ack != DAP_TRANSFER_OK) {
+        break;
+      }
+    }
+  }
+
+  return n;
+}
+
+
 // SWD Transfer I/O
 //   request: A[3:2] RnW APnDP
 //   data:    DATA[31:0]
 //   return:  ACK[2:0]
 uint8_t  SWD_Transfer(uint32_t request, uint32_t *data) {
+  uint8_t ack;
+
+#if (USE_SWD_SIM == 1)
+  ack = SWD_Sim_Transfer(request, data);
+#else
   switch (SWD_TransferSpeed) {
     case kTransfer_SPI:
-      return SWD_Transfer_SPI(request, data);
+      ack = SWD_Transfer_SPI(request, data);
+      break;
     case kTransfer_GPIO_fast:
-      return SWD_Transfer_GPIO(request, data, 0);
+      ack = SWD_Transfer_GPIO(request, data, 0);
+      break;
     case kTransfer_GPIO_normal:
-      return SWD_Transfer_GPIO(request, data, 1);
     default:
-      return SWD_Transfer_GPIO(request, data, 1);
+      ack = SWD_Transfer_GPIO(request, data, 1);
+      break;
   }
+#endif
+
+  DAP_TRACE(DAP_TRACE_SWD_TRANSFER, (uint8_t)request, ack, data ? *data : 0U);
+  return ack;
 }
 
 
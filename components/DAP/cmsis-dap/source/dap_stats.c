@@ -0,0 +1,36 @@
+/**
+ * @file dap_stats.c
+ * @brief Per command counters and log2 latency histograms.
+ *        Commands are counted by whichever task runs the DAP engine, the transports are
+ *        serialized by the engine mutex (dap_engine_mux). The other events come from the task
+ *        of the usbip session, there is only one. Each histogram thus has one writer at a time.
+ *        Readers take a plain copy, a value being updated at that moment may be off by one count.
+ * @change: 2026-10-17 first version
+ *          2026-10-17 writers serialized by dap_engine_mux
+ * @version 0.2
+ * @date 2026-10-17
+ *
+ * @copyright MIT License
+ *
+ */
+
+#include <string.h>
+
+#include "cmsis-dap/include/dap_stats.h"
+
+#if (USE_DAP_STATS == 1)
+
+dap_stats_t DAP_Stats;
+
+
+void DAP_Stats_Reset(void)
+{
+  memset(&DAP_Stats, 0, sizeof(DAP_Stats));
+}
+
+void DAP_Stats_Snapshot(dap_stats_t *stats)
+{
+  memcpy(stats, &DAP_Stats, sizeof(DAP_Stats));
+}
+
+#endif /* (USE_DAP_STATS == 1) */
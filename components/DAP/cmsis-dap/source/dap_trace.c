@@ -0,0 +1,132 @@
+/**
+ * @file dap_trace.c
+ * @brief Wire level trace of SWD/JTAG transfers.
+ *        Records are written by whichever task runs the DAP engine, the writers are serialized
+ *        by the engine mutex (dap_engine_mux). Readers copy the ring without locking: a writer
+ *        publishes a record by advancing `head`, a reader checks `head` again after copying
+ *        and drops what may have been overwritten meanwhile.
+ * @change: 2026-10-17 first version
+ *          2026-10-17 also drop the record that may be half overwritten
+ * @version 0.2
+ * @date 2026-10-17
+ *
+ * @copyright MIT License
+ *
+ */
+
+#include <string.h>
+
+#include "DAP_config.h"
+#include "cmsis-dap/include/DAP.h"
+#include "cmsis-dap/include/dap_trace.h"
+
+#if (USE_DAP_TRACE == 1)
+
+#if (DAP_TRACE_RECORD_NUM & (DAP_TRACE_RECORD_NUM - 1))
+#error DAP_TRACE_RECORD_NUM must be a power of 2
+#endif
+
+static dap_trace_record_t trace_ring[DAP_TRACE_RECORD_NUM];
+static uint32_t trace_head; // sequence number of the next record
+static uint32_t trace_base; // records before this one have been cleared
+static uint8_t trace_enabled;
+
+
+// Record one wire event, the cost is one timestamp read and one 12 byte store
+void DAP_Trace_Record(uint8_t type, uint8_t request, uint8_t ack, uint32_t data)
+{
+  dap_trace_record_t *rec;
+  uint32_t head;
+
+  if (!trace_enabled) {
+    return;
+  }
+
+  head = trace_head;
+  rec = &trace_ring[head & (DAP_TRACE_RECORD_NUM - 1U)];
+  rec->timestamp = TIMESTAMP_GET();
+  rec->type      = type;
+  rec->request   = request;
+  rec->ack       = ack;
+#if (DAP_JTAG != 0)
+  rec->index     = DAP_Data.jtag_dev.index;
+#else
+  rec->index     = 0U;
+#endif
+  rec->data      = data;
+
+  __atomic_store_n(&trace_head, head + 1U, __ATOMIC_RELEASE);
+}
+
+void DAP_Trace_Enable(uint8_t enable)
+{
+  trace_enabled = enable;
+}
+
+// Only drops what has been recorded so far, does not need to stop the writer
+void DAP_Trace_Clear(void)
+{
+  trace_base = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+}
+
+void DAP_Trace_GetStatus(dap_trace_status_t *status)
+{
+  status->head     = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+  status->base     = trace_base;
+  status->capacity = DAP_TRACE_RECORD_NUM;
+  status->enabled  = trace_enabled;
+}
+
+// Copy records starting at sequence number *seq
+//   seq:    in: first wanted record, out: sequence number of buf[0]
+//           (moved forward if the wanted records have been overwritten)
+//   buf:    output records
+//   num:    size of buf in records
+//   return: number of records copied
+uint32_t DAP_Trace_Read(uint32_t *seq, dap_trace_record_t *buf, uint32_t num)
+{
+  uint32_t head, oldest, first, n, i, lost;
+
+retry:
+  head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+  oldest = (head > DAP_TRACE_RECORD_NUM) ? head - DAP_TRACE_RECORD_NUM : 0U;
+  if (oldest < trace_base) {
+    oldest = trace_base;
+  }
+  first = *seq;
+  if (first < oldest || first > head) {
+    first = oldest;
+  }
+  n = head - first;
+  if (n > num) {
+    n = num;
+  }
+
+  for (i = 0U; i < n; i++) {
+    buf[i] = trace_ring[(first + i) & (DAP_TRACE_RECORD_NUM - 1U)];
+  }
+
+  // the writer may have wrapped over the oldest records while copying. Record `head` is
+  // written before `head` moves, so the slot of record head - DAP_TRACE_RECORD_NUM may be
+  // half overwritten as well.
+  head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+  lost = 0U;
+  if (head >= DAP_TRACE_RECORD_NUM && head - DAP_TRACE_RECORD_NUM >= first) {
+    lost = head - DAP_TRACE_RECORD_NUM - first + 1U;
+  }
+  if (lost > n) { // n may be 0 if the writer ran a whole ring ahead
+    lost = n;
+  }
+  if (lost >= n && n != 0U) {
+    *seq = 0U; // restart from the oldest record still available
+    goto retry;
+  }
+  if (lost) {
+    memmove(buf, &buf[lost], (n - lost) * sizeof(dap_trace_record_t));
+  }
+
+  *seq = first + lost;
+  return n - lost;
+}
+
+#endif /* (USE_DAP_TRACE == 1) */
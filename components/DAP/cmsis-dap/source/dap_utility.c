@@ -8,3 +8,12 @@ const uint8_t kParityByteTable[256] =
 
     P6(0), P6(1), P6(1), P6(0)
 };
+
+const uint8_t kSwdRequestByteTable[16] =
+{
+    #define REQ(n) (uint8_t)(0x81U | ((n) << 1) | (kParityNibble(n) << 5))
+    #define kParityNibble(n) ((0x6996U >> (n)) & 1U)
+
+    REQ(0x0), REQ(0x1), REQ(0x2), REQ(0x3), REQ(0x4), REQ(0x5), REQ(0x6), REQ(0x7),
+    REQ(0x8), REQ(0x9), REQ(0xA), REQ(0xB), REQ(0xC), REQ(0xD), REQ(0xE), REQ(0xF)
+};
@@ -7,8 +7,9 @@
  *          2021-3-10 Support 3-wire SPI
  *          2022-9-15 Support ESP32C3
  *          2024-6-9  Fix DAP_SPI_WriteBits issue
- * @version 0.5
- * @date 2024-6-9
+ *          2026-10-17 Split start/wait of the data phase
+ * @version 0.6
+ * @date 2026-10-17
  *
  * @copyright MIT License
  *
@@ -41,33 +42,41 @@
 #ifdef CONFIG_IDF_TARGET_ESP8266
     #define SET_MOSI_BIT_LEN(x) DAP_SPI.user1.usr_mosi_bitlen = x
     #define SET_MISO_BIT_LEN(x) DAP_SPI.user1.usr_miso_bitlen = x
-    #define START_AND_WAIT_SPI_TRANSMISSION_DONE() \
+    #define START_SPI_TRANSMISSION()               \
         do {                                       \
             DAP_SPI.cmd.usr = 1;                   \
-            while (DAP_SPI.cmd.usr) continue;      \
         } while(0)
 
 #elif defined CONFIG_IDF_TARGET_ESP32
     #define SET_MOSI_BIT_LEN(x) DAP_SPI.mosi_dlen.usr_mosi_dbitlen = x
     #define SET_MISO_BIT_LEN(x) DAP_SPI.miso_dlen.usr_miso_dbitlen = x
-    #define START_AND_WAIT_SPI_TRANSMISSION_DONE() \
+    #define START_SPI_TRANSMISSION()               \
         do {                                       \
             DAP_SPI.cmd.usr = 1;                   \
-            while (DAP_SPI.cmd.usr) continue;      \
         } while(0)
 
 #elif defined CONFIG_IDF_TARGET_ESP32C3 || defined CONFIG_IDF_TARGET_ESP32S3
     #define SET_MOSI_BIT_LEN(x) DAP_SPI.ms_dlen.ms_data_bitlen = x
     #define SET_MISO_BIT_LEN(x) DAP_SPI.ms_dlen.ms_data_bitlen = x
-    #define START_AND_WAIT_SPI_TRANSMISSION_DONE() \
+    #define START_SPI_TRANSMISSION()               \
         do {                                       \
             DAP_SPI.cmd.update = 1;                \
             while (DAP_SPI.cmd.update) continue;   \
             DAP_SPI.cmd.usr = 1;                   \
-            while (DAP_SPI.cmd.usr) continue;      \
         } while(0)
 #endif
 
+#define WAIT_SPI_TRANSMISSION_DONE()           \
+    do {                                       \
+        while (DAP_SPI.cmd.usr) continue;      \
+    } while(0)
+
+#define START_AND_WAIT_SPI_TRANSMISSION_DONE() \
+    do {                                       \
+        START_SPI_TRANSMISSION();              \
+        WAIT_SPI_TRANSMISSION_DONE();          \
+    } while(0)
+
 /**
  * @brief Calculate integer division and round up
  *
@@ -259,12 +268,13 @@ __FORCEINLINE void DAP_SPI_Read_Data(uint32_t *resData, uint8_t *resParity)
 
 #if defined CONFIG_IDF_TARGET_ESP8266 || defined CONFIG_IDF_TARGET_ESP32
 /**
- * @brief Step2: Write Data
+ * @brief Step2: Write Data, without waiting for the end of the transmission.
+ *        DAP_SPI_Wait_Done must be called before the next SPI operation.
  *
  * @param data data from host
  * @param parity parity from host
  */
-__FORCEINLINE void DAP_SPI_Write_Data(uint32_t data, uint8_t parity)
+__FORCEINLINE void DAP_SPI_Write_Data_Start(uint32_t data, uint8_t parity)
 {
     DAP_SPI.user.usr_mosi = 1;
     DAP_SPI.user.usr_miso = 0;
@@ -275,10 +285,10 @@ __FORCEINLINE void DAP_SPI_Write_Data(uint32_t data, uint8_t parity)
     DAP_SPI.data_buf[0] = data;
     DAP_SPI.data_buf[1] = parity;
 
-    START_AND_WAIT_SPI_TRANSMISSION_DONE();
+    START_SPI_TRANSMISSION();
 }
 #elif defined CONFIG_IDF_TARGET_ESP32C3 || defined CONFIG_IDF_TARGET_ESP32S3
-__FORCEINLINE void DAP_SPI_Write_Data(uint32_t data, uint8_t parity)
+__FORCEINLINE void DAP_SPI_Write_Data_Start(uint32_t data, uint8_t parity)
 {
     DAP_SPI.user.usr_mosi = 1;
     DAP_SPI.user.usr_miso = 0;
@@ -289,10 +299,31 @@ __FORCEINLINE void DAP_SPI_Write_Data(uint32_t data, uint8_t parity)
     DAP_SPI.data_buf[0] = data;
     DAP_SPI.data_buf[1] = parity == 0 ? 0b00 : 0b01;
 
-    START_AND_WAIT_SPI_TRANSMISSION_DONE();
+    START_SPI_TRANSMISSION();
 }
 #endif
 
+/**
+ * @brief Wait for the end of a transmission started by DAP_SPI_Write_Data_Start
+ *
+ */
+__FORCEINLINE void DAP_SPI_Wait_Done()
+{
+    WAIT_SPI_TRANSMISSION_DONE();
+}
+
+/**
+ * @brief Step2: Write Data
+ *
+ * @param data data from host
+ * @param parity parity from host
+ */
+__FORCEINLINE void DAP_SPI_Write_Data(uint32_t data, uint8_t parity)
+{
+    DAP_SPI_Write_Data_Start(data, parity);
+    WAIT_SPI_TRANSMISSION_DONE();
+}
+
 
 #if defined CONFIG_IDF_TARGET_ESP8266 || defined CONFIG_IDF_TARGET_ESP32 || defined CONFIG_IDF_TARGET_ESP32S3
 /**
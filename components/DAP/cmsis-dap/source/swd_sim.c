@@ -0,0 +1,319 @@
+/**
+ * @file swd_sim.c
+ * @brief Software model of an ADIv5 SW-DP with one AHB MEM-AP, used as a wire backend.
+ *        When USE_SWD_SIM is enabled, SWD_Transfer is served by this model instead of
+ *        the GPIO/SPI backends, so the whole DAP command path can be exercised and
+ *        timed without a target connected.
+ *        With USE_SWD_SIM 2 (host only) it is reached through the SPI backend of SW_DP.c
+ *        instead, the host model of the SPI peripheral drives the request and data phases.
+ * @change: 2026-10-17 first version
+ *          2026-10-17 separate request and data phases
+ * @version 0.2
+ * @date 2026-10-17
+ *
+ * @copyright MIT License
+ *
+ */
+
+#include <string.h>
+
+#include "DAP_config.h"
+#include "cmsis-dap/include/DAP.h"
+#include "cmsis-dap/include/swd_sim.h"
+
+#if (USE_SWD_SIM != 0)
+
+// DP CTRL/STAT bits
+#define CTRL_STAT_STICKYORUN   (1U << 1)
+#define CTRL_STAT_STICKYCMP    (1U << 4)
+#define CTRL_STAT_STICKYERR    (1U << 5)
+#define CTRL_STAT_WDATAERR     (1U << 7)
+#define CTRL_STAT_CDBGPWRUPREQ (1U << 28)
+#define CTRL_STAT_CSYSPWRUPREQ (1U << 30)
+
+// DP ABORT bits
+#define ABORT_STKCMPCLR        (1U << 1)
+#define ABORT_STKERRCLR        (1U << 2)
+#define ABORT_WDERRCLR         (1U << 3)
+#define ABORT_ORUNERRCLR       (1U << 4)
+
+// MEM-AP registers
+#define AP_CSW                 0x00U
+#define AP_TAR                 0x04U
+#define AP_DRW                 0x0CU
+#define AP_BD0                 0x10U
+#define AP_BD3                 0x1CU
+#define AP_BASE                0xF8U
+#define AP_IDR                 0xFCU
+
+#define CSW_SIZE_MASK          0x07U
+#define CSW_ADDRINC_SINGLE     (1U << 4)
+#define CSW_DEVICE_EN          (1U << 6)
+
+#define SIM_ACK_NONE           0x07U // no target drives the line
+
+static struct {
+    uint32_t ctrl_stat;
+    uint32_t select;
+    uint32_t rdbuff;
+    uint8_t  locked; // after a line reset only an IDCODE read is accepted
+
+    uint32_t csw;
+    uint32_t tar;
+
+    uint32_t wait_interval; // inject WAIT on every n-th AP access, 0 = never
+    uint32_t wait_count;
+
+    swd_sim_stats_t stats;
+} sim;
+
+static uint32_t sim_ram[SWD_SIM_RAM_SIZE / sizeof(uint32_t)];
+
+
+void SWD_Sim_Reset(void)
+{
+    uint32_t wait_interval = sim.wait_interval;
+
+    memset(&sim, 0, sizeof(sim));
+    memset(sim_ram, 0, sizeof(sim_ram));
+
+    sim.wait_interval = wait_interval;
+    sim.csw = 0x02U; // 32bit, no auto increment
+    sim.locked = 1;
+}
+
+void SWD_Sim_LineReset(void)
+{
+    sim.locked = 1;
+}
+
+void SWD_Sim_SetWaitInterval(uint32_t interval)
+{
+    sim.wait_interval = interval;
+    sim.wait_count = 0;
+}
+
+void SWD_Sim_GetStats(swd_sim_stats_t *stats)
+{
+    *stats = sim.stats;
+}
+
+
+static uint32_t *sim_ram_word(uint32_t addr)
+{
+    if (addr < SWD_SIM_RAM_BASE || addr - SWD_SIM_RAM_BASE >= SWD_SIM_RAM_SIZE) {
+        return NULL;
+    }
+
+    return &sim_ram[(addr - SWD_SIM_RAM_BASE) >> 2];
+}
+
+static uint32_t sim_mem_access(uint32_t addr, uint32_t value, uint8_t is_read)
+{
+    uint32_t *word;
+    uint32_t size, shift, mask;
+
+    word = sim_ram_word(addr & ~0x3U);
+    if (word == NULL) {
+        // bus error is reported through the sticky flag on the following AP access
+        sim.ctrl_stat |= CTRL_STAT_STICKYERR;
+        return 0;
+    }
+
+    if (is_read) {
+        return *word; // AHB-AP returns the whole word with byte lanes in place
+    }
+
+    size = sim.csw & CSW_SIZE_MASK;
+    if (size == 0U) {
+        mask = 0xFFU;
+    } else if (size == 1U) {
+        mask = 0xFFFFU;
+    } else {
+        mask = 0xFFFFFFFFU;
+    }
+
+    shift = (addr & 0x3U) * 8U;
+    *word = (*word & ~(mask << shift)) | (value & (mask << shift));
+    return 0;
+}
+
+static uint32_t sim_ap_access(uint32_t request, uint32_t value)
+{
+    uint32_t addr, res;
+    uint8_t is_read;
+
+    if ((sim.select >> 24) != 0U) {
+        return 0; // only AP #0 is implemented
+    }
+
+    addr = (sim.select & 0xF0U) | (request & 0x0CU);
+    is_read = (request & DAP_TRANSFER_RnW) != 0U;
+    res = 0;
+
+    switch (addr) {
+    case AP_CSW:
+        if (is_read) {
+            res = sim.csw | CSW_DEVICE_EN;
+        } else {
+            sim.csw = value;
+        }
+        break;
+    case AP_TAR:
+        if (is_read) {
+            res = sim.tar;
+        } else {
+            sim.tar = value;
+        }
+        break;
+    case AP_DRW:
+        res = sim_mem_access(sim.tar, value, is_read);
+        if (sim.csw & CSW_ADDRINC_SINGLE) {
+            sim.tar += 1U << (sim.csw & CSW_SIZE_MASK);
+        }
+        break;
+    case AP_BASE:
+        res = 0xE00FF003U;
+        break;
+    case AP_IDR:
+        res = SWD_SIM_AP_IDR;
+        break;
+    default:
+        if (addr >= AP_BD0 && addr <= AP_BD3) {
+            res = sim_mem_access((sim.tar & ~0xFU) | (addr & 0xCU), value, is_read);
+        }
+        break;
+    }
+
+    return res;
+}
+
+static uint32_t sim_dp_read(uint32_t addr)
+{
+    switch (addr) {
+    case DP_IDCODE:
+        return SWD_SIM_IDCODE;
+    case DP_CTRL_STAT:
+        // power-up requests are acknowledged immediately
+        return sim.ctrl_stat | ((sim.ctrl_stat & (CTRL_STAT_CDBGPWRUPREQ | CTRL_STAT_CSYSPWRUPREQ)) << 1);
+    case DP_RESEND:
+    case DP_RDBUFF:
+    default:
+        return sim.rdbuff;
+    }
+}
+
+static void sim_dp_write(uint32_t addr, uint32_t value)
+{
+    switch (addr) {
+    case DP_ABORT:
+        if (value & ABORT_STKCMPCLR) {
+            sim.ctrl_stat &= ~CTRL_STAT_STICKYCMP;
+        }
+        if (value & ABORT_STKERRCLR) {
+            sim.ctrl_stat &= ~CTRL_STAT_STICKYERR;
+        }
+        if (value & ABORT_WDERRCLR) {
+            sim.ctrl_stat &= ~CTRL_STAT_WDATAERR;
+        }
+        if (value & ABORT_ORUNERRCLR) {
+            sim.ctrl_stat &= ~CTRL_STAT_STICKYORUN;
+        }
+        break;
+    case DP_CTRL_STAT:
+        sim.ctrl_stat = (sim.ctrl_stat & (CTRL_STAT_STICKYORUN | CTRL_STAT_STICKYCMP |
+                                          CTRL_STAT_STICKYERR | CTRL_STAT_WDATAERR)) |
+                        (value & 0x50FFFF00U);
+        break;
+    case DP_SELECT:
+        sim.select = value;
+        break;
+    default:
+        break;
+    }
+}
+
+// Request phase: the ACK the target gives to a request
+//   request: A[3:2] RnW APnDP
+//   return:  ACK[2:0], the data phase follows only for DAP_TRANSFER_OK
+uint8_t SWD_Sim_Request(uint32_t request)
+{
+    uint32_t addr;
+
+    sim.stats.transfers++;
+    addr = request & (DAP_TRANSFER_A2 | DAP_TRANSFER_A3);
+
+    if (sim.locked) {
+        if ((request & (DAP_TRANSFER_APnDP | DAP_TRANSFER_RnW)) != DAP_TRANSFER_RnW || addr != DP_IDCODE) {
+            return SIM_ACK_NONE;
+        }
+        sim.locked = 0;
+    }
+
+    if (request & DAP_TRANSFER_APnDP) {
+        if (sim.ctrl_stat & CTRL_STAT_STICKYERR) {
+            sim.stats.faults++;
+            return DAP_TRANSFER_FAULT;
+        }
+        if (sim.wait_interval && ++sim.wait_count >= sim.wait_interval) {
+            sim.wait_count = 0;
+            sim.stats.waits++;
+            return DAP_TRANSFER_WAIT;
+        }
+    }
+
+    return DAP_TRANSFER_OK;
+}
+
+// Data phase of a request acknowledged with OK
+//   request: A[3:2] RnW APnDP
+//   data:    DATA[31:0]
+void SWD_Sim_Data(uint32_t request, uint32_t *data)
+{
+    uint32_t addr, val;
+
+    addr = request & (DAP_TRANSFER_A2 | DAP_TRANSFER_A3);
+
+    if (request & DAP_TRANSFER_APnDP) {
+        if (request & DAP_TRANSFER_RnW) {
+            // AP reads are posted: return the previous result, latch the new one
+            val = sim_ap_access(request, 0);
+            if (data) { *data = sim.rdbuff; }
+            sim.rdbuff = val;
+        } else {
+            sim_ap_access(request, *data);
+        }
+    } else {
+        if (request & DAP_TRANSFER_RnW) {
+            val = sim_dp_read(addr);
+            if (data) { *data = val; }
+        } else {
+            sim_dp_write(addr, *data);
+        }
+    }
+}
+
+// SWD Transfer I/O
+//   request: A[3:2] RnW APnDP
+//   data:    DATA[31:0]
+//   return:  ACK[2:0]
+uint8_t SWD_Sim_Transfer(uint32_t request, uint32_t *data)
+{
+    uint8_t ack;
+
+    ack = SWD_Sim_Request(request);
+    if (ack != DAP_TRANSFER_OK) {
+        return ack;
+    }
+
+    SWD_Sim_Data(request, data);
+
+    /* Capture Timestamp */
+    if (request & DAP_TRANSFER_TIMESTAMP) {
+        DAP_Data.timestamp = TIMESTAMP_GET();
+    }
+
+    return DAP_TRANSFER_OK;
+}
+
+#endif /* (USE_SWD_SIM != 0) */
@@ -228,14 +228,14 @@ static void handleGetDescriptor(usbip_stage2_header *header)
 	        printf("Sending only first part of CONFIG\r\n");
 
             send_stage2_submit(header, 0, header->u.cmd_submit.data_length);
-            usbip_network_send(kSock, kUSBd0ConfigDescriptor, sizeof(kUSBd0ConfigDescriptor), 0);
+            usbip_tx_submit(kUSBd0ConfigDescriptor, sizeof(kUSBd0ConfigDescriptor), NULL, NULL);
         }
         else
         {
 	        printf("Sending ALL CONFIG\r\n");
             send_stage2_submit(header, 0, sizeof(kUSBd0ConfigDescriptor) + sizeof(kUSBd0InterfaceDescriptor));
-            usbip_network_send(kSock, kUSBd0ConfigDescriptor, sizeof(kUSBd0ConfigDescriptor), 0);
-            usbip_network_send(kSock, kUSBd0InterfaceDescriptor, sizeof(kUSBd0InterfaceDescriptor), 0);
+            usbip_tx_submit(kUSBd0ConfigDescriptor, sizeof(kUSBd0ConfigDescriptor), NULL, NULL);
+            usbip_tx_submit(kUSBd0InterfaceDescriptor, sizeof(kUSBd0InterfaceDescriptor), NULL, NULL);
         }
         break;
 
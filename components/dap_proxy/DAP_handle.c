@@ -1,122 +1,314 @@
 /**
  * @file DAP_handle.c
  * @brief Handle DAP packets and transaction push
- * @version 0.5
+ * @version 0.6
  * @change: 2020.02.04 first version
  *          2020.11.11 support WinUSB mode
  *          2021.02.17 support SWO
  *          2021.10.03 try to handle unlink behavior
+ *          2026.10.17 zero-copy request/response slot pipeline
+ *          2026.10.17 share the DAP engine with other sessions
+ *          2026.10.17 track IN URBs by seqnum, exact unlink
+ *          2026.10.17 report the real pipeline depth, backpressure instead of blocking
+ *          2026.10.17 DAP_QueueCommands chains
+ *          2026.10.17 reset the slots on reconnect instead of reallocating them
  *
  * @copyright Copyright (c) 2021
  *
  */
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "usbip_server.h"
 #include "DAP_handle.h"
+#include "dap_session.h"
 #include "main/dap_configuration.h"
 #include "cmsis-dap/include/DAP.h"
+#include "cmsis-dap/include/dap_stats.h"
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <freertos/ringbuf.h>
+#include <freertos/queue.h>
 #include <freertos/semphr.h>
 
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
 #include "lwip/err.h"
 #include "lwip/sockets.h"
 
-#define DAP_BUFFER_NUM 10
+// Number of request/response slot pairs, announced to the host as DAP_PACKET_COUNT
+#define DAP_BUFFER_NUM DAP_PACKET_QUEUE_DEPTH
 
-#if (USE_WINUSB == 1)
+_Static_assert(DAP_BUFFER_NUM <= 255, "slot index is passed as uint8_t, 0xFF is DAP_CHAIN_HELD_MARK");
+
+// passed through dap_res_queue instead of a slot index: DAP_Thread went to sleep holding
+// a chain, a network task waiting for a response must go back to the socket
+#define DAP_CHAIN_HELD_MARK 0xFFU
+
+// while waiting for a free slot, hand out the responses that became ready this often
+#define DAP_SLOT_POLL_TICKS pdMS_TO_TICKS(10)
+
+/**
+ * @brief One request/response pair of the DAP pipeline.
+ * The network task receives the request straight into `req`, DAP_Thread executes it
+ * into `res`, and the RET_SUBMIT header is built in `header` right in front of the
+ * response so that the reply leaves the slot with a single send.
+ * Ownership moves between the tasks by passing the slot index through queues:
+ * free -> (network) -> req -> (DAP_Thread) -> res -> (network) -> free
+ */
 typedef struct
 {
-    uint32_t length;
-    uint8_t buf[DAP_PACKET_SIZE];
-} DapPacket_t;
-#else
+    uint8_t req[DAP_PACKET_SIZE];
+    usbip_stage2_header header;
+    uint8_t res[DAP_PACKET_SIZE];
+    uint32_t res_length;
+} DapSlot_t;
+
+_Static_assert(offsetof(DapSlot_t, res) == offsetof(DapSlot_t, header) + sizeof(usbip_stage2_header),
+               "response must directly follow the usbip header");
+
+/**
+ * @brief An ep1 IN URB waiting for its DAP response.
+ * DAP responses come out of DAP_Thread in request order, so the pending URBs form a FIFO:
+ * the oldest one receives the next response. An unlinked URB stays in the FIFO as `cancelled`
+ * and drops the response it would have received, so later URBs still get their own.
+ */
 typedef struct
 {
-    uint8_t buf[DAP_PACKET_SIZE];
-} DapPacket_t;
+    usbip_stage2_header header; // as received, network byte order
+    uint8_t cancelled;
+#if (USE_DAP_STATS == 1)
+    uint32_t start_us; // DAP_STATS_WAIT_RESPONSE
 #endif
-
-#define DAP_HANDLE_SIZE (sizeof(DapPacket_t))
+} DapPendingUrb_t;
 
 
 int kRestartDAPHandle = NO_SIGNAL;
 TaskHandle_t kDAPTaskHandle = NULL;
 
-
-static DapPacket_t DAPDataProcessed;
-static int dap_respond = 0;
-
 // SWO Trace
 static uint8_t *swo_data_to_send = NULL;
 static uint32_t swo_data_num;
 
 // DAP handle
-static RingbufHandle_t dap_dataIN_handle = NULL;
-static RingbufHandle_t dap_dataOUT_handle = NULL;
+static DapSlot_t *dap_slots = NULL;
+static QueueHandle_t dap_free_queue = NULL;
+static QueueHandle_t dap_req_queue = NULL;
+static QueueHandle_t dap_res_queue = NULL;
 static SemaphoreHandle_t data_response_mux = NULL;
 
+// slot acquired by the network task whose request is being received
+static int dap_recv_slot = -1;
+
+// IN URBs waiting for a response, only used by the network task
+static DapPendingUrb_t dap_pending[DAP_BUFFER_NUM];
+static uint8_t dap_pending_head = 0;
+static uint8_t dap_pending_num = 0;
+// requests submitted but not yet claimed by an IN URB
+static int dap_unclaimed_num = 0;
+
+// DAP_Thread sleeps holding an open DAP_QueueCommands chain
+static uint8_t dap_chain_idle = 0;
+
+static dap_queue_stats_t dap_queue_stats;
+static int64_t dap_stall_start = 0; // receive side stopped reading since, 0 = not stalled
+
+
+static void dap_slot_queue_delete()
+{
+    if (dap_free_queue) {
+        vQueueDelete(dap_free_queue);
+    }
+    if (dap_req_queue) {
+        vQueueDelete(dap_req_queue);
+    }
+    if (dap_res_queue) {
+        vQueueDelete(dap_res_queue);
+    }
+    if (dap_slots) {
+        free(dap_slots);
+    }
+
+    dap_slots = NULL;
+    dap_free_queue = dap_req_queue = dap_res_queue = NULL;
+    dap_recv_slot = -1;
+}
+
+static void dap_slot_queue_create()
+{
+    uint8_t idx;
+
+    if (dap_slots != NULL) {
+        return;
+    }
+
+#ifdef CONFIG_SPIRAM
+    dap_slots = heap_caps_malloc(sizeof(DapSlot_t) * DAP_BUFFER_NUM, MALLOC_CAP_SPIRAM);
+    if (dap_slots == NULL)
+#endif
+    dap_slots = malloc(sizeof(DapSlot_t) * DAP_BUFFER_NUM);
+    dap_free_queue = xQueueCreate(DAP_BUFFER_NUM, sizeof(uint8_t));
+    dap_req_queue = xQueueCreate(DAP_BUFFER_NUM, sizeof(uint8_t));
+    dap_res_queue = xQueueCreate(DAP_BUFFER_NUM + 1, sizeof(uint8_t)); // + DAP_CHAIN_HELD_MARK
+
+    if (dap_slots == NULL || dap_free_queue == NULL ||
+        dap_req_queue == NULL || dap_res_queue == NULL) {
+        dap_slot_queue_delete();
+        return;
+    }
+
+    for (idx = 0; idx < DAP_BUFFER_NUM; idx++) {
+        xQueueSend(dap_free_queue, &idx, 0);
+    }
+}
+
+// give every slot back to the free queue, for a new usbip connection
+static void dap_slot_queue_reset()
+{
+    uint8_t idx;
+
+    xQueueReset(dap_free_queue);
+    xQueueReset(dap_req_queue);
+    xQueueReset(dap_res_queue);
+    for (idx = 0; idx < DAP_BUFFER_NUM; idx++) {
+        xQueueSend(dap_free_queue, &idx, 0);
+    }
+    dap_recv_slot = -1;
+}
 
-void malloc_dap_ringbuf() {
+void reset_dap_ringbuf() {
     if (data_response_mux && xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE)
     {
-        if (dap_dataIN_handle == NULL) {
-            dap_dataIN_handle = xRingbufferCreate(DAP_HANDLE_SIZE * DAP_BUFFER_NUM, RINGBUF_TYPE_BYTEBUF);
-        }
-        if (dap_dataOUT_handle == NULL) {
-            dap_dataOUT_handle = xRingbufferCreate(DAP_HANDLE_SIZE * DAP_BUFFER_NUM, RINGBUF_TYPE_BYTEBUF);
+        if (dap_slots == NULL) {
+            dap_slot_queue_create(); // deleted before
+        } else {
+            dap_slot_queue_reset();
         }
-
         xSemaphoreGive(data_response_mux);
     }
 }
 
 void free_dap_ringbuf() {
     if (data_response_mux && xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE) {
-        if (dap_dataIN_handle) {
-            vRingbufferDelete(dap_dataIN_handle);
-        }
-        if (dap_dataOUT_handle) {
-            vRingbufferDelete(dap_dataOUT_handle);
+        dap_slot_queue_delete();
+        xSemaphoreGive(data_response_mux);
+    }
+
+}
+
+
+static void dap_request_slot_take(uint8_t idx)
+{
+    uint32_t in_flight;
+
+    dap_recv_slot = idx;
+
+    in_flight = DAP_BUFFER_NUM - uxQueueMessagesWaiting(dap_free_queue);
+    if (in_flight > dap_queue_stats.high_water) {
+        dap_queue_stats.high_water = in_flight;
+    }
+
+    if (dap_stall_start) {
+        uint32_t us = (uint32_t)(esp_timer_get_time() - dap_stall_start);
+
+        dap_queue_stats.stall_us += us;
+        if (us > dap_queue_stats.stall_max_us) {
+            dap_queue_stats.stall_max_us = us;
         }
+#if (USE_DAP_STATS == 1)
+        DAP_Stats_Event(DAP_STATS_WAIT_SLOT, us);
+#endif
+        dap_stall_start = 0;
+    }
+}
 
-        dap_dataIN_handle = dap_dataOUT_handle = NULL;
-        xSemaphoreGive(data_response_mux);
+/**
+ * @brief Reserve a free slot for the next DAP request, without blocking.
+ * When the pipeline is full the network task should stop reading the socket,
+ * so that the host is held back by TCP flow control, and call dap_request_slot_wait.
+ *
+ * @return 1 if a slot is reserved (or there is no pipeline to wait for), 0 if the pipeline is full
+ */
+int dap_request_slot_try()
+{
+    uint8_t idx;
+
+    if (dap_recv_slot >= 0 || dap_free_queue == NULL) {
+        return 1;
+    }
+
+    if (xQueueReceive(dap_free_queue, &idx, 0) == pdTRUE) {
+        dap_request_slot_take(idx);
+        return 1;
     }
 
+    if (dap_stall_start == 0) {
+        dap_stall_start = esp_timer_get_time();
+        dap_queue_stats.stalls++;
+    }
+    return 0;
 }
 
+/**
+ * @brief Wait for a slot to become free while the pipeline is full
+ *
+ * @param wait ticks to wait
+ * @return 1 if a slot is reserved
+ */
+int dap_request_slot_wait(TickType_t wait)
+{
+    uint8_t idx;
+
+    if (dap_free_queue == NULL) {
+        return 1;
+    }
+
+    // slots are held by responses of pending IN URBs, or by replies waiting for
+    // transmission: wait for the next response rather than for the slot it frees
+    if (dap_pending_num > 0) {
+        dap_urb_complete(wait);
+        wait = 0;
+    }
+    usbip_tx_flush();
+
+    if (xQueueReceive(dap_free_queue, &idx, wait) != pdTRUE) {
+        return 0;
+    }
+
+    dap_request_slot_take(idx);
+    return 1;
+}
 
 void handle_dap_data_request(usbip_stage2_header *header, uint32_t length)
 {
     uint8_t *data_in = (uint8_t *)header;
     data_in = &(data_in[sizeof(usbip_stage2_header)]);
     // Point to the beginning of the URB packet
+    uint8_t idx;
 
-#if (USE_WINUSB == 1)
-    send_stage2_submit_data_fast(header, NULL, 0);
+    while (!dap_request_slot_try()) {
+        dap_request_slot_wait(DAP_SLOT_POLL_TICKS);
+    }
+    if (dap_recv_slot < 0) {
+        // the pipeline is being reset, the host still waits for this OUT URB
+        send_stage2_submit_status_fast(header, -1);
+        return;
+    }
 
-    // always send constant size buf -> cuz we don't care about the IN packet size
-    // and to unify the style, we set aside the length of the section
-    xRingbufferSend(dap_dataIN_handle, data_in - sizeof(uint32_t), DAP_HANDLE_SIZE, portMAX_DELAY);
-    xTaskNotifyGive(kDAPTaskHandle);
+    memcpy(dap_slots[dap_recv_slot].req, data_in, length > DAP_PACKET_SIZE ? DAP_PACKET_SIZE : length);
 
-#else
     send_stage2_submit_data_fast(header, NULL, 0);
 
-    xRingbufferSend(dap_dataIN_handle, data_in, DAP_HANDLE_SIZE, portMAX_DELAY);
+    dap_queue_stats.requests++;
+    dap_unclaimed_num++;
+    idx = (uint8_t)dap_recv_slot;
+    dap_recv_slot = -1;
+    xQueueSend(dap_req_queue, &idx, portMAX_DELAY);
     xTaskNotifyGive(kDAPTaskHandle);
-
-#endif
-
-    // dap_respond = DAP_ProcessCommand((uint8_t *)data_in, (uint8_t *)data_out);
-    // //handle_dap_data_response(header);
-    // send_stage2_submit(header, 0, 0);
 }
 
 void handle_swo_trace_response(usbip_stage2_header *header)
@@ -150,161 +342,218 @@ void SWO_QueueTransfer(uint8_t *buf, uint32_t num)
 
 void DAP_Thread(void *argument)
 {
-    dap_dataIN_handle = xRingbufferCreate(DAP_HANDLE_SIZE * DAP_BUFFER_NUM, RINGBUF_TYPE_BYTEBUF);
-    dap_dataOUT_handle = xRingbufferCreate(DAP_HANDLE_SIZE * DAP_BUFFER_NUM, RINGBUF_TYPE_BYTEBUF);
+    (void)argument;
     data_response_mux = xSemaphoreCreateMutex();
+    dap_slot_queue_create();
     kDAPTaskHandle = xTaskGetCurrentTaskHandle();
-    size_t packetSize;
-    int resLength;
-    DapPacket_t *item;
+    DapSlot_t *slot;
+    uint8_t idx;
+    // slots of a DAP_QueueCommands chain, answered together when the chain ends
+    uint8_t chain[DAP_BUFFER_NUM];
+    uint32_t chain_num = 0;
 
-    if (dap_dataIN_handle == NULL || dap_dataIN_handle == NULL ||
-        data_response_mux == NULL)
+    if (dap_slots == NULL || data_response_mux == NULL)
     {
-	    printf("Can not create DAP ringbuf/mux!\r\n");
+	    printf("Can not create DAP slot/mux!\r\n");
         vTaskDelete(NULL);
     }
     for (;;)
     {
-
-        while (1)
+        if (kRestartDAPHandle)
         {
-            if (kRestartDAPHandle)
-            {
+            // the slots and queues live as long as the task, a new connection only resets them
+            if (kRestartDAPHandle == RESET_HANDLE) {
+                reset_dap_ringbuf();
+            } else {
                 free_dap_ringbuf();
-
-                if (kRestartDAPHandle == RESET_HANDLE) {
-                    malloc_dap_ringbuf();
-                    if (dap_dataIN_handle == NULL || dap_dataIN_handle == NULL)
-                    {
-	                    printf("Can not create DAP ringbuf/mux!\r\n");
-                        vTaskDelete(NULL);
-                    }
-                }
-
-                kRestartDAPHandle = NO_SIGNAL;
             }
 
-            ulTaskNotifyTake(pdFALSE, portMAX_DELAY); // wait event
+            kRestartDAPHandle = NO_SIGNAL;
+            chain_num = 0;
+        }
 
+        if (chain_num > 0) {
+            uint8_t mark = DAP_CHAIN_HELD_MARK;
 
-            if (dap_dataIN_handle == NULL || dap_dataOUT_handle == NULL) {
-                continue; // may be use elaphureLink, wait...
+            __atomic_store_n(&dap_chain_idle, 1, __ATOMIC_SEQ_CST);
+            if (uxQueueMessagesWaiting(dap_res_queue) == 0) {
+                xQueueSend(dap_res_queue, &mark, 0);
             }
+        }
+        ulTaskNotifyTake(pdFALSE, portMAX_DELAY); // wait event
+        __atomic_store_n(&dap_chain_idle, 0, __ATOMIC_SEQ_CST);
 
+        if (dap_req_queue == NULL) {
+            continue; // may be use elaphureLink, wait...
+        }
 
-            packetSize = 0;
-            item = (DapPacket_t *)xRingbufferReceiveUpTo(dap_dataIN_handle, &packetSize,
-                                                         pdMS_TO_TICKS(1), DAP_HANDLE_SIZE);
-            if (packetSize == 0)
+        while (xQueueReceive(dap_req_queue, &idx, 0) == pdTRUE)
+        {
+            slot = &dap_slots[idx];
+
+            // Queued packets are executed as they arrive, but their responses are held back
+            // until a packet that is not DAP_QueueCommands ends the chain. Then the whole chain
+            // is answered at once and leaves in one aggregated write.
+            // Every packet still gets its own response, as USB hosts expect one per packet.
+            if (slot->req[0] == ID_DAP_QueueCommands)
             {
-                break;
+                slot->req[0] = ID_DAP_ExecuteCommands;
+                slot->res_length = dap_engine_execute(slot->req, slot->res, DAP_PACKET_SIZE, DAP_BUFFER_NUM) & 0xFFFF;
+                chain[chain_num++] = idx;
+
+                // the host must not queue more than DAP_PACKET_COUNT packets,
+                // do not let a longer chain lock up the pipeline
+                if (chain_num < DAP_BUFFER_NUM && uxQueueMessagesWaiting(dap_free_queue) > 0)
+                {
+                    continue;
+                }
             }
-
-            else if (packetSize < DAP_HANDLE_SIZE)
+            else
             {
-	            printf("Wrong data in packet size:%d , data in remain: %d\r\n", packetSize,
-	                   (int) xRingbufferGetMaxItemSize(dap_dataIN_handle));
-                vRingbufferReturnItem(dap_dataIN_handle, (void *)item);
-                break;
-                // This may not happen because there is a semaphore acquisition
+                // res length in lower 16 bits
+                slot->res_length = dap_engine_execute(slot->req, slot->res, DAP_PACKET_SIZE, DAP_BUFFER_NUM) & 0xFFFF;
+                chain[chain_num++] = idx;
             }
 
-            if (item->buf[0] == ID_DAP_QueueCommands)
+            for (uint32_t i = 0; i < chain_num; i++)
             {
-                item->buf[0] = ID_DAP_ExecuteCommands;
+                xQueueSend(dap_res_queue, &chain[i], portMAX_DELAY);
             }
+            chain_num = 0;
+        }
+    }
+}
+
+// called by the usbip tx layer once the reply held by the slot has been sent
+static void dap_slot_release(void *arg)
+{
+    uint8_t idx = (uint8_t)(uintptr_t)arg;
 
-            resLength = DAP_ProcessCommand((uint8_t *)item->buf, (uint8_t *)DAPDataProcessed.buf); // use first 4 byte to save length
-            resLength &= 0xFFFF;                                                                   // res length in lower 16 bits
+    if (dap_free_queue) {
+        xQueueSend(dap_free_queue, &idx, 0);
+    }
+}
 
-            vRingbufferReturnItem(dap_dataIN_handle, (void *)item); // process done.
+void dap_urb_reset()
+{
+    dap_pending_head = 0;
+    dap_pending_num = 0;
+    dap_unclaimed_num = 0;
 
-            // now prepare to reply
-#if (USE_WINUSB == 1)
-            DAPDataProcessed.length = resLength;
-#endif
-            xRingbufferSend(dap_dataOUT_handle, (void *)&DAPDataProcessed, DAP_HANDLE_SIZE, portMAX_DELAY);
+    memset(&dap_queue_stats, 0, sizeof(dap_queue_stats));
+    dap_stall_start = 0;
+}
 
-            if (xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE)
-            {
-                ++dap_respond;
-                xSemaphoreGive(data_response_mux);
-            }
-        }
+void dap_queue_get_stats(dap_queue_stats_t *stats)
+{
+    *stats = dap_queue_stats;
+}
+
+int dap_urb_pending()
+{
+    return dap_pending_num;
+}
+
+int dap_chain_held()
+{
+    // flag first: DAP_Thread queues its responses before it sets it, and clears it
+    // before it takes the next request
+    return __atomic_load_n(&dap_chain_idle, __ATOMIC_SEQ_CST) &&
+           uxQueueMessagesWaiting(dap_req_queue) == 0 &&
+           uxQueueMessagesWaiting(dap_res_queue) == 0;
+}
+
+void handle_dap_in_request(usbip_stage2_header *header)
+{
+    DapPendingUrb_t *urb;
+
+    if (dap_unclaimed_num > 0 && dap_pending_num < DAP_BUFFER_NUM) {
+        // answered by dap_urb_complete once the response is ready
+        urb = &dap_pending[(dap_pending_head + dap_pending_num) % DAP_BUFFER_NUM];
+        memcpy(&urb->header, header, sizeof(usbip_stage2_header));
+        urb->cancelled = 0;
+#if (USE_DAP_STATS == 1)
+        urb->start_us = DAP_STATS_TIME_US();
+#endif
+        dap_pending_num++;
+        dap_unclaimed_num--;
+        return;
     }
+
+    // no request to answer
+    header->base.command = PP_HTONL(USBIP_STAGE2_RSP_SUBMIT);
+    header->base.direction = PP_HTONL(USBIP_DIR_OUT);
+    header->u.ret_submit.status = 0;
+    header->u.ret_submit.data_length = 0;
+    header->u.ret_submit.error_count = 0;
+    usbip_tx_submit(header, sizeof(usbip_stage2_header), NULL, NULL);
 }
 
-int fast_reply(uint8_t *buf, uint32_t length, int dap_req_num)
+/**
+ * @brief Hand out ready DAP responses to the pending IN URBs, oldest first
+ *
+ * @param wait ticks to wait for the first response
+ * @return number of responses taken from the pipeline
+ */
+int dap_urb_complete(TickType_t wait)
 {
-    usbip_stage2_header *buf_header = (usbip_stage2_header *)buf;
-
-    if (dap_req_num > 0) {
-        DapPacket_t *item;
-        size_t packetSize = 0;
-        item = (DapPacket_t *)xRingbufferReceiveUpTo(dap_dataOUT_handle, &packetSize,
-                                                     portMAX_DELAY, DAP_HANDLE_SIZE);
-        if (packetSize == DAP_HANDLE_SIZE) {
+    DapPendingUrb_t *urb;
+    DapSlot_t *slot;
+    uint8_t idx;
+    int num = 0;
+
+    if (dap_res_queue == NULL) {
+        return 0;
+    }
+
+    while (dap_pending_num > 0) {
+        if (xQueueReceive(dap_res_queue, &idx, num == 0 ? wait : 0) != pdTRUE) {
+            break;
+        }
+        if (idx == DAP_CHAIN_HELD_MARK) {
+            break; // nothing more before the next request
+        }
+
+        urb = &dap_pending[dap_pending_head];
+        dap_pending_head = (dap_pending_head + 1) % DAP_BUFFER_NUM;
+        dap_pending_num--;
+        num++;
+
+        if (urb->cancelled) {
+            dap_slot_release((void *)(uintptr_t)idx);
+            continue;
+        }
+#if (USE_DAP_STATS == 1)
+        DAP_Stats_Event(DAP_STATS_WAIT_RESPONSE, DAP_STATS_TIME_US() - urb->start_us);
+#endif
+
+        slot = &dap_slots[idx];
+        memcpy(&slot->header, &urb->header, sizeof(usbip_stage2_header));
 #if (USE_WINUSB == 1)
-            send_stage2_submit_data_fast((usbip_stage2_header *)buf, item->buf, item->length);
+        send_stage2_submit_data_zero_copy(&slot->header, slot->res_length, dap_slot_release, (void *)(uintptr_t)idx);
 #else
-            send_stage2_submit_data_fast((usbip_stage2_header *)buf, item->buf, DAP_HANDLE_SIZE);
+        send_stage2_submit_data_zero_copy(&slot->header, DAP_PACKET_SIZE, dap_slot_release, (void *)(uintptr_t)idx);
 #endif
+    }
 
-            if (xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE) {
-                --dap_respond;
-                xSemaphoreGive(data_response_mux);
-            }
+    return num;
+}
 
-            vRingbufferReturnItem(dap_dataOUT_handle, (void *)item);
+int handle_dap_unlink(uint32_t seqnum)
+{
+    DapPendingUrb_t *urb;
+
+    // `USBIP_CMD_UNLINK` means calling `usb_unlink_urb()` or `usb_kill_urb()` on the host.
+    // Only an IN URB still waiting for its response can be cancelled: OUT URBs are completed
+    // as soon as they are received. The response of a cancelled URB is dropped when it comes
+    // out of the pipeline, so that it does not lag into the next IN URB.
+    for (int i = 0; i < dap_pending_num; i++) {
+        urb = &dap_pending[(dap_pending_head + i) % DAP_BUFFER_NUM];
+        if (!urb->cancelled && ntohl(urb->header.base.seqnum) == seqnum) {
+            urb->cancelled = 1;
             return 1;
-        } else if (packetSize > 0) {
-	        printf("Wrong data out packet size:%d!\r\n", packetSize);
         }
-        ////TODO: fast reply
-    } else {
-        buf_header->base.command = PP_HTONL(USBIP_STAGE2_RSP_SUBMIT);
-        buf_header->base.direction = PP_HTONL(USBIP_DIR_OUT);
-        buf_header->u.ret_submit.status = 0;
-        buf_header->u.ret_submit.data_length = 0;
-        buf_header->u.ret_submit.error_count = 0;
-        usbip_network_send(kSock, buf, 48, 0);
-        return 1;
     }
 
     return 0;
 }
-
-void handle_dap_unlink()
-{
-    // `USBIP_CMD_UNLINK` means calling `usb_unlink_urb()` or `usb_kill_urb()`.
-    // Note that execution of an URB is inherently an asynchronous operation, and there may be
-    // synchronization problems in the following solutions.
-
-    // One of the reasons this happens is that the host wants to abort the URB transfer operation
-    // as soon as possible. USBIP network fluctuations will also cause this error, but I don't know
-    // whether this is the main reason.
-
-    // Unlink may be applied to zero length URB of "DIR_IN", or a URB containing data.
-    // In the case of unlink, for the new "DIR_IN" request, it may always return an older response,
-    // which will lead to panic. This code is a compromise for eliminating the lagging response
-    // caused by UNLINK. It will clean up the buffers that may have data for return to the host.
-    // In general, we assume that there is at most one piece of data that has not yet been returned.
-    if (dap_respond > 0)
-    {
-        DapPacket_t *item;
-        size_t packetSize = 0;
-        item = (DapPacket_t *)xRingbufferReceiveUpTo(dap_dataOUT_handle, &packetSize,
-                                                     pdMS_TO_TICKS(10), DAP_HANDLE_SIZE);
-        if (packetSize == DAP_HANDLE_SIZE)
-        {
-            if (xSemaphoreTake(data_response_mux, portMAX_DELAY) == pdTRUE)
-            {
-                --dap_respond;
-                xSemaphoreGive(data_response_mux);
-            }
-
-            vRingbufferReturnItem(dap_dataOUT_handle, (void *)item);
-        }
-    }
-}
\ No newline at end of file
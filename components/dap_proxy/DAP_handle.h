@@ -3,6 +3,8 @@
 
 #include "components/USBIP/usbip_defs.h"
 
+#include <freertos/FreeRTOS.h>
+
 enum reset_handle_t
 {
     NO_SIGNAL = 0,
@@ -10,11 +12,42 @@ enum reset_handle_t
     DELETE_HANDLE = 2,
 };
 
+typedef struct
+{
+    uint32_t requests;     // DAP requests queued
+    uint32_t high_water;   // most requests in the pipeline at once, out of DAP_PACKET_COUNT
+    uint32_t stalls;       // times the socket was left unread because the pipeline was full
+    uint32_t stall_us;     // total time spent stalled
+    uint32_t stall_max_us; // longest stall
+} dap_queue_stats_t;
+
+int dap_request_slot_try();
+int dap_request_slot_wait(TickType_t wait);
 void handle_dap_data_request(usbip_stage2_header *header, uint32_t length);
 void handle_swo_trace_response(usbip_stage2_header *header);
-void handle_dap_unlink();
+void handle_dap_in_request(usbip_stage2_header *header);
+
+/**
+ * @brief Cancel a pending IN URB
+ *
+ * @param seqnum seqnum of the URB to unlink, host byte order
+ * @return 1 if the URB was pending and is cancelled, 0 if it has already been answered
+ */
+int handle_dap_unlink(uint32_t seqnum);
+
+void dap_urb_reset();
+void dap_queue_get_stats(dap_queue_stats_t *stats);
+int dap_urb_pending();
 
-int fast_reply(uint8_t *buf, uint32_t length, int dap_req_num);
+/**
+ * @brief Whether the pending IN URBs wait for a DAP_QueueCommands chain that is still open.
+ * DAP_Thread holds the responses of the chain and has nothing else to execute, so none
+ * can complete before the host sends the packet that ends the chain.
+ *
+ * @return 1 if no response can become ready without new requests
+ */
+int dap_chain_held();
+int dap_urb_complete(TickType_t wait);
 void DAP_Thread(void *argument);
 
 #endif
\ No newline at end of file
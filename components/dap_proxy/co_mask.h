@@ -0,0 +1,94 @@
+/**
+ * @file co_mask.h
+ * @brief WebSocket payload unmasking, fused with the copy out of the receive buffer.
+ *        Little-endian only, like the rest of the websocket code.
+ *        Free of ESP-IDF dependencies, so it can be built and fuzzed on a host
+ *        (tools/ws_mask_bench.c).
+ * @change: 2026-10-17 first version, replaces co_websocket_fast_mask
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright MIT License
+ *
+ */
+#ifndef __CO_MASK_H__
+#define __CO_MASK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// shorter frames that are not word aligned to their destination are unmasked word by
+// word, below this the memcpy call costs more than it saves
+#define CO_MASK_MEMCPY_MIN 64
+
+// masking key for the byte `n` bytes further
+static inline uint32_t co_mask_rotr(uint32_t mask, size_t n)
+{
+    unsigned int c = (n & 3) * 8;
+
+    return c ? (mask >> c) | (mask << (32 - c)) : mask;
+}
+
+static inline void co_mask_bytes(uint8_t *dst, const uint8_t *src, size_t len, uint32_t mask)
+{
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = src[i] ^ (uint8_t)(mask >> (8 * (i & 3)));
+    }
+}
+
+/**
+ * @brief dst[i] = src[i] ^ key[i % 4], in one pass. dst may be src to unmask in place.
+ * When dst and src share their alignment the body runs on aligned 64-bit words
+ * (32-bit words if they only share 4-byte alignment). Otherwise memcpy does the
+ * misaligned part, it merges words faster than C can (in assembly on the ESP32 cores,
+ * with vectors on a host), and the key is applied in place on the aligned copy.
+ * Frames shorter than CO_MASK_MEMCPY_MIN skip memcpy and go word by word.
+ *
+ * @param mask masking key as it is stored in the frame, loaded little-endian
+ * @return masking key for the byte that follows the last one
+ */
+static inline uint32_t co_mask_copy(uint8_t *dst, const uint8_t *src, size_t len, uint32_t mask)
+{
+    uintptr_t skew = (uintptr_t)dst ^ (uintptr_t)src;
+    uint64_t mask64;
+    uint32_t word;
+    size_t head;
+
+    if (len >= CO_MASK_MEMCPY_MIN && (skew & 3) != 0) {
+        memcpy(dst, src, len);
+        src = dst;
+        skew = 0;
+    }
+
+    if (len >= 16 && (skew & 3) == 0) {
+        // align dst, src follows
+        head = (-(uintptr_t)dst) & ((skew & 7) ? 3 : 7);
+        co_mask_bytes(dst, src, head, mask);
+        mask = co_mask_rotr(mask, head);
+        dst += head;
+        src += head;
+        len -= head;
+
+        if ((skew & 7) == 0) {
+            mask64 = ((uint64_t)mask << 32) | mask;
+            for (; len >= 8; len -= 8, dst += 8, src += 8) {
+                *(uint64_t *)dst = *(const uint64_t *)src ^ mask64;
+            }
+        }
+        for (; len >= 4; len -= 4, dst += 4, src += 4) {
+            *(uint32_t *)dst = *(const uint32_t *)src ^ mask;
+        }
+    } else {
+        for (; len >= 4; len -= 4, dst += 4, src += 4) {
+            memcpy(&word, src, 4);
+            word ^= mask;
+            memcpy(dst, &word, 4);
+        }
+    }
+
+    co_mask_bytes(dst, src, len, mask);
+    return co_mask_rotr(mask, len);
+}
+
+#endif
@@ -0,0 +1,149 @@
+/**
+ * @file co_ws_parser.c
+ * @brief Incremental WebSocket (RFC 6455) frame parser.
+ * @change: 2026-10-17 first version
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright MIT License
+ *
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "co_ws_parser.h"
+#include "co_mask.h"
+
+void co_ws_parser_init(co_ws_parser_t *p)
+{
+    memset(p, 0, sizeof(co_ws_parser_t));
+}
+
+static size_t co_ws_parse_payload(co_ws_parser_t *p, uint8_t *data, size_t len, co_ws_event_t *ev)
+{
+    co_ws_frame_t *f = &p->frame;
+    size_t n;
+
+    n = f->remaining < len ? (size_t)f->remaining : len;
+    if ((n == 0 && f->remaining > 0) || (f->whole && n < f->remaining)) {
+        ev->type = CO_WS_NEED_MORE;
+        return 0;
+    }
+
+    ev->type = CO_WS_PAYLOAD;
+    ev->data = data;
+    ev->len = n;
+    ev->mask = f->mask;
+    f->mask = co_mask_rotr(f->mask, n);
+    f->remaining -= n;
+    ev->last = f->remaining == 0;
+    if (ev->last) {
+        p->in_payload = 0;
+    }
+
+    return n;
+}
+
+size_t co_ws_parse(co_ws_parser_t *p, uint8_t *data, size_t len, co_ws_event_t *ev)
+{
+    co_ws_frame_t *f = &p->frame;
+    uint8_t fin, opcode, masked;
+    uint64_t length;
+    size_t header;
+
+    if (p->in_payload) {
+        return co_ws_parse_payload(p, data, len, ev);
+    }
+
+    ev->type = CO_WS_NEED_MORE;
+    if (len < 2) {
+        return 0;
+    }
+
+    fin = (data[0] & WS_FIN) == WS_FIN;
+    opcode = data[0] & 0x0F;
+    masked = (data[1] & WS_MASK) == WS_MASK;
+    length = data[1] & 0x7F;
+
+    header = 2 + (length == 126 ? 2 : 0) + (length == 127 ? 8 : 0) + (masked ? 4 : 0);
+    if (len < header) {
+        return 0;
+    }
+
+    if (length == 126) {
+        length = data[2] << 8 | data[3];
+    } else if (length == 127) {
+        length = 0;
+        for (int i = 2; i < 10; i++) {
+            length = length << 8 | data[i];
+        }
+    }
+
+    // a non-empty frame is announced with the start of its payload
+    if (length > 0 && len == header) {
+        return 0;
+    }
+
+    ev->type = CO_WS_ERROR;
+    if (data[0] & (WS_RSV1 | WS_RSV2 | WS_RSV3)) {
+        return 0; // no extension defining RSV
+    }
+    if (length >> 63) {
+        return 0; // most significant bit MUST be 0
+    }
+
+    switch (opcode) {
+    case WS_OPCODE_CONTINUTAION:
+        if (p->message == 0) {
+            return 0;
+        }
+        f->message = p->message;
+        f->first = 0;
+        if (fin) {
+            p->message = 0;
+        }
+        break;
+    case WS_OPCODE_TEXT:
+    case WS_OPCODE_BINARY:
+        if (p->message != 0) {
+            return 0; // the previous message is not finished
+        }
+        f->message = opcode;
+        f->first = 1;
+        if (!fin) {
+            p->message = opcode;
+        }
+        break;
+    case WS_OPCODE_CLOSE:
+    case WS_OPCODE_PING:
+    case WS_OPCODE_PONG:
+        // control frames can come between fragments, but are not fragmented themselves
+        if (!fin || length > 125) {
+            return 0;
+        }
+        f->message = opcode;
+        f->first = 1;
+        break;
+    default:
+        return 0;
+    }
+
+    f->fin = fin;
+    f->opcode = opcode;
+    f->whole = (opcode & 0x08) != 0;
+    f->mask = 0;
+    if (masked) {
+        memcpy(&f->mask, data + header - 4, 4);
+    }
+    f->length = length;
+    f->remaining = length;
+    p->in_payload = 1;
+
+    ev->type = CO_WS_FRAME;
+    ev->data = data + header;
+    ev->len = len - header < length ? len - header : (size_t)length;
+    ev->mask = f->mask;
+    ev->last = 0;
+
+    return header;
+}
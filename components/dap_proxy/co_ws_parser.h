@@ -0,0 +1,83 @@
+/**
+ * @file co_ws_parser.h
+ * @brief Incremental WebSocket (RFC 6455) frame parser.
+ *        It walks the receive buffer in place: frames are found at any offset, several
+ *        of them in one read, and the payload is handed out as it arrives, still masked,
+ *        so the caller unmasks it on its way to where it is used (co_mask_copy).
+ *        The caller only has to keep the bytes the parser did not consume, at most an
+ *        incomplete header or a frame it asked to get in one piece.
+ *        Free of ESP-IDF dependencies, so it can be fuzzed on a host (tools/ws_parser_fuzz.c).
+ * @change: 2026-10-17 first version, replaces the header state machine of websocket_server.c
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright MIT License
+ *
+ */
+#ifndef __CO_WS_PARSER_H__
+#define __CO_WS_PARSER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WS_FIN                 0x80
+#define WS_RSV1                0x40
+#define WS_RSV2                0x20
+#define WS_RSV3                0x10
+#define WS_OPCODE_CONTINUTAION 0x00
+#define WS_OPCODE_TEXT         0x01
+#define WS_OPCODE_BINARY       0x02
+#define WS_OPCODE_CLOSE        0x08
+#define WS_OPCODE_PING         0x09
+#define WS_OPCODE_PONG         0x0A
+
+#define WS_MASK                0x80
+
+// longest frame header: 2 byte header, 8 byte extended length, 4 byte mask
+#define WS_HEADER_MAX_SIZE     14
+
+typedef enum {
+    CO_WS_NEED_MORE = 0, // nothing more in the given bytes
+    CO_WS_FRAME,         // a frame header, `frame` describes it
+    CO_WS_PAYLOAD,       // a piece of the payload of the current frame
+    CO_WS_ERROR,         // protocol error, the connection should be closed
+} co_ws_event_type_t;
+
+typedef struct co_ws_frame {
+    uint8_t fin;
+    uint8_t opcode;     // opcode of the frame, WS_OPCODE_CONTINUTAION included
+    uint8_t message;    // opcode of the message the frame is part of
+    uint8_t first;      // the frame starts its message
+    uint8_t whole;      // deliver the payload in one piece, always set for control frames
+    uint32_t mask;      // masking key of the next payload byte, 0 for an unmasked frame
+    uint64_t length;    // payload length
+    uint64_t remaining; // payload bytes not delivered yet
+} co_ws_frame_t;
+
+typedef struct co_ws_parser {
+    co_ws_frame_t frame;
+    uint8_t in_payload;
+    uint8_t message; // opcode of the fragmented message in progress, 0 if none
+} co_ws_parser_t;
+
+typedef struct co_ws_event {
+    co_ws_event_type_t type;
+    uint8_t *data; // CO_WS_PAYLOAD: the piece; CO_WS_FRAME: the payload bytes already received
+    size_t len;
+    uint32_t mask; // masking key of data[0]
+    uint8_t last;  // CO_WS_PAYLOAD: the piece ends the frame
+} co_ws_event_t;
+
+void co_ws_parser_init(co_ws_parser_t *p);
+
+/**
+ * @brief Parse the next event out of `data`.
+ * A CO_WS_FRAME event of a non-empty frame comes with at least one payload byte, so
+ * the caller can look at the start of the payload. It may set `p->frame.whole` then,
+ * if the payload fits its buffer.
+ *
+ * @return the number of bytes consumed, 0 for CO_WS_NEED_MORE and CO_WS_ERROR
+ */
+size_t co_ws_parse(co_ws_parser_t *p, uint8_t *data, size_t len, co_ws_event_t *ev);
+
+#endif
@@ -0,0 +1,333 @@
+/**
+ * @file dap_pipeline.c
+ * @brief Packet pipeline shared by the DAP front ends.
+ *        The front end frames requests out of its transport and submits them into
+ *        DAP_PIPELINE_DEPTH request slots. An executor task runs them on the DAP engine
+ *        and builds the responses in `tx_buffer`, each behind the header room of the transport.
+ *        The buffer is sent when no request is left in flight or when it can not hold
+ *        another response, so a lockstep host sees no added latency.
+ *        A pipeline is allocated once, with its queues, buffers and executor task, and then
+ *        bound to a transport for the lifetime of each connection, so that reconnects do not
+ *        allocate anything.
+ * @change: 2026-10-17 first version, from the elaphureLink pipeline
+ *          2026-10-17 two-step submit
+ *          2026-10-17 cancel a reserved slot
+ *          2026-10-17 allocate once, start and stop per connection
+ *          2026-10-17 client events moved to the session and KCP peer
+ * @version 0.5
+ * @date 2026-10-17
+ *
+ * @copyright MIT License
+ *
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dap_pipeline.h"
+#include "dap_session.h"
+#include "proxy_server_conf.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "esp_heap_caps.h"
+
+#define DAP_PIPELINE_EXIT  0xFF
+#define DAP_PIPELINE_DRAIN 0xFE
+
+#if (DAP_PIPELINE_DEPTH >= DAP_PIPELINE_DRAIN)
+#error "DAP_PIPELINE_DEPTH is too large"
+#endif
+
+struct dap_pipeline
+{
+    const dap_transport_t *transport;
+    void *ctx;
+    SemaphoreHandle_t done; // given by the executor for drain and exit
+    QueueHandle_t free_queue;
+    QueueHandle_t req_queue;
+    uint8_t *memory;        // slots, tx_buffer and chain buffer in one block
+    uint8_t *slots;
+    uint32_t slot_size;     // largest packet size the pipeline can take
+    uint32_t header_size;   // largest header room
+    uint8_t *tx_buffer;
+    uint32_t tx_size;       // part of tx_buffer in use by the transport
+    uint32_t tx_len;
+    uint32_t tx_num;        // responses in tx_buffer
+    uint8_t reserved;       // slot taken by dap_pipeline_reserve
+    dap_chain_t chain;
+    dap_pipeline_stats_t stats;
+};
+
+
+static void dap_pipeline_flush(dap_pipeline_t *pl)
+{
+    if (pl->tx_len == 0) {
+        return;
+    }
+
+    pl->transport->send(pl->ctx, pl->tx_buffer, pl->tx_len);
+
+    pl->stats.sends++;
+    pl->stats.bytes += pl->tx_len;
+    if (pl->tx_num > pl->stats.max_gather) {
+        pl->stats.max_gather = pl->tx_num;
+    }
+    pl->tx_len = 0;
+    pl->tx_num = 0;
+}
+
+// room for one more response in tx_buffer, behind the header room of the transport
+static uint8_t *dap_pipeline_payload(dap_pipeline_t *pl)
+{
+    const dap_transport_t *transport = pl->transport;
+
+    if (pl->tx_size - pl->tx_len < transport->header_size + transport->packet_size) {
+        dap_pipeline_flush(pl);
+    }
+    return pl->tx_buffer + pl->tx_len + transport->header_size;
+}
+
+static void dap_pipeline_add(dap_pipeline_t *pl, uint8_t *payload, uint32_t len)
+{
+    const dap_transport_t *transport = pl->transport;
+    uint32_t header;
+
+    header = transport->header ? transport->header(payload, len) : 0;
+    if (header != transport->header_size) {
+        // a shorter header than reserved, close the gap
+        memmove(pl->tx_buffer + pl->tx_len, payload - header, header + len);
+    }
+    pl->tx_len += header + len;
+    pl->tx_num++;
+    pl->stats.responses++;
+
+    if (!transport->gather) {
+        dap_pipeline_flush(pl);
+    }
+}
+
+static void dap_pipeline_execute(dap_pipeline_t *pl, uint8_t *request)
+{
+    uint8_t *payload;
+    uint32_t len;
+
+    // the response is built in place, queued requests add nothing until their chain ends
+    payload = dap_pipeline_payload(pl);
+    len = dap_engine_execute_chain(&pl->chain, request, payload, pl->transport->packet_size, DAP_PIPELINE_DEPTH);
+    pl->stats.requests++;
+    if (len != 0) {
+        dap_pipeline_add(pl, payload, len);
+    }
+}
+
+static void dap_pipeline_task(void *pvParameters)
+{
+    dap_pipeline_t *pl = pvParameters;
+    uint8_t idx;
+
+    for (;;) {
+        xQueueReceive(pl->req_queue, &idx, portMAX_DELAY);
+
+        if (idx == DAP_PIPELINE_EXIT || idx == DAP_PIPELINE_DRAIN) {
+            // a chain the host left open is answered before anything that comes after the drain,
+            // the exit follows dap_pipeline_stop and its drain
+            if (idx == DAP_PIPELINE_DRAIN) {
+                uint8_t *payload = dap_pipeline_payload(pl);
+                uint32_t len = dap_chain_end(&pl->chain, payload);
+
+                if (len != 0) {
+                    dap_pipeline_add(pl, payload, len);
+                }
+            }
+            dap_pipeline_flush(pl);
+            xSemaphoreGive(pl->done);
+            if (idx == DAP_PIPELINE_EXIT) {
+                break;
+            }
+            continue;
+        }
+
+        dap_pipeline_execute(pl, pl->slots + idx * pl->slot_size);
+        xQueueSend(pl->free_queue, &idx, portMAX_DELAY);
+
+        // nothing else in flight, answer now
+        if (uxQueueMessagesWaiting(pl->req_queue) == 0) {
+            dap_pipeline_flush(pl);
+        }
+    }
+
+    vTaskDelete(NULL);
+}
+
+static void dap_pipeline_free(dap_pipeline_t *pl)
+{
+    if (pl->done) {
+        vSemaphoreDelete(pl->done);
+    }
+    if (pl->free_queue) {
+        vQueueDelete(pl->free_queue);
+    }
+    if (pl->req_queue) {
+        vQueueDelete(pl->req_queue);
+    }
+    heap_caps_free(pl->memory);
+    free(pl);
+}
+
+dap_pipeline_t *dap_pipeline_alloc(uint32_t packet_size, uint32_t header_size)
+{
+    dap_pipeline_t *pl;
+    uint32_t size;
+    BaseType_t ret;
+
+    pl = calloc(1, sizeof(dap_pipeline_t));
+    if (pl == NULL) {
+        return NULL;
+    }
+
+    // room for two responses, the tx buffer of a transport that gathers
+    pl->slot_size = packet_size;
+    pl->header_size = header_size;
+    size = DAP_PIPELINE_DEPTH * packet_size + 2 * (header_size + packet_size) + packet_size;
+#ifdef CONFIG_SPIRAM
+    pl->memory = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (pl->memory == NULL)
+#endif
+    pl->memory = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    pl->done = xSemaphoreCreateBinary();
+    pl->free_queue = xQueueCreate(DAP_PIPELINE_DEPTH, sizeof(uint8_t));
+    pl->req_queue = xQueueCreate(DAP_PIPELINE_DEPTH + 1, sizeof(uint8_t)); // + drain or exit
+    if (pl->done == NULL || pl->free_queue == NULL || pl->req_queue == NULL || pl->memory == NULL) {
+        dap_pipeline_free(pl);
+        return NULL;
+    }
+
+    pl->slots = pl->memory;
+    pl->tx_buffer = pl->slots + DAP_PIPELINE_DEPTH * packet_size;
+    pl->chain.buffer = pl->tx_buffer + 2 * (header_size + packet_size);
+
+#if (portNUM_PROCESSORS > 1)
+    // the network stack runs on core 0
+    ret = xTaskCreatePinnedToCore(dap_pipeline_task, "dap_pipeline", DAP_PIPELINE_TASK_STACK, pl,
+                                  DAP_SESSION_TASK_PRIORITY, NULL, 1);
+#else
+    ret = xTaskCreate(dap_pipeline_task, "dap_pipeline", DAP_PIPELINE_TASK_STACK, pl,
+                      DAP_SESSION_TASK_PRIORITY, NULL);
+#endif
+    if (ret != pdPASS) {
+        dap_pipeline_free(pl);
+        return NULL;
+    }
+
+    return pl;
+}
+
+int dap_pipeline_start(dap_pipeline_t *pl, const dap_transport_t *transport, void *ctx)
+{
+    uint32_t frame_size;
+
+    if (transport->packet_size > pl->slot_size || transport->header_size > pl->header_size) {
+        return -1;
+    }
+
+    frame_size = transport->header_size + transport->packet_size;
+    pl->transport = transport;
+    pl->ctx = ctx;
+    pl->tx_size = transport->gather ? 2 * frame_size : frame_size;
+    pl->tx_len = 0;
+    pl->tx_num = 0;
+    memset(&pl->stats, 0, sizeof(pl->stats));
+
+    // slots left reserved by the last connection come back here
+    xQueueReset(pl->free_queue);
+    for (uint8_t i = 0; i < DAP_PIPELINE_DEPTH; i++) {
+        xQueueSend(pl->free_queue, &i, 0);
+    }
+
+    return 0;
+}
+
+void dap_pipeline_stop(dap_pipeline_t *pl)
+{
+    dap_pipeline_drain(pl);
+
+    printf("%s: %lu requests, %lu responses in %lu sends, up to %lu per send, %lu stalls\r\n",
+           pl->transport->name, pl->stats.requests, pl->stats.responses, pl->stats.sends,
+           pl->stats.max_gather, pl->stats.stalls);
+    pl->transport = NULL;
+    pl->ctx = NULL;
+}
+
+dap_pipeline_t *dap_pipeline_create(const dap_transport_t *transport, void *ctx)
+{
+    dap_pipeline_t *pl;
+
+    pl = dap_pipeline_alloc(transport->packet_size, transport->header_size);
+    if (pl == NULL) {
+        return NULL;
+    }
+
+    dap_pipeline_start(pl, transport, ctx);
+    return pl;
+}
+
+void dap_pipeline_destroy(dap_pipeline_t *pl)
+{
+    uint8_t idx = DAP_PIPELINE_EXIT;
+
+    dap_pipeline_stop(pl);
+
+    xQueueSend(pl->req_queue, &idx, portMAX_DELAY);
+    xSemaphoreTake(pl->done, portMAX_DELAY);
+    dap_pipeline_free(pl);
+}
+
+uint8_t *dap_pipeline_reserve(dap_pipeline_t *pl)
+{
+    if (xQueueReceive(pl->free_queue, &pl->reserved, 0) != pdTRUE) {
+        pl->stats.stalls++;
+        xQueueReceive(pl->free_queue, &pl->reserved, portMAX_DELAY);
+    }
+
+    return pl->slots + pl->reserved * pl->slot_size;
+}
+
+void dap_pipeline_commit(dap_pipeline_t *pl)
+{
+    xQueueSend(pl->req_queue, &pl->reserved, portMAX_DELAY);
+}
+
+void dap_pipeline_cancel(dap_pipeline_t *pl)
+{
+    xQueueSend(pl->free_queue, &pl->reserved, portMAX_DELAY);
+}
+
+int dap_pipeline_submit(dap_pipeline_t *pl, const uint8_t *request, uint32_t len)
+{
+    if (len > pl->transport->packet_size) {
+        return -1;
+    }
+
+    memcpy(dap_pipeline_reserve(pl), request, len);
+    dap_pipeline_commit(pl);
+
+    return 0;
+}
+
+void dap_pipeline_drain(dap_pipeline_t *pl)
+{
+    uint8_t idx = DAP_PIPELINE_DRAIN;
+
+    xQueueSend(pl->req_queue, &idx, portMAX_DELAY);
+    xSemaphoreTake(pl->done, portMAX_DELAY);
+}
+
+void dap_pipeline_get_stats(dap_pipeline_t *pl, dap_pipeline_stats_t *stats)
+{
+    *stats = pl->stats;
+}
@@ -0,0 +1,82 @@
+#ifndef __DAP_PIPELINE_H__
+#define __DAP_PIPELINE_H__
+
+#include <stdint.h>
+
+#include "dap_session.h"
+
+typedef struct dap_pipeline dap_pipeline_t;
+
+typedef struct
+{
+    uint32_t requests;    // requests executed
+    uint32_t responses;   // responses sent, queued requests have none
+    uint32_t sends;       // transport send calls
+    uint32_t bytes;       // bytes sent
+    uint32_t max_gather;  // most responses that left in one send
+    uint32_t stalls;      // submits that had to wait for a free slot
+} dap_pipeline_stats_t;
+
+/**
+ * @brief Allocate an idle packet pipeline, with its buffers, queues and executor task.
+ * Requests are executed by the task, on the second core where there is one,
+ * so that receiving the next request overlaps with the execution of the current one.
+ * Responses are framed by the transport and, if it allows, gathered into one send
+ * while more requests are in flight.
+ *
+ * @param packet_size largest packet size of the transports it will serve
+ * @param header_size largest header room of the transports it will serve
+ * @return pipeline, NULL if out of memory
+ */
+dap_pipeline_t *dap_pipeline_alloc(uint32_t packet_size, uint32_t header_size);
+
+/**
+ * @brief Bind an idle pipeline to the transport of a connection, nothing is allocated
+ *
+ * @param ctx passed to the transport functions
+ * @return 0 on success, -1 if the packets of the transport do not fit the pipeline
+ */
+int dap_pipeline_start(dap_pipeline_t *pl, const dap_transport_t *transport, void *ctx);
+
+/**
+ * @brief Answer everything submitted, print the statistics and leave the pipeline idle
+ */
+void dap_pipeline_stop(dap_pipeline_t *pl);
+
+/**
+ * @brief dap_pipeline_alloc and dap_pipeline_start in one, for a pipeline of its own
+ */
+dap_pipeline_t *dap_pipeline_create(const dap_transport_t *transport, void *ctx);
+
+/**
+ * @brief Stop the pipeline, then free it and end its task
+ */
+void dap_pipeline_destroy(dap_pipeline_t *pl);
+
+/**
+ * @brief Queue one complete DAP request, waits while all DAP_PIPELINE_DEPTH slots are in use
+ *
+ * @return 0 on success, -1 if the request is larger than the packet size of the transport
+ */
+int dap_pipeline_submit(dap_pipeline_t *pl, const uint8_t *request, uint32_t len);
+
+/**
+ * @brief Submit in two steps, for front ends that fill in the request themselves,
+ * for example while unmasking it. dap_pipeline_reserve waits for a free slot and
+ * returns it, the request may take up to the packet size of the transport.
+ * dap_pipeline_commit queues the reserved slot, dap_pipeline_cancel gives it back.
+ */
+uint8_t *dap_pipeline_reserve(dap_pipeline_t *pl);
+void dap_pipeline_commit(dap_pipeline_t *pl);
+void dap_pipeline_cancel(dap_pipeline_t *pl);
+
+/**
+ * @brief Wait until everything submitted so far has been answered.
+ * An unfinished DAP_QueueCommands chain is answered as if a packet of another kind
+ * had ended it, so the front end can answer out of band after the drain.
+ */
+void dap_pipeline_drain(dap_pipeline_t *pl);
+
+void dap_pipeline_get_stats(dap_pipeline_t *pl, dap_pipeline_stats_t *stats);
+
+#endif
@@ -0,0 +1,256 @@
+/**
+ * @file dap_session.c
+ * @brief Connection sessions of the DAP proxy and arbitration of the DAP engine.
+ *        Every accepted connection owns a slot of a static arena with its own receive buffer,
+ *        and is served by its own task, so that several tools can share the probe.
+ *        The slots, their buffers and packet pipelines are set up once at boot and reused,
+ *        so reconnecting does not allocate and does not fragment the heap.
+ *        The DAP engine itself is single: all transports execute commands under `dap_engine_mux`,
+ *        each with its own packet size.
+ * @change: 2026-10-17 first version
+ *          2026-10-17 per-transport packet size
+ *          2026-10-17 DAP_QueueCommands chains
+ *          2026-10-17 transports
+ *          2026-10-17 pipelines and work buffers allocated at boot
+ *          2026-10-17 client events
+ *          2026-10-17 client events on accept and close
+ * @version 0.7
+ * @date 2026-10-17
+ *
+ * @copyright MIT License
+ *
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dap_session.h"
+#include "dap_pipeline.h"
+#include "cmsis-dap/include/DAP.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_heap_caps.h"
+
+#include "lwip/sockets.h"
+
+static dap_session_t dap_sessions[DAP_SESSION_MAX];
+static uint8_t dap_session_used[DAP_SESSION_MAX];
+static SemaphoreHandle_t dap_session_mux = NULL;
+static SemaphoreHandle_t dap_engine_mux = NULL;
+static dap_session_event_cb_t dap_session_event_cb = NULL;
+static uint32_t dap_session_clients = 0;
+
+
+int dap_session_init(void)
+{
+    dap_session_mux = xSemaphoreCreateMutex();
+    dap_engine_mux = xSemaphoreCreateMutex();
+
+    if (dap_session_mux == NULL || dap_engine_mux == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < DAP_SESSION_MAX; i++) {
+        dap_sessions[i].fd = -1;
+        dap_sessions[i].index = i;
+        dap_sessions[i].pipeline = dap_pipeline_alloc(DAP_SESSION_PACKET_SIZE, DAP_SESSION_HEADER_SIZE);
+        if (dap_sessions[i].pipeline == NULL) {
+            return -1;
+        }
+    }
+
+    dap_session_print_heap("sessions ready");
+    return 0;
+}
+
+dap_session_t *dap_session_get(int index)
+{
+    return &dap_sessions[index];
+}
+
+dap_session_t *dap_session_alloc(int fd)
+{
+    dap_session_t *session = NULL;
+
+    xSemaphoreTake(dap_session_mux, portMAX_DELAY);
+    for (int i = 0; i < DAP_SESSION_MAX; i++) {
+        if (!dap_session_used[i]) {
+            dap_session_used[i] = 1;
+            session = &dap_sessions[i];
+            session->fd = fd;
+            session->transport = NULL;
+            break;
+        }
+    }
+    xSemaphoreGive(dap_session_mux);
+
+    if (session) {
+        dap_session_event(&dap_socket_transport, 1);
+    }
+    return session;
+}
+
+void dap_session_free(dap_session_t *session)
+{
+    xSemaphoreTake(dap_session_mux, portMAX_DELAY);
+    session->fd = -1;
+    dap_session_used[session->index] = 0;
+    xSemaphoreGive(dap_session_mux);
+
+    dap_session_event(&dap_socket_transport, 0);
+}
+
+int dap_session_active_num(void)
+{
+    int num = 0;
+
+    xSemaphoreTake(dap_session_mux, portMAX_DELAY);
+    for (int i = 0; i < DAP_SESSION_MAX; i++) {
+        num += dap_session_used[i];
+    }
+    xSemaphoreGive(dap_session_mux);
+
+    return num;
+}
+
+void dap_session_set_event_cb(dap_session_event_cb_t cb)
+{
+    dap_session_event_cb = cb;
+}
+
+void dap_session_event(const dap_transport_t *transport, uint8_t connected)
+{
+    uint32_t clients;
+
+    if (connected) {
+        clients = __atomic_add_fetch(&dap_session_clients, 1, __ATOMIC_RELAXED);
+    } else {
+        clients = __atomic_sub_fetch(&dap_session_clients, 1, __ATOMIC_RELAXED);
+    }
+
+    if (dap_session_event_cb) {
+        dap_session_event_cb(transport->name, connected, clients);
+    }
+}
+
+void dap_session_print_heap(const char *when)
+{
+    printf("%s: heap free %u, largest block %u, min free %u\r\n", when,
+           (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+           (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+           (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+}
+
+int dap_socket_send(void *ctx, const uint8_t *data, uint32_t len)
+{
+    dap_session_t *session = ctx;
+    uint32_t sent = 0;
+    int ret;
+
+    while (sent < len) {
+        ret = send(session->fd, data + sent, len - sent, 0);
+        if (ret <= 0) {
+            return ret;
+        }
+        sent += ret;
+    }
+
+    return sent;
+}
+
+int dap_socket_recv(void *ctx, uint8_t *data, uint32_t len)
+{
+    dap_session_t *session = ctx;
+
+    return recv(session->fd, data, len, 0);
+}
+
+const dap_transport_t dap_socket_transport = {
+    .name = "tcp",
+    .send = dap_socket_send,
+    .recv = dap_socket_recv,
+};
+
+uint32_t dap_engine_execute(const uint8_t *request, uint8_t *response, uint32_t packet_size,
+                            uint32_t packet_count)
+{
+    uint32_t ret;
+
+    xSemaphoreTake(dap_engine_mux, portMAX_DELAY);
+    DAP_SetPacketSize(packet_size);
+    DAP_SetPacketCount(packet_count);
+    ret = DAP_ExecuteCommand(request, response);
+    xSemaphoreGive(dap_engine_mux);
+
+    return ret;
+}
+
+static void dap_chain_append(dap_chain_t *chain, const uint8_t *response, uint32_t length, uint32_t packet_size)
+{
+    uint32_t count = 1;
+
+    if (response[0] == ID_DAP_ExecuteCommands) {
+        count = response[1];
+        response += 2;
+        length = length >= 2 ? length - 2 : 0;
+    }
+
+    if (chain->overflow || chain->count + count > 255 || 2 + chain->length + length > packet_size) {
+        chain->overflow = 1;
+        return;
+    }
+
+    memcpy(chain->buffer + chain->length, response, length);
+    chain->length += length;
+    chain->count += count;
+}
+
+uint32_t dap_engine_execute_chain(dap_chain_t *chain, uint8_t *request, uint8_t *response, uint32_t packet_size,
+                                  uint32_t packet_count)
+{
+    uint32_t length;
+    uint8_t queued = 0;
+
+    if (request[0] == ID_DAP_QueueCommands) {
+        request[0] = ID_DAP_ExecuteCommands;
+        queued = 1;
+    }
+
+    length = dap_engine_execute(request, response, packet_size, packet_count) & 0xFFFF;
+    if (!queued && chain->count == 0 && !chain->overflow) {
+        return length; // not part of a chain
+    }
+
+    dap_chain_append(chain, response, length, packet_size);
+    if (queued) {
+        return 0;
+    }
+
+    return dap_chain_end(chain, response);
+}
+
+uint32_t dap_chain_end(dap_chain_t *chain, uint8_t *response)
+{
+    uint32_t length;
+
+    if (chain->count == 0 && !chain->overflow) {
+        return 0;
+    }
+
+    if (chain->overflow) {
+        response[0] = ID_DAP_Invalid;
+        length = 1;
+    } else {
+        response[0] = ID_DAP_ExecuteCommands;
+        response[1] = chain->count;
+        memcpy(response + 2, chain->buffer, chain->length);
+        length = 2 + chain->length;
+    }
+
+    chain->length = 0;
+    chain->count = 0;
+    chain->overflow = 0;
+    return length;
+}
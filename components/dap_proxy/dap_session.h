@@ -0,0 +1,142 @@
+#ifndef __DAP_SESSION_H__
+#define __DAP_SESSION_H__
+
+#include <stdint.h>
+
+#include "proxy_server_conf.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * @brief How a front end moves bytes, so that the packet pipeline and the framers
+ * do not depend on sockets. `ctx` is the argument given along with the transport,
+ * the session itself for TCP clients.
+ */
+typedef struct
+{
+    const char *name;
+    uint32_t packet_size;   // DAP packet size, reported by DAP_Info
+    uint32_t header_size;   // room reserved in front of every response for `header`
+    uint8_t gather;         // several responses may leave in one send
+    int (*send)(void *ctx, const uint8_t *data, uint32_t len);
+    int (*recv)(void *ctx, uint8_t *data, uint32_t len);
+    // write the framing of a `len` byte response right before `payload`, return its size. optional
+    uint32_t (*header)(uint8_t *payload, uint32_t len);
+} dap_transport_t;
+
+typedef struct
+{
+    int fd;
+    int index;
+    TaskHandle_t task;                // serves every connection of the slot
+    const dap_transport_t *transport;
+    struct dap_pipeline *pipeline;    // idle between connections
+    uint8_t rx_buffer[DAP_SESSION_BUFFER_SIZE];
+    uint8_t work_buffer[DAP_SESSION_WORK_SIZE];
+} dap_session_t;
+
+/**
+ * @brief Set up all session slots, including their packet pipelines.
+ * Nothing is allocated when a client connects after this.
+ */
+int dap_session_init(void);
+
+dap_session_t *dap_session_get(int index);
+
+/**
+ * @brief Take a free session slot for an accepted connection
+ *
+ * @param fd connected socket
+ * @return session, NULL if all DAP_SESSION_MAX slots are in use
+ */
+dap_session_t *dap_session_alloc(int fd);
+void dap_session_free(dap_session_t *session);
+int dap_session_active_num(void);
+
+/**
+ * @brief Called when a client connects or disconnects: a TCP connection is given a session
+ * slot or closed ("tcp", whatever protocol it speaks), a KCP peer is opened or closed ("kcp").
+ * Called from the task accepting or serving the client, must not block.
+ *
+ * @param transport name of the transport
+ * @param connected 1 on connect, 0 on disconnect
+ * @param clients clients connected after the change
+ */
+typedef void (*dap_session_event_cb_t)(const char *transport, uint8_t connected, uint8_t clients);
+
+void dap_session_set_event_cb(dap_session_event_cb_t cb);
+void dap_session_event(const dap_transport_t *transport, uint8_t connected);
+
+/**
+ * @brief Print free heap and largest free block, to watch fragmentation across reconnects
+ */
+void dap_session_print_heap(const char *when);
+
+/**
+ * @brief Plain TCP socket I/O of a session, `ctx` is the dap_session_t.
+ * send returns once all data is written.
+ *
+ * @return bytes transferred, <= 0 on error or closed connection
+ */
+int dap_socket_send(void *ctx, const uint8_t *data, uint32_t len);
+int dap_socket_recv(void *ctx, uint8_t *data, uint32_t len);
+
+// socket I/O without framing, used until the protocol of a connection is known
+extern const dap_transport_t dap_socket_transport;
+
+static inline int dap_session_send(dap_session_t *session, const void *data, uint32_t len)
+{
+    return session->transport->send(session, data, len);
+}
+
+static inline int dap_session_recv(dap_session_t *session, void *data, uint32_t len)
+{
+    return session->transport->recv(session, data, len);
+}
+
+/**
+ * @brief Execute a DAP command (or an ExecuteCommands batch) on the shared DAP engine.
+ * Calls are serialized between sessions and transports, so a batch is never
+ * interleaved with commands of another client.
+ *
+ * @param packet_size packet size of the calling transport, reported by DAP_Info.
+ *                    request and response must hold this many bytes.
+ * @param packet_count requests the calling transport can hold, reported by DAP_Info
+ * @return DAP_ExecuteCommand result: response length in the lower 16 bits
+ */
+uint32_t dap_engine_execute(const uint8_t *request, uint8_t *response, uint32_t packet_size,
+                            uint32_t packet_count);
+
+typedef struct
+{
+    uint8_t *buffer; // responses of the chain so far, packet_size bytes
+    uint32_t length;
+    uint32_t count;  // number of commands answered in `buffer`
+    uint8_t overflow;
+} dap_chain_t;
+
+/**
+ * @brief Execute a DAP packet with DAP_QueueCommands semantics, for the stream transports.
+ * A DAP_QueueCommands packet is executed at once but not answered, its responses are
+ * collected in `chain`. The next packet of another kind ends the chain, and the whole
+ * chain is answered with one DAP_ExecuteCommands response. A chain whose responses do
+ * not fit in one packet is answered with ID_DAP_Invalid.
+ *
+ * @param chain chain state of the connection, zeroed with `buffer` set before the first call
+ * @param request the first byte is rewritten for queued packets
+ * @return response length in `response`, 0 if the packet was queued
+ */
+uint32_t dap_engine_execute_chain(dap_chain_t *chain, uint8_t *request, uint8_t *response, uint32_t packet_size,
+                                  uint32_t packet_count);
+
+/**
+ * @brief Answer an open chain now, as a packet of another kind would have ended it,
+ * and leave `chain` clean for the next packet.
+ *
+ * @param response room for packet_size bytes
+ * @return response length in `response`, 0 if no chain is open
+ */
+uint32_t dap_chain_end(dap_chain_t *chain, uint8_t *response);
+
+#endif
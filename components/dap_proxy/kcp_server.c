@@ -0,0 +1,299 @@
+/**
+ * @file kcp_server.c
+ * @brief DAP over KCP/UDP, with the elaphureLink framing:
+ *        the first KCP message is the elaphureLink handshake, then every message carries
+ *        one DAP command and is answered by one message carrying the DAP response,
+ *        except DAP_QueueCommands packets, which are answered together by the end of the chain.
+ *
+ *        The KCP control block is shared under `kcp_mux`:
+ *          - kcp_server_task receives datagrams and feeds them to ikcp_input
+ *          - kcp_worker runs ikcp_update and submits DAP commands to the packet pipeline
+ *          - the pipeline sends the responses through kcp_transport
+ *        kcp_worker sleeps until it is notified by the receive side or by `kcp_timer`,
+ *        which is armed for the time returned by ikcp_check.
+ * @change: 2026-10-17 first version
+ *          2026-10-17 execute through the packet pipeline
+ *          2026-10-17 client events per peer
+ * @version 0.3
+ * @date 2026-10-17
+ *
+ * @copyright MIT License
+ *
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "kcp_server.h"
+#include "DAP_handle.h"
+#include "dap_session.h"
+#include "dap_pipeline.h"
+#include "proxy_server_conf.h"
+
+#include "main/dap_configuration.h"
+#include "components/kcp/ikcp.h"
+#include "components/kcp/ikcp_util.h"
+#include "components/elaphureLink/elaphureLink_protocol.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "freertos/semphr.h"
+
+#include "lwip/err.h"
+#include "lwip/sockets.h"
+
+#define KCP_HEADER_SIZE   24 // IKCP_OVERHEAD
+
+#define KCP_NOTIFY_INPUT  (1 << 0)
+#define KCP_NOTIFY_UPDATE (1 << 1)
+
+typedef struct
+{
+    ikcpcb *kcp;
+#ifdef CONFIG_EXAMPLE_IPV4
+    struct sockaddr_in peer;
+#else
+    struct sockaddr_in6 peer;
+#endif
+    uint32_t last_input;
+    uint8_t handshaked;
+} kcp_session_t;
+
+static int kcp_sock = -1;
+static kcp_session_t kcp_session;
+static SemaphoreHandle_t kcp_mux = NULL;
+static TaskHandle_t kcp_worker_handle = NULL;
+static TimerHandle_t kcp_timer = NULL;
+static dap_pipeline_t *kcp_pipeline = NULL;
+
+
+static int kcp_output(const char *buf, int len, ikcpcb *kcp, void *user)
+{
+    kcp_session_t *session = user;
+
+    return sendto(kcp_sock, buf, len, 0, (struct sockaddr *)&session->peer, sizeof(session->peer));
+}
+
+// one KCP message per response, the worker flushes them
+static int kcp_transport_send(void *ctx, const uint8_t *data, uint32_t len)
+{
+    kcp_session_t *session = ctx;
+    int ret = -1;
+
+    xSemaphoreTake(kcp_mux, portMAX_DELAY);
+    if (session->kcp && session->handshaked) {
+        ret = ikcp_send(session->kcp, (const char *)data, len) == 0 ? len : -1;
+    }
+    xSemaphoreGive(kcp_mux);
+
+    xTaskNotify(kcp_worker_handle, KCP_NOTIFY_UPDATE, eSetBits);
+    return ret;
+}
+
+static const dap_transport_t kcp_transport = {
+    .name = "kcp",
+    .packet_size = DAP_KCP_PACKET_SIZE,
+    .gather = 0, // keep message boundaries
+    .send = kcp_transport_send,
+};
+
+static void kcp_timer_cb(TimerHandle_t timer)
+{
+    xTaskNotify(kcp_worker_handle, KCP_NOTIFY_UPDATE, eSetBits);
+}
+
+static void kcp_session_close(kcp_session_t *session)
+{
+    if (session->kcp) {
+        ikcp_release(session->kcp);
+        printf("kcp session closed\r\n");
+        dap_session_event(&kcp_transport, 0);
+    }
+
+    session->kcp = NULL;
+    session->handshaked = 0;
+}
+
+static int kcp_session_open(kcp_session_t *session, uint32_t conv)
+{
+    ikcpcb *kcp = ikcp_create(conv, session);
+    if (kcp == NULL)
+        return -1;
+
+    ikcp_setoutput(kcp, kcp_output);
+    ikcp_nodelay(kcp, DAP_KCP_NODELAY, DAP_KCP_INTERVAL, DAP_KCP_RESEND, DAP_KCP_NC);
+    ikcp_wndsize(kcp, DAP_KCP_SND_WND, DAP_KCP_RCV_WND);
+    ikcp_setmtu(kcp, DAP_KCP_MTU);
+
+    session->kcp = kcp;
+    session->handshaked = 0;
+    printf("kcp session opened, conv %lu\r\n", conv);
+    dap_session_event(&kcp_transport, 1);
+    return 0;
+}
+
+/**
+ * @brief Handle one KCP message
+ *
+ * @return length of the response in `res`, 0 if the pipeline answers, < 0 to drop the session
+ */
+static int kcp_process_message(kcp_session_t *session, uint8_t *req, int len, uint8_t *res)
+{
+    el_request_handshake *hs = (el_request_handshake *)req;
+    el_response_handshake *hs_res = (el_response_handshake *)res;
+
+    if (!session->handshaked) {
+        if (len != sizeof(el_request_handshake) ||
+            ntohl(hs->el_link_identifier) != EL_LINK_IDENTIFIER ||
+            ntohl(hs->command) != EL_COMMAND_HANDSHAKE) {
+            return -1;
+        }
+
+        // nothing of the previous peer may follow the handshake
+        dap_pipeline_drain(kcp_pipeline);
+
+        hs_res->el_link_identifier = htonl(EL_LINK_IDENTIFIER);
+        hs_res->command = htonl(EL_COMMAND_HANDSHAKE);
+        hs_res->el_dap_version = htonl(EL_DAP_VERSION);
+        session->handshaked = 1;
+        return sizeof(el_response_handshake);
+    }
+
+    dap_pipeline_submit(kcp_pipeline, req, len);
+    return 0;
+}
+
+static void kcp_worker(void *pvParameters)
+{
+    static uint8_t req[DAP_KCP_PACKET_SIZE];
+    static uint8_t res[sizeof(el_response_handshake)];
+    kcp_session_t *session = &kcp_session;
+    ikcpcb *kcp;
+    uint32_t now, next;
+    int len;
+
+    for (;;) {
+        xTaskNotifyWait(0, UINT32_MAX, NULL, portMAX_DELAY);
+
+        xSemaphoreTake(kcp_mux, portMAX_DELAY);
+        if (session->kcp == NULL) {
+            xSemaphoreGive(kcp_mux);
+            continue;
+        }
+
+        kcp = session->kcp;
+        now = iclock();
+        ikcp_update(kcp, now);
+
+        while ((len = ikcp_recv(kcp, (char *)req, sizeof(req))) > 0) {
+            // the DAP engine is not touched by the receive side, let it feed input meanwhile
+            xSemaphoreGive(kcp_mux);
+            len = kcp_process_message(session, req, len, res);
+            xSemaphoreTake(kcp_mux, portMAX_DELAY);
+
+            if (session->kcp != kcp)
+                break; // replaced by another client meanwhile
+            if (len < 0) {
+                printf("kcp: bad handshake\r\n");
+                kcp_session_close(session);
+                break;
+            }
+            if (len > 0)
+                ikcp_send(kcp, (const char *)res, len);
+        }
+
+        if (session->kcp) {
+            // push out responses and acks now instead of at the next interval
+            ikcp_flush(session->kcp);
+
+            now = iclock();
+            next = pdMS_TO_TICKS(ikcp_check(session->kcp, now) - now);
+            xTimerChangePeriod(kcp_timer, next ? next : 1, 0);
+        }
+        xSemaphoreGive(kcp_mux);
+    }
+}
+
+void kcp_server_task(void *pvParameters)
+{
+    static uint8_t rx_buffer[1500];
+    kcp_session_t *session = &kcp_session;
+    char addr_str[128];
+    int addr_family;
+    int ip_protocol;
+    uint32_t conv, now;
+    int ret;
+
+#ifdef CONFIG_EXAMPLE_IPV4
+    struct sockaddr_in destAddr;
+    struct sockaddr_in sourceAddr;
+    destAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    destAddr.sin_family = AF_INET;
+    destAddr.sin_port = htons(DAP_PROXY_PORT);
+    addr_family = AF_INET;
+    ip_protocol = IPPROTO_IP;
+    inet_ntoa_r(destAddr.sin_addr, addr_str, sizeof(addr_str) - 1);
+#else // IPV6
+    struct sockaddr_in6 destAddr;
+    struct sockaddr_in6 sourceAddr;
+    bzero(&destAddr.sin6_addr.un, sizeof(destAddr.sin6_addr.un));
+    destAddr.sin6_family = AF_INET6;
+    destAddr.sin6_port = htons(DAP_PROXY_PORT);
+    addr_family = AF_INET6;
+    ip_protocol = IPPROTO_IPV6;
+    inet6_ntoa_r(destAddr.sin6_addr, addr_str, sizeof(addr_str) - 1);
+#endif
+    socklen_t addrLen;
+
+    kcp_mux = xSemaphoreCreateMutex();
+    kcp_timer = xTimerCreate("kcp", pdMS_TO_TICKS(DAP_KCP_INTERVAL) ? pdMS_TO_TICKS(DAP_KCP_INTERVAL) : 1,
+                             pdFALSE, NULL, kcp_timer_cb);
+    kcp_pipeline = dap_pipeline_create(&kcp_transport, session);
+    if (kcp_mux == NULL || kcp_timer == NULL || kcp_pipeline == NULL ||
+        xTaskCreate(kcp_worker, "kcp_worker", 3072, NULL, 10, &kcp_worker_handle) != pdPASS) {
+        printf("kcp: can not create worker\r\n");
+        vTaskDelete(NULL);
+    }
+
+    kcp_sock = socket(addr_family, SOCK_DGRAM, ip_protocol);
+    if (kcp_sock < 0) {
+        printf("kcp: unable to create socket: errno %d\r\n", errno);
+        vTaskDelete(NULL);
+    }
+
+    if (bind(kcp_sock, (struct sockaddr *)&destAddr, sizeof(destAddr)) != 0) {
+        printf("kcp: unable to bind: errno %d\r\n", errno);
+        close(kcp_sock);
+        vTaskDelete(NULL);
+    }
+    printf("kcp listening\r\n");
+
+    while (1) {
+        addrLen = sizeof(sourceAddr);
+        ret = recvfrom(kcp_sock, rx_buffer, sizeof(rx_buffer), 0, (struct sockaddr *)&sourceAddr, &addrLen);
+        if (ret < KCP_HEADER_SIZE)
+            continue;
+
+        conv = ikcp_getconv(rx_buffer);
+        now = iclock();
+
+        xSemaphoreTake(kcp_mux, portMAX_DELAY);
+        if (session->kcp == NULL ||
+            (session->kcp->conv != conv && now - session->last_input > DAP_KCP_SESSION_TIMEOUT)) {
+            // new client, or the previous one went away
+            kcp_session_close(session);
+            if (kcp_session_open(session, conv) != 0) {
+                xSemaphoreGive(kcp_mux);
+                continue;
+            }
+        }
+
+        if (session->kcp->conv == conv) {
+            memcpy(&session->peer, &sourceAddr, sizeof(session->peer));
+            session->last_input = now;
+            ikcp_input(session->kcp, (const char *)rx_buffer, ret);
+            xTaskNotify(kcp_worker_handle, KCP_NOTIFY_INPUT, eSetBits);
+        }
+        xSemaphoreGive(kcp_mux);
+    }
+}
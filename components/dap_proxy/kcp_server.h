@@ -0,0 +1,6 @@
+#ifndef __KCP_SERVER_H__
+#define __KCP_SERVER_H__
+
+void kcp_server_task(void *pvParameters);
+
+#endif
@@ -1,6 +1,69 @@
 #ifndef PROXY_SERVER_CONF_H_GUARD
 #define PROXY_SERVER_CONF_H_GUARD
 
+#include "sdkconfig.h"
+
 #define DAP_PROXY_PORT 3240
 
+/**
+ * Concurrent TCP clients (usbip, elaphureLink, websocket).
+ * Only one of them may be a usbip client at a time.
+ * Every slot holds its memory from boot, about 24 KB of internal RAM without PSRAM.
+ */
+#ifdef CONFIG_SPIRAM
+#define DAP_SESSION_MAX           3
+#else
+#define DAP_SESSION_MAX           2
+#endif
+#define DAP_SESSION_BUFFER_SIZE   1500
+#define DAP_SESSION_TASK_STACK    4096
+#define DAP_SESSION_TASK_PRIORITY 14
+
+/**
+ * DAP packet size of each transport, reported to the host by DAP_Info.
+ * usbip is bound to the USB endpoint, see DAP_PACKET_SIZE in main/dap_configuration.h.
+ * elaphureLink has no framing, requests are delimited by parsing the DAP command.
+ * A websocket request and its frame header must fit DAP_SESSION_BUFFER_SIZE.
+ * KCP fragments messages itself, packets may span several datagrams.
+ */
+#define DAP_EL_PACKET_SIZE        1400
+#define DAP_WS_PACKET_SIZE        1400
+#define DAP_KCP_PACKET_SIZE       4096
+
+#if (DAP_EL_PACKET_SIZE > DAP_SESSION_BUFFER_SIZE) || (DAP_WS_PACKET_SIZE + 14 > DAP_SESSION_BUFFER_SIZE)
+#error "DAP packet size does not fit the session buffer"
+#endif
+
+/**
+ * Every session slot is set up at boot and reused by all of its connections:
+ * the session task, the receive buffer, a work buffer of the transport
+ * (websocket multi-command responses) and a packet pipeline that takes
+ * elaphureLink and websocket packets.
+ */
+#define DAP_SESSION_WORK_SIZE     5632
+#define DAP_SESSION_PACKET_SIZE   (DAP_EL_PACKET_SIZE > DAP_WS_PACKET_SIZE ? DAP_EL_PACKET_SIZE : DAP_WS_PACKET_SIZE)
+#define DAP_SESSION_HEADER_SIZE   4
+
+/**
+ * Packet pipeline of the elaphureLink, websocket and KCP transports:
+ * requests received ahead of the one being executed.
+ */
+#define DAP_PIPELINE_DEPTH        4
+#define DAP_PIPELINE_TASK_STACK   3072
+
+/**
+ * KCP over UDP, listens on DAP_PROXY_PORT (UDP).
+ * Profile: nodelay, update interval (ms), fast resend, no congestion control.
+ *   normal: 0, 40, 0, 0
+ *   fast:   1, 10, 2, 1
+ */
+#define DAP_KCP_NODELAY           1
+#define DAP_KCP_INTERVAL          10
+#define DAP_KCP_RESEND            2
+#define DAP_KCP_NC                1
+#define DAP_KCP_SND_WND           32   // in packets
+#define DAP_KCP_RCV_WND           32
+#define DAP_KCP_MTU               1400
+#define DAP_KCP_SESSION_TIMEOUT   10000 // ms without input before another peer may connect
+
 #endif //PROXY_SERVER_CONF_H_GUARD
\ No newline at end of file
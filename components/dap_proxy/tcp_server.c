@@ -1,6 +1,6 @@
 /**
  * @file tcp_server.c
- * @brief Handle main tcp tasks
+ * @brief Accept tcp clients and hand each one to the task of a free session slot
  * @version 0.1
  * @date 2020-01-22
  *
@@ -11,6 +11,7 @@
 
 #include "usbip_server.h"
 #include "DAP_handle.h"
+#include "dap_session.h"
 
 #include "components/elaphureLink/elaphureLink_protocol.h"
 #include "proxy_server_conf.h"
@@ -22,23 +23,84 @@
 #include "lwip/sockets.h"
 #include "websocket_server.h"
 
-extern TaskHandle_t kDAPTaskHandle;
-extern int kRestartDAPHandle;
+static void tcp_session_serve(dap_session_t *session)
+{
+    uint8_t *tcp_rx_buffer = session->rx_buffer;
+    enum usbip_server_state_t usbip_state = WAIT_DEVLIST;
+    uint8_t *data;
+    int header;
+    int ret, sz;
+
+    session->transport = &dap_socket_transport;
+
+    // Read header
+    sz = 4;
+    data = &tcp_rx_buffer[0];
+    do {
+        ret = dap_session_recv(session, data, sz);
+        if (ret <= 0)
+            return;
+        sz -= ret;
+        data += ret;
+    } while (sz > 0);
+
+    header = *((int *)(tcp_rx_buffer));
+    header = ntohl(header);
+
+    if (header == EL_LINK_IDENTIFIER) {
+        el_dap_work(session);
+    } else if ((header & 0xFFFF) == 0x8003 ||
+               (header & 0xFFFF) == 0x8005) { // usbip OP_REQ_DEVLIST/OP_REQ_IMPORT
+        if ((header & 0xFFFF) == 0x8005)
+            usbip_state = WAIT_DEVLIST;
+        else
+            usbip_state = WAIT_IMPORT;
+        usbip_worker(session->fd, tcp_rx_buffer, DAP_SESSION_BUFFER_SIZE, &usbip_state);
+    } else if (header == 0x47455420) { // string "GET "
+        websocket_worker(session);
+    } else {
+        printf("Unknown protocol\n");
+    }
+}
 
-int kSock = -1;
+// the task of a session slot, woken by tcp_server_task for every connection given to the slot
+static void tcp_session_task(void *pvParameters)
+{
+    dap_session_t *session = pvParameters;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        tcp_session_serve(session);
+
+        printf("Session %d: shutting down socket\r\n", session->index);
+        close(session->fd);
+        dap_session_free(session);
+        dap_session_print_heap("session closed");
+    }
+}
 
 void tcp_server_task(void *pvParameters)
 {
-    uint8_t tcp_rx_buffer[1500] = {0};
     char addr_str[128];
-    enum usbip_server_state_t usbip_state = WAIT_DEVLIST;
-    uint8_t *data;
+    dap_session_t *session;
     int addr_family;
     int ip_protocol;
-    int header;
-    int ret, sz;
+    int sock;
 
     int on = 1;
+
+    for (int i = 0; i < DAP_SESSION_MAX; i++)
+    {
+        session = dap_session_get(i);
+        if (xTaskCreate(tcp_session_task, "dap_session", DAP_SESSION_TASK_STACK, session,
+                        DAP_SESSION_TASK_PRIORITY, &session->task) != pdPASS)
+        {
+            printf("Can not create session task\r\n");
+            vTaskDelete(NULL);
+        }
+    }
+
     while (1)
     {
 
@@ -79,7 +141,7 @@ void tcp_server_task(void *pvParameters)
         }
         printf("Socket binded\r\n");
 
-        err = listen(listen_sock, 1);
+        err = listen(listen_sock, DAP_SESSION_MAX);
         if (err != 0)
         {
             printf("Error occured during listen: errno %d\r\n", errno);
@@ -95,63 +157,25 @@ void tcp_server_task(void *pvParameters)
         uint32_t addrLen = sizeof(sourceAddr);
         while (1)
         {
-            kSock = accept(listen_sock, (struct sockaddr *)&sourceAddr, &addrLen);
-            if (kSock < 0)
+            sock = accept(listen_sock, (struct sockaddr *)&sourceAddr, &addrLen);
+            if (sock < 0)
             {
                 printf("Unable to accept connection: errno %d\r\n", errno);
                 break;
             }
-            setsockopt(kSock, SOL_SOCKET, SO_KEEPALIVE, (void *)&on, sizeof(on));
-            setsockopt(kSock, IPPROTO_TCP, TCP_NODELAY, (void *)&on, sizeof(on));
-            printf("Socket accepted\r\n");
-
-            // Read header
-            sz = 4;
-            data = &tcp_rx_buffer[0];
-            do {
-                ret = recv(kSock, data, sz, 0);
-                if (ret <= 0)
-                    goto cleanup;
-                sz -= ret;
-                data += ret;
-            } while (sz > 0);
-
-            header = *((int *)(tcp_rx_buffer));
-            header = ntohl(header);
-
-            if (header == EL_LINK_IDENTIFIER) {
-                el_dap_work(tcp_rx_buffer, sizeof(tcp_rx_buffer));
-            } else if ((header & 0xFFFF) == 0x8003 ||
-                       (header & 0xFFFF) == 0x8005) { // usbip OP_REQ_DEVLIST/OP_REQ_IMPORT
-                if ((header & 0xFFFF) == 0x8005)
-                    usbip_state = WAIT_DEVLIST;
-                else
-                    usbip_state = WAIT_IMPORT;
-                usbip_worker(tcp_rx_buffer, sizeof(tcp_rx_buffer), &usbip_state);
-            } else if (header == 0x47455420) { // string "GET "
-                websocket_worker(kSock, tcp_rx_buffer, sizeof(tcp_rx_buffer));
-            } else {
-                printf("Unknown protocol\n");
-            }
+            setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (void *)&on, sizeof(on));
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (void *)&on, sizeof(on));
 
-cleanup:
-            if (kSock != -1)
+            session = dap_session_alloc(sock);
+            if (session == NULL)
             {
-                printf("Shutting down socket and restarting...\r\n");
-                //shutdown(kSock, 0);
-                close(kSock);
-
-                // Restart DAP Handle
-                el_process_buffer_free();
-
-                kRestartDAPHandle = RESET_HANDLE;
-                if (kDAPTaskHandle)
-                    xTaskNotifyGive(kDAPTaskHandle);
-
-                //shutdown(listen_sock, 0);
-                //close(listen_sock);
-                //vTaskDelay(5);
+                printf("Too many clients, connection refused\r\n");
+                close(sock);
+                continue;
             }
+
+            xTaskNotifyGive(session->task);
+            printf("Socket accepted, session %d, %d active\r\n", session->index, dap_session_active_num());
         }
     }
     vTaskDelete(NULL);
@@ -4,8 +4,15 @@
 #include "usbip_server.h"
 #include "DAP_handle.h"
 
+#include "main/dap_configuration.h"
 #include "components/USBIP/usb_handle.h"
 #include "components/USBIP/usb_descriptor.h"
+#include "cmsis-dap/include/dap_stats.h"
+
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #include "lwip/err.h"
 #include "lwip/sockets.h"
@@ -33,12 +40,188 @@ static void unpack(void *data, int size);
 
 static void handle_unlink(usbip_stage2_header *header);
 // unlink helper function
-static void send_stage2_unlink(usbip_stage2_header *req_header);
+static void send_stage2_unlink(usbip_stage2_header *req_header, int32_t status);
+
+extern TaskHandle_t kDAPTaskHandle;
+extern int kRestartDAPHandle;
+
+// socket of the attached usbip client. The DAP slot pipeline and the tx aggregation
+// are global, so only one session at a time may use usbip.
+int kSock = -1;
 
 int usbip_network_send(int s, const void *dataptr, size_t size, int flags) {
     return send(s, dataptr, size, flags);
 }
 
+
+/*
+ * Transmit aggregation for stage2 replies.
+ *
+ * Replies are gathered into one scatter/gather list and written with a single sendmsg().
+ * Small records (headers built in the receive buffer) are copied into `buf`, large records
+ * (DAP responses living in a pipeline slot) are referenced in place and released through
+ * their done callback once they have been sent.
+ *
+ * The list is flushed when:
+ *  - the next record would exceed USBIP_TX_FLUSH_SIZE or the iov list is full
+ *  - the socket has no more input to process (see usbip_urb_process)
+ *  - the oldest pending byte is older than USBIP_TX_DEADLINE_US
+ */
+#define USBIP_TX_FLUSH_SIZE   1440 // one TCP segment (CONFIG_LWIP_TCP_MSS)
+#define USBIP_TX_IOV_NUM      8
+#define USBIP_TX_DEADLINE_US  500
+
+// while IN URBs wait for a DAP response, check the socket for new URBs this often
+#define USBIP_URB_POLL_TICKS  pdMS_TO_TICKS(10)
+
+static struct {
+    struct iovec iov[USBIP_TX_IOV_NUM];
+    usbip_tx_done_cb done[USBIP_TX_IOV_NUM];
+    void *done_arg[USBIP_TX_IOV_NUM];
+    int iov_num;
+    size_t pending;   // bytes referenced by iov
+    size_t staged;    // bytes used in buf
+    int64_t first_us; // submit time of the oldest pending record
+    uint8_t buf[USBIP_TX_FLUSH_SIZE];
+
+    usbip_tx_stats_t stats;
+} usbip_tx;
+
+static void usbip_tx_release(void)
+{
+    for (int i = 0; i < usbip_tx.iov_num; i++) {
+        if (usbip_tx.done[i])
+            usbip_tx.done[i](usbip_tx.done_arg[i]);
+    }
+
+    usbip_tx.iov_num = 0;
+    usbip_tx.pending = 0;
+    usbip_tx.staged = 0;
+}
+
+static void usbip_tx_reset(void)
+{
+    usbip_tx_release(); // drop anything not sent yet
+    memset(&usbip_tx.stats, 0, sizeof(usbip_tx.stats));
+}
+
+void usbip_tx_flush(void)
+{
+    struct msghdr msg;
+    struct iovec *iov = usbip_tx.iov;
+    int iov_num = usbip_tx.iov_num;
+    int ret;
+
+    if (usbip_tx.pending == 0)
+        return;
+
+    usbip_tx.stats.segments++;
+    usbip_tx.stats.bytes += usbip_tx.pending;
+    if (usbip_tx.pending > usbip_tx.stats.max_segment)
+        usbip_tx.stats.max_segment = usbip_tx.pending;
+
+    memset(&msg, 0, sizeof(msg));
+    while (iov_num > 0) {
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_num;
+        DAP_STATS_EVENT_BEGIN(send_start);
+        ret = sendmsg(kSock, &msg, 0);
+        DAP_STATS_EVENT_END(send_start, DAP_STATS_NET_SEND);
+        if (ret <= 0)
+            break; // the receive side will notice the broken connection
+
+        // partial write, skip what has been sent
+        while (iov_num > 0 && (size_t)ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            iov_num--;
+        }
+        if (iov_num > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    usbip_tx_release();
+}
+
+/**
+ * @brief Queue a stage2 record for transmission
+ *
+ * @param data record data
+ * @param size record size
+ * @param done NULL: data is copied and may be reused at once.
+ *             Otherwise data is sent in place and done(arg) is called once it is no longer needed.
+ * @param arg argument of done
+ */
+void usbip_tx_submit(const void *data, size_t size, usbip_tx_done_cb done, void *arg)
+{
+    int64_t now = esp_timer_get_time();
+    struct iovec *last;
+    bool copy = (done == NULL);
+
+    usbip_tx.stats.submits++;
+
+    if (usbip_tx.pending + size > USBIP_TX_FLUSH_SIZE || usbip_tx.iov_num == USBIP_TX_IOV_NUM ||
+        (copy && usbip_tx.staged + size > sizeof(usbip_tx.buf))) {
+        usbip_tx.stats.flush_size++;
+        usbip_tx_flush();
+    }
+
+    if (usbip_tx.pending == 0)
+        usbip_tx.first_us = now;
+
+    if (copy && size <= sizeof(usbip_tx.buf)) {
+        memcpy(&usbip_tx.buf[usbip_tx.staged], data, size);
+        data = &usbip_tx.buf[usbip_tx.staged];
+        usbip_tx.staged += size;
+
+        // extend the previous entry if it ends where this copy starts
+        if (usbip_tx.iov_num > 0) {
+            last = &usbip_tx.iov[usbip_tx.iov_num - 1];
+            if (usbip_tx.done[usbip_tx.iov_num - 1] == NULL &&
+                (uint8_t *)last->iov_base + last->iov_len == data) {
+                last->iov_len += size;
+                goto appended;
+            }
+        }
+    } else if (copy) {
+        // larger than the staging buffer, the list is empty here so send it as is
+        usbip_tx.stats.segments++;
+        usbip_tx.stats.bytes += size;
+        usbip_network_send(kSock, data, size, 0);
+        return;
+    }
+
+    usbip_tx.iov[usbip_tx.iov_num].iov_base = (void *)data;
+    usbip_tx.iov[usbip_tx.iov_num].iov_len = size;
+    usbip_tx.done[usbip_tx.iov_num] = done;
+    usbip_tx.done_arg[usbip_tx.iov_num] = arg;
+    usbip_tx.iov_num++;
+
+appended:
+    usbip_tx.pending += size;
+
+    if (usbip_tx.pending >= USBIP_TX_FLUSH_SIZE) {
+        usbip_tx.stats.flush_size++;
+        usbip_tx_flush();
+    } else if (now - usbip_tx.first_us >= USBIP_TX_DEADLINE_US) {
+        usbip_tx.stats.flush_deadline++;
+        usbip_tx_flush();
+    }
+}
+
+void usbip_tx_get_stats(usbip_tx_stats_t *stats)
+{
+    *stats = usbip_tx.stats;
+}
+
+static bool usbip_rx_ready(void)
+{
+    uint8_t c;
+    return recv(kSock, &c, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+}
+
 static int attach(uint8_t *buffer, uint32_t length)
 {
     int command = read_stage1_command(buffer, length);
@@ -76,6 +259,8 @@ static int read_stage1_command(uint8_t *buffer, uint32_t length)
 
 static void handle_device_list(uint8_t *buffer, uint32_t length)
 {
+    (void)buffer;
+    (void)length;
 	printf("Handling dev list request...\r\n");
     send_stage1_header(USBIP_STAGE1_CMD_DEVICE_LIST, 0);
     send_device_list();
@@ -83,6 +268,7 @@ static void handle_device_list(uint8_t *buffer, uint32_t length)
 
 static void handle_device_attach(uint8_t *buffer, uint32_t length)
 {
+    (void)buffer;
 	printf("Handling dev attach request...\r\n");
 
     //char bus[USBIP_BUSID_SIZE];
@@ -173,77 +359,169 @@ static void send_interface_info()
     usbip_network_send(kSock, (uint8_t *)&interface, sizeof(usbip_stage1_usb_interface), 0);
 }
 
-static int usbip_urb_process(uint8_t *base, uint32_t length)
+/**
+ * @brief Size of the stage2 record starting at `header`
+ *
+ * @return header + payload size, 0 if not enough bytes for the header yet
+ */
+static uint32_t usbip_urb_record_size(const uint8_t *data, uint32_t avail)
+{
+    const usbip_stage2_header *header = (const usbip_stage2_header *)data;
+
+    if (avail < sizeof(usbip_stage2_header))
+        return 0;
+
+    if (ntohl(header->base.command) == USBIP_STAGE2_REQ_SUBMIT &&
+        ntohl(header->base.direction) == USBIP_DIR_OUT)
+        return sizeof(usbip_stage2_header) + ntohl(header->u.cmd_submit.data_length);
+
+    return sizeof(usbip_stage2_header); // USBIP_CMD_UNLINK, IN submit
+}
+
+/**
+ * @brief Handle one complete stage2 record, in place in the receive buffer.
+ * The payload of an OUT submit directly follows the header.
+ */
+static int usbip_urb_dispatch(usbip_stage2_header *header, uint32_t *unlink_count)
 {
-    usbip_stage2_header *header = (usbip_stage2_header *)base;
-    uint8_t *data;
     uint32_t command, dir, ep;
+
+    command = ntohl(header->base.command);
+    dir = ntohl(header->base.direction);
+    ep = ntohl(header->base.ep);
+
+    if (likely(command == USBIP_STAGE2_REQ_SUBMIT)) {
+        if (likely(ep == 1 && dir == USBIP_DIR_IN)) {
+            handle_dap_in_request(header);
+        } else if (likely(ep == 1 && dir == USBIP_DIR_OUT)) {
+            handle_dap_data_request(header, ntohl(header->u.cmd_submit.data_length));
+        } else if (ep == 0) {
+            unpack(header, sizeof(usbip_stage2_header));
+            handleUSBControlRequest(header);
+        } else {
+            // ep3 reserved for SWO
+            printf("ep reserved:%lu\r\n", ep);
+            send_stage2_submit(header, 0, 0);
+        }
+    } else if (command == USBIP_STAGE2_REQ_UNLINK) {
+        if (*unlink_count == 0 || *unlink_count % 100 == 0)
+            printf("unlink\r\n");
+        (*unlink_count)++;
+        unpack(header, sizeof(usbip_stage2_header));
+        handle_unlink(header);
+    } else {
+        printf("emulate unknown command:%lu\r\n", command);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Stage2 records are received in a stream: every recv() takes as much as the socket holds,
+ * then all complete records in the buffer are dispatched in place. A partial record at the
+ * end is completed by the next recv(), it is only moved to the front of the buffer when the
+ * rest of it would not fit behind it.
+ * DAP requests are copied into their pipeline slot by handle_dap_data_request, as they are
+ * executed after the buffer has been reused.
+ */
+static int usbip_urb_process(uint8_t *base, uint32_t length)
+{
+    const usbip_stage2_header *header;
+    dap_queue_stats_t queue_stats;
     uint32_t unlink_count = 0;
-    bool may_has_data;
-    int sz, ret;
-    int dap_req_num = 0;
+    uint32_t recv_num = 0, urb_num = 0;
+    uint32_t head = 0, tail = 0, sz;
+    bool stalled = false;
+    int ret;
+
+    usbip_tx_reset();
+    dap_urb_reset();
 
     while (1) {
-        // header
-        data = base;
-        sz = 48; // for USBIP_CMD_SUBMIT/USBIP_CMD_UNLINK
-        do {
-            ret = recv(kSock, data, sz, 0);
-            if (ret <= 0)
-                goto out;
-            sz -= ret;
-            data += ret;
-        } while (sz > 0);
+        if (stalled) {
+            // DAP pipeline is full: leave the socket unread, TCP flow control holds the host back
+            if (!dap_request_slot_wait(USBIP_URB_POLL_TICKS))
+                continue;
+            stalled = false;
+        } else {
+            dap_urb_complete(0);
+
+            if (!usbip_rx_ready()) {
+                // nothing more to process, push out the gathered replies before blocking
+                if (usbip_tx.pending) {
+                    usbip_tx.stats.flush_idle++;
+                    usbip_tx_flush();
+                }
+                // IN URBs are waiting for the DAP engine, keep an eye on the socket meanwhile (UNLINK).
+                // Not for an open DAP_QueueCommands chain, only the next request can end it.
+                if (dap_urb_pending() && !dap_chain_held()) {
+                    dap_urb_complete(USBIP_URB_POLL_TICKS);
+                    continue;
+                }
+            }
 
-        command = ntohl(header->base.command);
-        dir = ntohl(header->base.direction);
-        ep = ntohl(header->base.ep);
-        may_has_data = (command == USBIP_STAGE2_REQ_SUBMIT && dir == USBIP_DIR_OUT);
-        sz = may_has_data ? ntohl(header->u.cmd_submit.data_length) : 0;
-
-        while (sz) {
-                ret = recv(kSock, data, sz, 0);
-                if (ret <= 0)
-                    goto out;
-                sz -= ret;
-                data += ret;
+            ret = recv(kSock, base + tail, length - tail, 0);
+            if (ret <= 0) {
+                if (ret < 0)
+                    printf("recv failed: errno %d\r\n", errno);
+                goto out;
+            }
+            tail += ret;
+            recv_num++;
         }
 
-        if (likely(command == USBIP_STAGE2_REQ_SUBMIT)) {
-            if (likely(ep == 1 && dir == USBIP_DIR_IN)) {
-                fast_reply(base, sizeof(usbip_stage2_header), dap_req_num);
-                if (dap_req_num > 0)
-                    dap_req_num--;
-            } else if (likely(ep == 1 && dir == USBIP_DIR_OUT)) {
-                dap_req_num++;
-                handle_dap_data_request(header, length);
-            } else if (ep == 0) {
-                unpack(base, sizeof(usbip_stage2_header));
-                handleUSBControlRequest(header);
-            } else {
-                // ep3 reserved for SWO
-                printf("ep reserved:%lu\r\n", ep);
-                send_stage2_submit(header, 0, 0);
+        while ((sz = usbip_urb_record_size(base + head, tail - head)) != 0) {
+            if (unlikely(sz > length)) {
+                printf("urb too long:%lu\r\n", sz);
+                ret = -1;
+                goto out;
             }
-        } else if (command == USBIP_STAGE2_REQ_UNLINK) {
-            if (unlink_count == 0 || unlink_count % 100 == 0)
-                printf("unlink\r\n");
-            unlink_count++;
-            unpack(base, sizeof(usbip_stage2_header));
-            handle_unlink(header);
-        } else {
-            printf("emulate unknown command:%lu\r\n", command);
-            return -1;
+            if (sz > tail - head)
+                break; // payload not complete yet
+
+            header = (const usbip_stage2_header *)(base + head);
+            if (header->base.command == PP_HTONL(USBIP_STAGE2_REQ_SUBMIT) &&
+                header->base.direction == PP_HTONL(USBIP_DIR_OUT) &&
+                header->base.ep == PP_HTONL(1) && !dap_request_slot_try()) {
+                stalled = true;
+                break;
+            }
+
+            ret = usbip_urb_dispatch((usbip_stage2_header *)(base + head), &unlink_count);
+            if (ret)
+                goto out;
+            head += sz;
+            urb_num++;
+        }
+
+        if (head == tail) {
+            head = tail = 0;
+        } else if (length - head < (sz ? sz : sizeof(usbip_stage2_header))) {
+            // carry the partial record over, the rest of it does not fit behind
+            tail -= head;
+            memmove(base, base + head, tail);
+            head = 0;
         }
     }
 
 out:
-    if (ret < 0)
-        printf("recv failed: errno %d\r\n", errno);
+    if (recv_num)
+        printf("usbip rx: %lu records in %lu recv\r\n", urb_num, recv_num);
+    if (usbip_tx.stats.segments)
+        printf("usbip tx: %lu records in %lu segments, %lu bytes/segment, max %lu\r\n",
+               usbip_tx.stats.submits, usbip_tx.stats.segments,
+               usbip_tx.stats.bytes / usbip_tx.stats.segments, usbip_tx.stats.max_segment);
+    dap_queue_get_stats(&queue_stats);
+    if (queue_stats.requests)
+        printf("dap queue: %lu requests, high water %lu/%u, %lu stalls, %lu us stalled, max %lu us\r\n",
+               queue_stats.requests, queue_stats.high_water, DAP_PACKET_QUEUE_DEPTH,
+               queue_stats.stalls, queue_stats.stall_us, queue_stats.stall_max_us);
+    usbip_tx_release();
     return ret;
 }
 
-int usbip_worker(uint8_t *base, uint32_t length, enum usbip_server_state_t *state)
+static int usbip_session_work(uint8_t *base, uint32_t length, enum usbip_server_state_t *state)
 {
     uint8_t *data;
     int pre_read_sz = 4;
@@ -295,6 +573,27 @@ int usbip_worker(uint8_t *base, uint32_t length, enum usbip_server_state_t *stat
     return 0;
 }
 
+int usbip_worker(int fd, uint8_t *base, uint32_t length, enum usbip_server_state_t *state)
+{
+    int idle = -1;
+    int ret;
+
+    if (!__atomic_compare_exchange_n(&kSock, &idle, fd, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        printf("usbip: another client is attached\r\n");
+        return -1;
+    }
+
+    ret = usbip_session_work(base, length, state);
+
+    // drop what is left in the DAP pipeline before the next client attaches
+    kRestartDAPHandle = RESET_HANDLE;
+    if (kDAPTaskHandle)
+        xTaskNotifyGive(kDAPTaskHandle);
+
+    __atomic_store_n(&kSock, -1, __ATOMIC_RELEASE);
+    return ret;
+}
+
 /**
  * @brief Pack the following packets(Offset 0x00 - 0x28):
  *       - cmd_submit
@@ -354,7 +653,7 @@ void send_stage2_submit(usbip_stage2_header *req_header, int32_t status, int32_t
     req_header->u.ret_submit.data_length = data_length;
     // already unpacked
     pack(req_header, sizeof(usbip_stage2_header));
-    usbip_network_send(kSock, req_header, sizeof(usbip_stage2_header), 0);
+    usbip_tx_submit(req_header, sizeof(usbip_stage2_header), NULL, NULL);
 }
 
 void send_stage2_submit_data(usbip_stage2_header *req_header, int32_t status, const void *const data, int32_t data_length)
@@ -364,35 +663,58 @@ void send_stage2_submit_data(usbip_stage2_header *req_header, int32_t status, co
 
     if (data_length)
     {
-        usbip_network_send(kSock, data, data_length, 0);
+        usbip_tx_submit(data, data_length, NULL, NULL);
     }
 }
 
-void send_stage2_submit_data_fast(usbip_stage2_header *req_header, const void *const data, int32_t data_length)
+static void prepare_stage2_submit_fast(usbip_stage2_header *req_header, int32_t data_length)
 {
-    uint8_t * send_buf = (uint8_t *)req_header;
-
     req_header->base.command = PP_HTONL(USBIP_STAGE2_RSP_SUBMIT);
     req_header->base.direction = htonl(!(req_header->base.direction));
 
     memset(&(req_header->u.ret_submit), 0, sizeof(usbip_stage2_header_ret_submit));
     req_header->u.ret_submit.data_length = htonl(data_length);
+}
+
+void send_stage2_submit_data_fast(usbip_stage2_header *req_header, const void *const data, int32_t data_length)
+{
+    uint8_t * send_buf = (uint8_t *)req_header;
+
+    prepare_stage2_submit_fast(req_header, data_length);
 
     // payload
     if (data)
         memcpy(&send_buf[sizeof(usbip_stage2_header)], data, data_length);
-    usbip_network_send(kSock, send_buf, sizeof(usbip_stage2_header) + data_length, 0);
+    usbip_tx_submit(send_buf, sizeof(usbip_stage2_header) + data_length, NULL, NULL);
+}
+
+void send_stage2_submit_status_fast(usbip_stage2_header *req_header, int32_t status)
+{
+    prepare_stage2_submit_fast(req_header, 0);
+    req_header->u.ret_submit.status = htonl(status);
+    usbip_tx_submit(req_header, sizeof(usbip_stage2_header), NULL, NULL);
+}
+
+void send_stage2_submit_data_zero_copy(usbip_stage2_header *req_header, int32_t data_length,
+                                       usbip_tx_done_cb done, void *arg)
+{
+    prepare_stage2_submit_fast(req_header, data_length);
+    usbip_tx_submit(req_header, sizeof(usbip_stage2_header) + data_length, done, arg);
 }
 
 
 static void handle_unlink(usbip_stage2_header *header)
 {
-	printf("s2 handling cmd unlink...\r\n");
-    handle_dap_unlink();
-    send_stage2_unlink(header);
+    int32_t status = 0; // URB already completed
+
+    // The ep of CMD_UNLINK is not the one of the URB it cancels, Linux vhci sends 0.
+    // Only DAP IN URBs are ever left pending, look the seqnum up there.
+    if (handle_dap_unlink(header->u.cmd_unlink.seqnum))
+        status = -1;
+    send_stage2_unlink(header, status);
 }
 
-static void send_stage2_unlink(usbip_stage2_header *req_header)
+static void send_stage2_unlink(usbip_stage2_header *req_header, int32_t status)
 {
 
     req_header->base.command = USBIP_STAGE2_RSP_UNLINK;
@@ -402,11 +724,10 @@ static void send_stage2_unlink(usbip_stage2_header *req_header)
 
     // To be more precise, the value is `-ECONNRESET`, but usbip-win only cares if it is a
     // non zero value. A non-zero value indicates that our UNLINK operation was "successful",
-    // but the host driver's may behave differently, or may even ignore this state. For consistent
-    // behavior, we use non-zero value here. See also comments regarding `handle_dap_unlink()`.
-    req_header->u.ret_unlink.status = -1;
+    // 0 that the URB had already been given back. See also comments regarding `handle_dap_unlink()`.
+    req_header->u.ret_unlink.status = status;
 
     pack(req_header, sizeof(usbip_stage2_header));
 
-    usbip_network_send(kSock, req_header, sizeof(usbip_stage2_header), 0);
+    usbip_tx_submit(req_header, sizeof(usbip_stage2_header), NULL, NULL);
 }
@@ -12,12 +12,32 @@ enum usbip_server_state_t
     WAIT_URB,
 };
 
+typedef void (*usbip_tx_done_cb)(void *arg);
+
+typedef struct
+{
+    uint32_t submits;        // records queued for transmission
+    uint32_t segments;       // send calls issued to the socket
+    uint32_t bytes;          // bytes sent, bytes / segments = average segment size
+    uint32_t max_segment;    // largest single send
+    uint32_t flush_size;     // flushes caused by the size threshold
+    uint32_t flush_idle;     // flushes caused by an empty receive side
+    uint32_t flush_deadline; // flushes caused by USBIP_TX_DEADLINE_US
+} usbip_tx_stats_t;
+
 extern int kSock;
 
-int usbip_worker(uint8_t *base, uint32_t length, enum usbip_server_state_t *state);
+int usbip_worker(int fd, uint8_t *base, uint32_t length, enum usbip_server_state_t *state);
 void send_stage2_submit_data(usbip_stage2_header *req_header, int32_t status, const void * const data, int32_t data_length);
 void send_stage2_submit(usbip_stage2_header *req_header, int32_t status, int32_t data_length);
 void send_stage2_submit_data_fast(usbip_stage2_header *req_header, const void *const data, int32_t data_length);
+void send_stage2_submit_status_fast(usbip_stage2_header *req_header, int32_t status);
+void send_stage2_submit_data_zero_copy(usbip_stage2_header *req_header, int32_t data_length,
+                                       usbip_tx_done_cb done, void *arg);
 int usbip_network_send(int s, const void *dataptr, size_t size, int flags);
 
+void usbip_tx_submit(const void *data, size_t size, usbip_tx_done_cb done, void *arg);
+void usbip_tx_flush(void);
+void usbip_tx_get_stats(usbip_tx_stats_t *stats);
+
 #endif
\ No newline at end of file
@@ -20,11 +20,17 @@
  * SOFTWARE.
  */
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/param.h>
 
 // share header file
 #include "corsacOTA.h"
+#include "co_mask.h"
+#include "co_ws_parser.h"
+#include "dap_session.h"
+#include "dap_pipeline.h"
+#include "cmsis-dap/include/DAP.h"
 
 #include "esp_log.h"
 
@@ -46,7 +52,7 @@
 
 static const char *CO_TAG = "corsacOTA";
 
-#define CONFIG_CO_SOCKET_BUFFER_SIZE  1500
+#define CONFIG_CO_SOCKET_BUFFER_SIZE  DAP_SESSION_BUFFER_SIZE
 #define CONFIG_CO_WS_TEXT_BUFFER_SIZE 100
 
 #define LOG_FMT(x)                    "%s: " x, __func__
@@ -62,33 +68,46 @@ static const char *CO_TAG = "corsacOTA";
 #warning corsacOTA test mode is in use
 #endif
 
-extern void free_dap_ringbuf();
-extern uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response);
+// response frame header, at most 4 bytes for DAP_WS_PACKET_SIZE
+#define CO_DAP_HEADER_SIZE            4
 
-static void co_websocket_process_dap(uint8_t *data, size_t len);
+/*
+ * Multi-command frames
+ *
+ * A binary frame that starts with CO_DAP_MULTI carries several DAP requests, each one
+ * prefixed with its length (16 bit, little-endian):
+ *   CO_DAP_MULTI, len0, request0, len1, request1, ...
+ * The requests are executed in place out of the receive buffer, and answered with frames
+ * of the same layout. The responses are built behind the reserved frame header of
+ * `dap_multi_buffer`. When it is full a frame is sent and the next one started, so the
+ * client reads responses until it has one for every request.
+ * A request frame must fit CONFIG_CO_SOCKET_BUFFER_SIZE and can not be fragmented.
+ * The marker is ID_DAP_Invalid: no DAP command uses it, while 0xA0-0xFE is the extended
+ * vendor command range of CMSIS-DAP and 0x80-0x9F the vendor one. The engine would answer
+ * a lone 0xFF with 0xFF anyway, which is also what an empty multi-command frame gets.
+ */
+#define CO_DAP_MULTI                  ID_DAP_Invalid
+#define CO_DAP_MULTI_BUFFER_SIZE      (CO_DAP_HEADER_SIZE + 1 + 4 * (2 + DAP_WS_PACKET_SIZE))
 
-uint8_t* ws_process_buffer = NULL;
+#if (CO_DAP_MULTI_BUFFER_SIZE > DAP_SESSION_WORK_SIZE) || (CO_DAP_HEADER_SIZE > DAP_SESSION_HEADER_SIZE)
+#error "multi-command buffer or DAP frame header does not fit the session"
+#endif
 
 /**
  * @brief corsacOTA websocket control block
  *
  */
 typedef struct co_websocket_cb {
-    uint8_t FIN;
-    uint8_t OPCODE;
+    co_ws_parser_t parser;
 
-    uint8_t MASK;
-    size_t payload_len; // it is used not only for the 7-bit payload len,
-                        // but also for the total length of the payload after the extended payload length is included.
+    enum co_websocket_sink {
+        CO_WS_SINK_DROP = 0, // skip the payload: too long, or nothing to do with it
+        CO_WS_SINK_WHOLE,    // handled once the whole frame is in the buffer
+        CO_WS_SINK_DAP,      // unmasked into a pipeline slot as it arrives
+    } sink; // where the payload of the current data message goes
 
-    size_t payload_read_len; // the number of payload bytes already read
-
-    union {
-        uint32_t val;
-        uint8_t data[4];
-    } mask;
-
-    bool skip_frame; // skip too long text frames
+    uint8_t *dap_request; // pipeline slot of the DAP request being received
+    size_t dap_len;       // bytes of it received so far
 } co_websocket_cb_t;
 
 /**
@@ -99,17 +118,13 @@ typedef struct co_socket_cb {
     int fd; // The file descriptor for this socket
     enum co_socket_status {
         CO_SOCKET_ACCEPT = 0,
-        CO_SOCKET_HANDSHAKE,               // not handshake, or in progress
-        CO_SOCKET_WEBSOCKET_HEADER,        // already handshake, now reading the header of websocket frame
-        CO_SOCKET_WEBSOCKET_EXTEND_LENGTH, // reading the extended length of websocket header
-        CO_SOCKET_WEBSOCKET_MASK,          // reading the mask part of websocket header
-        CO_SOCKET_WEBSOCKET_PAYLOAD,       // reading the payload of websocket frame
-        CO_SOCKET_CLOSING                  // waiting to close
+        CO_SOCKET_HANDSHAKE, // not handshake, or in progress
+        CO_SOCKET_WEBSOCKET, // already handshake, now reading websocket frames
+        CO_SOCKET_CLOSING    // waiting to close
     } status;
 
     char *buf;            // data from raw socket
-    size_t remaining_len; // the number of available bytes remaining in buf
-    size_t read_len;      // the number of bytes that have been processed
+    size_t remaining_len; // the number of bytes in buf, from buf[0]
 
     co_websocket_cb_t wcb; // websocket control block
 
@@ -144,8 +159,6 @@ typedef struct co_ota_cb {
 typedef struct co_cb {
     int listen_fd;        // server listener FD
     int websocket_fd;     // only one websocket is allowed.
-    uint8_t *recv_data;   // recv buffer at websocket stage (text mode)
-    int recv_data_offset; // (text mode)
     int max_listen_num;   // maxium number of connections. In fact, after the handshake is complete, there is only one connection to provide services
 
     int wait_timeout_sec;  // timeout (in seconds)
@@ -160,9 +173,13 @@ typedef struct co_cb {
 
     co_ota_cb_t ota; // ota control block
 
+    dap_session_t *session;
+    dap_pipeline_t *dap_pipeline; // DAP requests of this connection, from the session
+    uint8_t *dap_multi_buffer;    // responses to multi-command frames, the session work buffer
+
 } co_cb_t;
 
-static co_cb_t *global_cb = NULL;
+static void co_websocket_process_dap_multi(co_cb_t *cb, uint8_t *data, size_t len);
 
 /*  RFC 6455: The WebSocket Protocol
 
@@ -186,138 +203,13 @@ static co_cb_t *global_cb = NULL;
     +---------------------------------------------------------------+
 */
 
-#define WS_FIN                 0x80
-#define WS_RSV1                0x40
-#define WS_RSV2                0x20
-#define WS_RSV3                0x10
-#define WS_OPCODE_CONTINUTAION 0x00
-#define WS_OPCODE_TEXT         0x01
-#define WS_OPCODE_BINARY       0x02
-#define WS_OPCODE_CLOSE        0x08
-#define WS_OPCODE_PING         0x09
-#define WS_OPCODE_PONG         0x0A
-
-#define WS_MASK                0x80
-
 static inline int co_websocket_get_res_payload_offset(int payload_len) {
     //  promise: payload_len <= 65535
     return 2 + (payload_len >= 126 ? 2 : 0);
 }
 
-static co_err_t co_websocket_process_header(co_cb_t *cb, co_socket_cb_t *scb) {
-    uint8_t opcode, fin, mask;
-    uint64_t payload_len;
-    uint8_t *data;
-
-    data = (uint8_t *)scb->buf;
-
-    if (scb->status == CO_SOCKET_WEBSOCKET_HEADER) {
-        if (scb->remaining_len < 2) {
-            return CO_OK;
-        }
-
-        // check RSV
-        if (data[0] & 0b1110000) {
-            return CO_FAIL; // no extension defining RSV
-        }
-
-        // first byte
-        fin = (data[0] & WS_FIN) == WS_FIN;
-        opcode = data[0] & 0b1111;
-        // second byte
-        mask = (data[1] & WS_MASK) == WS_MASK;
-        payload_len = data[1] & 0x7F;
-
-        switch (opcode) {
-        case WS_OPCODE_CONTINUTAION:
-            // nothing to do
-            break;
-        case WS_OPCODE_TEXT:
-        case WS_OPCODE_BINARY:
-            scb->wcb.OPCODE = opcode;
-            break;
-        case WS_OPCODE_PING:
-        case WS_OPCODE_PONG:
-            scb->wcb.OPCODE = opcode;
-            break;
-        case WS_OPCODE_CLOSE:
-            scb->wcb.OPCODE = opcode;
-            break;
-        default:
-            return CO_FAIL;
-            break;
-        }
-
-        scb->wcb.FIN = fin;
-        scb->wcb.MASK = mask;
-        scb->wcb.payload_len = payload_len;
-
-        // extended payload length should be read
-        if (payload_len == 126 || payload_len == 127) {
-            scb->status = CO_SOCKET_WEBSOCKET_EXTEND_LENGTH;
-        } else if (mask == 1) {
-            scb->status = CO_SOCKET_WEBSOCKET_MASK;
-        }
-
-        scb->read_len = 2; // first 2 byte header
-    }
-
-    if (scb->status == CO_SOCKET_WEBSOCKET_EXTEND_LENGTH) {
-        if (scb->wcb.payload_len == 126) {
-            if (scb->remaining_len < scb->read_len + 2) { // 2 byte extended length
-                return CO_OK;
-            }
-
-            payload_len = data[2] << 8 | data[3]; // 0 + scb->read_len == 2
-
-            scb->read_len += 2;
-        } else if (scb->wcb.payload_len == 127) { // 8 byte extended length
-            if (scb->remaining_len < scb->read_len + 8) {
-                return CO_OK;
-            }
-
-            payload_len = ((uint64_t)(data[9]) << 0);
-            payload_len |= ((uint64_t)(data[8]) << 8);
-            payload_len |= ((uint64_t)(data[7]) << 16);
-            payload_len |= ((uint64_t)(data[6]) << 24);
-            payload_len |= ((uint64_t)(data[5]) << 32);
-            payload_len |= ((uint64_t)(data[4]) << 40);
-            payload_len |= ((uint64_t)(data[3]) << 48);
-            payload_len |= ((uint64_t)(data[2]) << 56);
-
-            // most significant bit MUST be 0
-            if (((payload_len >> 63) & 0b1) == 0x1) {
-                ESP_LOGE(CO_TAG, "wrong payload length");
-                return CO_FAIL;
-            }
-
-            scb->read_len += 8;
-        } else {
-            payload_len = scb->wcb.payload_len;
-        }
-
-        scb->wcb.payload_len = payload_len;
-
-        scb->status = scb->wcb.MASK == 1 ? CO_SOCKET_WEBSOCKET_MASK : CO_SOCKET_WEBSOCKET_PAYLOAD;
-    }
-
-    if (scb->status == CO_SOCKET_WEBSOCKET_MASK) {
-        if (scb->remaining_len < scb->read_len + 4) { // 4 byte mask
-            return CO_OK;
-        }
-
-        memcpy(&scb->wcb.mask.data[0], &data[scb->read_len], 4);
-        scb->read_len += 4;
-        scb->status = CO_SOCKET_WEBSOCKET_PAYLOAD;
-    } else {
-        scb->status = CO_SOCKET_WEBSOCKET_PAYLOAD;
-    }
-
-    return CO_OK;
-}
-
 // We promise that the length of the payload should not exceed 65535
-static co_err_t co_websocket_send_frame(void *frame_buffer, size_t payload_len, int frame_type) {
+static co_err_t co_websocket_send_frame(int fd, void *frame_buffer, size_t payload_len, int frame_type) {
     int sz;
     uint16_t payload_length;
     uint8_t *p;
@@ -339,13 +231,13 @@ static co_err_t co_websocket_send_frame(void *frame_buffer, size_t payload_len,
 
     // no mask
 
-    send(global_cb->websocket->fd, frame_buffer, sz, 0);
+    send(fd, frame_buffer, sz, 0);
 
     return CO_OK;
 }
 
 // Create a new frame buffer, construct text and send frame.
-static co_err_t co_websocket_send_msg_with_code(int code, const char *msg) {
+static co_err_t co_websocket_send_msg_with_code(int fd, int code, const char *msg) {
     char *buffer;
     int len, ret;
     int offset;
@@ -370,7 +262,7 @@ static co_err_t co_websocket_send_msg_with_code(int code, const char *msg) {
         goto cleanup;
     }
 
-    ret = co_websocket_send_frame(buffer, ret, WS_OPCODE_TEXT);
+    ret = co_websocket_send_frame(fd, buffer, ret, WS_OPCODE_TEXT);
 
 cleanup:
     free(buffer);
@@ -379,7 +271,7 @@ cleanup:
 
 #if (CO_TEST_MODE == 1)
 // use for test
-static co_err_t co_websocket_send_echo(void *data, size_t len, int frame_type) {
+static co_err_t co_websocket_send_echo(int fd, void *data, size_t len, int frame_type) {
     char *buffer;
     int ret;
     int offset;
@@ -392,7 +284,7 @@ static co_err_t co_websocket_send_echo(void *data, size_t len, int frame_type) {
     }
     memcpy(buffer + offset, data, len);
 
-    ret = co_websocket_send_frame(buffer, len, frame_type);
+    ret = co_websocket_send_frame(fd, buffer, len, frame_type);
 
 cleanup:
     free(buffer);
@@ -400,24 +292,18 @@ cleanup:
 }
 #endif // (CO_TEST_MODE == 1)
 
-static void co_websocket_process_binary(uint8_t *data, size_t len) {
-    co_websocket_process_dap(data, len);
-}
-
 static void co_websocket_process_text(uint8_t *data, size_t len) {
 }
 
-// send pong response
-// TODO: too long ping frame
-static void co_websocket_process_ping(co_cb_t *cb, co_socket_cb_t *scb) {
-    int len;
-
-    // control frame max payload length: 125 -> 0 byte extended length
-    len = 2 + scb->wcb.payload_len + (scb->wcb.MASK ? 4 : 0);
+// send pong response with the unmasked ping payload
+static void co_websocket_process_ping(co_cb_t *cb, co_socket_cb_t *scb, const uint8_t *data, size_t len) {
+    uint8_t buf[2 + 125]; // control frame max payload length: 125 -> 0 byte extended length
 
-    scb->buf[0] = WS_FIN | WS_OPCODE_PONG;
+    buf[0] = WS_FIN | WS_OPCODE_PONG;
+    buf[1] = len;
+    memcpy(buf + 2, data, len);
 
-    send(scb->fd, scb->buf, len, 0);
+    send(scb->fd, buf, 2 + len, 0);
 }
 
 // close handshake
@@ -435,209 +321,136 @@ static void co_websocket_process_close(co_cb_t *cb, co_socket_cb_t *scb) {
     send(scb->fd, buf, 4, 0);
 }
 
-static inline CO_INLINE uint32_t co_rotr32(uint32_t n, unsigned int c) {
-    const unsigned int mask = (CHAR_BIT * sizeof(n) - 1);
-    c &= mask;
-    return (n >> c) | (n << ((-c) & mask));
-}
-
 /**
- * @brief Quick calculation WebSocket. The process of calculating the mask is one of the performance bottlenecks
- * of the entire websocket. The performance between the optimized version and the version without mask is not significant.
- *
- * We assume: the natural machine word length is 4byte (32bits) and the endianness is little-endian
- * For xtensa: single fetch: 4 byte(32bit)
+ * @brief Choose where the payload of a new frame goes
  *
- * @param data data buffer ptr
- * @param mask websocket mask. Little-endian 32bis mask.
- * @param len data length
+ * @param cb corsacOTA control block
+ * @param scb corsacOTA socket control block
+ * @param ev frame event, with the payload bytes already received
+ * @return co_err_t
  */
-static void co_websocket_fast_mask(uint8_t *data, uint32_t mask, size_t len) {
-    uint32_t new_mask;
-    int align_len;
-    size_t i;
-
-    const uint8_t *p_mask = (uint8_t *)&mask;
-
-    unsigned long int dst = (long int)data;
+static co_err_t co_websocket_process_frame(co_cb_t *cb, co_socket_cb_t *scb, co_ws_event_t *ev) {
+    co_websocket_cb_t *wcb = &scb->wcb;
+    co_ws_frame_t *frame = &wcb->parser.frame;
 
-    if (len >= 8) {
-        // copy just a few bytes to make dst aligned.
-        align_len = (-dst) % 4;
-        len -= align_len;
+    // control frames are handled whole, they may come between the fragments of a message
+    if (frame->opcode & 0x08) {
+        return CO_OK;
+    }
 
-        for (i = 0; i < align_len; i++) {
-            data[i] ^= p_mask[i];
-        }
+#if (CO_TEST_MODE == 1)
+    return CO_OK; // echoed as it arrives
+#endif
 
-        // use the new mask on the aligned address
-        switch (align_len) {
-        case 1:
-            new_mask = co_rotr32(mask, 8U);
-            break;
-        case 2:
-            new_mask = co_rotr32(mask, 16U);
-            break;
-        case 3:
-            new_mask = co_rotr32(mask, 24U);
-            break;
-        default: // 0
-            new_mask = mask;
-            break;
+    if (!frame->first) {
+        if (wcb->sink == CO_WS_SINK_DAP && wcb->dap_len + frame->length > DAP_WS_PACKET_SIZE) {
+            ESP_LOGE(CO_TAG, "DAP request too long");
+            dap_pipeline_cancel(cb->dap_pipeline);
+            wcb->sink = CO_WS_SINK_DROP;
         }
+        return CO_OK;
+    }
 
-        p_mask = (uint8_t *)&new_mask;
-
-        dst += align_len;
+    wcb->sink = CO_WS_SINK_DROP;
 
-        for (i = 0; i < len / 4; i++) {
-            *((uint32_t *)dst) ^= new_mask;
-            dst += 4;
+    if (frame->message == WS_OPCODE_TEXT) {
+        if (frame->fin && frame->length <= CONFIG_CO_WS_TEXT_BUFFER_SIZE) {
+            wcb->sink = CO_WS_SINK_WHOLE;
+            frame->whole = 1;
+        } else {
+            co_websocket_send_msg_with_code(scb->fd, CO_RES_INVALID_SIZE, "request too long");
         }
+        return CO_OK;
+    }
 
-        len %= 4;
+    if (frame->length == 0 && frame->fin) {
+        return CO_OK;
     }
 
-    // There are just a few bytes to process
-    for (i = 0; i < len; i++) {
-        *((uint8_t *)dst) ^= p_mask[i % 4];
-        dst += 1;
+    // multi-command frames are executed in place, out of the receive buffer
+    if (ev->len > 0 && (ev->data[0] ^ (uint8_t)ev->mask) == CO_DAP_MULTI) {
+        if (frame->fin && frame->length <= CONFIG_CO_SOCKET_BUFFER_SIZE) {
+            wcb->sink = CO_WS_SINK_WHOLE;
+            frame->whole = 1;
+        } else {
+            ESP_LOGE(CO_TAG, "multi-command frame too long");
+        }
+        return CO_OK;
     }
-}
 
-static inline uint32_t co_websocket_get_new_mask(uint32_t mask, size_t len) {
-    switch (len & 0b11) {
-    case 1:
-        return co_rotr32(mask, 8U);
-    case 2:
-        return co_rotr32(mask, 16U);
-    case 3:
-        return co_rotr32(mask, 24U);
-    default:
-        return mask;
+    if (frame->length > DAP_WS_PACKET_SIZE) {
+        ESP_LOGE(CO_TAG, "DAP request too long");
+        return CO_OK;
     }
+
+    wcb->sink = CO_WS_SINK_DAP;
+    wcb->dap_request = dap_pipeline_reserve(cb->dap_pipeline);
+    wcb->dap_len = 0;
+
+    return CO_OK;
 }
 
 /**
- * @brief Process websocket payload
+ * @brief Process a piece of websocket payload, still masked
  *
  * @param cb corsacOTA control block
  * @param scb corsacOTA socket control block
+ * @param ev payload event
  * @return co_err_t
- * - CO_OK: Successful processing of all payloads
- * - CO_ERROR_IO_PENDING: There are still new frames to be processed
+ * - CO_OK: Successful processing
+ * - CO_FAIL: The connection is closed
  */
-static co_err_t co_websocket_process_payload(co_cb_t *cb, co_socket_cb_t *scb) {
-    int len, new_len;
-    uint8_t *data;
-    uint32_t mask;
+static co_err_t co_websocket_process_payload(co_cb_t *cb, co_socket_cb_t *scb, co_ws_event_t *ev) {
+    co_websocket_cb_t *wcb = &scb->wcb;
+    co_ws_frame_t *frame = &wcb->parser.frame;
 
-    data = (uint8_t *)scb->buf + scb->read_len;
-    // May be possible to read the complete frame and maybe a new frame rate afterwards
-    len = min(scb->remaining_len - scb->read_len, scb->wcb.payload_len);
-
-    // For ping frames, we will directly change their opcode and send.
-    if (scb->wcb.MASK == 1 && scb->wcb.OPCODE != WS_OPCODE_PING) {
-        mask = scb->wcb.mask.val;
-        co_websocket_fast_mask(data, mask, len);
-
-        scb->wcb.mask.val = co_websocket_get_new_mask(mask, len);
+    switch (frame->message) {
+    case WS_OPCODE_PING:
+        co_mask_copy(ev->data, ev->data, ev->len, ev->mask);
+        co_websocket_process_ping(cb, scb, ev->data, ev->len);
+        return CO_OK;
+    case WS_OPCODE_PONG:
+        return CO_OK;
+    case WS_OPCODE_CLOSE:
+        co_websocket_process_close(cb, scb);
+        return CO_FAIL; // close by server
+    default:
+        break;
     }
 
-    // In the previous processing, we can ensure that each new frame can begin in a place where the Buffer offset is 0.
-    switch (scb->wcb.OPCODE) {
-    case WS_OPCODE_TEXT:
 #if (CO_TEST_MODE == 1)
-        co_websocket_send_echo(data, len, WS_OPCODE_TEXT);
-        break;
+    co_mask_copy(ev->data, ev->data, ev->len, ev->mask);
+    co_websocket_send_echo(scb->fd, ev->data, ev->len, frame->message);
+    return CO_OK;
 #endif
-        // case 0: This frame should be skip
-        if (scb->wcb.skip_frame) {
-            if (len == scb->wcb.payload_len) { // The last part of the data in this frame has been received
-                scb->wcb.skip_frame = false;
-            }
-            break;
-        }
 
-        // case 1: Receive the entire payload
-        if (len == scb->wcb.payload_len && cb->recv_data_offset == 0) {
-            co_websocket_process_text(data, len);
-            break;
+    switch (wcb->sink) {
+    case CO_WS_SINK_WHOLE:
+        co_mask_copy(ev->data, ev->data, ev->len, ev->mask);
+        if (frame->message == WS_OPCODE_TEXT) {
+            co_websocket_process_text(ev->data, ev->len);
+        } else {
+            co_websocket_process_dap_multi(cb, ev->data, ev->len);
         }
-
-        // case 2: Part of the payload has been received before
-        if (len > CONFIG_CO_WS_TEXT_BUFFER_SIZE - cb->recv_data_offset) { // overflow
-            if (len < scb->wcb.payload_len) {                             // This frame has not yet been received
-                scb->wcb.skip_frame = true;
+        break;
+    case CO_WS_SINK_DAP:
+        // the request is unmasked while it is copied into the pipeline slot
+        co_mask_copy(wcb->dap_request + wcb->dap_len, ev->data, ev->len, ev->mask);
+        wcb->dap_len += ev->len;
+        if (ev->last && frame->fin) {
+            if (wcb->dap_len > 0) {
+                dap_pipeline_commit(cb->dap_pipeline);
+            } else {
+                dap_pipeline_cancel(cb->dap_pipeline);
             }
-
-            co_websocket_send_msg_with_code(CO_RES_INVALID_SIZE, "request too long");
-            cb->recv_data_offset = 0;
-            break;
-        }
-
-        memcpy(cb->recv_data + cb->recv_data_offset, data, len);
-        cb->recv_data_offset += len;
-
-        if (len == scb->wcb.payload_len) {
-            co_websocket_process_text(cb->recv_data, len);
-            cb->recv_data_offset = 0;
+            wcb->sink = CO_WS_SINK_DROP;
         }
         break;
-    case WS_OPCODE_BINARY:
-#if (CO_TEST_MODE == 1)
-        co_websocket_send_echo(data, len, WS_OPCODE_BINARY);
-        break;
-#endif
-        //// TODO: check return val
-        co_websocket_process_binary(data, len);
-        break;
-    case WS_OPCODE_PING:
-        co_websocket_process_ping(cb, scb);
-        break;
-    case WS_OPCODE_PONG:
-        break;
-    case WS_OPCODE_CLOSE:
-        co_websocket_process_close(cb, scb);
-        return CO_FAIL; // close by server
     default:
-        ESP_LOGE(CO_TAG, "unknow opcode: %d", scb->wcb.OPCODE);
         break;
     }
 
-    new_len = scb->remaining_len - scb->read_len - len;
-    // case 0: New frames still exist
-    if (new_len > 0) {
-        // For simplicity, we make sure that the websocket header is always at the beginning of the buf.
-        memcpy(scb->buf, data + len, new_len);
-
-        scb->read_len = 0;
-        scb->remaining_len = new_len;
-
-        scb->status = CO_SOCKET_WEBSOCKET_HEADER;
-        scb->wcb.payload_len = 0;
-        scb->wcb.payload_read_len = 0;
-        return CO_ERROR_IO_PENDING;
-    }
-    // case 1: The payload part is not yet fully read.
-    else if (scb->wcb.payload_len > len) {
-        scb->wcb.payload_len -= len;
-
-        scb->read_len = 0;
-        scb->remaining_len = 0;
-
-        return CO_OK;
-    }
-    // case 2: Exactly one complete frame is read and there is no remaining available data in buf.
-    else {
-        scb->read_len = 0;
-        scb->remaining_len = 0;
-
-        scb->status = CO_SOCKET_WEBSOCKET_HEADER;
-        scb->wcb.payload_len = 0;
-        scb->wcb.payload_read_len = 0;
-        return CO_OK;
-    }
+    return CO_OK;
 }
 
 static esp_err_t co_websocket_process(co_cb_t *cb, co_socket_cb_t *scb) {
@@ -645,36 +458,46 @@ static esp_err_t co_websocket_process(co_cb_t *cb, co_socket_cb_t *scb) {
         return ESP_FAIL;
     }
 
-    int fd, ret, offset;
+    co_ws_event_t ev;
+    uint8_t *data;
+    size_t pos, n;
+    int ret;
 
-    fd = scb->fd;
-    offset = scb->remaining_len;
+    data = (uint8_t *)scb->buf;
 
-    ret = recv(fd, scb->buf + offset, CONFIG_CO_SOCKET_BUFFER_SIZE - offset, 0);
+    ret = dap_session_recv(cb->session, data + scb->remaining_len, CONFIG_CO_SOCKET_BUFFER_SIZE - scb->remaining_len);
     if (ret <= 0) {
         return ESP_FAIL;
     }
     scb->remaining_len += ret;
 
-    do {
-        // After we process a partial or complete payload,
-        // we always receive a new payload or header starting from the head of the buf.
-        if (scb->status != CO_SOCKET_WEBSOCKET_PAYLOAD) {
-            ret = co_websocket_process_header(cb, scb);
-            if (ret != CO_OK) {
-                return CO_FAIL;
-            }
+    // every frame in the buffer, wherever it starts
+    for (pos = 0;; pos += n) {
+        n = co_ws_parse(&scb->wcb.parser, data + pos, scb->remaining_len - pos, &ev);
+        if (ev.type == CO_WS_NEED_MORE) {
+            break;
+        }
+        if (ev.type == CO_WS_ERROR) {
+            ESP_LOGE(CO_TAG, "websocket protocol error");
+            return ESP_FAIL;
         }
 
-        // Perhaps we have already read the header section, and if there are extra bytes left over,
-        // we continue reading the payload section.
-        if (scb->status == CO_SOCKET_WEBSOCKET_PAYLOAD) {
-            ret = co_websocket_process_payload(cb, scb);
-            if (ret == CO_FAIL) {
-                return CO_FAIL;
-            }
+        if (ev.type == CO_WS_FRAME) {
+            ret = co_websocket_process_frame(cb, scb, &ev);
+        } else {
+            ret = co_websocket_process_payload(cb, scb, &ev);
+        }
+        if (ret != CO_OK) {
+            return ESP_FAIL;
         }
-    } while (ret == CO_ERROR_IO_PENDING);
+    }
+
+    // Left over is an incomplete header or a frame handled whole, the next read goes behind it.
+    // Streamed payloads are never left over, so during bulk DAP traffic this moves a few bytes at most.
+    scb->remaining_len -= pos;
+    if (pos > 0 && scb->remaining_len > 0) {
+        memmove(data, data + pos, scb->remaining_len);
+    }
 
     return ESP_OK;
 }
@@ -807,9 +630,8 @@ static esp_err_t co_websocket_handshake_process(co_cb_t *cb, co_socket_cb_t *scb
     }
 
     int offset = scb->remaining_len;
-    int fd = scb->fd;
 
-    int ret = recv(fd, scb->buf + offset, CONFIG_CO_SOCKET_BUFFER_SIZE - offset, 0);
+    int ret = dap_session_recv(cb->session, scb->buf + offset, CONFIG_CO_SOCKET_BUFFER_SIZE - offset);
     if (ret <= 0) {
         co_http_error_400_response(cb, scb);
         return ESP_FAIL;
@@ -866,46 +688,86 @@ static esp_err_t co_websocket_handshake_process(co_cb_t *cb, co_socket_cb_t *scb
     ESP_LOGD(CO_TAG, "websocket handshake success");
 
     cb->websocket = scb;
-    scb->status = CO_SOCKET_WEBSOCKET_HEADER;
+    scb->status = CO_SOCKET_WEBSOCKET;
     scb->remaining_len = 0;
-
-    memset(scb->buf, 0, CONFIG_CO_SOCKET_BUFFER_SIZE);
+    co_ws_parser_init(&scb->wcb.parser);
 
     return ESP_OK;
 }
 
-static void websocket_buffer_malloc() {
-    if (ws_process_buffer != NULL)
-        return;
+// binary frame header of a DAP response, written in front of the payload built by the pipeline
+static uint32_t co_websocket_dap_header(uint8_t *payload, uint32_t len) {
+    uint32_t offset;
+    uint8_t *p;
 
-    free_dap_ringbuf();
-    ws_process_buffer = malloc(1200);
-}
+    offset = co_websocket_get_res_payload_offset(len);
+    p = payload - offset;
 
-static void websocket_buffer_free() {
-    if (ws_process_buffer != NULL) {
-        free(ws_process_buffer);
-        ws_process_buffer = NULL;
+    *p++ = WS_FIN | WS_OPCODE_BINARY;
+    *p++ = (len >= 126 ? 126 : len);
+    if (len >= 126) {
+        *p++ = len >> 8;
+        *p++ = len & 0xFF;
     }
+
+    return offset;
 }
 
-static void co_websocket_process_dap(uint8_t *data, size_t len) {
-    uint8_t *buf;
-    int max_offset, res, offset;
+static const dap_transport_t co_dap_transport = {
+    .name = "websocket",
+    .packet_size = DAP_WS_PACKET_SIZE,
+    .header_size = CO_DAP_HEADER_SIZE,
+    .gather = 1,
+    .send = dap_socket_send,
+    .recv = dap_socket_recv,
+    .header = co_websocket_dap_header,
+};
+
+static void co_websocket_send_dap_multi(co_cb_t *cb, uint32_t len) {
+    uint8_t *payload = cb->dap_multi_buffer + CO_DAP_HEADER_SIZE;
+    uint32_t offset;
+
+    offset = co_websocket_dap_header(payload, len);
+    dap_session_send(cb->session, payload - offset, offset + len);
+}
 
-    max_offset = co_websocket_get_res_payload_offset(1500);
-    buf = ws_process_buffer + max_offset;
+static void co_websocket_process_dap_multi(co_cb_t *cb, uint8_t *data, size_t len) {
+    uint8_t *payload = cb->dap_multi_buffer + CO_DAP_HEADER_SIZE;
+    uint32_t pos, out, req_len, res_len;
+
+    // answer the requests in flight first, responses keep the request order
+    dap_pipeline_drain(cb->dap_pipeline);
+
+    payload[0] = CO_DAP_MULTI;
+    out = 1;
+    for (pos = 1; pos + 2 <= len; pos += req_len) {
+        req_len = data[pos] | (data[pos + 1] << 8);
+        pos += 2;
+        if (req_len == 0 || req_len > DAP_WS_PACKET_SIZE || req_len > len - pos) {
+            ESP_LOGE(CO_TAG, "bad multi-command frame");
+            break; // answer what has been executed
+        }
 
-    res = DAP_ExecuteCommand(data, buf);
-    res &= 0xFFFF;
+        if (CO_DAP_MULTI_BUFFER_SIZE - CO_DAP_HEADER_SIZE - out < 2 + DAP_WS_PACKET_SIZE) {
+            co_websocket_send_dap_multi(cb, out);
+            out = 1;
+        }
+
+        // the frame is a batch already
+        if (data[pos] == ID_DAP_QueueCommands) {
+            data[pos] = ID_DAP_ExecuteCommands;
+        }
 
-    offset = co_websocket_get_res_payload_offset(res);
-    buf -= offset;
+        res_len = dap_engine_execute(data + pos, payload + out + 2, DAP_WS_PACKET_SIZE, DAP_PIPELINE_DEPTH) & 0xFFFF;
+        payload[out] = res_len & 0xFF;
+        payload[out + 1] = res_len >> 8;
+        out += 2 + res_len;
+    }
 
-    co_websocket_send_frame(buf, res, WS_OPCODE_BINARY);
+    co_websocket_send_dap_multi(cb, out);
 }
 
-int websocket_worker(int fd, uint8_t *base, uint32_t length) {
+int websocket_worker(dap_session_t *session) {
     co_cb_t cb;
     co_socket_cb_t scb;
     esp_err_t ret;
@@ -913,16 +775,16 @@ int websocket_worker(int fd, uint8_t *base, uint32_t length) {
     memset(&cb, 0, sizeof(co_cb_t));
     memset(&scb, 0, sizeof(co_socket_cb_t));
 
-    cb.recv_data = NULL; // used in websocket text mode
+    session->transport = &co_dap_transport;
+
     cb.websocket = &scb;
+    cb.session = session;
 
-    scb.fd = fd;
+    scb.fd = session->fd;
     scb.status = CO_SOCKET_HANDSHAKE;
-    scb.buf = (char *)base;
+    scb.buf = (char *)session->rx_buffer;
     scb.remaining_len = 4; // already read 4 byte
 
-    global_cb = &cb;
-
     // handshake
     do {
         ret = co_websocket_handshake_process(&cb, &scb);
@@ -930,17 +792,16 @@ int websocket_worker(int fd, uint8_t *base, uint32_t length) {
             return ret;
     } while (scb.status == CO_SOCKET_HANDSHAKE);
 
-    websocket_buffer_malloc();
+    cb.dap_multi_buffer = session->work_buffer;
+    cb.dap_pipeline = session->pipeline;
+    if (dap_pipeline_start(cb.dap_pipeline, &co_dap_transport, session) != 0)
+        return ESP_ERR_INVALID_SIZE;
 
     // websocket data process
     do {
         ret = co_websocket_process(&cb, &scb);
-        if (ret != ESP_OK)
-            goto out;
-    } while (1);
-
+    } while (ret == ESP_OK);
 
-out:
-    websocket_buffer_free();
+    dap_pipeline_stop(cb.dap_pipeline);
     return 0;
 }
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
-int websocket_worker(int fd, uint8_t *base, uint32_t length);
+#include "dap_session.h"
+
+int websocket_worker(dap_session_t *session);
 
 #endif
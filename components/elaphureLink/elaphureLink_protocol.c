@@ -1,40 +1,27 @@
 #include "components/elaphureLink/elaphureLink_protocol.h"
 
-#include "DAP_handle.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "dap_session.h"
+#include "dap_pipeline.h"
+#include "proxy_server_conf.h"
+#include "cmsis-dap/include/DAP.h"
 
 #include "lwip/err.h"
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
 #include <lwip/netdb.h>
 
-extern int kRestartDAPHandle;
-extern int kSock;
-extern int usbip_network_send(int s, const void *dataptr, size_t size, int flags);
-
-extern void malloc_dap_ringbuf();
-extern void free_dap_ringbuf();
-
-extern uint32_t DAP_ExecuteCommand(const uint8_t *request, uint8_t *response);
-
-uint8_t* el_process_buffer = NULL;
-
-void el_process_buffer_malloc() {
-    if (el_process_buffer != NULL)
-        return;
-
-    free_dap_ringbuf();
-
-    el_process_buffer = malloc(1500);
-}
-
-void el_process_buffer_free() {
-    if (el_process_buffer != NULL) {
-        free(el_process_buffer);
-        el_process_buffer = NULL;
-    }
-}
+static const dap_transport_t el_transport = {
+    .name = "elaphureLink",
+    .packet_size = DAP_EL_PACKET_SIZE,
+    .gather = 1,
+    .send = dap_socket_send,
+    .recv = dap_socket_recv,
+};
 
-int el_handshake_process(int fd, void *buffer, size_t len) {
+int el_handshake_process(dap_session_t *session, void *buffer, size_t len) {
     if (len != sizeof(el_request_handshake)) {
         return -1;
     }
@@ -54,47 +41,201 @@ int el_handshake_process(int fd, void *buffer, size_t len) {
     res.command = htonl(EL_COMMAND_HANDSHAKE);
     res.el_dap_version = htonl(EL_DAP_VERSION);
 
-    usbip_network_send(fd, &res, sizeof(el_response_handshake), 0);
+    dap_session_send(session, &res, sizeof(el_response_handshake));
 
     return 0;
 }
 
-void el_dap_data_process(void* buffer, size_t len) {
-    int res = DAP_ExecuteCommand(buffer, (uint8_t *)el_process_buffer);
-    res &= 0xFFFF;
+static int el_dap_one_request_length(const uint8_t *buffer, size_t len)
+{
+    size_t need, pos;
+    uint32_t count, n;
+    uint8_t info;
+
+    if (len < 1)
+        return 0;
+
+    switch (buffer[0]) {
+    case ID_DAP_Disconnect:
+    case ID_DAP_TransferAbort:
+    case ID_DAP_ResetTarget:
+    case ID_DAP_SWO_Status:
+    case ID_DAP_UART_Status:
+        need = 1;
+        break;
+    case ID_DAP_Info:
+    case ID_DAP_Connect:
+    case ID_DAP_SWD_Configure:
+    case ID_DAP_JTAG_IDCODE:
+    case ID_DAP_SWO_Transport:
+    case ID_DAP_SWO_Mode:
+    case ID_DAP_SWO_Control:
+    case ID_DAP_SWO_ExtendedStatus:
+    case ID_DAP_UART_Transport:
+    case ID_DAP_UART_Control:
+        need = 2;
+        break;
+    case ID_DAP_HostStatus:
+    case ID_DAP_Delay:
+    case ID_DAP_SWO_Data:
+        need = 3;
+        break;
+    case ID_DAP_SWJ_Clock:
+    case ID_DAP_SWO_Baudrate:
+        need = 5;
+        break;
+    case ID_DAP_TransferConfigure:
+    case ID_DAP_WriteABORT:
+    case ID_DAP_UART_Configure:
+        need = 6;
+        break;
+    case ID_DAP_SWJ_Pins:
+        need = 7;
+        break;
+
+    case ID_DAP_SWJ_Sequence:
+        if (len < 2)
+            return 0;
+        n = buffer[1] ? buffer[1] : 256;
+        need = 2 + (n + 7) / 8;
+        break;
+    case ID_DAP_JTAG_Configure:
+        if (len < 2)
+            return 0;
+        need = 2 + buffer[1];
+        break;
+
+    case ID_DAP_SWD_Sequence:
+    case ID_DAP_JTAG_Sequence:
+        if (len < 2)
+            return 0;
+        count = buffer[1];
+        for (pos = 2; count--; ) {
+            if (pos >= len)
+                return 0;
+            info = buffer[pos++];
+            n = (info & 0x3F) ? (info & 0x3F) : 64;
+            // SWD input sequences carry no data, JTAG sequences always carry TDI
+            if (buffer[0] == ID_DAP_JTAG_Sequence || !(info & 0x80))
+                pos += (n + 7) / 8;
+        }
+        need = pos;
+        break;
+
+    case ID_DAP_Transfer:
+        if (len < 3)
+            return 0;
+        count = buffer[2];
+        for (pos = 3; count--; ) {
+            if (pos >= len)
+                return 0;
+            info = buffer[pos++];
+            // writes carry data, reads only with a match value
+            if (!(info & DAP_TRANSFER_RnW) || (info & DAP_TRANSFER_MATCH_VALUE))
+                pos += 4;
+        }
+        need = pos;
+        break;
+    case ID_DAP_TransferBlock:
+        if (len < 5)
+            return 0;
+        need = 5;
+        if (!(buffer[4] & DAP_TRANSFER_RnW))
+            need += 4 * (buffer[2] | (buffer[3] << 8));
+        break;
+    case ID_DAP_UART_Transfer:
+        if (len < 5)
+            return 0;
+        need = 5 + (buffer[3] | (buffer[4] << 8));
+        break;
+
+    default:
+        return -1; // vendor or unknown command
+    }
+
+    if (need > DAP_EL_PACKET_SIZE)
+        return -1;
+    return need <= len ? (int)need : 0;
+}
+
+int el_dap_request_length(const uint8_t *buffer, size_t len)
+{
+    size_t pos;
+    uint32_t count;
+    int ret;
+
+    if (len >= 1 && (buffer[0] == ID_DAP_ExecuteCommands || buffer[0] == ID_DAP_QueueCommands)) {
+        if (len < 2)
+            return 0;
+        ret = 0;
+        for (pos = 2, count = buffer[1]; count > 0; count--) {
+            ret = el_dap_one_request_length(buffer + pos, len - pos);
+            if (ret <= 0)
+                break;
+            pos += ret;
+        }
+        if (count == 0)
+            ret = pos <= DAP_EL_PACKET_SIZE ? (int)pos : -1;
+    } else {
+        ret = el_dap_one_request_length(buffer, len);
+    }
 
-    usbip_network_send(kSock, el_process_buffer, res, 0);
+    // a request never spans more than one packet
+    if (ret == 0 && len >= DAP_EL_PACKET_SIZE)
+        return -1;
+    return ret;
 }
 
-int el_dap_work(uint8_t* base, size_t len)
+int el_dap_work(dap_session_t *session)
 {
+    dap_pipeline_t *pl = session->pipeline;
+    uint8_t *base = session->rx_buffer;
     uint8_t *data;
+    size_t rx_len, pos;
     int sz, ret;
 
+    session->transport = &el_transport;
+
     // read command code and protocol version
     data = base + 4;
     sz = 8;
     do {
-        ret = recv(kSock, data, sz, 0);
+        ret = dap_session_recv(session, data, sz);
         if (ret <= 0)
             return ret;
         sz -= ret;
         data += ret;
     } while (sz > 0);
 
-    ret = el_handshake_process(kSock, base, 12);
+    ret = el_handshake_process(session, base, 12);
     if (ret)
         return ret;
 
-    kRestartDAPHandle = DELETE_HANDLE;
-    el_process_buffer_malloc();
-    // data process
-    while(1) {
-        ret = recv(kSock, base, len, 0);
+    if (dap_pipeline_start(pl, &el_transport, session) != 0)
+        return -1;
+
+    // frame requests out of the stream, a partial request stays at the front of the buffer
+    rx_len = 0;
+    while (1) {
+        ret = dap_session_recv(session, base + rx_len, sizeof(session->rx_buffer) - rx_len);
         if (ret <= 0)
-            return ret;
-        el_dap_data_process(base, ret);
+            break;
+        rx_len += ret;
+
+        for (pos = 0; pos < rx_len; pos += sz) {
+            sz = el_dap_request_length(base + pos, rx_len - pos);
+            if (sz == 0)
+                break;
+            if (sz < 0) // can not be framed, take what has arrived as one request like before
+                sz = rx_len - pos < DAP_EL_PACKET_SIZE ? rx_len - pos : DAP_EL_PACKET_SIZE;
+
+            dap_pipeline_submit(pl, base + pos, sz);
+        }
+
+        rx_len -= pos;
+        memmove(base, base + pos, rx_len);
     }
 
-    return 0;
+    dap_pipeline_stop(pl);
+    return ret;
 }
@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "dap_session.h"
+
 #define EL_LINK_IDENTIFIER 0x8a656c70
 
 #define EL_DAP_VERSION 0x00000001
@@ -30,26 +32,31 @@ typedef struct
 /**
  * @brief elahpureLink Proxy handshake phase process
  *
- * @param fd socket fd
+ * @param session connection
  * @param buffer packet buffer
  * @param len packet length
  * @return 0 on Success, other on failed.
  */
-int el_handshake_process(int fd, void* buffer, size_t len);
+int el_handshake_process(dap_session_t *session, void* buffer, size_t len);
 
 
 /**
- * @brief Process dap data and send to socket
+ * @brief Length of the DAP request at the head of the stream.
+ * elaphureLink has no framing, the length is derived from the command itself.
  *
- * @param buffer dap data buffer
- * @param len dap data length
+ * @param buffer received data
+ * @param len received data length
+ * @return request length, 0 if more data is needed,
+ *         -1 for unknown commands and requests larger than DAP_EL_PACKET_SIZE
  */
-void el_dap_data_process(void* buffer, size_t len);
-
+int el_dap_request_length(const uint8_t *buffer, size_t len);
 
-int el_dap_work(uint8_t* base, size_t len);
 
-void el_process_buffer_malloc();
-void el_process_buffer_free();
+/**
+ * @brief Serve an elaphureLink connection
+ *
+ * @param session connection, its receive buffer holds the first 4 bytes of the handshake
+ */
+int el_dap_work(dap_session_t *session);
 
 #endif
\ No newline at end of file
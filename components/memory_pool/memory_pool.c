@@ -5,55 +5,209 @@
  */
 
 #include "memory_pool.h"
+#include "memory_pool_stack.h"
+
+#include <assert.h>
+#include <stddef.h>
+
 #include <freertos/FreeRTOS.h>
-#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <sdkconfig.h>
 
+#define TAG "memory_pool"
+
+/* 7 x 2 KiB as before the size classes, the 256 byte class is 2 KiB on top of them */
+#define SMALL_NR  8
 #define BUFFER_NR 7
-#define BUFFER_SZ 2048
+#if CONFIG_SPIRAM
+#define BIG_NR    4
+#else
+#define BIG_NR    0
+#endif
 
-static uint8_t buf[BUFFER_NR][BUFFER_SZ];
+static uint8_t small_buf[SMALL_NR][MEMORY_POOL_SMALL_SIZE] __attribute__((aligned(4)));
+static uint8_t buf[BUFFER_NR][MEMORY_POOL_BUF_SIZE] __attribute__((aligned(4)));
+static uint16_t next_idx[SMALL_NR + BUFFER_NR + BIG_NR];
 
-/* TODO: use CAS */
-static QueueHandle_t buf_queue = NULL;
+typedef struct pool_class_t {
+	mp_stack_t stack;
+	uint8_t *base;
+	uint32_t size;
+	uint16_t total;
+	uint32_t in_use;     /* 32-bit, for the CAS of every target */
+	uint32_t high_water;
+	uint32_t failures;
+} pool_class_t;
+
+static pool_class_t pool[] = {
+	{
+		.stack.next = next_idx,
+		.base = &small_buf[0][0],
+		.size = MEMORY_POOL_SMALL_SIZE,
+		.total = SMALL_NR,
+	},
+	{
+		.stack.next = next_idx + SMALL_NR,
+		.base = &buf[0][0],
+		.size = MEMORY_POOL_BUF_SIZE,
+		.total = BUFFER_NR,
+	},
+	{
+		.stack.next = next_idx + SMALL_NR + BUFFER_NR,
+		.base = NULL, /* allocated in PSRAM */
+		.size = MEMORY_POOL_BIG_SIZE,
+		.total = BIG_NR,
+	},
+};
+
+#define CLASS_NR ((int)(sizeof(pool) / sizeof(pool[0])))
 
 int memory_pool_init()
 {
-	if (buf_queue != NULL)
+	static int initialized;
+
+	if (initialized)
 		return 0;
 
-	buf_queue = xQueueCreate(BUFFER_NR, sizeof(void *));
-	if (buf_queue == NULL) {
-		return 1;
-	}
-	for (int i = 0; i < BUFFER_NR; ++i) {
-		uint8_t *buf_ptr = buf[i];
-		if (xQueueSend(buf_queue, &buf_ptr, 0) != pdTRUE) {
-			return 1;
+	for (int i = 0; i < CLASS_NR; ++i) {
+		pool_class_t *c = &pool[i];
+		if (c->base == NULL && c->total > 0) {
+			c->base = heap_caps_malloc(c->size * c->total, MALLOC_CAP_SPIRAM);
+			if (c->base == NULL) {
+				ESP_LOGW(TAG, "no PSRAM for %u byte buffers", (unsigned)c->size);
+				c->total = 0;
+			}
+		}
+		/* buffer 0 on top */
+		for (int j = c->total - 1; j >= 0; --j) {
+			mp_stack_push(&c->stack, j);
 		}
 	}
 
+	initialized = 1;
 	return 0;
 }
 
-void *memory_pool_get(uint32_t tick_wait)
+static void *pool_take(uint32_t size)
+{
+	uint32_t in_use, high_water;
+	int idx;
+
+	for (int i = 0; i < CLASS_NR; ++i) {
+		pool_class_t *c = &pool[i];
+		if (c->size < size)
+			continue;
+
+		idx = mp_stack_pop(&c->stack);
+		if (idx < 0)
+			continue; /* a larger class may still have one */
+
+		in_use = __atomic_add_fetch(&c->in_use, 1, __ATOMIC_RELAXED);
+		high_water = __atomic_load_n(&c->high_water, __ATOMIC_RELAXED);
+		while (in_use > high_water &&
+		       !__atomic_compare_exchange_n(&c->high_water, &high_water, in_use, 1,
+		                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		}
+		return c->base + idx * c->size;
+	}
+
+	return NULL;
+}
+
+static void pool_count_failure(uint32_t size)
+{
+	for (int i = 0; i < CLASS_NR; ++i) {
+		if (pool[i].size >= size) {
+			__atomic_add_fetch(&pool[i].failures, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+}
+
+void *memory_pool_try_get(uint32_t size)
+{
+	void *ptr = pool_take(size);
+	if (unlikely(ptr == NULL))
+		pool_count_failure(size);
+	return ptr;
+}
+
+void *memory_pool_get_size(uint32_t size, uint32_t tick_wait)
 {
-	void *ptr = NULL;
-	xQueueReceive(buf_queue, &ptr, tick_wait);
-	assert(ptr);
+	TickType_t start = xTaskGetTickCount();
+	void *ptr;
+
+	/* nothing to block on without a lock, poll every tick */
+	while ((ptr = pool_take(size)) == NULL) {
+		if (tick_wait != portMAX_DELAY && xTaskGetTickCount() - start >= tick_wait) {
+			pool_count_failure(size);
+			return NULL;
+		}
+		vTaskDelay(1);
+	}
 	return ptr;
 }
 
+void *memory_pool_get(uint32_t tick_wait)
+{
+	return memory_pool_get_size(MEMORY_POOL_BUF_SIZE, tick_wait);
+}
+
+static pool_class_t *pool_find(const void *ptr, int *idx)
+{
+	const uint8_t *p = ptr;
+
+	for (int i = 0; i < CLASS_NR; ++i) {
+		pool_class_t *c = &pool[i];
+		if (c->total > 0 && p >= c->base && p < c->base + c->size * c->total) {
+			*idx = (p - c->base) / c->size;
+			return c;
+		}
+	}
+	return NULL;
+}
+
 void memory_pool_put(void *ptr)
 {
-#ifdef WT_DEBUG_MODE
-	printf("put buf %d\n", uxQueueMessagesWaiting(buf_queue));
-#endif
-	if (unlikely(xQueueSend(buf_queue, &ptr, 0) != pdTRUE)) {
+	pool_class_t *c;
+	int idx;
+
+	c = pool_find(ptr, &idx);
+	if (unlikely(c == NULL || (uint8_t *)ptr != c->base + idx * c->size)) {
 		assert(0);
+		return;
 	}
+#ifdef WT_DEBUG_MODE
+	printf("put buf %u: %u in use\n", (unsigned)c->size, (unsigned)c->in_use);
+#endif
+	__atomic_sub_fetch(&c->in_use, 1, __ATOMIC_RELAXED);
+	mp_stack_push(&c->stack, idx);
 }
 
 inline uint32_t memory_pool_get_buf_size()
 {
-	return BUFFER_SZ;
+	return MEMORY_POOL_BUF_SIZE;
+}
+
+uint32_t memory_pool_buf_size(const void *ptr)
+{
+	pool_class_t *c;
+	int idx;
+
+	c = pool_find(ptr, &idx);
+	return c ? c->size : 0;
+}
+
+int memory_pool_get_stats(memory_pool_stats_t *stats, int max)
+{
+	for (int i = 0; i < CLASS_NR && i < max; ++i) {
+		stats[i].size = pool[i].size;
+		stats[i].total = pool[i].total;
+		stats[i].in_use = __atomic_load_n(&pool[i].in_use, __ATOMIC_RELAXED);
+		stats[i].high_water = __atomic_load_n(&pool[i].high_water, __ATOMIC_RELAXED);
+		stats[i].failures = __atomic_load_n(&pool[i].failures, __ATOMIC_RELAXED);
+	}
+	return CLASS_NR;
 }
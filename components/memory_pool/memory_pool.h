@@ -9,13 +9,39 @@
 
 #include <stdint.h>
 
+/* buffer sizes of the classes, a get is served by the smallest class that fits
+ * and has a free buffer */
+#define MEMORY_POOL_SMALL_SIZE 256
+#define MEMORY_POOL_BUF_SIZE   2048
+#define MEMORY_POOL_BIG_SIZE   8192 /* PSRAM only, see api_json_req_t.big_buffer */
+
+typedef struct memory_pool_stats_t {
+	uint32_t size;       /* buffer size of the class */
+	uint16_t total;      /* buffers in the class */
+	uint16_t in_use;
+	uint16_t high_water; /* most buffers in use at once */
+	uint32_t failures;   /* gets that found no free buffer */
+} memory_pool_stats_t;
+
 int memory_pool_init();
 
+/* MEMORY_POOL_BUF_SIZE buffer, waits up to tick_wait, NULL on timeout */
 void *memory_pool_get(uint32_t tick_wait);
 
+/* buffer of at least `size` bytes, waits up to tick_wait, NULL on timeout */
+void *memory_pool_get_size(uint32_t size, uint32_t tick_wait);
+
+/* lock-free, never waits, NULL if no buffer of at least `size` bytes is free */
+void *memory_pool_try_get(uint32_t size);
+
 void memory_pool_put(void *ptr);
 
 uint32_t memory_pool_get_buf_size();
 
+/* size of a buffer returned by one of the get functions */
+uint32_t memory_pool_buf_size(const void *ptr);
+
+/* @return number of classes, up to `max` of them are written to `stats` */
+int memory_pool_get_stats(memory_pool_stats_t *stats, int max);
 
-#endif //STATIC_BUFFER_H_GUARD
\ No newline at end of file
+#endif //STATIC_BUFFER_H_GUARD
@@ -0,0 +1,55 @@
+/*
+ * SPDX-FileCopyrightText: 2024 kerms
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef MEMORY_POOL_STACK_H_GUARD
+#define MEMORY_POOL_STACK_H_GUARD
+
+#include <stdint.h>
+
+/*
+ * Lock-free (Treiber) stack of buffer indexes.
+ * The head packs a tag, bumped by every push and pop, with the index of the top
+ * node, so a 32-bit CAS is enough and a node that is popped and pushed back
+ * between a load and the CAS (ABA) does not go unnoticed.
+ * The links live in `next`, outside the buffers, so a stale read of a link is
+ * harmless. No FreeRTOS dependency: tools/memory_pool_stress.c runs it on a host.
+ */
+typedef struct mp_stack_t {
+	uint32_t head;  /* tag << 16 | (top index + 1), index 0: empty */
+	uint16_t *next; /* next[i]: index + 1 of the node under i */
+} mp_stack_t;
+
+#define MP_STACK_TOP(head)      ((head) & 0xFFFF)
+#define MP_STACK_HEAD(head, top) ((((head) & 0xFFFF0000) + 0x10000) | (top))
+
+static inline void mp_stack_push(mp_stack_t *s, uint16_t idx)
+{
+	uint32_t old, new;
+
+	old = __atomic_load_n(&s->head, __ATOMIC_RELAXED);
+	do {
+		__atomic_store_n(&s->next[idx], MP_STACK_TOP(old), __ATOMIC_RELAXED);
+		new = MP_STACK_HEAD(old, idx + 1);
+	} while (!__atomic_compare_exchange_n(&s->head, &old, new, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* @return index of the popped node, -1 if the stack is empty */
+static inline int mp_stack_pop(mp_stack_t *s)
+{
+	uint32_t old, new;
+
+	old = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+	do {
+		if (MP_STACK_TOP(old) == 0) {
+			return -1;
+		}
+		new = MP_STACK_HEAD(old, __atomic_load_n(&s->next[MP_STACK_TOP(old) - 1], __ATOMIC_RELAXED));
+	} while (!__atomic_compare_exchange_n(&s->head, &old, new, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+	return MP_STACK_TOP(old) - 1;
+}
+
+#endif //MEMORY_POOL_STACK_H_GUARD
@@ -1,6 +1,8 @@
 #ifndef __DAP_CONFIGURATION_H__
 #define __DAP_CONFIGURATION_H__
 
+#include "sdkconfig.h"
+
 /**
  * @brief Specify the use of WINUSB
  *
@@ -21,6 +23,40 @@
 #define USE_USB_3_0 0
 
 
+/**
+ * @brief Serve SWD transfers from the software target model in swd_sim.c
+ *        instead of the SWD pins. Used to measure the DAP command path without a target.
+ *        The host build in tools/host sets it to 1.
+ *        2 (host only) keeps the SPI backend of SW_DP.c and serves the model through
+ *        the host model of the SPI peripheral, tools/host/spi_sim.c.
+ *
+ */
+#ifndef USE_SWD_SIM
+#define USE_SWD_SIM 0
+#endif
+
+
+/**
+ * @brief Record every SWD/JTAG transfer into a ring buffer, see dap_trace.c.
+ *        The ring can be downloaded from the web server at /dap_trace.
+ *
+ */
+#ifndef USE_DAP_TRACE
+#define USE_DAP_TRACE 0
+#endif
+#define DAP_TRACE_RECORD_NUM 1024U // 12 bytes each, must be a power of 2
+
+
+/**
+ * @brief Count DAP commands and keep latency histograms, see dap_stats.c.
+ *        Costs a cycle counter read and a few increments per command.
+ *
+ */
+#ifndef USE_DAP_STATS
+#define USE_DAP_STATS 0
+#endif
+
+
 // For USB 3.0, it must be 1024 byte.
 #if (USE_USB_3_0 == 1)
     #define USB_ENDPOINT_SIZE 1024U
@@ -39,5 +75,17 @@
     #define DAP_PACKET_SIZE 255U // 255 for USB HID
 #endif
 
+/**
+ * @brief Number of DAP requests the probe can hold, reported to the host as DAP_PACKET_COUNT.
+ *        Every request takes a slot of about 2 * DAP_PACKET_SIZE until its response is sent.
+ *        With PSRAM the slots are allocated there, so the pipeline can be deeper.
+ *
+ */
+#ifdef CONFIG_SPIRAM
+    #define DAP_PACKET_QUEUE_DEPTH 64U
+#else
+    #define DAP_PACKET_QUEUE_DEPTH 20U
+#endif
+
 
 #endif
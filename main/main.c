@@ -4,8 +4,10 @@
 #include <esp_netif.h>
 
 #include "tcp_server.h"
+#include "kcp_server.h"
 #include "cmsis-dap/include/DAP.h"
 #include "DAP_handle.h"
+#include "dap_session.h"
 #include "wt_mdns_config.h"
 #include "wt_storage.h"
 #include "wifi_manager.h"
@@ -30,10 +32,12 @@ void app_main()
     DAP_Setup();
 
 	global_module_init();
+	assert(dap_session_init() == 0);
 
 	start_webserver();
 
     xTaskCreate(tcp_server_task, "tcp_server", 4096, NULL, 14, NULL);
+    xTaskCreate(kcp_server_task, "kcp_server", 3072, NULL, 13, NULL);
 
     // DAP handle task
     xTaskCreate(DAP_Thread, "DAP_Task", 2048, NULL, 10, NULL);
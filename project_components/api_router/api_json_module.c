@@ -10,6 +10,7 @@
 
 typedef struct api_json_module_t {
 	api_json_on_req on_req;
+	api_bin_on_req on_bin;
 } api_json_module_t;
 
 static api_json_module_t module_arr[API_MODULE_MAX] = {0};
@@ -18,7 +19,7 @@ static uint8_t module_count = 0;
 void api_json_module_dump()
 {
 	for (int i = 0; i < API_MODULE_MAX; ++i) {
-		printf("%d = %p\n", i, module_arr[i].on_req);
+		printf("%d = %p, bin %p\n", i, module_arr[i].on_req, module_arr[i].on_bin);
 	}
 }
 
@@ -29,6 +30,7 @@ int api_json_module_add(api_json_init_func func)
 
 	api_module.module_id = -1;
 	api_module.on_req = NULL;
+	api_module.on_bin = NULL;
 
 	err = func(&api_module);
 	if (err) {
@@ -47,6 +49,7 @@ int api_json_module_add(api_json_init_func func)
 	}
 
 	module_arr[api_module.module_id].on_req = api_module.on_req;
+	module_arr[api_module.module_id].on_bin = api_module.on_bin;
 	module_count++;
 	printf("%p is added\n", func);
 	return 0;
@@ -60,3 +63,14 @@ int api_json_module_call(uint8_t id, uint16_t cmd, api_json_req_t *in, api_json_
 
 	return module_arr[id].on_req(cmd, in, out);
 }
+
+int api_bin_module_call(wt_bin_data_t *data, uint16_t *len, uint16_t max_len)
+{
+	uint8_t id = data->hdr.module_id;
+
+	if (unlikely(id >= API_MODULE_MAX || module_arr[id].on_bin == NULL)) {
+		return API_JSON_BAD_REQUEST;
+	}
+
+	return module_arr[id].on_bin(data, len, max_len);
+}
@@ -2,6 +2,7 @@
 #define API_JSON_MODULE_H_GUARD
 
 #include "request_runner.h"
+#include "wt_data_def.h"
 #include <cJSON.h>
 #include <stdint.h>
 
@@ -40,8 +41,19 @@ typedef enum api_json_req_status_e {
 
 typedef int (*api_json_on_req)(uint16_t cmd, api_json_req_t *req, api_json_module_async_t *rsp);
 
+/**
+ * Binary request (WT_DATA_CMD or WT_DATA_RAW), handled in place in the receive buffer
+ * without leaving the calling task. The reply payload is written over the request one.
+ * @param data    hdr.sub_id selects the command, the payload follows the header
+ * @param len     in: request payload length, out: reply payload length
+ * @param max_len room for the reply payload
+ * @return api_json_req_status_e, API_JSON_ASYNC is not supported
+ */
+typedef int (*api_bin_on_req)(wt_bin_data_t *data, uint16_t *len, uint16_t max_len);
+
 typedef struct api_json_module_cfg_t {
 	api_json_on_req on_req; /* input request callback */
+	api_bin_on_req on_bin;  /* binary request callback, optional */
 	uint8_t module_id;
 } api_json_module_cfg_t;
 
@@ -57,4 +69,7 @@ int api_json_module_add(api_json_init_func);
 
 int api_json_module_call(uint8_t id, uint16_t cmd, api_json_req_t *in, api_json_module_async_t *out);
 
+/* dispatch by data->hdr.module_id, see api_bin_on_req */
+int api_bin_module_call(wt_bin_data_t *data, uint16_t *len, uint16_t max_len);
+
 #endif //API_JSON_MODULE_H_GUARD
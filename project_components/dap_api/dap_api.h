@@ -0,0 +1,38 @@
+/*
+ * SPDX-FileCopyrightText: 2026 kerms <kerms@niazo.org>
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef DAP_API_H_GUARD
+#define DAP_API_H_GUARD
+
+#include <stdint.h>
+
+#define DAP_MODULE_ID 4
+
+/* also the sub_id of the binary requests, their replies carry the C structs:
+ * TRACE_STATUS: dap_trace_status_t
+ * STATS_GET:    dap_stats_hist_t event[DAP_STATS_EVENT_NUM], then {uint32_t id, dap_stats_hist_t}
+ *               for each command seen, as many as fit in the reply */
+typedef enum dap_api_json_cmd_t {
+	DAP_API_JSON_TRACE_STATUS = 1, /* ret:{enabled, head, base, capacity} */
+	DAP_API_JSON_TRACE_START  = 2, /* recording can be downloaded from GET /dap_trace */
+	DAP_API_JSON_TRACE_STOP   = 3,
+	DAP_API_JSON_TRACE_CLEAR  = 4,
+	DAP_API_JSON_STATS_GET    = 5, /* ret:{commands:[{id, count, total, max, hist[]}], events:{...}} */
+	DAP_API_JSON_STATS_RESET  = 6,
+} dap_api_json_cmd_t;
+
+/* WT_DATA_EVENT sub_id */
+typedef enum dap_api_event_t {
+	DAP_API_EVENT_CLIENT = 1, /* dap_api_event_client_t */
+} dap_api_event_t;
+
+typedef struct dap_api_event_client_t {
+	uint8_t connected; /* 1: a client connected (tcp session or kcp peer), 0: it left */
+	uint8_t clients;   /* clients connected now */
+	char transport[14];
+} dap_api_event_client_t;
+
+#endif //DAP_API_H_GUARD
@@ -0,0 +1,245 @@
+/*
+ * SPDX-FileCopyrightText: 2026 kerms <kerms@niazo.org>
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "dap_api.h"
+#include "api_json_module.h"
+#include "wt_event.h"
+#include "dap_session.h"
+
+#include "main/dap_configuration.h"
+#include "cmsis-dap/include/dap_trace.h"
+#include "cmsis-dap/include/dap_stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if (USE_DAP_TRACE == 1) || (USE_DAP_STATS == 1)
+static void dap_json_add_header(cJSON *root, dap_api_json_cmd_t cmd)
+{
+	cJSON_AddNumberToObject(root, "cmd", cmd);
+	cJSON_AddNumberToObject(root, "module", DAP_MODULE_ID);
+}
+#endif
+
+#if (USE_DAP_TRACE == 1)
+static int dap_api_json_trace_status(api_json_req_t *req)
+{
+	dap_trace_status_t status;
+	cJSON *root;
+
+	DAP_Trace_GetStatus(&status);
+
+	root = cJSON_CreateObject();
+	dap_json_add_header(root, DAP_API_JSON_TRACE_STATUS);
+	cJSON_AddBoolToObject(root, "enabled", status.enabled);
+	cJSON_AddNumberToObject(root, "head", status.head);
+	cJSON_AddNumberToObject(root, "base", status.base);
+	cJSON_AddNumberToObject(root, "capacity", status.capacity);
+	req->out = root;
+	return API_JSON_OK;
+}
+#endif
+
+#if (USE_DAP_STATS == 1)
+static cJSON *dap_json_ser_hist(const dap_stats_hist_t *h)
+{
+	cJSON *obj = cJSON_CreateObject();
+	int last;
+
+	cJSON_AddNumberToObject(obj, "count", h->count);
+	cJSON_AddNumberToObject(obj, "total", h->total);
+	cJSON_AddNumberToObject(obj, "max", h->max);
+
+	/* hist[n]: 2^n <= value < 2^(n+1), trailing empty buckets are omitted */
+	for (last = DAP_STATS_BUCKETS - 1; last >= 0 && h->hist[last] == 0; last--);
+	cJSON_AddItemToObject(obj, "hist", cJSON_CreateIntArray((const int *)h->hist, last + 1));
+	return obj;
+}
+
+static int dap_api_json_stats_get(api_json_req_t *req)
+{
+	static const char *event_name[DAP_STATS_EVENT_NUM] = {
+		[DAP_STATS_WAIT_SLOT] = "wait_slot",
+		[DAP_STATS_WAIT_RESPONSE] = "wait_response",
+		[DAP_STATS_NET_SEND] = "net_send",
+	};
+	dap_stats_t *stats;
+	cJSON *root, *cmds, *events, *item;
+
+	stats = malloc(sizeof(dap_stats_t));
+	if (stats == NULL) {
+		return API_JSON_INTERNAL_ERR;
+	}
+	DAP_Stats_Snapshot(stats);
+
+	root = cJSON_CreateObject();
+	dap_json_add_header(root, DAP_API_JSON_STATS_GET);
+
+	/* command latency in CPU cycles, only commands seen so far */
+	cmds = cJSON_AddArrayToObject(root, "commands");
+	for (int i = 0; i < DAP_STATS_CMD_NUM; i++) {
+		if (stats->cmd[i].count == 0) {
+			continue;
+		}
+		item = dap_json_ser_hist(&stats->cmd[i]);
+		cJSON_AddNumberToObject(item, "id", i);
+		cJSON_AddItemToArray(cmds, item);
+	}
+
+	/* network side in us */
+	events = cJSON_AddObjectToObject(root, "events");
+	for (int i = 0; i < DAP_STATS_EVENT_NUM; i++) {
+		cJSON_AddItemToObject(events, event_name[i], dap_json_ser_hist(&stats->event[i]));
+	}
+
+	free(stats);
+	req->out = root;
+	return API_JSON_OK;
+}
+#endif
+
+static int on_json_req(uint16_t cmd, api_json_req_t *req, api_json_module_async_t *async)
+{
+	dap_api_json_cmd_t dap_cmd = cmd;
+	switch (dap_cmd) {
+	default:
+		break;
+#if (USE_DAP_TRACE == 1)
+	case DAP_API_JSON_TRACE_STATUS:
+		return dap_api_json_trace_status(req);
+	case DAP_API_JSON_TRACE_START:
+		DAP_Trace_Enable(1);
+		return API_JSON_OK;
+	case DAP_API_JSON_TRACE_STOP:
+		DAP_Trace_Enable(0);
+		return API_JSON_OK;
+	case DAP_API_JSON_TRACE_CLEAR:
+		DAP_Trace_Clear();
+		return API_JSON_OK;
+#endif
+#if (USE_DAP_STATS == 1)
+	case DAP_API_JSON_STATS_GET:
+		return dap_api_json_stats_get(req);
+	case DAP_API_JSON_STATS_RESET:
+		DAP_Stats_Reset();
+		return API_JSON_OK;
+#endif
+	}
+	return API_JSON_UNSUPPORTED_CMD;
+}
+
+
+/* ****
+ *  binary requests, sub_id is a dap_api_json_cmd_t, the values are copied as they are
+ * */
+
+#if (USE_DAP_STATS == 1)
+typedef struct dap_bin_cmd_stats_t {
+	uint32_t id;
+	dap_stats_hist_t hist;
+} dap_bin_cmd_stats_t;
+
+/* dap_stats_hist_t event[DAP_STATS_EVENT_NUM], then a dap_bin_cmd_stats_t per command seen,
+ * as many as fit */
+static int dap_api_bin_stats_get(uint8_t *out, uint16_t *len, uint16_t max_len)
+{
+	dap_stats_t *stats;
+	dap_bin_cmd_stats_t *cmd;
+	uint16_t used = sizeof(stats->event);
+
+	if (max_len < sizeof(stats->event)) {
+		return API_JSON_INTERNAL_ERR;
+	}
+	stats = malloc(sizeof(dap_stats_t));
+	if (stats == NULL) {
+		return API_JSON_INTERNAL_ERR;
+	}
+	DAP_Stats_Snapshot(stats);
+
+	memcpy(out, stats->event, sizeof(stats->event));
+	for (int i = 0; i < DAP_STATS_CMD_NUM && used + sizeof(*cmd) <= max_len; i++) {
+		if (stats->cmd[i].count == 0) {
+			continue;
+		}
+		cmd = (dap_bin_cmd_stats_t *)(out + used);
+		cmd->id = i;
+		memcpy(&cmd->hist, &stats->cmd[i], sizeof(cmd->hist));
+		used += sizeof(*cmd);
+	}
+
+	free(stats);
+	*len = used;
+	return API_JSON_OK;
+}
+#endif
+
+static int on_bin_req(wt_bin_data_t *data, uint16_t *len, uint16_t max_len)
+{
+	dap_api_json_cmd_t dap_cmd = data->hdr.sub_id;
+
+	*len = 0;
+	switch (dap_cmd) {
+	default:
+		break;
+#if (USE_DAP_TRACE == 1)
+	case DAP_API_JSON_TRACE_STATUS:
+		if (max_len < sizeof(dap_trace_status_t)) {
+			return API_JSON_INTERNAL_ERR;
+		}
+		DAP_Trace_GetStatus((dap_trace_status_t *)data->payload);
+		*len = sizeof(dap_trace_status_t);
+		return API_JSON_OK;
+	case DAP_API_JSON_TRACE_START:
+		DAP_Trace_Enable(1);
+		return API_JSON_OK;
+	case DAP_API_JSON_TRACE_STOP:
+		DAP_Trace_Enable(0);
+		return API_JSON_OK;
+	case DAP_API_JSON_TRACE_CLEAR:
+		DAP_Trace_Clear();
+		return API_JSON_OK;
+#endif
+#if (USE_DAP_STATS == 1)
+	case DAP_API_JSON_STATS_GET:
+		return dap_api_bin_stats_get(data->payload, len, max_len);
+	case DAP_API_JSON_STATS_RESET:
+		DAP_Stats_Reset();
+		return API_JSON_OK;
+#endif
+	}
+	return API_JSON_UNSUPPORTED_CMD;
+}
+
+
+/* ****
+ *  events
+ * */
+
+static void dap_api_on_session_event(const char *transport, uint8_t connected, uint8_t clients)
+{
+	dap_api_event_client_t event = {
+		.connected = connected,
+		.clients = clients,
+	};
+
+	strncpy(event.transport, transport, sizeof(event.transport) - 1);
+	wt_event_publish(DAP_MODULE_ID, DAP_API_EVENT_CLIENT, &event, sizeof(event));
+}
+
+
+/* ****
+ *  register module
+ * */
+
+static int dap_json_init(api_json_module_cfg_t *cfg)
+{
+	cfg->on_req = on_json_req;
+	cfg->on_bin = on_bin_req;
+	cfg->module_id = DAP_MODULE_ID;
+	dap_session_set_event_cb(dap_api_on_session_event);
+	return 0;
+}
+
+API_JSON_MODULE_REGISTER(dap_json_init)
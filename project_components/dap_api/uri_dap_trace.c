@@ -0,0 +1,113 @@
+/*
+ * SPDX-FileCopyrightText: 2026 kerms <kerms@niazo.org>
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "main/dap_configuration.h"
+
+#if (USE_DAP_TRACE == 1)
+
+#include "web_uri_module.h"
+#include "memory_pool.h"
+
+#include "DAP_config.h"
+#include "cmsis-dap/include/dap_trace.h"
+
+#include <esp_http_server.h>
+#include <esp_log.h>
+
+#define TAG __FILE_NAME__
+
+/**
+ * GET /dap_trace
+ * Binary dump of the trace ring: dap_trace_file_hdr_t followed by the records.
+ * Recording is paused during the download, tools/dap_trace_to_vcd.py decodes the file.
+ */
+static esp_err_t dap_trace_get_handler(httpd_req_t *req)
+{
+	dap_trace_file_hdr_t hdr;
+	dap_trace_status_t status;
+	dap_trace_record_t *buf;
+	uint32_t buf_num;
+	uint32_t seq, want, end, n;
+	uint8_t enabled;
+	esp_err_t err;
+
+	buf = memory_pool_get(pdMS_TO_TICKS(20));
+	if (unlikely(buf == NULL)) {
+		ESP_LOGE(TAG, "static buf busy");
+		return ESP_FAIL;
+	}
+	buf_num = memory_pool_get_buf_size() / sizeof(dap_trace_record_t);
+
+	DAP_Trace_GetStatus(&status);
+	enabled = status.enabled;
+	DAP_Trace_Enable(0);
+	// recording is off, a record being written right now is the last one to move head
+	DAP_Trace_GetStatus(&status);
+
+	seq = status.base;
+	end = status.head;
+	// only this first read may find records overwritten, the header counts from what it kept
+	n = DAP_Trace_Read(&seq, buf, buf_num < end - seq ? buf_num : end - seq);
+
+	hdr.magic = DAP_TRACE_MAGIC;
+	hdr.version = DAP_TRACE_VERSION;
+	hdr.record_size = sizeof(dap_trace_record_t);
+	hdr.reserved = 0;
+	hdr.timestamp_clock = TIMESTAMP_CLOCK;
+	hdr.first_seq = seq;
+	hdr.count = n != 0 ? end - seq : 0;
+	hdr.lost = seq - status.base;
+
+	httpd_resp_set_type(req, "application/octet-stream");
+	httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"dap_trace.bin\"");
+
+	err = httpd_resp_send_chunk(req, (const char *)&hdr, sizeof(hdr));
+	while (err == ESP_OK && n != 0) {
+		err = httpd_resp_send_chunk(req, (const char *)buf, n * sizeof(dap_trace_record_t));
+		seq += n;
+		if (err != ESP_OK || seq >= end) {
+			break;
+		}
+		want = seq;
+		n = DAP_Trace_Read(&seq, buf, buf_num < end - seq ? buf_num : end - seq);
+		if (unlikely(seq != want || n == 0)) {
+			// the file would not hold what the header announces, fail the download instead
+			ESP_LOGE(TAG, "records overwritten during the download");
+			err = ESP_FAIL;
+		}
+	}
+	if (err == ESP_OK) {
+		err = httpd_resp_send_chunk(req, NULL, 0);
+	}
+
+	DAP_Trace_Enable(enabled);
+	memory_pool_put(buf);
+	return err;
+}
+
+/**
+ * REGISTER MODULE
+ * */
+
+static const httpd_uri_t uri_dap_trace = {
+	.uri       = "/dap_trace",
+	.method    = HTTP_GET,
+	.handler   = dap_trace_get_handler,
+	.user_ctx  = NULL
+};
+
+static int URI_DAP_TRACE_INIT(const httpd_uri_t **uri_conf) {
+	*uri_conf = &uri_dap_trace;
+	return 0;
+}
+
+static int URI_DAP_TRACE_EXIT(const httpd_uri_t **uri_conf) {
+	*uri_conf = &uri_dap_trace;
+	return 0;
+}
+
+WEB_URI_MODULE_REGISTER(0x82, URI_DAP_TRACE_INIT, URI_DAP_TRACE_EXIT)
+
+#endif /* (USE_DAP_TRACE == 1) */
@@ -65,6 +65,7 @@ static esp_err_t api_post_handler(httpd_req_t *req)
 	}
 
 	post_req->json.out = NULL;
+	post_req->json.out_flag = 0;
 	err = api_json_route(&post_req->json, &post_req->async);
 	if (err == API_JSON_ASYNC) {
 		httpd_req_async_handler_begin(req, &post_req->req_out);
@@ -104,6 +105,7 @@ put_buf:
 int uri_api_send_out(httpd_req_t *req, post_request_t *post_req, int err)
 {
 	char *buf;
+	char *big_buf = NULL;
 	uint32_t buf_len;
 
 	buf = post_req->buf;
@@ -111,6 +113,14 @@ int uri_api_send_out(httpd_req_t *req, post_request_t *post_req, int err)
 	cJSON_Delete(post_req->json.in);
 	if (post_req->json.out) {
 		ESP_LOGI(TAG, "json out ok");
+		/* the module expects a reply too long for the request buffer */
+		if (post_req->json.big_buffer) {
+			big_buf = memory_pool_try_get(MEMORY_POOL_BIG_SIZE);
+			if (big_buf) {
+				buf = big_buf;
+				buf_len = memory_pool_buf_size(big_buf);
+			}
+		}
 		httpd_resp_set_type(req, HTTPD_TYPE_JSON);
 		err = !cJSON_PrintPreallocated(post_req->json.out, buf, buf_len - 5, 0);
 		cJSON_Delete(post_req->json.out);
@@ -118,10 +128,15 @@ int uri_api_send_out(httpd_req_t *req, post_request_t *post_req, int err)
 
 	if (unlikely(err)) {
 		httpd_resp_set_status(req, HTTPD_500);
-		return httpd_resp_send(req, NULL, 0);
+		err = httpd_resp_send(req, NULL, 0);
+	} else {
+		err = httpd_resp_send(req, buf, strlen(buf));
 	}
 
-	return httpd_resp_send(req, buf, strlen(buf));
+	if (big_buf) {
+		memory_pool_put(big_buf);
+	}
+	return err;
 }
 
 void async_send_out_cb(void *arg, int module_status)
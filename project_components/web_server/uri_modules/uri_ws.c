@@ -5,8 +5,10 @@
  */
 
 #include "web_uri_module.h"
+#include "ws_send_queue.h"
 #include "api_json_router.h"
 #include "memory_pool.h"
+#include "wt_event.h"
 
 #include <esp_http_server.h>
 #include <esp_log.h>
@@ -16,6 +18,7 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
+#include <freertos/task.h>
 #include <lwipopts.h>
 #include <lwip/netdb.h>
 
@@ -38,12 +41,22 @@
 
 #define WS_MODULE_ID 3
 
+/* binary requests to WS_MODULE_ID, by sub_id */
+enum {
+	/* req: {module_id, sub_id} pairs, up to WT_BUS_FILTER_MAX, WT_BUS_ANY for any.
+	 * replaces the event topics of the client, none to unsubscribe */
+	WS_BIN_SUBSCRIBE = 1,
+};
+
+#define WS_HEARTBEAT_MS 1500
+
 typedef struct ws_msg_t {
 	api_json_req_t json;
 	api_json_module_async_t async;
-	httpd_handle_t hd;
 	int fd;
 	httpd_ws_frame_t ws_pkt;
+	wsq_frame_t out;  /* the reply, holds the buffer until it is sent */
+	uint8_t *big_buf; /* reply printed into a MEMORY_POOL_BIG_SIZE buffer, see json_to_text() */
 	uint8_t delim[0];
 	uint8_t payload[0]; /* size = static_buf_size - offsetof(this, delim) */
 } ws_msg_t;
@@ -51,20 +64,14 @@ typedef struct ws_msg_t {
 #define PAYLOAD_LEN memory_pool_get_buf_size() - sizeof(ws_msg_t)
 
 struct ws_ctx_t {
-	struct ws_client_info_t {
-		httpd_handle_t hd;
-		int fd; /* range 64 - max_socket ~ 64 */
-	} clients[CONFIG_LWIP_MAX_SOCKETS];
-	TaskHandle_t task_heartbeat;
-	/* valid <client_count> fd are stored at beginning of the array
+	/* outbound frames, sent by task_writer only
 	 * use GET_FD_IDX to get the index in clients */
-	uint8_t valid_fd[CONFIG_LWIP_MAX_SOCKETS];
-	int8_t client_count;
-
-	struct {
-		SemaphoreHandle_t mutex;
-		StaticSemaphore_t xMutexBuffer;
-	} lock[CONFIG_LWIP_MAX_SOCKETS];
+	wsq_t send_queue;
+	wsq_client_t clients[CONFIG_LWIP_MAX_SOCKETS];
+	TaskHandle_t task_writer;
+	/* event topics of each client, set by WS_BIN_SUBSCRIBE */
+	uint32_t topics[CONFIG_LWIP_MAX_SOCKETS][WT_BUS_FILTER_MAX];
+	int bus_sub;
 } ws_ctx;
 
 static int ws_on_text_data(httpd_req_t *req, ws_msg_t *ws_msg);
@@ -72,18 +79,19 @@ static int ws_on_binary_data(httpd_req_t *req, ws_msg_t *ws_msg);
 static int ws_on_socket_open(httpd_req_t *req);
 static int ws_on_close(httpd_req_t *req, httpd_ws_frame_t *ws_pkt, void *msg);
 
-/* send with lock per fd */
-static inline int ws_send_frame_safe(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame);
+/* queue the reply of ws_msg to fd, never blocks, the message is released once sent */
+static void ws_msg_send(int fd, ws_msg_t *ws_msg);
 
-static void ws_async_resp(void *arg);
 static void async_send_out_cb(void *arg, int module_status);
 static void json_to_text(ws_msg_t *msg);
+static inline void ws_msg_put(ws_msg_t *msg);
 
-/* Heartbeat related */
+/* Client related */
 static inline int8_t ws_add_fd(httpd_handle_t hd, int fd);
 static inline void ws_rm_fd(int fd);
 
-_Noreturn static void heartbeat_task(void *arg);
+/* sends every frame and the heartbeat */
+_Noreturn static void ws_writer_task(void *arg);
 
 
 
@@ -95,7 +103,7 @@ static esp_err_t ws_req_handler(httpd_req_t *req)
 #ifdef WT_DEBUG_MODE
 	ESP_LOGI(TAG, "ws_handler: httpd_handle_t=%p, sockfd=%d, client_info:%d, client_count: %d", req->handle,
 	         httpd_req_to_sockfd(req), httpd_ws_get_fd_info(req->handle, httpd_req_to_sockfd(req)),
-	         ws_ctx.client_count);
+	         ws_ctx.send_queue.stats.clients);
 #endif
 
 	int err = ESP_OK;
@@ -104,14 +112,15 @@ static esp_err_t ws_req_handler(httpd_req_t *req)
 
 	ws_msg = memory_pool_get(pdMS_TO_TICKS(10));
 	if (unlikely(ws_msg == NULL)) {
-		httpd_ws_frame_t resp_pkt;
-		resp_pkt.type = HTTPD_WS_TYPE_TEXT;
-		resp_pkt.len = strlen(MSG_BUSY_ERROR);
-		resp_pkt.payload = (uint8_t *)MSG_BUSY_ERROR;
-		resp_pkt.final = 1;
-		ws_send_frame_safe(req->handle, httpd_req_to_sockfd(req), &resp_pkt);
-		goto end;
+		static wsq_frame_t busy_frame = {
+			.type = HTTPD_WS_TYPE_TEXT,
+			.payload = (const uint8_t *)MSG_BUSY_ERROR,
+			.len = sizeof(MSG_BUSY_ERROR) - 1,
+		};
+		wsq_push(&ws_ctx.send_queue, GET_FD_IDX(httpd_req_to_sockfd(req)), &busy_frame);
+		return ESP_OK;
 	}
+	ws_msg->big_buf = NULL;
 	ws_pkt = &ws_msg->ws_pkt;
 	ws_pkt->len = 0;
 
@@ -155,12 +164,8 @@ static esp_err_t ws_req_handler(httpd_req_t *req)
 			return ws_on_close(req, ws_pkt, ws_msg);
 		}
 		ws_pkt->type = HTTPD_WS_TYPE_PONG;
-		err = ws_send_frame_safe(req->handle, httpd_req_to_sockfd(req), ws_pkt);
-		if (err) {
-			ESP_LOGE(TAG, "Cannot send PONG frame %s", esp_err_to_name(err));
-			return ws_on_close(req, ws_pkt, ws_msg);
-		}
-		goto end;
+		ws_msg_send(httpd_req_to_sockfd(req), ws_msg);
+		return ESP_OK;
 	case HTTPD_WS_TYPE_PONG:
 		err = ESP_OK;
 		goto end;
@@ -169,7 +174,7 @@ static esp_err_t ws_req_handler(httpd_req_t *req)
 		goto end;
 	}
 end:
-	memory_pool_put(ws_msg);
+	ws_msg_put(ws_msg);
 	return err;
 }
 
@@ -199,7 +204,6 @@ int ws_on_text_data(httpd_req_t *req, ws_msg_t *ws_msg)
 	ws_msg->json.out_flag = 0;
 	ret = api_json_route(&ws_msg->json, &ws_msg->async);
 	if (ret == API_JSON_ASYNC) {
-		ws_msg->hd = req->handle;
 		ws_msg->fd = httpd_req_to_sockfd(req);
 		ws_msg->async.req_task.send_out.cb = async_send_out_cb;
 		ws_msg->async.req_task.send_out.arg = ws_msg;
@@ -223,8 +227,7 @@ int ws_on_text_data(httpd_req_t *req, ws_msg_t *ws_msg)
 end:
 	cJSON_Delete(ws_msg->json.in);
 put_buf:
-	ws_send_frame_safe(req->handle, httpd_req_to_sockfd(req), ws_pkt);
-	memory_pool_put(ws_msg);
+	ws_msg_send(httpd_req_to_sockfd(req), ws_msg);
 	return err;
 }
 
@@ -255,13 +258,151 @@ void ws_set_err_msg(httpd_ws_frame_t *p_frame, api_json_req_status_e ret)
 	}
 }
 
-_Static_assert(sizeof(httpd_ws_frame_t) <= 16, "bin_data_internal padding not sufficient for httpd_ws_frame_t");
+/* the ws_frame_slot of a published message is ours, one frame covers all clients */
+static void ws_bus_release(wsq_frame_t *frame)
+{
+	wt_event_put((wt_bin_data_internal_t *)frame);
+}
+
+static int ws_bus_match(void *arg, int idx)
+{
+	const wt_bin_data_hdr_t *hdr = arg;
+	return wt_bus_match(ws_ctx.topics[idx], hdr->module_id, hdr->sub_id);
+}
+
+/* runs in the publisher's task: one frame for the message, queued to every subscribed client */
+static void ws_on_bus_msg(void *arg, wt_bin_data_internal_t *msg)
+{
+	wsq_frame_t *frame = (wsq_frame_t *)&msg->ws_frame_slot;
+
+	(void)arg;
+	wt_event_get(msg);
+	wsq_frame_init(frame, HTTPD_WS_TYPE_BINARY, &msg->data, sizeof(wt_bin_data_hdr_t) + msg->data_len,
+	               ws_bus_release);
+	wsq_multicast(&ws_ctx.send_queue, frame, ws_bus_match, &msg->data.hdr);
+	wsq_frame_put(frame);
+}
+
+/* the bus only builds events while a client wants some */
+static void ws_bus_update(void)
+{
+	static const uint32_t any = WT_BUS_FILTER(WT_BUS_ANY, WT_BUS_ANY);
+
+	if (ws_ctx.bus_sub < 0) {
+		return;
+	}
+	for (int i = 0; i < CONFIG_LWIP_MAX_SOCKETS; ++i) {
+		for (int j = 0; j < WT_BUS_FILTER_MAX; ++j) {
+			if (ws_ctx.topics[i][j]) {
+				wt_event_set_filters(ws_ctx.bus_sub, &any, 1);
+				return;
+			}
+		}
+	}
+	wt_event_set_filters(ws_ctx.bus_sub, NULL, 0);
+}
+
+static void ws_set_topics(int fd, const uint8_t *pairs, int num)
+{
+	uint32_t *topics = ws_ctx.topics[GET_FD_IDX(fd)];
+
+	for (int i = 0; i < WT_BUS_FILTER_MAX; ++i) {
+		__atomic_store_n(&topics[i], i < num ? WT_BUS_FILTER(pairs[2 * i], pairs[2 * i + 1]) : 0,
+		                 __ATOMIC_RELAXED);
+	}
+	ws_bus_update();
+}
 
+static int ws_on_bin_req(int fd, wt_bin_data_t *data, uint16_t *len)
+{
+	switch (data->hdr.sub_id) {
+	case WS_BIN_SUBSCRIBE:
+		if (*len % 2 || *len / 2 > WT_BUS_FILTER_MAX) {
+			return API_JSON_BAD_REQUEST;
+		}
+		ws_set_topics(fd, data->payload, *len / 2);
+		*len = 0;
+		return API_JSON_OK;
+	default:
+		return API_JSON_UNSUPPORTED_CMD;
+	}
+}
+
+_Static_assert(sizeof(wsq_frame_t) <= sizeof(((wt_bin_data_internal_t *)0)->ws_frame_slot),
+               "bin_data_internal padding not sufficient for wsq_frame_t");
+
+static void ws_bin_release(wsq_frame_t *frame)
+{
+	/* ws_frame_slot is the start of the buffer */
+	memory_pool_put(frame);
+}
+
+/**
+ * The buffer is taken over as a wt_bin_data_internal_t, the frame is received at its data
+ * member and the module replies in place. The reply goes out from the same buffer, its
+ * wsq_frame_t lives in ws_frame_slot.
+ */
 int ws_on_binary_data(httpd_req_t *req, ws_msg_t *ws_msg)
 {
-	(void) req;
-	memory_pool_put(ws_msg);
-	return 0;
+	wt_bin_data_internal_t *bin = (wt_bin_data_internal_t *)ws_msg;
+	httpd_ws_frame_t ws_pkt = ws_msg->ws_pkt; /* overwritten by the frame data */
+	wsq_frame_t *out = (wsq_frame_t *)&bin->ws_frame_slot;
+	wt_bin_data_hdr_t hdr;
+	uint16_t len, max_len;
+	int ret;
+
+	ws_pkt.payload = (uint8_t *)&bin->data;
+	if (unlikely(httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len) != ESP_OK)) {
+		ESP_LOGE(TAG, "ws recv data error");
+		return ws_on_close(req, &ws_pkt, bin);
+	}
+	if (unlikely(ws_pkt.len < sizeof(wt_bin_data_hdr_t))) {
+		memory_pool_put(bin);
+		return ESP_OK;
+	}
+
+	hdr = bin->data.hdr;
+	len = ws_pkt.len - sizeof(wt_bin_data_hdr_t);
+	max_len = memory_pool_buf_size(bin) - sizeof(wt_bin_data_internal_t);
+	switch (hdr.data_type) {
+	case WT_DATA_CMD:
+	case WT_DATA_RAW:
+		if (hdr.module_id == WS_MODULE_ID) {
+			ret = ws_on_bin_req(httpd_req_to_sockfd(req), &bin->data, &len);
+		} else {
+			ret = api_bin_module_call(&bin->data, &len, max_len);
+		}
+		break;
+	default:
+		ret = API_JSON_BAD_REQUEST;
+		break;
+	}
+
+	/* raw data is not acknowledged, only its errors are */
+	if (ret == API_JSON_OK && hdr.data_type == WT_DATA_RAW) {
+		memory_pool_put(bin);
+		return ESP_OK;
+	}
+	if (unlikely(ret != API_JSON_OK || len > max_len)) {
+		ret = ret == API_JSON_OK || ret == API_JSON_ASYNC ? API_JSON_INTERNAL_ERR : ret;
+		len = 0;
+	}
+
+	bin->data_len = len;
+	bin->src_module = hdr.module_id;
+	bin->src_sub_module = hdr.sub_id;
+	bin->send_count = 0;
+	bin->data.hdr.data_type = WT_DATA_RESPONSE;
+	bin->data.hdr.module_id = hdr.module_id;
+	bin->data.hdr.sub_id = hdr.sub_id;
+	bin->data.hdr.status = ret;
+
+	wsq_frame_init(out, HTTPD_WS_TYPE_BINARY, &bin->data, sizeof(wt_bin_data_hdr_t) + len, ws_bin_release);
+	if (unlikely(wsq_push(&ws_ctx.send_queue, GET_FD_IDX(httpd_req_to_sockfd(req)), out))) {
+		ESP_LOGE(TAG, "ws %d: reply dropped", httpd_req_to_sockfd(req));
+	}
+	wsq_frame_put(out);
+	return ESP_OK;
 }
 
 int ws_on_socket_open(httpd_req_t *req)
@@ -279,32 +420,19 @@ static int ws_on_close(httpd_req_t *req, httpd_ws_frame_t *ws_pkt, void *msg)
 {
 	/* Read the rest of the CLOSE frame and response */
 	/* Please refer to RFC6455 Section 5.5.1 for more details */
-	ws_pkt->len = 0;
-	ws_pkt->type = HTTPD_WS_TYPE_CLOSE;
-	ESP_LOGI(TAG, "ws %d closed", httpd_req_to_sockfd(req));
-	ws_rm_fd(httpd_req_to_sockfd(req));
-	int err = httpd_ws_send_frame_async(req, httpd_req_to_sockfd(req), ws_pkt);
-	if (err) {
-		ESP_LOGE(TAG, "on close %s", esp_err_to_name(err));
-	}
-	httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
-	memory_pool_put(msg);
-	return err;
-}
-
-static void ws_async_resp(void *arg)
-{
-	ws_msg_t *req = arg;
-	httpd_handle_t hd = req->hd;
-	int fd = req->fd;
-	int err;
+	static wsq_frame_t close_frame = {
+		.type = HTTPD_WS_TYPE_CLOSE,
+		.len = 0,
+	};
+	int fd = httpd_req_to_sockfd(req);
 
-	ESP_LOGI(TAG, "ws async fd : %d", fd);
-	err = ws_send_frame_safe(hd, fd, &req->ws_pkt);
-	if (unlikely(err)) {
-		ESP_LOGE(TAG, "%s", esp_err_to_name(err));
-	}
-	memory_pool_put(req);
+	(void)ws_pkt;
+	ESP_LOGI(TAG, "ws %d closed", fd);
+	/* the writer sends what is queued and the CLOSE frame, then closes the session */
+	wsq_push(&ws_ctx.send_queue, GET_FD_IDX(fd), &close_frame);
+	wsq_close_after_flush(&ws_ctx.send_queue, GET_FD_IDX(fd));
+	memory_pool_put(msg);
+	return ESP_OK;
 }
 
 void async_send_out_cb(void *arg, int module_status)
@@ -316,34 +444,30 @@ void async_send_out_cb(void *arg, int module_status)
 	if (module_status != API_JSON_OK) {
 		req->ws_pkt.payload = req->payload;
 		ws_set_err_msg(&req->ws_pkt, module_status);
-		int err = ws_send_frame_safe(req->hd, req->fd, &req->ws_pkt);
-		if (err) {
-			ESP_LOGE(TAG, "send out %s", esp_err_to_name(err));
-		}
-		goto end;
-	}
-
-	int err;
-	json_to_text(req);
-	err = httpd_queue_work(req->hd, ws_async_resp, req);
-	if (likely(err == ESP_OK)) {
-		/* msg queued, let callee release the buffer */
-		return;
+	} else {
+		json_to_text(req);
 	}
 
-	ESP_LOGE(TAG, "errno: %d, fd %p: %s", errno, req->hd, esp_err_to_name(err));
-
-end:
-	/* clean resources */
-	memory_pool_put(req);
+	/* queued without blocking, the request runner goes on at once */
+	ws_msg_send(req->fd, req);
 }
 
 void json_to_text(ws_msg_t *ws_msg)
 {
 	int err;
+	uint32_t payload_len = PAYLOAD_LEN;
 	httpd_ws_frame_t *ws_pkt = &ws_msg->ws_pkt;
+
+	/* the module expects a reply too long for the message buffer */
+	if (ws_msg->json.big_buffer) {
+		ws_msg->big_buf = memory_pool_try_get(MEMORY_POOL_BIG_SIZE);
+		if (ws_msg->big_buf) {
+			ws_pkt->payload = ws_msg->big_buf;
+			payload_len = memory_pool_buf_size(ws_msg->big_buf);
+		}
+	}
 	/* api function returns something, send it to http client */
-	err = !cJSON_PrintPreallocated(ws_msg->json.out, (char *)ws_pkt->payload, PAYLOAD_LEN - 5, 0);
+	err = !cJSON_PrintPreallocated(ws_msg->json.out, (char *)ws_pkt->payload, payload_len - 5, 0);
 	cJSON_Delete(ws_msg->json.out);
 	if (unlikely(err)) {
 		ws_pkt->len = strlen(MSG_SEND_JSON_ERROR);
@@ -354,74 +478,123 @@ void json_to_text(ws_msg_t *ws_msg)
 }
 
 
-/* Clients array manipulation function
+static inline void ws_msg_put(ws_msg_t *msg)
+{
+	if (msg->big_buf) {
+		memory_pool_put(msg->big_buf);
+	}
+	memory_pool_put(msg);
+}
+
+static void ws_msg_release(wsq_frame_t *frame)
+{
+	ws_msg_put((ws_msg_t *)((uint8_t *)frame - offsetof(ws_msg_t, out)));
+}
+
+static void ws_msg_send(int fd, ws_msg_t *ws_msg)
+{
+	httpd_ws_frame_t *ws_pkt = &ws_msg->ws_pkt;
+
+	wsq_frame_init(&ws_msg->out, ws_pkt->type, ws_pkt->payload, ws_pkt->len, ws_msg_release);
+	if (unlikely(wsq_push(&ws_ctx.send_queue, GET_FD_IDX(fd), &ws_msg->out))) {
+		ESP_LOGE(TAG, "ws %d: reply dropped", fd);
+	}
+	wsq_frame_put(&ws_msg->out);
+}
+
+/* Clients
  * */
 static inline int8_t ws_add_fd(httpd_handle_t hd, int fd)
 {
-	if (ws_ctx.client_count >= CONFIG_LWIP_MAX_SOCKETS) {
+	wsq_t *q = &ws_ctx.send_queue;
+
+	if (GET_FD_IDX(fd) < 0 || GET_FD_IDX(fd) >= CONFIG_LWIP_MAX_SOCKETS) {
 		return 1;
 	}
 
-	uint8_t idx = GET_FD_IDX(fd);
-	ws_ctx.clients[idx].fd = fd;
-	ws_ctx.clients[idx].hd = hd;
-	ws_ctx.valid_fd[ws_ctx.client_count] = fd;
-	ws_ctx.client_count++;
-	return 0;
+	/* a handshake on this fd, whatever was there before is gone */
+	wsq_close(q, GET_FD_IDX(fd));
+	ws_set_topics(fd, NULL, 0);
+	/* the writer may still be finishing the last client of the fd */
+	for (int i = 0; i < 10; ++i) {
+		if (wsq_open(q, GET_FD_IDX(fd), hd, fd) == 0) {
+			return 0;
+		}
+		vTaskDelay(pdMS_TO_TICKS(10));
+	}
+	return 1;
 }
 
-/**
- * @brief replace the fd and hd to be removed by the last item
- * all front items are valid
- */
 static inline void ws_rm_fd(int fd)
 {
-	for (int i = 0; i < ws_ctx.client_count; ++i) {
-		if (ws_ctx.valid_fd[i] != fd) {
-			continue;
-		}
-		ws_ctx.valid_fd[i] = ws_ctx.valid_fd[ws_ctx.client_count - 1];
-		ws_ctx.client_count--;
-		return;
+	if (GET_FD_IDX(fd) >= 0 && GET_FD_IDX(fd) < CONFIG_LWIP_MAX_SOCKETS) {
+		wsq_close(&ws_ctx.send_queue, GET_FD_IDX(fd));
+		ws_set_topics(fd, NULL, 0);
 	}
 }
 
-static inline int ws_send_frame_safe(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame)
+/* called by the web server when a session is gone, websocket or not */
+void uri_ws_on_sock_close(int fd)
 {
-	int err;
-	xSemaphoreTake(ws_ctx.lock[GET_FD_IDX(fd)].mutex, portMAX_DELAY);
-	err = httpd_ws_send_frame_async(hd, fd, frame);
-	xSemaphoreGive(ws_ctx.lock[GET_FD_IDX(fd)].mutex);
-	return err;
+	ws_rm_fd(fd);
 }
 
-static inline void ws_broadcast_heartbeat()
+static int ws_writer_send(void *hd, int fd, const wsq_frame_t *frame)
 {
-	static httpd_ws_frame_t ws_pkt = {
-		.len = 0,
-		.payload = NULL,
-		.type = HTTPD_WS_TYPE_TEXT,
+	httpd_ws_frame_t ws_pkt = {
+		.final = 1,
+		.fragmented = 0,
+		.type = frame->type,
+		.payload = (uint8_t *)frame->payload,
+		.len = frame->len,
 	};
+	return httpd_ws_send_frame_async(hd, fd, &ws_pkt);
+}
 
-	int err;
-	for (int i = 0; i < ws_ctx.client_count; ++i) {
-		uint8_t idx = GET_FD_IDX(ws_ctx.valid_fd[i]);
-		err = ws_send_frame_safe(ws_ctx.clients[idx].hd, ws_ctx.clients[idx].fd, &ws_pkt);
-		if (err) {
-			ws_rm_fd(ws_ctx.clients[idx].fd);
-			httpd_sess_trigger_close(ws_ctx.clients[idx].hd, ws_ctx.clients[idx].fd);
-			ESP_LOGE(TAG, "hb send err: %s", esp_err_to_name(err));
-		}
+static void ws_writer_close(void *hd, int fd)
+{
+	wsq_stats_t stats;
+
+	wsq_get_stats(&ws_ctx.send_queue, &stats);
+	ESP_LOGI(TAG, "ws %d closing, %lu queued, %lu sent, %lu dropped, %lu clients dropped, depth %lu max %lu",
+	         fd, stats.queued, stats.sent, stats.dropped, stats.dropped_clients, stats.depth, stats.high_water);
+	httpd_sess_trigger_close(hd, fd);
+}
+
+static void ws_writer_wake(void)
+{
+	if (ws_ctx.task_writer) {
+		xTaskNotifyGive(ws_ctx.task_writer);
 	}
 }
 
+static const wsq_ops_t ws_writer_ops = {
+	.send = ws_writer_send,
+	.close = ws_writer_close,
+	.wake = ws_writer_wake,
+};
+
 _Noreturn
-void heartbeat_task(void *arg)
+void ws_writer_task(void *arg)
 {
+	/* empty text frame, only to clients that had nothing else sent to them */
+	static wsq_frame_t heartbeat = {
+		.type = HTTPD_WS_TYPE_TEXT,
+		.len = 0,
+	};
+	const TickType_t period = pdMS_TO_TICKS(WS_HEARTBEAT_MS);
+	TickType_t last = xTaskGetTickCount(), elapsed;
+	int again = 0;
+
 	(void)arg;
 	while (1) {
-		vTaskDelay(pdMS_TO_TICKS(1500));
-		ws_broadcast_heartbeat();
+		elapsed = xTaskGetTickCount() - last;
+		ulTaskNotifyTake(pdTRUE, again ? 1 : (elapsed >= period ? 0 : period - elapsed));
+		if (xTaskGetTickCount() - last >= period) {
+			last = xTaskGetTickCount();
+			wsq_broadcast(&ws_ctx.send_queue, &heartbeat, 1);
+		}
+		again = wsq_drain(&ws_ctx.send_queue);
 	}
 };
 
@@ -443,20 +616,20 @@ static const httpd_uri_t uri_api = {
 static int WS_REQ_INIT(const httpd_uri_t **uri_conf)
 {
 	*uri_conf = &uri_api;
-	xTaskCreate(heartbeat_task, "hb task", 2048, NULL, 3, &ws_ctx.task_heartbeat);
-
-	ws_ctx.client_count = 0;
-	for (int i = 0; i < CONFIG_LWIP_MAX_SOCKETS; ++i) {
-		ws_ctx.lock[i].mutex = xSemaphoreCreateMutexStatic(&ws_ctx.lock[i].xMutexBuffer);
-	}
+	wsq_init(&ws_ctx.send_queue, ws_ctx.clients, CONFIG_LWIP_MAX_SOCKETS, &ws_writer_ops);
+	xTaskCreate(ws_writer_task, "ws writer", 3072, NULL, 5, &ws_ctx.task_writer);
+	ws_ctx.bus_sub = wt_event_subscribe(ws_on_bus_msg, NULL);
 	return 0;
 }
 
 static int WS_REQ_EXIT(const httpd_uri_t **uri_conf)
 {
 	*uri_conf = &uri_api;
-	vTaskDelete(ws_ctx.task_heartbeat);
-	ws_ctx.task_heartbeat = NULL;
+	if (ws_ctx.bus_sub >= 0) {
+		wt_event_unsubscribe(ws_ctx.bus_sub);
+	}
+	vTaskDelete(ws_ctx.task_writer);
+	ws_ctx.task_writer = NULL;
 	return 0;
 }
 
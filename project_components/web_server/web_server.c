@@ -92,6 +92,7 @@ static void web_server_on_close(httpd_handle_t hd, int sockfd)
 {
 	opened_socket--;
 	ESP_LOGI(TAG, "%d closed, now: %d", sockfd, opened_socket);
+	uri_ws_on_sock_close(sockfd);
 	close(sockfd);
 }
 
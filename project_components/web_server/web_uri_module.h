@@ -28,4 +28,7 @@ int uri_module_add(uint8_t priority, uri_module_func init, uri_module_func exit)
 int uri_module_init(httpd_handle_t server);
 int uri_module_exit(httpd_handle_t server);
 
+/* a session of the server is closed, see uri_ws.c */
+void uri_ws_on_sock_close(int sockfd);
+
 #endif //WEB_URI_MODULE_H_GUARD
\ No newline at end of file
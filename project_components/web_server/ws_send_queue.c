@@ -0,0 +1,295 @@
+/*
+ * SPDX-FileCopyrightText: 2024 kerms
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ws_send_queue.h"
+
+#include <stddef.h>
+
+/*
+ * Client states, moved forward by anyone, back to FREE by the writer only,
+ * once no producer is left inside wsq_push
+ */
+enum {
+	WSQ_FREE = 0,
+	WSQ_OPEN,
+	WSQ_FLUSH,  /* send what is queued, then close */
+	WSQ_DROP,   /* discard what is queued, then close */
+	WSQ_CLOSED, /* discard what is queued, the peer is gone */
+};
+
+#define WSQ_MASK (WSQ_BACKLOG - 1)
+
+#define atomic_inc(p) __atomic_add_fetch(p, 1, __ATOMIC_RELAXED)
+
+void wsq_init(wsq_t *q, wsq_client_t *clients, int client_num, const wsq_ops_t *ops)
+{
+	q->clients = clients;
+	q->client_num = client_num;
+	q->ops = ops;
+	for (int i = 0; i < client_num; ++i) {
+		wsq_client_t *c = &clients[i];
+		c->state = WSQ_FREE;
+		c->users = 0;
+		c->enq_pos = 0;
+		c->deq_pos = 0;
+		for (uint32_t j = 0; j < WSQ_BACKLOG; ++j)
+			c->cells[j].seq = j;
+	}
+}
+
+int wsq_open(wsq_t *q, int idx, void *hd, int fd)
+{
+	wsq_client_t *c = &q->clients[idx];
+
+	if (__atomic_load_n(&c->state, __ATOMIC_ACQUIRE) != WSQ_FREE)
+		return -1;
+
+	/* the queue is empty: the writer emptied it before freeing the slot */
+	c->hd = hd;
+	c->fd = fd;
+	c->busy = 0;
+	__atomic_store_n(&c->state, WSQ_OPEN, __ATOMIC_SEQ_CST);
+	atomic_inc(&q->stats.clients);
+	return 0;
+}
+
+static void wsq_set_state(wsq_t *q, int idx, uint32_t state)
+{
+	wsq_client_t *c = &q->clients[idx];
+	uint32_t old = __atomic_load_n(&c->state, __ATOMIC_RELAXED);
+
+	/* a later state wins, CLOSED over DROP keeps a gone peer from being closed twice */
+	do {
+		if (old == WSQ_FREE || old >= state)
+			return;
+	} while (!__atomic_compare_exchange_n(&c->state, &old, state, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+	if (state == WSQ_DROP)
+		atomic_inc(&q->stats.dropped_clients);
+	if (q->ops->wake)
+		q->ops->wake();
+}
+
+void wsq_close(wsq_t *q, int idx)
+{
+	wsq_set_state(q, idx, WSQ_CLOSED);
+}
+
+void wsq_close_after_flush(wsq_t *q, int idx)
+{
+	wsq_set_state(q, idx, WSQ_FLUSH);
+}
+
+void wsq_frame_init(wsq_frame_t *frame, uint8_t type, const void *payload, uint32_t len,
+                    void (*release)(wsq_frame_t *frame))
+{
+	frame->ref = 1;
+	frame->type = type;
+	frame->keepalive = 0;
+	frame->payload = payload;
+	frame->len = len;
+	frame->release = release;
+}
+
+void wsq_frame_put(wsq_frame_t *frame)
+{
+	if (__atomic_sub_fetch(&frame->ref, 1, __ATOMIC_ACQ_REL) == 0 && frame->release)
+		frame->release(frame);
+}
+
+/* multi-producer enqueue of a bounded ring, cells carry the position they expect next */
+static int wsq_enqueue(wsq_client_t *c, wsq_frame_t *frame, uint32_t *depth)
+{
+	uint32_t pos = __atomic_load_n(&c->enq_pos, __ATOMIC_RELAXED), seq;
+	int32_t diff;
+
+	for (;;) {
+		seq = __atomic_load_n(&c->cells[pos & WSQ_MASK].seq, __ATOMIC_ACQUIRE);
+		diff = (int32_t)(seq - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&c->enq_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			return -1; /* full */
+		} else {
+			pos = __atomic_load_n(&c->enq_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	c->cells[pos & WSQ_MASK].frame = frame;
+	__atomic_store_n(&c->cells[pos & WSQ_MASK].seq, pos + 1, __ATOMIC_RELEASE);
+	*depth = pos + 1 - __atomic_load_n(&c->deq_pos, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static wsq_frame_t *wsq_dequeue(wsq_client_t *c)
+{
+	uint32_t pos = c->deq_pos;
+	wsq_frame_t *frame;
+
+	if (__atomic_load_n(&c->cells[pos & WSQ_MASK].seq, __ATOMIC_ACQUIRE) != pos + 1)
+		return NULL;
+
+	frame = c->cells[pos & WSQ_MASK].frame;
+	__atomic_store_n(&c->cells[pos & WSQ_MASK].seq, pos + WSQ_BACKLOG, __ATOMIC_RELEASE);
+	__atomic_store_n(&c->deq_pos, pos + 1, __ATOMIC_RELAXED);
+	return frame;
+}
+
+static int wsq_push_client(wsq_t *q, int idx, wsq_frame_t *frame)
+{
+	wsq_client_t *c = &q->clients[idx];
+	uint32_t depth, high_water;
+	int ret = -1;
+
+	/* seq_cst pairs with the state change and the users check of the writer:
+	 * either the writer sees us here, or we see the client is no longer open */
+	__atomic_add_fetch(&c->users, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&c->state, __ATOMIC_SEQ_CST) != WSQ_OPEN)
+		goto out;
+
+	__atomic_add_fetch(&frame->ref, 1, __ATOMIC_RELAXED);
+	if (wsq_enqueue(c, frame, &depth) != 0) {
+		/* a client this far behind is dropped, not waited for */
+		__atomic_sub_fetch(&frame->ref, 1, __ATOMIC_RELAXED);
+		atomic_inc(&q->stats.dropped);
+		wsq_set_state(q, idx, WSQ_DROP);
+		goto out;
+	}
+
+	atomic_inc(&q->stats.queued);
+	high_water = __atomic_load_n(&q->stats.high_water, __ATOMIC_RELAXED);
+	while (depth > high_water &&
+	       !__atomic_compare_exchange_n(&q->stats.high_water, &high_water, depth, 1,
+	                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+	ret = 0;
+out:
+	__atomic_sub_fetch(&c->users, 1, __ATOMIC_SEQ_CST);
+	return ret;
+}
+
+int wsq_push(wsq_t *q, int idx, wsq_frame_t *frame)
+{
+	int ret = wsq_push_client(q, idx, frame);
+	if (ret == 0 && q->ops->wake)
+		q->ops->wake();
+	return ret;
+}
+
+int wsq_broadcast(wsq_t *q, wsq_frame_t *frame, int idle_only)
+{
+	int num = 0;
+
+	frame->keepalive = idle_only;
+	for (int i = 0; i < q->client_num; ++i) {
+		wsq_client_t *c = &q->clients[i];
+		if (__atomic_load_n(&c->state, __ATOMIC_RELAXED) != WSQ_OPEN)
+			continue;
+		if (idle_only) {
+			/* traffic keeps the client alive as well as a heartbeat would */
+			if (__atomic_exchange_n(&c->busy, 0, __ATOMIC_RELAXED) ||
+			    __atomic_load_n(&c->enq_pos, __ATOMIC_RELAXED) != __atomic_load_n(&c->deq_pos, __ATOMIC_RELAXED))
+				continue;
+		}
+		if (wsq_push_client(q, i, frame) == 0)
+			num++;
+	}
+
+	if (num && q->ops->wake)
+		q->ops->wake();
+	return num;
+}
+
+int wsq_multicast(wsq_t *q, wsq_frame_t *frame, int (*match)(void *arg, int idx), void *arg)
+{
+	int num = 0;
+
+	for (int i = 0; i < q->client_num; ++i) {
+		if (__atomic_load_n(&q->clients[i].state, __ATOMIC_RELAXED) != WSQ_OPEN || !match(arg, i))
+			continue;
+		if (wsq_push_client(q, i, frame) == 0)
+			num++;
+	}
+
+	if (num && q->ops->wake)
+		q->ops->wake();
+	return num;
+}
+
+/* @return 1 if the client can not be finished now, producers are still inside wsq_push */
+static int wsq_finish(wsq_t *q, wsq_client_t *c, uint32_t state)
+{
+	wsq_frame_t *frame;
+
+	if (__atomic_load_n(&c->users, __ATOMIC_SEQ_CST) != 0)
+		return 1;
+
+	while ((frame = wsq_dequeue(c)) != NULL) {
+		atomic_inc(&q->stats.dropped);
+		wsq_frame_put(frame);
+	}
+	if (state != WSQ_CLOSED && q->ops->close)
+		q->ops->close(c->hd, c->fd);
+
+	__atomic_sub_fetch(&q->stats.clients, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&c->state, WSQ_FREE, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int wsq_drain(wsq_t *q)
+{
+	wsq_frame_t *frame;
+	int sent, again = 0;
+
+	do {
+		sent = 0;
+		for (int i = 0; i < q->client_num; ++i) {
+			wsq_client_t *c = &q->clients[i];
+			uint32_t state = __atomic_load_n(&c->state, __ATOMIC_SEQ_CST);
+
+			if (state == WSQ_FREE)
+				continue;
+			if (state == WSQ_DROP || state == WSQ_CLOSED) {
+				again |= wsq_finish(q, c, state);
+				continue;
+			}
+
+			/* one frame per client and round, a busy client does not starve the others */
+			frame = wsq_dequeue(c);
+			if (frame == NULL) {
+				if (state == WSQ_FLUSH)
+					again |= wsq_finish(q, c, state);
+				continue;
+			}
+
+			if (q->ops->send(c->hd, c->fd, frame) == 0) {
+				atomic_inc(&q->stats.sent);
+				if (!frame->keepalive)
+					__atomic_store_n(&c->busy, 1, __ATOMIC_RELAXED);
+			} else {
+				atomic_inc(&q->stats.dropped);
+				wsq_set_state(q, i, WSQ_DROP);
+			}
+			wsq_frame_put(frame);
+			sent++;
+		}
+	} while (sent);
+
+	return again;
+}
+
+void wsq_get_stats(wsq_t *q, wsq_stats_t *stats)
+{
+	*stats = q->stats;
+	stats->depth = 0;
+	for (int i = 0; i < q->client_num; ++i) {
+		wsq_client_t *c = &q->clients[i];
+		if (__atomic_load_n(&c->state, __ATOMIC_RELAXED) != WSQ_FREE)
+			stats->depth += __atomic_load_n(&c->enq_pos, __ATOMIC_RELAXED) -
+			                __atomic_load_n(&c->deq_pos, __ATOMIC_RELAXED);
+	}
+}
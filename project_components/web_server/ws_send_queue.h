@@ -0,0 +1,114 @@
+/*
+ * SPDX-FileCopyrightText: 2024 kerms
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef WS_SEND_QUEUE_H_GUARD
+#define WS_SEND_QUEUE_H_GUARD
+
+#include <stdint.h>
+
+/*
+ * Outbound frames of the websocket clients.
+ *
+ * Any task queues frames without blocking, one writer context sends them.
+ * Every client has a bounded queue of WSQ_BACKLOG frames; a client that lets
+ * it fill up is dropped instead of stalling the producers or the other clients.
+ * Frames are reference counted, a frame queued to several clients is shared.
+ *
+ * Lock-free, no FreeRTOS or httpd dependency: the writer side talks to the
+ * server through wsq_ops_t, so tools/ws_send_queue_test.c runs it on a host.
+ */
+
+#ifndef WSQ_BACKLOG
+#define WSQ_BACKLOG 8 /* frames per client, power of 2 */
+#endif
+
+_Static_assert((WSQ_BACKLOG & (WSQ_BACKLOG - 1)) == 0, "WSQ_BACKLOG must be a power of 2");
+
+/* 16 bytes on the target, fits the ws_frame_slot in front of a binary message */
+typedef struct wsq_frame_t {
+	uint32_t ref;
+	uint32_t len: 24;
+	uint32_t type: 7;       /* httpd_ws_type_t */
+	uint32_t keepalive: 1;  /* set by an idle broadcast, not counted as traffic */
+	const uint8_t *payload;
+	/* called when the last reference is gone, NULL for a static frame */
+	void (*release)(struct wsq_frame_t *frame);
+} wsq_frame_t;
+
+typedef struct wsq_client_t {
+	uint32_t state;
+	uint32_t users;         /* producers between their state check and enqueue */
+	uint32_t busy;          /* a frame was sent since the last heartbeat */
+	void *hd;
+	int fd;
+	uint32_t enq_pos;
+	uint32_t deq_pos;       /* writer only */
+	struct {
+		uint32_t seq;
+		wsq_frame_t *frame;
+	} cells[WSQ_BACKLOG];
+} wsq_client_t;
+
+typedef struct wsq_ops_t {
+	/* send one frame, may block, 0 on success */
+	int (*send)(void *hd, int fd, const wsq_frame_t *frame);
+	/* close a client that was dropped or asked to be closed */
+	void (*close)(void *hd, int fd);
+	/* frames were queued, run wsq_drain() */
+	void (*wake)(void);
+} wsq_ops_t;
+
+typedef struct wsq_stats_t {
+	uint32_t clients;         /* open clients */
+	uint32_t depth;           /* frames waiting now, all clients */
+	uint32_t high_water;      /* most frames one client had waiting */
+	uint32_t queued;          /* frames accepted */
+	uint32_t sent;
+	uint32_t dropped;         /* frames refused with a full queue or discarded with their client */
+	uint32_t dropped_clients; /* clients dropped for a full queue or a failed send */
+} wsq_stats_t;
+
+typedef struct wsq_t {
+	wsq_client_t *clients;
+	int client_num;
+	const wsq_ops_t *ops;
+	wsq_stats_t stats;
+} wsq_t;
+
+void wsq_init(wsq_t *q, wsq_client_t *clients, int client_num, const wsq_ops_t *ops);
+
+/* @return 0, -1 if the slot still holds a client that is being closed, try again later */
+int wsq_open(wsq_t *q, int idx, void *hd, int fd);
+
+/* the peer is gone, discard its frames */
+void wsq_close(wsq_t *q, int idx);
+
+/* send what is queued, then close the client through wsq_ops_t.close */
+void wsq_close_after_flush(wsq_t *q, int idx);
+
+/* reference count starts at 1, owned by the caller: put it once queued */
+void wsq_frame_init(wsq_frame_t *frame, uint8_t type, const void *payload, uint32_t len,
+                    void (*release)(wsq_frame_t *frame));
+void wsq_frame_put(wsq_frame_t *frame);
+
+/* never blocks, @return 0 if queued, -1 if the client is not open or has been dropped */
+int wsq_push(wsq_t *q, int idx, wsq_frame_t *frame);
+
+/* queue to every open client, or to the ones without traffic since the last idle broadcast
+ * @return number of clients the frame was queued to */
+int wsq_broadcast(wsq_t *q, wsq_frame_t *frame, int idle_only);
+
+/* queue to every open client `match` returns non-zero for
+ * @return number of clients the frame was queued to */
+int wsq_multicast(wsq_t *q, wsq_frame_t *frame, int (*match)(void *arg, int idx), void *arg);
+
+/* writer: send the queued frames round-robin, finish closes and drops
+ * @return 0 when done, 1 if a client could not be finished yet, drain again soon */
+int wsq_drain(wsq_t *q);
+
+void wsq_get_stats(wsq_t *q, wsq_stats_t *stats);
+
+#endif //WS_SEND_QUEUE_H_GUARD
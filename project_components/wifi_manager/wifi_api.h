@@ -19,6 +19,16 @@ typedef enum wifi_api_json_cmd_t {
 	WIFI_API_JSON_STA_SET_STATIC_CONF = 10, /* static_ip_en: 0/1, static_dns_en: 0/1 */
 } wifi_api_json_cmd_t;
 
+/* WT_DATA_EVENT sub_id */
+typedef enum wifi_api_event_t {
+	WIFI_API_EVENT_STA_CONNECTED       = 1, /* bssid[6] */
+	WIFI_API_EVENT_STA_DISCONNECTED    = 2, /* reason: uint8_t */
+	WIFI_API_EVENT_STA_GOT_IP          = 3, /* ip, gateway, netmask: ip4_addr_t */
+	WIFI_API_EVENT_STA_LOST_IP         = 4,
+	WIFI_API_EVENT_AP_STA_CONNECTED    = 5, /* mac[6] */
+	WIFI_API_EVENT_AP_STA_DISCONNECTED = 6, /* mac[6] */
+} wifi_api_event_t;
+
 typedef struct wifi_api_ap_info_t {
 	ip4_addr_t ip;
 	ip4_addr_t gateway;
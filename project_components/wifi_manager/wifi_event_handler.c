@@ -9,6 +9,8 @@
 
 #include "ssdp.h"
 #include "wifi_configuration.h"
+#include "wifi_api.h"
+#include "wt_event.h"
 
 #define TAG __FILE_NAME__
 
@@ -26,6 +28,10 @@ void ip_event_handler(void *handler_arg __attribute__((unused)),
 		       ip4addr_ntoa((const ip4_addr_t *) &event->ip_info.ip));
 		event_on_connected(event);
 		ssdp_set_ip_gw(&event->ip_info.ip.addr, &event->ip_info.gw.addr);
+		ip4_addr_t ip_info[3] = {
+			{event->ip_info.ip.addr}, {event->ip_info.gw.addr}, {event->ip_info.netmask.addr},
+		};
+		wt_event_publish(WIFI_MODULE_ID, WIFI_API_EVENT_STA_GOT_IP, ip_info, sizeof(ip_info));
 		break;
 	}
 	case IP_EVENT_STA_LOST_IP: {
@@ -35,6 +41,7 @@ void ip_event_handler(void *handler_arg __attribute__((unused)),
 		IP4_ADDR_EXPAND(&ip, WIFI_DEFAULT_AP_IP);
 		IP4_ADDR_EXPAND(&gw, WIFI_DEFAULT_AP_GATEWAY);
 		ssdp_set_ip_gw(&ip.addr, &gw.addr);
+		wt_event_publish(WIFI_MODULE_ID, WIFI_API_EVENT_STA_LOST_IP, NULL, 0);
 		break;
 	}
 	case IP_EVENT_AP_STAIPASSIGNED:
@@ -174,6 +181,7 @@ void wifi_event_handler(void *handler_arg __attribute__((unused)),
 		tcpip_adapter_create_ip6_linklocal(TCPIP_ADAPTER_IF_STA);
 #endif
 		event_ctx.is_connected = 1;
+		wt_event_publish(WIFI_MODULE_ID, WIFI_API_EVENT_STA_CONNECTED, event->bssid, sizeof(event->bssid));
 		break;
 	}
 	case WIFI_EVENT_STA_DISCONNECTED: {
@@ -183,6 +191,7 @@ void wifi_event_handler(void *handler_arg __attribute__((unused)),
 		printf("sta %02X:%02X:%02X:%02X:%02X:%02X disconnect reason %d\n",
 		       m[0], m[1], m[2], m[3], m[4], m[5], event->reason);
 		event_ctx.is_connected = 0;
+		wt_event_publish(WIFI_MODULE_ID, WIFI_API_EVENT_STA_DISCONNECTED, &event->reason, sizeof(event->reason));
 		reconnect_after_disco();
 		break;
 	}
@@ -195,6 +204,7 @@ void wifi_event_handler(void *handler_arg __attribute__((unused)),
 		printf("event: WIFI_EVENT_AP_STACONNECTED\n");
 		printf("%02X:%02X:%02X:%02X:%02X:%02X is connected\n",
 			   m[0], m[1], m[2], m[3], m[4], m[5]);
+		wt_event_publish(WIFI_MODULE_ID, WIFI_API_EVENT_AP_STA_CONNECTED, event->mac, sizeof(event->mac));
 		break;
 	}
 	case WIFI_EVENT_AP_STADISCONNECTED: {
@@ -203,6 +213,7 @@ void wifi_event_handler(void *handler_arg __attribute__((unused)),
 		printf("event: WIFI_EVENT_AP_STADISCONNECTED\n");
 		printf("%02X:%02X:%02X:%02X:%02X:%02X is disconnected\n",
 		       m[0], m[1], m[2], m[3], m[4], m[5]);
+		wt_event_publish(WIFI_MODULE_ID, WIFI_API_EVENT_AP_STA_DISCONNECTED, event->mac, sizeof(event->mac));
 		break;
 	}
 	default:
@@ -0,0 +1,150 @@
+/*
+ * SPDX-FileCopyrightText: 2024 kerms <kerms@niazo.org>
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "wt_bus.h"
+
+#include <stddef.h>
+
+/*
+ * Subscriber states. A slot is claimed FREE -> SETUP -> ACTIVE by wt_bus_subscribe,
+ * and goes back to FREE through CLOSING once no publisher is inside it any more.
+ */
+enum {
+	WT_BUS_FREE = 0,
+	WT_BUS_SETUP,
+	WT_BUS_ACTIVE,
+	WT_BUS_CLOSING,
+};
+
+#define atomic_inc(p) __atomic_add_fetch(p, 1, __ATOMIC_RELAXED)
+
+void wt_bus_init(wt_bus_t *bus, void (*free)(void *msg))
+{
+	for (int i = 0; i < WT_BUS_SUB_MAX; ++i) {
+		bus->subs[i].state = WT_BUS_FREE;
+		bus->subs[i].users = 0;
+	}
+	bus->free = free;
+	bus->stats = (wt_bus_stats_t) {0};
+}
+
+int wt_bus_subscribe(wt_bus_t *bus, wt_bus_on_msg on_msg, void *arg)
+{
+	for (int i = 0; i < WT_BUS_SUB_MAX; ++i) {
+		wt_bus_sub_t *sub = &bus->subs[i];
+		uint32_t state = WT_BUS_FREE;
+
+		if (!__atomic_compare_exchange_n(&sub->state, &state, WT_BUS_SETUP, 0,
+		                                 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			continue;
+
+		/* publishers skip the slot until it is ACTIVE */
+		for (int j = 0; j < WT_BUS_FILTER_MAX; ++j)
+			__atomic_store_n(&sub->filters[j], 0, __ATOMIC_RELAXED);
+		sub->on_msg = on_msg;
+		sub->arg = arg;
+		__atomic_store_n(&sub->state, WT_BUS_ACTIVE, __ATOMIC_SEQ_CST);
+		return i;
+	}
+	return -1;
+}
+
+void wt_bus_set_filters(wt_bus_t *bus, int id, const uint32_t *filters, int num)
+{
+	wt_bus_sub_t *sub = &bus->subs[id];
+
+	for (int i = 0; i < WT_BUS_FILTER_MAX; ++i)
+		__atomic_store_n(&sub->filters[i], i < num ? filters[i] : 0, __ATOMIC_RELAXED);
+}
+
+/* whoever sees CLOSING with no publisher left frees the slot */
+static void wt_bus_try_free(wt_bus_sub_t *sub)
+{
+	uint32_t state = WT_BUS_CLOSING;
+
+	if (__atomic_load_n(&sub->users, __ATOMIC_SEQ_CST) == 0)
+		__atomic_compare_exchange_n(&sub->state, &state, WT_BUS_FREE, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+void wt_bus_unsubscribe(wt_bus_t *bus, int id)
+{
+	wt_bus_sub_t *sub = &bus->subs[id];
+
+	wt_bus_set_filters(bus, id, NULL, 0);
+	__atomic_store_n(&sub->state, WT_BUS_CLOSING, __ATOMIC_SEQ_CST);
+	wt_bus_try_free(sub);
+}
+
+int wt_bus_wanted(wt_bus_t *bus, uint8_t module_id, uint8_t sub_id)
+{
+	for (int i = 0; i < WT_BUS_SUB_MAX; ++i) {
+		wt_bus_sub_t *sub = &bus->subs[i];
+		if (__atomic_load_n(&sub->state, __ATOMIC_RELAXED) == WT_BUS_ACTIVE &&
+		    wt_bus_match(sub->filters, module_id, sub_id))
+			return 1;
+	}
+	return 0;
+}
+
+void wt_bus_msg_init(wt_bin_data_internal_t *msg, wt_data_type_t type, uint8_t module_id, uint8_t sub_id,
+                     uint16_t len)
+{
+	msg->data_len = len;
+	msg->src_module = module_id;
+	msg->src_sub_module = sub_id;
+	msg->send_count = 1;
+	msg->data.hdr.data_type = type;
+	msg->data.hdr.module_id = module_id;
+	msg->data.hdr.sub_id = sub_id;
+	msg->data.hdr.status = 0;
+}
+
+void wt_bus_msg_put(wt_bus_t *bus, wt_bin_data_internal_t *msg)
+{
+	if (__atomic_sub_fetch(&msg->send_count, 1, __ATOMIC_ACQ_REL) == 0)
+		bus->free(msg);
+}
+
+int wt_bus_publish(wt_bus_t *bus, wt_bin_data_internal_t *msg)
+{
+	uint8_t module_id = msg->data.hdr.module_id, sub_id = msg->data.hdr.sub_id;
+	int num = 0;
+
+	for (int i = 0; i < WT_BUS_SUB_MAX; ++i) {
+		wt_bus_sub_t *sub = &bus->subs[i];
+
+		if (__atomic_load_n(&sub->state, __ATOMIC_RELAXED) == WT_BUS_FREE)
+			continue;
+
+		/* seq_cst pairs with wt_bus_unsubscribe: either it sees us here and leaves
+		 * the slot to us, or we see it is no longer active */
+		__atomic_add_fetch(&sub->users, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&sub->state, __ATOMIC_SEQ_CST) == WT_BUS_ACTIVE &&
+		    wt_bus_match(sub->filters, module_id, sub_id)) {
+			sub->on_msg(sub->arg, msg);
+			num++;
+		}
+		if (__atomic_sub_fetch(&sub->users, 1, __ATOMIC_SEQ_CST) == 0 &&
+		    __atomic_load_n(&sub->state, __ATOMIC_SEQ_CST) == WT_BUS_CLOSING)
+			wt_bus_try_free(sub);
+	}
+
+	atomic_inc(&bus->stats.published);
+	if (num)
+		__atomic_add_fetch(&bus->stats.delivered, num, __ATOMIC_RELAXED);
+	else
+		atomic_inc(&bus->stats.unmatched);
+
+	wt_bus_msg_put(bus, msg);
+	return num;
+}
+
+void wt_bus_get_stats(wt_bus_t *bus, wt_bus_stats_t *stats)
+{
+	stats->published = __atomic_load_n(&bus->stats.published, __ATOMIC_RELAXED);
+	stats->delivered = __atomic_load_n(&bus->stats.delivered, __ATOMIC_RELAXED);
+	stats->unmatched = __atomic_load_n(&bus->stats.unmatched, __ATOMIC_RELAXED);
+}
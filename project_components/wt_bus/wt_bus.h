@@ -0,0 +1,106 @@
+/*
+ * SPDX-FileCopyrightText: 2024 kerms <kerms@niazo.org>
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef WT_BUS_H_GUARD
+#define WT_BUS_H_GUARD
+
+#include "wt_data_def.h"
+
+#include <stdint.h>
+
+/*
+ * Publish/subscribe between the modules.
+ *
+ * A message is a buffer laid out as wt_bin_data_internal_t, its topic is the
+ * module_id/sub_id of the header. Publishing hands it to every subscriber with
+ * a matching filter, in the publisher's task. A subscriber that keeps it takes
+ * a reference, send_count counts them and the buffer is freed with the last one,
+ * so a message reaches any number of subscribers without being copied.
+ *
+ * Lock-free, no FreeRTOS dependency, see tools/wt_bus_bench.c.
+ */
+
+#ifndef WT_BUS_SUB_MAX
+#define WT_BUS_SUB_MAX 8
+#endif
+
+#define WT_BUS_FILTER_MAX 4    /* topic filters per subscriber */
+#define WT_BUS_ANY        0xFF /* module_id or sub_id of a filter matching any */
+
+/* 0 is an unused filter */
+#define WT_BUS_FILTER(module_id, sub_id) (0x10000u | (uint32_t)(module_id) << 8 | (uint8_t)(sub_id))
+
+/**
+ * Runs in the publisher's task and must not block. `msg` is shared, read only,
+ * and valid until return, unless a reference is taken with wt_bus_msg_get().
+ */
+typedef void (*wt_bus_on_msg)(void *arg, wt_bin_data_internal_t *msg);
+
+typedef struct wt_bus_sub_t {
+	uint32_t state;
+	uint32_t users;  /* publishers between their state check and on_msg */
+	uint32_t filters[WT_BUS_FILTER_MAX];
+	wt_bus_on_msg on_msg;
+	void *arg;
+} wt_bus_sub_t;
+
+typedef struct wt_bus_stats_t {
+	uint32_t published;
+	uint32_t delivered; /* on_msg calls */
+	uint32_t unmatched; /* messages no subscriber wanted */
+} wt_bus_stats_t;
+
+typedef struct wt_bus_t {
+	wt_bus_sub_t subs[WT_BUS_SUB_MAX];
+	void (*free)(void *msg);
+	wt_bus_stats_t stats;
+} wt_bus_t;
+
+static inline int wt_bus_match(const uint32_t *filters, uint8_t module_id, uint8_t sub_id)
+{
+	for (int i = 0; i < WT_BUS_FILTER_MAX; ++i) {
+		uint32_t f = __atomic_load_n(&filters[i], __ATOMIC_RELAXED);
+		uint8_t m = f >> 8, s = f;
+
+		if (f && (m == WT_BUS_ANY || m == module_id) && (s == WT_BUS_ANY || s == sub_id))
+			return 1;
+	}
+	return 0;
+}
+
+/* all zero is an empty bus as well, only `free` needs to be set */
+void wt_bus_init(wt_bus_t *bus, void (*free)(void *msg));
+
+/* @return subscriber id, -1 if WT_BUS_SUB_MAX are in use. No filter is set yet */
+int wt_bus_subscribe(wt_bus_t *bus, wt_bus_on_msg on_msg, void *arg);
+
+/* replaces the filters of the subscriber, `num` up to WT_BUS_FILTER_MAX */
+void wt_bus_set_filters(wt_bus_t *bus, int id, const uint32_t *filters, int num);
+
+/* a publish already running may still call on_msg once, `arg` must outlive it */
+void wt_bus_unsubscribe(wt_bus_t *bus, int id);
+
+/* @return 1 if a subscriber would get a message of this topic, to skip building it */
+int wt_bus_wanted(wt_bus_t *bus, uint8_t module_id, uint8_t sub_id);
+
+/* header and bookkeeping of a message of `len` payload bytes, one reference held by the caller */
+void wt_bus_msg_init(wt_bin_data_internal_t *msg, wt_data_type_t type, uint8_t module_id, uint8_t sub_id,
+                     uint16_t len);
+
+static inline void wt_bus_msg_get(wt_bin_data_internal_t *msg)
+{
+	__atomic_add_fetch(&msg->send_count, 1, __ATOMIC_RELAXED);
+}
+
+void wt_bus_msg_put(wt_bus_t *bus, wt_bin_data_internal_t *msg);
+
+/* takes over the caller's reference
+ * @return number of subscribers the message was handed to */
+int wt_bus_publish(wt_bus_t *bus, wt_bin_data_internal_t *msg);
+
+void wt_bus_get_stats(wt_bus_t *bus, wt_bus_stats_t *stats);
+
+#endif //WT_BUS_H_GUARD
@@ -0,0 +1,77 @@
+/*
+ * SPDX-FileCopyrightText: 2024 kerms <kerms@niazo.org>
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "wt_event.h"
+#include "memory_pool.h"
+
+#include <string.h>
+
+static wt_bus_t event_bus = {
+	.free = memory_pool_put,
+};
+
+int wt_event_wanted(uint8_t module_id, uint8_t sub_id)
+{
+	return wt_bus_wanted(&event_bus, module_id, sub_id);
+}
+
+wt_bin_data_internal_t *wt_event_alloc(wt_data_type_t type, uint8_t module_id, uint8_t sub_id, uint16_t len)
+{
+	wt_bin_data_internal_t *msg;
+
+	msg = memory_pool_try_get(sizeof(wt_bin_data_internal_t) + len);
+	if (msg == NULL)
+		return NULL;
+
+	wt_bus_msg_init(msg, type, module_id, sub_id, len);
+	return msg;
+}
+
+int wt_event_send(wt_bin_data_internal_t *msg)
+{
+	return wt_bus_publish(&event_bus, msg);
+}
+
+int wt_event_publish(uint8_t module_id, uint8_t sub_id, const void *payload, uint16_t len)
+{
+	wt_bin_data_internal_t *msg;
+
+	if (!wt_bus_wanted(&event_bus, module_id, sub_id))
+		return 0;
+
+	msg = wt_event_alloc(WT_DATA_EVENT, module_id, sub_id, len);
+	if (msg == NULL)
+		return -1;
+
+	if (len)
+		memcpy(msg->data.payload, payload, len);
+	return wt_bus_publish(&event_bus, msg);
+}
+
+int wt_event_subscribe(wt_bus_on_msg on_msg, void *arg)
+{
+	return wt_bus_subscribe(&event_bus, on_msg, arg);
+}
+
+void wt_event_set_filters(int id, const uint32_t *filters, int num)
+{
+	wt_bus_set_filters(&event_bus, id, filters, num);
+}
+
+void wt_event_unsubscribe(int id)
+{
+	wt_bus_unsubscribe(&event_bus, id);
+}
+
+void wt_event_put(wt_bin_data_internal_t *msg)
+{
+	wt_bus_msg_put(&event_bus, msg);
+}
+
+void wt_event_get_stats(wt_bus_stats_t *stats)
+{
+	wt_bus_get_stats(&event_bus, stats);
+}
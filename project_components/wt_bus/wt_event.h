@@ -0,0 +1,46 @@
+/*
+ * SPDX-FileCopyrightText: 2024 kerms <kerms@niazo.org>
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef WT_EVENT_H_GUARD
+#define WT_EVENT_H_GUARD
+
+#include "wt_bus.h"
+
+/*
+ * The bus of the firmware, messages are memory pool buffers.
+ * Modules publish their state changes as WT_DATA_EVENT of their module_id,
+ * the websocket clients subscribe to them, see uri_ws.c.
+ */
+
+/* @return 1 if anybody listens to the topic, 0 to skip building the event */
+int wt_event_wanted(uint8_t module_id, uint8_t sub_id);
+
+/* a message with room for `len` payload bytes, never waits, NULL if no buffer is free */
+wt_bin_data_internal_t *wt_event_alloc(wt_data_type_t type, uint8_t module_id, uint8_t sub_id, uint16_t len);
+
+/* publish a message of wt_event_alloc, the caller's reference is taken over */
+int wt_event_send(wt_bin_data_internal_t *msg);
+
+/**
+ * Copy `payload` into a WT_DATA_EVENT and publish it, only if somebody listens
+ * @return number of subscribers reached, -1 if no buffer was free
+ */
+int wt_event_publish(uint8_t module_id, uint8_t sub_id, const void *payload, uint16_t len);
+
+int wt_event_subscribe(wt_bus_on_msg on_msg, void *arg);
+void wt_event_set_filters(int id, const uint32_t *filters, int num);
+void wt_event_unsubscribe(int id);
+
+static inline void wt_event_get(wt_bin_data_internal_t *msg)
+{
+	wt_bus_msg_get(msg);
+}
+
+void wt_event_put(wt_bin_data_internal_t *msg);
+
+void wt_event_get_stats(wt_bus_stats_t *stats);
+
+#endif //WT_EVENT_H_GUARD
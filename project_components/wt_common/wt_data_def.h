@@ -42,6 +42,7 @@ typedef struct wt_bin_data_hdr_t {
 		struct {
 			uint8_t module_id; /* src when broadcast, else target module */
 			uint8_t sub_id;    /* src when broadcast, else target sub_id */
+			uint8_t status;    /* WT_DATA_RESPONSE: api_json_req_status_e */
 		};
 		/* not used, only for make the union == 3B */
 		struct {
@@ -60,19 +61,15 @@ typedef struct wt_bin_data_t {
 
 typedef struct wt_bin_data_internal_t {
 	struct {
-		uint64_t Dummy1;
-		uint64_t Dummy2;
-	} ws_frame_slot; /* 16 byte padding for httpd_ws_frame */
+		/* 16 bytes on the targets, twice that with the pointers of a 64-bit host */
+		uint64_t Dummy[sizeof(void *) / 2];
+	} ws_frame_slot; /* padding for httpd_ws_frame, or the wsq_frame_t sending the message */
 	struct { /*  */
 		uint16_t data_len;
 		uint8_t src_module;
 		uint8_t src_sub_module;
 	};
-	struct { /*  */
-		uint8_t send_count;
-		uint8_t reserved1;
-		uint16_t reserved2;
-	};
+	uint32_t send_count; /* references to a published message, see wt_bus.h */
 	wt_bin_data_t data;
 } wt_bin_data_internal_t;
 
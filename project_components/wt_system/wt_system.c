@@ -6,6 +6,7 @@
 
 #include "wt_system.h"
 #include "wt_system_api.h"
+#include "wt_event.h"
 #include <esp_app_desc.h>
 #include <string.h>
 #include <esp_system.h>
@@ -31,6 +32,9 @@ static void reboot_task(void *arg)
 
 void wt_system_reboot()
 {
+	uint8_t delay_s = 2;
+
+	wt_event_publish(SYSTEM_MODULE_ID, WT_SYS_EVENT_REBOOT, &delay_s, sizeof(delay_s));
 	xTaskCreatePinnedToCore(reboot_task, "reboot", 4096, NULL, 3, NULL, 0);
 }
 
@@ -16,5 +16,10 @@ typedef enum wt_system_cmd_t {
 	WT_SYS_DO_CRASH = 200,
 } wt_system_cmd_t;
 
+/* WT_DATA_EVENT sub_id */
+typedef enum wt_system_event_t {
+	WT_SYS_EVENT_REBOOT = 1, /* seconds until reboot: uint8_t */
+} wt_system_event_t;
+
 
 #endif //WT_SYSTEM_API_H_GUARD
\ No newline at end of file
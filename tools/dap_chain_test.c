@@ -0,0 +1,297 @@
+/*
+ * DAP_QueueCommands chains of the stream transports, on the host.
+ *
+ * dap_engine_execute_chain of dap_session.c is fed recorded batch streams: packets
+ * queued with DAP_QueueCommands, ended by a packet of another kind. The answer of the
+ * chain must be the responses of every queued command, in order, as if each packet
+ * had been executed on its own, in one DAP_ExecuteCommands response. Queued packets
+ * must not be answered, a chain that does not fit in one packet (bytes or more than
+ * 255 commands) must be answered with ID_DAP_Invalid, and the chain state must be
+ * clean for the next packet either way. DAP_Info must report the packet count of the
+ * stream pipeline, not the one of the usbip slots. Last, a chain left open when the
+ * pipeline is drained, as on a KCP handshake, must be answered.
+ *
+ * build: cmake -S host -B build && cmake --build build
+ * usage: dap_chain_test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "DAP_config.h"
+#include "cmsis-dap/include/DAP.h"
+#include "components/dap_proxy/dap_session.h"
+#include "components/dap_proxy/dap_pipeline.h"
+
+#define PACKET_MAX 1024
+#define STREAM_MAX 8
+
+typedef struct {
+	uint32_t length;
+	uint8_t data[PACKET_MAX];
+} packet_t;
+
+typedef struct {
+	const char *name;
+	uint32_t packet_size;
+	uint32_t num;
+	packet_t packets[STREAM_MAX];
+	int overflow;  /* the chain must be answered with ID_DAP_Invalid */
+} stream_t;
+
+static uint8_t chain_buffer[PACKET_MAX];
+static dap_chain_t chain = { .buffer = chain_buffer };
+
+static void add(stream_t *s, const uint8_t *data, uint32_t length)
+{
+	packet_t *p = &s->packets[s->num++];
+
+	memcpy(p->data, data, length);
+	p->length = length;
+}
+
+/* a DAP_QueueCommands packet of `count` copies of one command */
+static void add_queued(stream_t *s, const uint8_t *cmd, uint32_t cmd_length, uint32_t count)
+{
+	uint8_t data[PACKET_MAX];
+
+	data[0] = ID_DAP_QueueCommands;
+	data[1] = count;
+	for (uint32_t i = 0; i < count; i++)
+		memcpy(data + 2 + i * cmd_length, cmd, cmd_length);
+	add(s, data, 2 + count * cmd_length);
+}
+
+/* what the chain must answer: every packet executed on its own, the responses concatenated */
+static uint32_t expected_answer(const stream_t *s, uint8_t *answer)
+{
+	uint8_t request[PACKET_MAX], response[PACKET_MAX];
+	uint32_t length = 2, count = 0, ret;
+
+	for (uint32_t i = 0; i < s->num; i++) {
+		memcpy(request, s->packets[i].data, s->packets[i].length);
+		if (request[0] == ID_DAP_QueueCommands)
+			request[0] = ID_DAP_ExecuteCommands;
+		ret = dap_engine_execute(request, response, s->packet_size, DAP_PIPELINE_DEPTH) & 0xFFFF;
+		if (response[0] == ID_DAP_ExecuteCommands) {
+			count += response[1];
+			memcpy(answer + length, response + 2, ret - 2);
+			length += ret - 2;
+		} else {
+			count++;
+			memcpy(answer + length, response, ret);
+			length += ret;
+		}
+	}
+	answer[0] = ID_DAP_ExecuteCommands;
+	answer[1] = count;
+	return length;
+}
+
+static int check(const stream_t *s)
+{
+	static uint8_t request[PACKET_MAX], response[PACKET_MAX], answer[PACKET_MAX];
+	uint32_t length = 0, expected_length = 0;
+	int errors = 0;
+
+	if (!s->overflow)
+		expected_length = expected_answer(s, answer);
+
+	for (uint32_t i = 0; i < s->num; i++) {
+		memcpy(request, s->packets[i].data, s->packets[i].length);
+		length = dap_engine_execute_chain(&chain, request, response, s->packet_size, DAP_PIPELINE_DEPTH);
+		if (i + 1 < s->num && length != 0) {
+			printf("  queued packet %u answered with %u bytes\n", i, length);
+			errors++;
+		}
+	}
+
+	if (s->overflow) {
+		if (length != 1 || response[0] != ID_DAP_Invalid) {
+			printf("  overflow answered with %u bytes, %02x\n", length, response[0]);
+			errors++;
+		}
+	} else if (length != expected_length || memcmp(response, answer, length) != 0) {
+		printf("  answer of %u bytes, %u commands, expected %u bytes, %u commands\n", length,
+		       response[1], expected_length, answer[1]);
+		errors++;
+	}
+	if (chain.length != 0 || chain.count != 0 || chain.overflow != 0) {
+		printf("  chain state left: %u bytes, %u commands, overflow %u\n", chain.length,
+		       chain.count, chain.overflow);
+		errors++;
+	}
+
+	printf("%-28s %s\n", s->name, errors ? "FAIL" : "ok");
+	return errors;
+}
+
+/* a packet outside of a chain is answered as is, not wrapped */
+static int check_single(const uint8_t *cmd, uint32_t cmd_length)
+{
+	uint8_t request[PACKET_MAX], response[PACKET_MAX];
+	uint32_t length;
+	int errors = 0;
+
+	memcpy(request, cmd, cmd_length);
+	length = dap_engine_execute_chain(&chain, request, response, 512, DAP_PIPELINE_DEPTH);
+	if (length == 0 || response[0] != cmd[0]) {
+		printf("  answered with %u bytes, %02x\n", length, response[0]);
+		errors++;
+	}
+	printf("%-28s %s\n", "single packet", errors ? "FAIL" : "ok");
+	return errors;
+}
+
+/* DAP_Info packet count, as the caller reports it */
+static int check_packet_count(uint32_t packet_count)
+{
+	uint8_t request[] = { ID_DAP_Info, 0xFE }, response[PACKET_MAX];
+	uint32_t length;
+	int errors = 0;
+
+	length = dap_engine_execute_chain(&chain, request, response, 512, packet_count);
+	if (length != 3 || response[1] != 1 || response[2] != packet_count) {
+		printf("  packet count %u reported as %u\n", packet_count, response[2]);
+		errors++;
+	}
+	printf("%-28s %s\n", "packet count", errors ? "FAIL" : "ok");
+	return errors;
+}
+
+static uint8_t sent[PACKET_MAX];
+static uint32_t sent_length;
+
+static int capture_send(void *ctx, const uint8_t *data, uint32_t len)
+{
+	(void)ctx;
+	if (sent_length + len <= sizeof(sent)) {
+		memcpy(sent + sent_length, data, len);
+		sent_length += len;
+	}
+	return len;
+}
+
+static const dap_transport_t capture_transport = {
+	.name = "capture",
+	.packet_size = 512,
+	.send = capture_send,
+};
+
+/* an open chain is answered by dap_pipeline_drain, in order after what was sent before */
+static int check_drain(const stream_t *s)
+{
+	static uint8_t answer[PACKET_MAX];
+	dap_pipeline_t *pl;
+	uint32_t expected_length;
+	int errors = 0;
+
+	expected_length = expected_answer(s, answer);
+	sent_length = 0;
+	pl = dap_pipeline_create(&capture_transport, NULL);
+	if (pl == NULL) {
+		printf("  no pipeline\n");
+		return 1;
+	}
+	for (uint32_t i = 0; i < s->num; i++)
+		dap_pipeline_submit(pl, s->packets[i].data, s->packets[i].length);
+	dap_pipeline_drain(pl);
+	if (sent_length != expected_length || memcmp(sent, answer, sent_length) != 0) {
+		printf("  drain sent %u bytes, %u commands, expected %u bytes, %u commands\n", sent_length,
+		       sent_length > 1 ? sent[1] : 0, expected_length, answer[1]);
+		errors++;
+	}
+	dap_pipeline_destroy(pl);
+
+	printf("%-28s %s\n", s->name, errors ? "FAIL" : "ok");
+	return errors;
+}
+
+int main(void)
+{
+	static const uint8_t info_version[] = { ID_DAP_Info, 0x04 };
+	static const uint8_t info_count[] = { ID_DAP_Info, 0xFE };
+	static const uint8_t host_status[] = { ID_DAP_HostStatus, 0x00, 0x00 };
+	static const uint8_t execute[] = { ID_DAP_ExecuteCommands, 0x02, ID_DAP_Info, 0xFF,
+					   ID_DAP_HostStatus, 0x01, 0x00 };
+	static stream_t s;
+	int errors = 0;
+
+	DAP_Setup();
+	if (dap_session_init() != 0) {
+		fprintf(stderr, "dap_session_init failed\n");
+		return 1;
+	}
+
+	errors += check_single(info_version, sizeof(info_version));
+	errors += check_packet_count(DAP_PIPELINE_DEPTH);
+
+	memset(&s, 0, sizeof(s));
+	s.name = "3 queued, DAP_Info ends";
+	s.packet_size = 512;
+	add_queued(&s, info_count, sizeof(info_count), 1);
+	add_queued(&s, host_status, sizeof(host_status), 1);
+	add_queued(&s, info_version, sizeof(info_version), 1);
+	add(&s, info_version, sizeof(info_version));
+	errors += check(&s);
+
+	memset(&s, 0, sizeof(s));
+	s.name = "queued batches";
+	s.packet_size = 512;
+	add_queued(&s, host_status, sizeof(host_status), 5);
+	add_queued(&s, info_count, sizeof(info_count), 3);
+	add(&s, host_status, sizeof(host_status));
+	errors += check(&s);
+
+	memset(&s, 0, sizeof(s));
+	s.name = "ExecuteCommands ends";
+	s.packet_size = 512;
+	add_queued(&s, info_version, sizeof(info_version), 2);
+	add(&s, execute, sizeof(execute));
+	errors += check(&s);
+
+	memset(&s, 0, sizeof(s));
+	s.name = "fills the packet exactly";
+	s.packet_size = 64;
+	/* DAP_HostStatus answers 2 bytes: 2 + 31 * 2 = 64 */
+	add_queued(&s, host_status, sizeof(host_status), 20);
+	add_queued(&s, host_status, sizeof(host_status), 10);
+	add(&s, host_status, sizeof(host_status));
+	errors += check(&s);
+
+	memset(&s, 0, sizeof(s));
+	s.name = "one response too many";
+	s.packet_size = 64;
+	s.overflow = 1;
+	add_queued(&s, host_status, sizeof(host_status), 20);
+	add_queued(&s, host_status, sizeof(host_status), 11);
+	add(&s, host_status, sizeof(host_status));
+	errors += check(&s);
+
+	memset(&s, 0, sizeof(s));
+	s.name = "more than 255 commands";
+	s.packet_size = 1024;
+	s.overflow = 1;
+	for (int i = 0; i < 4; i++)
+		add_queued(&s, host_status, sizeof(host_status), 64);
+	add(&s, host_status, sizeof(host_status));
+	errors += check(&s);
+
+	/* the chain state is clean after an overflow */
+	memset(&s, 0, sizeof(s));
+	s.name = "chain after an overflow";
+	s.packet_size = 512;
+	add_queued(&s, info_count, sizeof(info_count), 1);
+	add(&s, info_count, sizeof(info_count));
+	errors += check(&s);
+
+	memset(&s, 0, sizeof(s));
+	s.name = "chain ended by a drain";
+	s.packet_size = 512;
+	add_queued(&s, info_count, sizeof(info_count), 2);
+	add_queued(&s, host_status, sizeof(host_status), 3);
+	errors += check_drain(&s);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""
+Multi-client stress test for the DAP proxy.
+
+Opens several elaphureLink connections at once and has every client send
+DAP_Info and DAP_ExecuteCommands batches in a loop. Every response is checked
+against the request that produced it, so a reply that leaked into another
+session, or a batch interleaved with another client, is reported.
+
+usage: dap_multi_client.py host [-p 3240] [-c 3] [-n 1000]
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import threading
+import time
+
+EL_LINK_IDENTIFIER = 0x8A656C70
+EL_COMMAND_HANDSHAKE = 0x00000000
+EL_PROXY_VERSION = 0x00000001
+
+ID_DAP_INFO = 0x00
+ID_DAP_EXECUTE_COMMANDS = 0x7F
+
+# DAP_Info IDs with a fixed answer for the lifetime of the probe
+INFO_IDS = [0x04, 0xF0, 0xFE, 0xFF]
+
+
+def recv_response(sock):
+    # elaphureLink has no length field, a response is expected to arrive in one segment
+    sock.settimeout(3)
+    data = sock.recv(1500)
+    if not data:
+        raise ConnectionError("connection closed")
+    return data
+
+
+def client(index, args, results):
+    sock = socket.create_connection((args.host, args.port), timeout=3)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    sock.sendall(struct.pack(">III", EL_LINK_IDENTIFIER, EL_COMMAND_HANDSHAKE, EL_PROXY_VERSION))
+    res = recv_response(sock)
+    if len(res) != 12 or struct.unpack(">I", res[:4])[0] != EL_LINK_IDENTIFIER:
+        raise RuntimeError("client %d: handshake failed" % index)
+
+    expected = {}
+    errors = 0
+    latency = []
+
+    for i in range(args.count):
+        info_id = INFO_IDS[(i + index) % len(INFO_IDS)]
+        if i % 2:
+            # two DAP_Info commands in one batch, must come back in one piece
+            req = bytes([ID_DAP_EXECUTE_COMMANDS, 2, ID_DAP_INFO, info_id, ID_DAP_INFO, info_id])
+        else:
+            req = bytes([ID_DAP_INFO, info_id])
+
+        start = time.monotonic()
+        sock.sendall(req)
+        res = recv_response(sock)
+        latency.append(time.monotonic() - start)
+
+        if i % 2:
+            if res[0] != ID_DAP_EXECUTE_COMMANDS or res[1] != 2:
+                errors += 1
+                continue
+            half = (len(res) - 2) // 2
+            first, second = res[2:2 + half], res[2 + half:]
+            if first != second or first[0] != ID_DAP_INFO:
+                errors += 1
+                continue
+            res = first
+        elif res[0] != ID_DAP_INFO:
+            errors += 1
+            continue
+
+        # every answer to the same info id must be identical
+        if expected.setdefault(info_id, res) != res:
+            errors += 1
+
+    sock.close()
+    latency.sort()
+    results[index] = (errors, latency)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("-p", "--port", type=int, default=3240)
+    parser.add_argument("-c", "--clients", type=int, default=3)
+    parser.add_argument("-n", "--count", type=int, default=1000, help="commands per client")
+    args = parser.parse_args()
+
+    results = {}
+    failures = []
+
+    def run(index):
+        try:
+            client(index, args, results)
+        except Exception as e:  # report, keep the other clients running
+            failures.append("client %d: %s" % (index, e))
+
+    threads = [threading.Thread(target=run, args=(i,)) for i in range(args.clients)]
+    start = time.monotonic()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.monotonic() - start
+
+    for msg in failures:
+        print(msg, file=sys.stderr)
+
+    total = 0
+    for index in sorted(results):
+        errors, latency = results[index]
+        total += errors
+        print("client %d: %d commands, %d mismatches, p50 %.2f ms, p99 %.2f ms, max %.2f ms" % (
+            index, len(latency), errors, latency[len(latency) // 2] * 1e3,
+            latency[len(latency) * 99 // 100] * 1e3, latency[-1] * 1e3))
+    print("%d clients, %.1f commands/s" % (len(results), sum(len(r[1]) for r in results.values()) / elapsed))
+
+    return 1 if failures or total else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,389 @@
+/*
+ * Replay benchmark of the DAP core on the host.
+ *
+ * DAP.c, SW_DP.c and JTAG_DP.c are built for Linux (see host/DAP_config.h) with the
+ * wire served by swd_sim.c, and a DAP command stream is pushed through
+ * DAP_ExecuteCommand as the network task does. Reports commands/s, bytes/s and the
+ * latency histogram of every command ID, plus the SWD transfers the target model saw.
+ *
+ * Without a file, a pyOCD-like flash session is generated: connect, line reset,
+ * power-up, then the 16 KiB of simulated RAM are written with DAP_TransferBlock and
+ * read back with DAP_TransferBlock and DAP_Transfer. The read back data is checked,
+ * a mismatch fails the run. -o writes this session out in the file format below.
+ *
+ * Stream file: one DAP request per line as hex bytes, spaces and ':' are ignored, '#'
+ * starts a comment. That is what `tshark -T fields -e usb.capdata` gives for the OUT
+ * endpoint of a recorded OpenOCD/pyOCD session. DAP_QueueCommands runs like
+ * DAP_ExecuteCommands and its response is dropped, as DAP_handle.c does.
+ *
+ * build: cc -O2 -g -DUSE_SWD_SIM=1 -DUSE_ASSEMBLY=0 -DUSE_DAP_STATS=1 -Ihost -I.. -I../components/DAP -o dap_replay_bench \
+ *        dap_replay_bench.c host/dap_host.c ../components/DAP/cmsis-dap/source/{DAP,SW_DP,JTAG_DP,DAP_vendor,swd_sim,dap_utility,dap_stats,dap_trace}.c
+ *        or: cmake -S host -B build && cmake --build build
+ *        (-fsanitize=address,undefined also needs -fno-sanitize=shift, CMSIS-DAP assembles
+ *        words from int shifts)
+ * usage: dap_replay_bench [-n rounds] [-w wait_interval] [-s packet_size] [-o out_file] [stream_file]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "DAP_config.h"
+#include "cmsis-dap/include/DAP.h"
+#include "cmsis-dap/include/dap_stats.h"
+#include "cmsis-dap/include/swd_sim.h"
+
+#define PACKET_MAX 4096
+
+typedef struct {
+	uint8_t *data;
+	size_t len, size;
+	uint32_t count;
+} stream_t;
+
+static uint32_t packet_size = DAP_PACKET_SIZE;
+static uint32_t shadow[SWD_SIM_RAM_SIZE / 4]; /* what the session wrote to the target */
+
+/* each request: 16-bit length, then the bytes */
+static void put_request(stream_t *s, const uint8_t *req, size_t len)
+{
+	if (s->len + len + 2 > s->size) {
+		s->size = (s->len + len + 2) * 2;
+		s->data = realloc(s->data, s->size);
+	}
+	s->data[s->len++] = len;
+	s->data[s->len++] = len >> 8;
+	memcpy(s->data + s->len, req, len);
+	s->len += len;
+	s->count++;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+	*p++ = v;
+	*p++ = v >> 8;
+	*p++ = v >> 16;
+	*p++ = v >> 24;
+	return p;
+}
+
+#define REQ(...) do { \
+	static const uint8_t r[] = { __VA_ARGS__ }; \
+	put_request(s, r, sizeof(r)); \
+} while (0)
+
+static void dp_ap_write(stream_t *s, uint8_t request, uint32_t value)
+{
+	uint8_t r[8] = { ID_DAP_Transfer, 0, 1, request };
+
+	put32(&r[4], value);
+	put_request(s, r, sizeof(r));
+}
+
+static void generate(stream_t *s, int rounds)
+{
+	uint8_t r[PACKET_MAX], *p;
+	/* the TAR auto increment only covers 1 KiB, blocks do not cross that */
+	uint32_t block = (packet_size - 5) / 4 < 256 ? (packet_size - 5) / 4 : 256;
+
+	REQ(ID_DAP_Info, DAP_ID_PACKET_COUNT);
+	REQ(ID_DAP_Info, DAP_ID_PACKET_SIZE);
+	REQ(ID_DAP_Connect, DAP_PORT_SWD);
+	REQ(ID_DAP_SWJ_Clock, 0x80, 0x96, 0x98, 0x00);               /* 10 MHz */
+	REQ(ID_DAP_TransferConfigure, 0, 64, 0, 0, 0);
+	REQ(ID_DAP_SWJ_Sequence, 56, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF);
+	REQ(ID_DAP_SWJ_Sequence, 16, 0x9E, 0xE7);                    /* JTAG to SWD */
+	REQ(ID_DAP_SWJ_Sequence, 56, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF);
+	REQ(ID_DAP_SWJ_Sequence, 8, 0x00);
+	REQ(ID_DAP_Transfer, 0, 1, 0x02);                             /* IDCODE */
+	dp_ap_write(s, 0x00, 0x1E);                                   /* ABORT */
+	dp_ap_write(s, 0x08, 0x00);                                   /* SELECT */
+	REQ(ID_DAP_Transfer, 0, 2, 0x04, 0x00, 0x00, 0x00, 0x50, 0x06); /* power-up, CTRL/STAT */
+	REQ(ID_DAP_Transfer, 0, 3, 0x08, 0xF0, 0, 0, 0, 0x0F, 0x08, 0, 0, 0, 0); /* AP IDR */
+	dp_ap_write(s, 0x01, 0x23000012);                             /* CSW: 32-bit, auto increment */
+
+	for (int round = 0; round < rounds; round++) {
+		/* write */
+		for (uint32_t addr = 0; addr < SWD_SIM_RAM_SIZE;) {
+			uint32_t words = (1024 - addr % 1024) / 4;
+
+			if (words > block)
+				words = block;
+			dp_ap_write(s, 0x05, SWD_SIM_RAM_BASE + addr);
+			p = r;
+			*p++ = ID_DAP_TransferBlock;
+			*p++ = 0;
+			*p++ = words;
+			*p++ = words >> 8;
+			*p++ = 0x0D;
+			for (uint32_t i = 0; i < words; i++)
+				p = put32(p, (uint32_t)round * 0x9E3779B9u ^ ((addr / 4 + i) * 0x01000193u));
+			put_request(s, r, p - r);
+			addr += words * 4;
+		}
+
+		/* verify: blocks for the first half, single DRW reads for the second */
+		for (uint32_t addr = 0; addr < SWD_SIM_RAM_SIZE / 2;) {
+			uint32_t words = (1024 - addr % 1024) / 4;
+
+			if (words > block)
+				words = block;
+			dp_ap_write(s, 0x05, SWD_SIM_RAM_BASE + addr);
+			p = r;
+			*p++ = ID_DAP_TransferBlock;
+			*p++ = 0;
+			*p++ = words;
+			*p++ = words >> 8;
+			*p++ = 0x0F;
+			put_request(s, r, p - r);
+			addr += words * 4;
+		}
+		for (uint32_t addr = SWD_SIM_RAM_SIZE / 2; addr < SWD_SIM_RAM_SIZE; addr += 64) {
+			p = r;
+			*p++ = ID_DAP_Transfer;
+			*p++ = 0;
+			*p++ = 1 + 16;
+			*p++ = 0x05;
+			p = put32(p, SWD_SIM_RAM_BASE + addr);
+			memset(p, 0x0F, 16);
+			p += 16;
+			put_request(s, r, p - r);
+		}
+	}
+	REQ(ID_DAP_Disconnect);
+}
+
+static int load(stream_t *s, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[3 * PACKET_MAX];
+	uint8_t r[PACKET_MAX];
+
+	if (f == NULL) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		size_t n = 0;
+		int hi = -1;
+
+		for (char *c = line; *c && *c != '#' && n < sizeof(r); c++) {
+			int v;
+
+			if (*c >= '0' && *c <= '9')
+				v = *c - '0';
+			else if ((*c | 0x20) >= 'a' && (*c | 0x20) <= 'f')
+				v = (*c | 0x20) - 'a' + 10;
+			else
+				continue;
+			if (hi < 0) {
+				hi = v;
+			} else {
+				r[n++] = hi << 4 | v;
+				hi = -1;
+			}
+		}
+		if (n)
+			put_request(s, r, n);
+	}
+	fclose(f);
+	return 0;
+}
+
+static int dump(const stream_t *s, const char *path)
+{
+	FILE *f = fopen(path, "w");
+
+	if (f == NULL) {
+		perror(path);
+		return -1;
+	}
+	for (size_t pos = 0; pos < s->len;) {
+		size_t len = s->data[pos] | s->data[pos + 1] << 8;
+
+		pos += 2;
+		for (size_t i = 0; i < len; i++)
+			fprintf(f, "%02x", s->data[pos + i]);
+		fputc('\n', f);
+		pos += len;
+	}
+	return fclose(f);
+}
+
+/* read responses of the generated session have to return what it wrote */
+static int check(const uint8_t *req, const uint8_t *res, uint32_t *tar)
+{
+	uint32_t words, count;
+	const uint8_t *data;
+
+	if (req[0] == ID_DAP_Transfer && req[2] == 1 && req[3] == 0x05) {
+		*tar = req[4] | req[5] << 8 | req[6] << 16 | (uint32_t)req[7] << 24;
+		return 0;
+	}
+	if (req[0] == ID_DAP_TransferBlock && req[4] == 0x0D) {
+		words = req[2] | req[3] << 8;
+		memcpy(&shadow[(*tar - SWD_SIM_RAM_BASE) / 4], &req[5], words * 4);
+		*tar += words * 4;
+		return 0;
+	}
+	if (req[0] == ID_DAP_TransferBlock && req[4] == 0x0F) {
+		/* ID, 16-bit count, ack, data */
+		words = req[2] | req[3] << 8;
+		count = res[1] | res[2] << 8;
+		if (res[3] != DAP_TRANSFER_OK)
+			return -1;
+		data = &res[4];
+	} else if (req[0] == ID_DAP_Transfer && req[2] == 17 && req[3] == 0x05) {
+		/* ID, 8-bit count, ack, data of the reads */
+		*tar = req[4] | req[5] << 8 | req[6] << 16 | (uint32_t)req[7] << 24;
+		words = 16;
+		count = res[1] - 1;
+		if (res[2] != DAP_TRANSFER_OK)
+			return -1;
+		data = &res[3];
+	} else {
+		return 0;
+	}
+
+	if (count != words)
+		return -1;
+	for (uint32_t i = 0; i < words; i++) {
+		const uint8_t *d = &data[4 * i];
+		uint32_t v = d[0] | d[1] << 8 | d[2] << 16 | (uint32_t)d[3] << 24;
+
+		if (v != shadow[(*tar - SWD_SIM_RAM_BASE) / 4 + i])
+			return -1;
+	}
+	*tar += words * 4;
+	return 0;
+}
+
+static const char *command_name(uint32_t id)
+{
+	static const char *names[DAP_STATS_CMD_NUM] = {
+		[ID_DAP_Info] = "Info", [ID_DAP_HostStatus] = "HostStatus", [ID_DAP_Connect] = "Connect",
+		[ID_DAP_Disconnect] = "Disconnect", [ID_DAP_TransferConfigure] = "TransferConfigure",
+		[ID_DAP_Transfer] = "Transfer", [ID_DAP_TransferBlock] = "TransferBlock",
+		[ID_DAP_TransferAbort] = "TransferAbort", [ID_DAP_WriteABORT] = "WriteABORT",
+		[ID_DAP_Delay] = "Delay", [ID_DAP_ResetTarget] = "ResetTarget", [ID_DAP_SWJ_Pins] = "SWJ_Pins",
+		[ID_DAP_SWJ_Clock] = "SWJ_Clock", [ID_DAP_SWJ_Sequence] = "SWJ_Sequence",
+		[ID_DAP_SWD_Configure] = "SWD_Configure", [ID_DAP_SWD_Sequence] = "SWD_Sequence",
+		[ID_DAP_JTAG_Sequence] = "JTAG_Sequence", [ID_DAP_JTAG_Configure] = "JTAG_Configure",
+		[ID_DAP_JTAG_IDCODE] = "JTAG_IDCODE", [0x20] = "other",
+	};
+
+	return names[id] ? names[id] : "?";
+}
+
+/* upper bound of the bucket holding the q-th value */
+static uint32_t percentile(const dap_stats_hist_t *h, double q)
+{
+	uint32_t want = h->count * q, seen = 0;
+
+	for (uint32_t b = 0; b < DAP_STATS_BUCKETS; b++) {
+		seen += h->hist[b];
+		if (seen > want)
+			return b + 1 < DAP_STATS_BUCKETS && (2u << b) < h->max ? 2u << b : h->max;
+	}
+	return h->max;
+}
+
+int main(int argc, char **argv)
+{
+	static uint8_t request[PACKET_MAX], response[PACKET_MAX];
+	static dap_stats_t stats;
+	const char *out = NULL;
+	stream_t s = { 0 };
+	swd_sim_stats_t wire;
+	uint64_t start, elapsed, req_bytes = 0, res_bytes = 0;
+	uint32_t tar = 0;
+	int rounds = 64, wait = 0, opt, errors = 0;
+
+	while ((opt = getopt(argc, argv, "n:w:s:o:")) != -1) {
+		switch (opt) {
+		case 'n':
+			rounds = atoi(optarg);
+			break;
+		case 'w':
+			wait = atoi(optarg);
+			break;
+		case 's':
+			packet_size = atoi(optarg);
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n rounds] [-w wait_interval] [-s packet_size] [-o out_file] [stream_file]\n",
+			        argv[0]);
+			return 2;
+		}
+	}
+	if (packet_size < 64 || packet_size > PACKET_MAX) {
+		fprintf(stderr, "packet size 64..%d\n", PACKET_MAX);
+		return 2;
+	}
+
+	if (optind < argc) {
+		if (load(&s, argv[optind]) != 0)
+			return 2;
+	} else {
+		generate(&s, rounds);
+	}
+	if (out)
+		return dump(&s, out) != 0;
+
+	DAP_Setup();
+	DAP_SetPacketSize(packet_size);
+	SWD_Sim_SetWaitInterval(wait);
+	DAP_Stats_Reset();
+
+	start = host_time_ns();
+	for (size_t pos = 0; pos < s.len;) {
+		size_t len = s.data[pos] | s.data[pos + 1] << 8;
+		uint32_t num;
+
+		pos += 2;
+		memset(request + len, 0, packet_size > len ? packet_size - len : 0);
+		memcpy(request, s.data + pos, len);
+		pos += len;
+		req_bytes += len;
+
+		if (request[0] == ID_DAP_QueueCommands) {
+			request[0] = ID_DAP_ExecuteCommands;
+			DAP_ExecuteCommand(request, response);
+			continue;
+		}
+		num = DAP_ExecuteCommand(request, response);
+		res_bytes += (uint16_t)num;
+		if (optind >= argc && check(request, response, &tar) != 0) {
+			if (errors++ < 10)
+				printf("read back mismatch, request %02x at 0x%08x\n", request[0], tar);
+		}
+	}
+	elapsed = host_time_ns() - start;
+
+	DAP_Stats_Snapshot(&stats);
+	SWD_Sim_GetStats(&wire);
+
+	printf("%u requests in %.3f ms: %.0f requests/s, %.1f MB/s requests, %.1f MB/s responses\n",
+	       s.count, elapsed / 1e6, s.count / (elapsed / 1e9), req_bytes / (elapsed / 1e3),
+	       res_bytes / (elapsed / 1e3));
+	printf("wire: %u SWD transfers, %u WAIT, %u FAULT, %.1f ns per transfer\n", wire.transfers, wire.waits,
+	       wire.faults, wire.transfers ? (double)elapsed / wire.transfers : 0.0);
+	printf("%-18s %8s %10s %10s %10s %10s\n", "command", "count", "avg ns", "p50 ns", "p99 ns", "max ns");
+	for (uint32_t id = 0; id < DAP_STATS_CMD_NUM; id++) {
+		const dap_stats_hist_t *h = &stats.cmd[id];
+
+		if (h->count == 0)
+			continue;
+		printf("%-18s %8u %10u %10u %10u %10u\n", command_name(id), h->count, h->total / h->count,
+		       percentile(h, 0.5), percentile(h, 0.99), h->max);
+	}
+	if (errors)
+		printf("%d read back errors\n", errors);
+	free(s.data);
+	return errors != 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Wire trace of the DAP core (dap_trace.c), on the host.
+ *
+ * The DAP core is built with USE_DAP_TRACE 1 and the wire served by swd_sim.c. SWD
+ * transfers and a line reset must leave one record each, nothing while recording is
+ * off, and DAP_Trace_Clear must drop what was recorded. Once the ring has wrapped,
+ * DAP_Trace_Read must start after the oldest record, whose slot the next record would
+ * take. Last, a writer thread
+ * records a counter while the main thread reads the ring behind it: every record
+ * returned must be the one of its sequence number, none half overwritten.
+ *
+ * build: cmake -S host -B build && cmake --build build
+ * usage: dap_trace_test
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "DAP_config.h"
+#include "cmsis-dap/include/DAP.h"
+#include "cmsis-dap/include/dap_trace.h"
+#include "cmsis-dap/include/swd_sim.h"
+
+#define DP_R_IDCODE   0x02U
+#define DP_W_SELECT   0x08U
+
+#define RACE_RECORDS  (16U * DAP_TRACE_RECORD_NUM)
+
+static volatile int writer_stop;
+
+static uint32_t trace_read_all(uint32_t *seq, dap_trace_record_t *buf)
+{
+	return DAP_Trace_Read(seq, buf, DAP_TRACE_RECORD_NUM);
+}
+
+static int check_transfers(void)
+{
+	static dap_trace_record_t buf[DAP_TRACE_RECORD_NUM];
+	static const uint8_t line_reset[7] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x03 };
+	uint32_t seq = 0, val, n;
+	int errors = 0;
+
+	DAP_Trace_Clear();
+	DAP_Trace_Enable(1);
+	SWJ_Sequence(51, line_reset);
+	SWD_Transfer(DP_R_IDCODE, &val);
+	val = 0xF0U;
+	SWD_Transfer(DP_W_SELECT, &val);
+	DAP_Trace_Enable(0);
+	SWD_Transfer(DP_R_IDCODE, &val);
+
+	n = trace_read_all(&seq, buf);
+	if (n != 3 || buf[0].type != DAP_TRACE_SWJ_SEQUENCE || buf[0].request != 51 ||
+	    buf[0].data != 0xFFFFFFFFU ||
+	    buf[1].type != DAP_TRACE_SWD_TRANSFER || buf[1].request != DP_R_IDCODE ||
+	    buf[1].ack != DAP_TRANSFER_OK || buf[1].data != SWD_SIM_IDCODE ||
+	    buf[2].type != DAP_TRACE_SWD_TRANSFER || buf[2].request != DP_W_SELECT ||
+	    buf[2].data != 0xF0U) {
+		printf("  %u records, first type %u\n", n, n ? buf[0].type : 0U);
+		errors++;
+	}
+
+	DAP_Trace_Clear();
+	seq = 0;
+	if (trace_read_all(&seq, buf) != 0) {
+		printf("  records left after clear\n");
+		errors++;
+	}
+	printf("%-18s %s\n", "transfers", errors ? "FAIL" : "ok");
+	return errors;
+}
+
+static int check_wrap(void)
+{
+	static dap_trace_record_t buf[DAP_TRACE_RECORD_NUM];
+	dap_trace_status_t status;
+	uint32_t seq = 0, n, i;
+	int errors = 0;
+
+	DAP_Trace_Clear();
+	DAP_Trace_GetStatus(&status);
+	DAP_Trace_Enable(1);
+	for (i = 0; i < DAP_TRACE_RECORD_NUM + DAP_TRACE_RECORD_NUM / 2; i++)
+		DAP_Trace_Record(DAP_TRACE_SWD_TRANSFER, 0, DAP_TRANSFER_OK, i);
+	DAP_Trace_Enable(0);
+
+	n = trace_read_all(&seq, buf);
+	if (n != DAP_TRACE_RECORD_NUM - 1 || seq != status.head + DAP_TRACE_RECORD_NUM / 2 + 1 ||
+	    buf[0].data != DAP_TRACE_RECORD_NUM / 2 + 1 || buf[n - 1].data != i - 1) {
+		printf("  %u records from seq %u, first %u\n", n, seq - status.head, buf[0].data);
+		errors++;
+	}
+	printf("%-18s %s\n", "wrap", errors ? "FAIL" : "ok");
+	return errors;
+}
+
+static void *writer(void *arg)
+{
+	(void)arg;
+	for (uint32_t i = 0; !writer_stop; i++)
+		DAP_Trace_Record(DAP_TRACE_SWD_TRANSFER, (uint8_t)i, (uint8_t)(i >> 8), i);
+	return NULL;
+}
+
+// the records of the writer carry their own number, base is the head when it started
+static int check_race(void)
+{
+	static dap_trace_record_t buf[64];
+	dap_trace_status_t status;
+	pthread_t thread;
+	uint32_t seq, n, i, reads = 0, copied = 0, skipped = 0;
+	int errors = 0;
+
+	DAP_Trace_Clear();
+	DAP_Trace_GetStatus(&status);
+	seq = status.head;
+	writer_stop = 0;
+	DAP_Trace_Enable(1);
+	pthread_create(&thread, NULL, writer, NULL);
+
+	while (copied < RACE_RECORDS && errors < 10) {
+		uint32_t want = seq;
+
+		n = DAP_Trace_Read(&seq, buf, sizeof(buf) / sizeof(buf[0]));
+		reads++;
+		if (seq != want)
+			skipped++;
+		for (i = 0; i < n; i++) {
+			uint32_t id = seq + i - status.head;
+
+			if (buf[i].data != id || buf[i].request != (uint8_t)id || buf[i].ack != (uint8_t)(id >> 8)) {
+				printf("  seq %u holds record %u\n", id, buf[i].data);
+				errors++;
+				break;
+			}
+		}
+		copied += n;
+		seq += n;
+		if (n == 0)
+			sched_yield(); // caught up, let the writer run
+	}
+	writer_stop = 1;
+	pthread_join(thread, NULL);
+	DAP_Trace_Enable(0);
+
+	printf("%-18s %s: %u reads, %u records, %u times behind the writer\n", "read while writing",
+	       errors ? "FAIL" : "ok", reads, copied, skipped);
+	return errors;
+}
+
+int main(void)
+{
+	int errors = 0;
+
+	DAP_Setup();
+	SWD_Sim_Reset();
+
+	errors += check_transfers();
+	errors += check_wrap();
+	errors += check_race();
+
+	return errors ? 1 : 0;
+}
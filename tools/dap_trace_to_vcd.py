@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""
+Convert a DAP wire trace (GET /dap_trace) into a VCD file.
+
+The trace is recorded by components/DAP/cmsis-dap/source/dap_trace.c when
+USE_DAP_TRACE is enabled. Every record becomes a value change of the
+`type`, `request`, `ack`, `index` and `data` buses at its timestamp, which
+can be viewed with GTKWave or imported into sigrok/PulseView.
+
+usage: dap_trace_to_vcd.py dap_trace.bin [-o dap_trace.vcd]
+"""
+
+import argparse
+import struct
+import sys
+
+HDR_FMT = "<IBBHIIII"
+HDR_SIZE = struct.calcsize(HDR_FMT)
+REC_FMT = "<IBBBBI"
+MAGIC = 0x43525444
+VERSION = 1
+
+TYPES = {1: "SWD_TRANSFER", 2: "SWJ_SEQUENCE", 3: "JTAG_TRANSFER", 4: "JTAG_IR"}
+
+# (id, name, width)
+SIGNALS = [
+    ("!", "type", 8),
+    ("#", "request", 8),
+    ("$", "ack", 3),
+    ("%", "index", 8),
+    ("&", "data", 32),
+]
+
+
+def read_trace(f):
+    raw = f.read()
+    if len(raw) < HDR_SIZE:
+        raise ValueError("file too short")
+
+    magic, version, rec_size, _, clock, first_seq, count, lost = struct.unpack_from(HDR_FMT, raw)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a DAP trace file (magic %08x version %d)" % (magic, version))
+
+    body = raw[HDR_SIZE:]
+    # the recorder may have dropped records during the download, trust the file length
+    n = len(body) // rec_size
+    if n != count:
+        print("warning: header announces %d records, file has %d" % (count, n), file=sys.stderr)
+    if lost:
+        print("warning: %d records were overwritten before the download" % lost, file=sys.stderr)
+
+    records = [struct.unpack_from(REC_FMT, body, i * rec_size) for i in range(n)]
+    return clock, first_seq, records
+
+
+def write_vcd(out, clock, records):
+    ns_per_tick = 1e9 / clock if clock else 1
+
+    out.write("$comment DAP wire trace, %d records $end\n" % len(records))
+    out.write("$timescale 1 ns $end\n")
+    out.write("$scope module dap $end\n")
+    for ident, name, width in SIGNALS:
+        out.write("$var wire %d %s %s $end\n" % (width, ident, name))
+    out.write("$upscope $end\n$enddefinitions $end\n")
+
+    last_time = -1
+    wrap = 0
+    prev_ts = None
+    for ts, rtype, request, ack, index, data in records:
+        # 32 bit timestamp counter, unwrap
+        if prev_ts is not None and ts < prev_ts:
+            wrap += 1 << 32
+        prev_ts = ts
+
+        time = int((ts + wrap) * ns_per_tick)
+        if time <= last_time:
+            time = last_time + 1  # several events within one timer tick
+        last_time = time
+
+        out.write("#%d\n" % time)
+        for (ident, _, width), value in zip(SIGNALS, (rtype, request, ack, index, data)):
+            out.write("b%s %s\n" % (format(value, "0%db" % width), ident))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("trace", help="file downloaded from GET /dap_trace")
+    parser.add_argument("-o", "--output", help="output VCD file (default: stdout)")
+    args = parser.parse_args()
+
+    with open(args.trace, "rb") as f:
+        clock, first_seq, records = read_trace(f)
+
+    counts = {}
+    for rec in records:
+        name = TYPES.get(rec[1], "UNKNOWN")
+        counts[name] = counts.get(name, 0) + 1
+    print("first seq %d, %s" % (first_seq, ", ".join("%s: %d" % kv for kv in sorted(counts.items()))),
+          file=sys.stderr)
+
+    if args.output:
+        with open(args.output, "w") as out:
+            write_vcd(out, clock, records)
+    else:
+        write_vcd(sys.stdout, clock, records)
+
+
+if __name__ == "__main__":
+    main()
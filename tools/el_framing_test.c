@@ -0,0 +1,106 @@
+/*
+ * elaphureLink request framing, on the host.
+ *
+ * elaphureLink has no length field: el_dap_request_length of elaphureLink_protocol.c
+ * derives the length of every request from the DAP command itself. A recorded stream
+ * of requests, alone and in DAP_ExecuteCommands / DAP_QueueCommands batches, is cut
+ * into two reads at every possible point and framed like el_dap_work does. Every read
+ * pattern must give back the requests that were sent, one by one and unchanged, and a
+ * partial request must wait for the rest instead of being submitted.
+ *
+ * build: cmake -S host -B build && cmake --build build
+ * usage: el_framing_test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "DAP_config.h"
+#include "cmsis-dap/include/DAP.h"
+#include "components/dap_proxy/proxy_server_conf.h"
+#include "components/elaphureLink/elaphureLink_protocol.h"
+
+#define REQUEST_MAX 32
+
+typedef struct {
+	const char *name;
+	uint8_t length;
+	uint8_t data[24];
+} request_t;
+
+static const request_t requests[] = {
+	{ "DAP_Info",             2, { ID_DAP_Info, 0xFF } },
+	{ "DAP_TransferAbort",    1, { ID_DAP_TransferAbort } },
+	{ "DAP_Transfer",         9, { ID_DAP_Transfer, 0, 2, 0x05, 0x00, 0x00, 0x00, 0x20, 0x0F } },
+	{ "DAP_TransferAbort",    1, { ID_DAP_TransferAbort } },
+	{ "DAP_TransferAbort",    1, { ID_DAP_TransferAbort } },
+	{ "batch with aborts",   10, { ID_DAP_ExecuteCommands, 5, ID_DAP_TransferAbort, ID_DAP_Info, 0x04,
+				       ID_DAP_TransferAbort, ID_DAP_HostStatus, 0x00, 0x01, ID_DAP_TransferAbort } },
+	{ "DAP_TransferBlock",   13, { ID_DAP_TransferBlock, 0, 2, 0, 0x0D, 1, 2, 3, 4, 5, 6, 7, 8 } },
+	{ "queued abort",         3, { ID_DAP_QueueCommands, 1, ID_DAP_TransferAbort } },
+	{ "queued batch",         9, { ID_DAP_QueueCommands, 3, ID_DAP_SWJ_Sequence, 8, 0xFF, ID_DAP_TransferAbort,
+				       ID_DAP_Delay, 0x01, 0x00 } },
+	{ "DAP_Delay",            3, { ID_DAP_Delay, 0x01, 0x00 } },
+	{ "DAP_TransferAbort",    1, { ID_DAP_TransferAbort } },
+};
+
+#define REQUEST_NUM (sizeof(requests) / sizeof(requests[0]))
+
+/* the framing loop of el_dap_work, over reads of stream[0, split) and stream[split, len) */
+static int frame(const uint8_t *stream, size_t len, size_t split)
+{
+	uint8_t base[DAP_SESSION_BUFFER_SIZE];
+	size_t rx_len = 0, pos, chunk, fed = 0;
+	uint32_t next = 0;
+	int sz, errors = 0;
+
+	while (fed < len) {
+		chunk = fed < split ? split - fed : len - fed;
+		memcpy(base + rx_len, stream + fed, chunk);
+		fed += chunk;
+		rx_len += chunk;
+
+		for (pos = 0; pos < rx_len; pos += sz) {
+			sz = el_dap_request_length(base + pos, rx_len - pos);
+			if (sz == 0)
+				break;
+			if (sz < 0 || next >= REQUEST_NUM || (size_t)sz != requests[next].length ||
+			    memcmp(base + pos, requests[next].data, sz) != 0) {
+				printf("  split at %zu: request %u (%s) framed as %d bytes\n", split, next,
+				       next < REQUEST_NUM ? requests[next].name : "none", sz);
+				return 1;
+			}
+			next++;
+		}
+
+		rx_len -= pos;
+		memmove(base, base + pos, rx_len);
+	}
+
+	if (next != REQUEST_NUM || rx_len != 0) {
+		printf("  split at %zu: %u of %zu requests framed, %zu bytes left\n", split, next,
+		       REQUEST_NUM, rx_len);
+		errors++;
+	}
+	return errors;
+}
+
+int main(void)
+{
+	uint8_t stream[REQUEST_NUM * REQUEST_MAX];
+	size_t len = 0;
+	int errors = 0;
+
+	for (size_t i = 0; i < REQUEST_NUM; i++) {
+		memcpy(stream + len, requests[i].data, requests[i].length);
+		len += requests[i].length;
+	}
+
+	for (size_t split = 1; split <= len; split++)
+		errors += frame(stream, len, split);
+
+	printf("%zu requests, %zu bytes, %zu read patterns: %s\n", REQUEST_NUM, len, len,
+	       errors ? "FAIL" : "ok");
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""
+elaphureLink replay benchmark.
+
+Replays the traffic of a Keil-like debug session: connect, line reset,
+IDCODE, then memory reads through DAP_Transfer (TAR write + DRW reads) and
+DAP_TransferBlock. With -w 1 every request waits for its response, as Keil
+does. A larger window keeps several requests in flight to exercise the
+pipelined executor, and --split sends the request stream in random pieces,
+so that requests are split and coalesced across TCP segments.
+
+elaphureLink has no framing, responses are delimited here from the request
+they answer. A target (or USE_SWD_SIM) is needed for full responses.
+
+usage: el_replay.py host [-p 3240] [-n 2000] [-w 1] [--split]
+compare: for w in 1 2 4; do el_replay.py -w $w host; done
+"""
+
+import argparse
+import random
+import socket
+import statistics
+import struct
+import sys
+import time
+
+EL_LINK_IDENTIFIER = 0x8A656C70
+EL_COMMAND_HANDSHAKE = 0x00000000
+EL_PROXY_VERSION = 0x00000001
+
+SETUP = [
+    bytes([0x02, 0x01]),                                # DAP_Connect: SWD
+    bytes([0x11]) + struct.pack("<I", 10000000),        # DAP_SWJ_Clock
+    bytes([0x04, 0x00]) + struct.pack("<HH", 64, 0),    # DAP_TransferConfigure
+    bytes([0x12, 0x38]) + bytes([0xFF] * 7),            # DAP_SWJ_Sequence: line reset
+    bytes([0x05, 0x00, 0x01, 0x02]),                    # DAP_Transfer: read DP IDCODE
+    bytes([0x05, 0x00, 0x02, 0x04]) + struct.pack("<I", 0x50000000) + bytes([0x06]),  # power-up, read CTRL/STAT
+]
+
+
+def transfer_read(addr, words):
+    # DAP_Transfer: write CSW, write TAR, read DRW `words` times
+    req = bytes([0x05, 0x00, 2 + words])
+    req += bytes([0x01]) + struct.pack("<I", 0x23000012)
+    req += bytes([0x05]) + struct.pack("<I", addr)
+    req += bytes([0x0F]) * words
+    return req
+
+
+def block_read(words):
+    return bytes([0x06, 0x00]) + struct.pack("<H", words) + bytes([0x0F])
+
+
+def session(count):
+    reqs = list(SETUP)
+    addr = 0x20000000
+    for i in range(count):
+        if i % 4 == 3:
+            reqs.append(block_read(256))
+        else:
+            reqs.append(transfer_read(addr + (i % 64) * 16, 4))
+    return reqs
+
+
+def response_length(req, buf):
+    """Length of the response to `req` at the head of `buf`, None if incomplete."""
+    cmd = req[0]
+    if len(buf) < {0x05: 3, 0x06: 4}.get(cmd, 2):
+        return None
+    if cmd == 0x05:
+        done = buf[1]
+        pos, n = 3, 0
+        for _ in range(done):
+            r = req[pos]
+            if not r & 0x02 or r & 0x10:  # write, or read with match value
+                pos += 5
+            else:
+                pos += 1
+                n += 1
+        length = 3 + 4 * n
+    elif cmd == 0x06:
+        done = buf[1] | (buf[2] << 8)
+        length = 4 + (4 * done if req[4] & 0x02 else 0)
+    else:
+        length = 2
+    return length if len(buf) >= length else None
+
+
+def recv_exact(sock, n):
+    buf = b""
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            raise ConnectionError("connection closed")
+        buf += chunk
+    return buf
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("-p", "--port", type=int, default=3240)
+    parser.add_argument("-n", "--count", type=int, default=2000, help="memory read requests")
+    parser.add_argument("-w", "--window", type=int, default=1, help="requests in flight")
+    parser.add_argument("--split", action="store_true", help="send the stream in random pieces")
+    args = parser.parse_args()
+
+    sock = socket.create_connection((args.host, args.port), timeout=5)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    sock.sendall(struct.pack(">III", EL_LINK_IDENTIFIER, EL_COMMAND_HANDSHAKE, EL_PROXY_VERSION))
+    if struct.unpack(">I", recv_exact(sock, 12)[:4])[0] != EL_LINK_IDENTIFIER:
+        print("handshake failed", file=sys.stderr)
+        return 1
+
+    reqs = session(args.count)
+    sent_at = []
+    latency = []
+    rx = b""
+    sent = done = rx_bytes = short = 0
+    pending = b""
+    start = time.monotonic()
+
+    while done < len(reqs):
+        while sent < len(reqs) and sent - done < args.window:
+            pending += reqs[sent]
+            sent_at.append(time.monotonic())
+            sent += 1
+        while pending:
+            cut = random.randint(1, len(pending)) if args.split else len(pending)
+            sock.sendall(pending[:cut])
+            pending = pending[cut:]
+
+        chunk = sock.recv(65536)
+        if not chunk:
+            print("connection closed after %d responses" % done, file=sys.stderr)
+            return 1
+        rx += chunk
+        while done < sent:
+            length = response_length(reqs[done], rx)
+            if length is None:
+                break
+            if rx[0] != reqs[done][0]:
+                print("request %d: response 0x%02x to command 0x%02x" % (done, rx[0], reqs[done][0]),
+                      file=sys.stderr)
+                return 1
+            if reqs[done][0] in (0x05, 0x06) and rx[3 if reqs[done][0] == 0x06 else 2] != 1:
+                short += 1
+            latency.append(time.monotonic() - sent_at[done])
+            rx_bytes += length
+            rx = rx[length:]
+            done += 1
+
+    elapsed = time.monotonic() - start
+    latency.sort()
+    print("window %d%s: %d requests in %.2f s, %.0f req/s, %.0f response bytes/s" %
+          (args.window, ", split" if args.split else "", len(reqs), elapsed, len(reqs) / elapsed, rx_bytes / elapsed))
+    print("latency p50 %.0f us, p99 %.0f us" %
+          (statistics.median(latency) * 1e6, latency[len(latency) * 99 // 100] * 1e6))
+    if short:
+        print("%d transfers failed, no target?" % short)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
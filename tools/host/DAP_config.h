@@ -0,0 +1,186 @@
+/**
+ * @file DAP_config.h
+ * @brief Host (Linux) port of components/DAP/DAP_config.h.
+ *        Same capabilities and packet sizes as the firmware, the I/O pins are plain
+ *        variables and the wire is served by swd_sim.c (USE_SWD_SIM), so DAP.c,
+ *        SW_DP.c and JTAG_DP.c build and run unchanged on the host.
+ *        Build with -DUSE_SWD_SIM=1 -DUSE_ASSEMBLY=0 (PIN_DELAY_SLOW as a C loop).
+ * @change: 2026-10-17 first version
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright MIT License
+ *
+ */
+
+#ifndef __DAP_CONFIG_H__
+#define __DAP_CONFIG_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "main/dap_configuration.h"
+
+#include "cmsis-dap/include/cmsis_compiler.h"
+#include "cmsis-dap/include/spi_switch.h"
+
+
+#define CPU_CLOCK               240000000U  ///< as ESP32/S3, only used to compute clock delays
+#define BUS_CLOCK_FIXED         100000000U
+#define IO_PORT_WRITE_CYCLES    2U
+
+#define DAP_SWD                 1
+#define DAP_JTAG                1
+#define DAP_JTAG_DEV_CNT        8U
+#define DAP_DEFAULT_PORT        1U
+#define DAP_DEFAULT_SWJ_CLOCK   1000000U
+
+#define DAP_PACKET_COUNT        DAP_PACKET_QUEUE_DEPTH
+
+#define SWO_FUNCTION_ENABLE     0
+#define SWO_UART                SWO_FUNCTION_ENABLE
+#define SWO_UART_DRIVER         0
+#define SWO_UART_MAX_BAUDRATE   (115200U * 40U)
+#define SWO_MANCHESTER          0
+#define SWO_BUFFER_SIZE         2048U
+#define SWO_STREAM              SWO_FUNCTION_ENABLE
+
+#define TIMESTAMP_CLOCK         1000000U    ///< TIMESTAMP_GET() counts microseconds
+
+#define DAP_UART                0
+#define DAP_UART_DRIVER         1
+#define DAP_UART_RX_BUFFER_SIZE 1024U
+#define DAP_UART_TX_BUFFER_SIZE 1024U
+#define DAP_UART_USB_COM_PORT   0
+
+#define TARGET_FIXED            0
+
+
+__STATIC_INLINE uint8_t DAP_GetVendorString(char *str)
+{
+  strcpy(str, "windowsair");
+  return (sizeof("windowsair"));
+}
+
+__STATIC_INLINE uint8_t DAP_GetProductString(char *str)
+{
+  strcpy(str, "CMSIS-DAP v2");
+  return (sizeof("CMSIS-DAP v2"));
+}
+
+__STATIC_INLINE uint8_t DAP_GetSerNumString(char *str)
+{
+  strcpy(str, "host");
+  return (sizeof("host"));
+}
+
+__STATIC_INLINE uint8_t DAP_GetTargetDeviceVendorString(char *str)
+{
+  (void)str;
+  return (0U);
+}
+
+__STATIC_INLINE uint8_t DAP_GetTargetDeviceNameString(char *str)
+{
+  (void)str;
+  return (0U);
+}
+
+__STATIC_INLINE uint8_t DAP_GetTargetBoardVendorString(char *str)
+{
+  (void)str;
+  return (0U);
+}
+
+__STATIC_INLINE uint8_t DAP_GetTargetBoardNameString(char *str)
+{
+  (void)str;
+  return (0U);
+}
+
+__STATIC_INLINE uint8_t DAP_GetProductFirmwareVersionString(char *str)
+{
+  (void)str;
+  return (0U);
+}
+
+
+// Pin levels, nobody drives them but the DAP core itself
+extern uint8_t host_pin_swclk, host_pin_swdio, host_pin_tdi, host_pin_ntrst, host_pin_nreset;
+
+__STATIC_INLINE void PORT_JTAG_SETUP(void)
+{
+  host_pin_swclk = host_pin_swdio = host_pin_tdi = host_pin_ntrst = host_pin_nreset = 1U;
+}
+
+__STATIC_INLINE void PORT_SWD_SETUP(void)
+{
+  DAP_SPI_Deinit();
+}
+
+__STATIC_INLINE void PORT_OFF(void)
+{
+  DAP_SPI_Disable();
+}
+
+__STATIC_FORCEINLINE uint32_t PIN_SWCLK_TCK_IN(void)   { return host_pin_swclk; }
+__STATIC_FORCEINLINE void     PIN_SWCLK_TCK_SET(void)  { host_pin_swclk = 1U; }
+__STATIC_FORCEINLINE void     PIN_SWCLK_TCK_CLR(void)  { host_pin_swclk = 0U; }
+
+__STATIC_FORCEINLINE uint32_t PIN_SWDIO_TMS_IN(void)   { return host_pin_swdio; }
+__STATIC_FORCEINLINE void     PIN_SWDIO_TMS_SET(void)  { host_pin_swdio = 1U; }
+__STATIC_FORCEINLINE void     PIN_SWDIO_TMS_CLR(void)  { host_pin_swdio = 0U; }
+
+__STATIC_FORCEINLINE uint32_t PIN_SWDIO_IN(void)       { return host_pin_swdio; }
+__STATIC_FORCEINLINE void     PIN_SWDIO_OUT(uint32_t bit) { host_pin_swdio = bit & 1U; }
+__STATIC_FORCEINLINE void     PIN_SWDIO_OUT_ENABLE(void)  {}
+__STATIC_FORCEINLINE void     PIN_SWDIO_OUT_DISABLE(void) {}
+
+__STATIC_FORCEINLINE uint32_t PIN_TDI_IN(void)         { return host_pin_tdi; }
+__STATIC_FORCEINLINE void     PIN_TDI_OUT(uint32_t bit) { host_pin_tdi = bit & 1U; }
+__STATIC_FORCEINLINE uint32_t PIN_TDO_IN(void)         { return 0U; }
+
+__STATIC_FORCEINLINE uint32_t PIN_nTRST_IN(void)       { return host_pin_ntrst; }
+__STATIC_FORCEINLINE void     PIN_nTRST_OUT(uint32_t bit) { host_pin_ntrst = bit & 1U; }
+__STATIC_FORCEINLINE uint32_t PIN_nRESET_IN(void)      { return host_pin_nreset; }
+__STATIC_FORCEINLINE void     PIN_nRESET_OUT(uint32_t bit) { host_pin_nreset = bit & 1U; }
+
+__STATIC_INLINE void LED_CONNECTED_OUT(uint32_t bit) { (void)(bit); }
+__STATIC_INLINE void LED_RUNNING_OUT(uint32_t bit)   { (void)(bit); }
+
+
+static inline uint64_t host_time_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+__STATIC_INLINE uint32_t TIMESTAMP_GET(void)
+{
+  return (uint32_t)(host_time_ns() / 1000U);
+}
+
+// dap_stats.h: command times are in ns on the host instead of CPU cycles
+#define DAP_STATS_CYCLES()  ((uint32_t)host_time_ns())
+#define DAP_STATS_TIME_US() TIMESTAMP_GET()
+
+__STATIC_INLINE void DAP_SETUP(void)
+{
+  PORT_OFF();
+}
+
+extern void dap_os_delay(int ms);
+
+__STATIC_INLINE uint8_t RESET_TARGET(void)
+{
+  PIN_nRESET_OUT(0);
+  dap_os_delay(2);
+  PIN_nRESET_OUT(1);
+  dap_os_delay(2);
+  return (1U);
+}
+
+#endif /* __DAP_CONFIG_H__ */
@@ -0,0 +1,27 @@
+/**
+ * @file dap_host.c
+ * @brief Host (Linux) stand-ins for the pins and the SPI switch of the DAP core.
+ *        The SPI transfers themselves are modelled by spi_sim.c.
+ * @change: 2026-10-17 first version
+ *          2026-10-17 SPI transfers moved to spi_sim.c
+ *          2026-10-17 the SPI switch checks that no data phase is on the wire
+ * @version 0.3
+ * @date 2026-10-17
+ *
+ * @copyright MIT License
+ *
+ */
+
+#include "DAP_config.h"
+#include "cmsis-dap/include/spi_switch.h"
+#include "spi_sim.h"
+
+uint8_t host_pin_swclk = 1U, host_pin_swdio = 1U, host_pin_tdi = 1U, host_pin_ntrst = 1U, host_pin_nreset = 1U;
+
+
+void DAP_SPI_Init() {}
+void DAP_SPI_Deinit() {}
+void DAP_SPI_Enable() { SPI_Sim_Switch(); }
+void DAP_SPI_Disable() { SPI_Sim_Switch(); }
+void DAP_SPI_Acquire() { SPI_Sim_Switch(); }
+void DAP_SPI_Release() { SPI_Sim_Switch(); }
@@ -0,0 +1,29 @@
+/*
+ * Host build: one heap for every capability, there is no heap to watch on the host.
+ */
+
+#ifndef __HOST_ESP_HEAP_CAPS_H__
+#define __HOST_ESP_HEAP_CAPS_H__
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT   (1U << 2)
+#define MALLOC_CAP_SPIRAM (1U << 10)
+
+static inline void *heap_caps_malloc(size_t size, unsigned caps)
+{
+  (void)caps;
+  return malloc(size);
+}
+
+static inline void heap_caps_free(void *ptr)
+{
+  free(ptr);
+}
+
+static inline size_t heap_caps_get_free_size(unsigned caps) { (void)caps; return 0; }
+static inline size_t heap_caps_get_largest_free_block(unsigned caps) { (void)caps; return 0; }
+static inline size_t heap_caps_get_minimum_free_size(unsigned caps) { (void)caps; return 0; }
+
+#endif
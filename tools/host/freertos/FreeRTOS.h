@@ -0,0 +1,27 @@
+/*
+ * Host build: the parts of FreeRTOS used by the DAP core and the DAP proxy,
+ * tasks, queues and semaphores run on pthreads (host_rtos.c).
+ */
+
+#ifndef __HOST_FREERTOS_H__
+#define __HOST_FREERTOS_H__
+
+#include <stdint.h>
+#include <stdio.h> // printf, reached through the port headers of ESP-IDF
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ    1000U
+#define portTICK_PERIOD_MS    (1000U / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)     ((TickType_t)(ms) * configTICK_RATE_HZ / 1000U)
+#define portMAX_DELAY         ((TickType_t)0xFFFFFFFFU)
+#define portNUM_PROCESSORS    1
+
+#define pdFALSE               0
+#define pdTRUE                1
+#define pdPASS                pdTRUE
+#define pdFAIL                pdFALSE
+
+#endif
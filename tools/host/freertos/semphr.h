@@ -0,0 +1,19 @@
+/*
+ * Host build: FreeRTOS semaphores are queues of empty items, as on the target.
+ */
+
+#ifndef __HOST_SEMPHR_H__
+#define __HOST_SEMPHR_H__
+
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+
+#define vSemaphoreDelete(sem)       vQueueDelete(sem)
+#define xSemaphoreTake(sem, wait)   xQueueReceive(sem, NULL, wait)
+#define xSemaphoreGive(sem)         xQueueSend(sem, NULL, 0)
+
+#endif
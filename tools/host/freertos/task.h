@@ -0,0 +1,32 @@
+/*
+ * Host build: the parts of FreeRTOS used by the DAP core and the DAP proxy.
+ * Every task is a detached pthread, priorities and stack sizes are ignored.
+ */
+
+#ifndef __HOST_TASK_H__
+#define __HOST_TASK_H__
+
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+static inline void vTaskDelay(TickType_t ticks)
+{
+  usleep(ticks * portTICK_PERIOD_MS * 1000U);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t priority, TaskHandle_t *task);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *task, BaseType_t core);
+/* only a task deleting itself (NULL) is supported */
+void vTaskDelete(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+void xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+
+#endif
@@ -0,0 +1,273 @@
+/**
+ * @file host_rtos.c
+ * @brief Host (Linux) stand-ins for the FreeRTOS tasks, queues, semaphores and task
+ *        notifications used by the DAP proxy, on pthreads.
+ *        Enough for DAP_handle.c, usbip_server.c, dap_session.c and dap_pipeline.c
+ *        to run unchanged on the host.
+ * @change: 2026-10-17 first version
+ * @version 0.1
+ * @date 2026-10-17
+ *
+ * @copyright MIT License
+ *
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+struct host_task
+{
+  pthread_t thread;
+  TaskFunction_t fn;
+  void *arg;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint32_t notify;
+};
+
+struct host_queue
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond; // any change of `count`
+  uint8_t *items;
+  uint32_t length;
+  uint32_t item_size;
+  uint32_t head;
+  uint32_t count;
+};
+
+static __thread struct host_task *host_current_task = NULL;
+
+
+static void host_deadline(struct timespec *ts, TickType_t wait)
+{
+  uint64_t ns;
+
+  clock_gettime(CLOCK_REALTIME, ts);
+  ns = (uint64_t)ts->tv_nsec + (uint64_t)wait * portTICK_PERIOD_MS * 1000000U;
+  ts->tv_sec += ns / 1000000000U;
+  ts->tv_nsec = ns % 1000000000U;
+}
+
+// wait on `cond` until `ready` or the ticks run out, with `lock` held
+#define HOST_WAIT(cond, lock, wait, ready)                              \
+  ({                                                                    \
+    struct timespec __ts;                                               \
+    int __ret = 0;                                                      \
+    if ((wait) != portMAX_DELAY)                                        \
+      host_deadline(&__ts, wait);                                       \
+    while (!(ready) && __ret == 0) {                                    \
+      if ((wait) == 0)                                                  \
+        __ret = -1;                                                     \
+      else if ((wait) == portMAX_DELAY)                                 \
+        pthread_cond_wait(cond, lock);                                  \
+      else                                                              \
+        __ret = pthread_cond_timedwait(cond, lock, &__ts);              \
+    }                                                                   \
+    (ready);                                                            \
+  })
+
+
+static struct host_task *host_task_new(TaskFunction_t fn, void *arg)
+{
+  struct host_task *task = calloc(1, sizeof(*task));
+
+  if (task == NULL) {
+    return NULL;
+  }
+  task->fn = fn;
+  task->arg = arg;
+  pthread_mutex_init(&task->lock, NULL);
+  pthread_cond_init(&task->cond, NULL);
+  return task;
+}
+
+static void *host_task_entry(void *arg)
+{
+  struct host_task *task = arg;
+
+  host_current_task = task;
+  task->fn(task->arg);
+  return NULL; // FreeRTOS tasks must not return, the firmware does not rely on it either
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle)
+{
+  struct host_task *task = host_task_new(fn, arg);
+
+  (void)name;
+  (void)stack;
+  (void)priority;
+
+  if (task == NULL) {
+    return pdFAIL;
+  }
+  if (handle) {
+    *handle = task;
+  }
+  if (pthread_create(&task->thread, NULL, host_task_entry, task) != 0) {
+    free(task);
+    return pdFAIL;
+  }
+  pthread_detach(task->thread);
+  return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+  (void)core;
+  return xTaskCreate(fn, name, stack, arg, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+  if (task == NULL || task == host_current_task) {
+    pthread_exit(NULL); // the handle stays valid, somebody may still notify it
+  }
+  abort();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+  if (host_current_task == NULL) {
+    host_current_task = host_task_new(NULL, NULL); // a thread not created by xTaskCreate, main()
+  }
+  return host_current_task;
+}
+
+void xTaskNotifyGive(TaskHandle_t task)
+{
+  pthread_mutex_lock(&task->lock);
+  task->notify++;
+  pthread_cond_signal(&task->cond);
+  pthread_mutex_unlock(&task->lock);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+  struct host_task *task = xTaskGetCurrentTaskHandle();
+  uint32_t value;
+
+  pthread_mutex_lock(&task->lock);
+  HOST_WAIT(&task->cond, &task->lock, wait, task->notify > 0);
+  value = task->notify;
+  if (value) {
+    task->notify = clear ? 0 : value - 1;
+  }
+  pthread_mutex_unlock(&task->lock);
+
+  return value;
+}
+
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+  struct host_queue *queue = calloc(1, sizeof(*queue));
+
+  if (queue == NULL) {
+    return NULL;
+  }
+  queue->items = calloc(length, item_size ? item_size : 1);
+  if (queue->items == NULL) {
+    free(queue);
+    return NULL;
+  }
+  queue->length = length;
+  queue->item_size = item_size;
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->cond, NULL);
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->cond);
+  free(queue->items);
+  free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+  uint32_t tail;
+
+  pthread_mutex_lock(&queue->lock);
+  if (!HOST_WAIT(&queue->cond, &queue->lock, wait, queue->count < queue->length)) {
+    pthread_mutex_unlock(&queue->lock);
+    return pdFAIL;
+  }
+  tail = (queue->head + queue->count) % queue->length;
+  if (queue->item_size) {
+    memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+  }
+  queue->count++;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->lock);
+
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+  pthread_mutex_lock(&queue->lock);
+  if (!HOST_WAIT(&queue->cond, &queue->lock, wait, queue->count > 0)) {
+    pthread_mutex_unlock(&queue->lock);
+    return pdFAIL;
+  }
+  if (queue->item_size) {
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+  }
+  queue->head = (queue->head + 1) % queue->length;
+  queue->count--;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->lock);
+
+  return pdPASS;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+  pthread_mutex_lock(&queue->lock);
+  queue->head = 0;
+  queue->count = 0;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->lock);
+
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+  UBaseType_t count;
+
+  pthread_mutex_lock(&queue->lock);
+  count = queue->count;
+  pthread_mutex_unlock(&queue->lock);
+
+  return count;
+}
+
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+  SemaphoreHandle_t sem = xQueueCreate(1, 0);
+
+  if (sem) {
+    xSemaphoreGive(sem); // a mutex starts out available
+  }
+  return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+  return xQueueCreate(1, 0);
+}
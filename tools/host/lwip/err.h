@@ -0,0 +1,11 @@
+/*
+ * Host build: nothing of lwIP's err_t is used by the DAP proxy, but usb_handle.c
+ * gets printf through it as through lwIP's arch headers.
+ */
+
+#ifndef __HOST_LWIP_ERR_H__
+#define __HOST_LWIP_ERR_H__
+
+#include <stdio.h>
+
+#endif
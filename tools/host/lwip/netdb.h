@@ -0,0 +1,10 @@
+/*
+ * Host build: lwIP's netdb.h is the POSIX one.
+ */
+
+#ifndef __HOST_LWIP_NETDB_H__
+#define __HOST_LWIP_NETDB_H__
+
+#include <netdb.h>
+
+#endif
@@ -0,0 +1,27 @@
+/*
+ * Host build: lwIP's BSD socket API is the POSIX one.
+ */
+
+#ifndef __HOST_LWIP_SOCKETS_H__
+#define __HOST_LWIP_SOCKETS_H__
+
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PP_HTONL(x) __builtin_bswap32((uint32_t)(x))
+#define PP_HTONS(x) __builtin_bswap16((uint16_t)(x))
+#else
+#define PP_HTONL(x) ((uint32_t)(x))
+#define PP_HTONS(x) ((uint16_t)(x))
+#endif
+#define PP_NTOHL(x) PP_HTONL(x)
+#define PP_NTOHS(x) PP_HTONS(x)
+
+#endif
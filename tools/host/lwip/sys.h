@@ -0,0 +1,8 @@
+/*
+ * Host build: nothing of lwIP's sys layer is used by the DAP proxy.
+ */
+
+#ifndef __HOST_LWIP_SYS_H__
+#define __HOST_LWIP_SYS_H__
+
+#endif
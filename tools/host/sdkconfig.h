@@ -0,0 +1,11 @@
+/*
+ * Host build: stands in for the sdkconfig.h generated by ESP-IDF.
+ * No CONFIG_IDF_TARGET_* is set, target specific SPI/GPIO code is left out.
+ */
+
+#ifndef __HOST_SDKCONFIG_H__
+#define __HOST_SDKCONFIG_H__
+
+#define CONFIG_FREERTOS_HZ 1000
+
+#endif
@@ -0,0 +1,203 @@
+/**
+ * @file spi_sim.c
+ * @brief Host (Linux) model of the SPI peripheral behind spi_op.h.
+ *        The request byte of DAP_SPI_Send_Header is decoded and handed to swd_sim.c,
+ *        which answers the ACK, then the data phase reads or writes the model.
+ *        With USE_SWD_SIM 2 this lets SWD_Transfer_SPI and SWD_TransferBlock_SPI run
+ *        unchanged against the target model. With USE_SWD_SIM 1 nothing calls it.
+ *        DAP_SPI_Write_Data_Start leaves its data phase on the wire until DAP_SPI_Wait_Done,
+ *        like the peripheral does: the word reaches the model only then, and touching the
+ *        SPI or the pins in between is counted as an order error.
+ *        SPI_Sim_AbortAt raises DAP_TransferAbort during a given request phase, like a
+ *        DAP_TransferAbort command of the host arriving in the middle of a block.
+ * @change: 2026-10-17 first version, from the stubs of dap_host.c
+ *          2026-10-17 DAP_TransferAbort during a request phase
+ *          2026-10-17 data phases in flight between Write_Data_Start and Wait_Done
+ * @version 0.3
+ * @date 2026-10-17
+ *
+ * @copyright MIT License
+ *
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "DAP_config.h"
+#include "cmsis-dap/include/DAP.h"
+#include "cmsis-dap/include/spi_op.h"
+#include "cmsis-dap/include/swd_sim.h"
+#include "spi_sim.h"
+
+#define SPI_SIM_NO_REQUEST 0xFFFFFFFFU
+
+static uint32_t spi_request = SPI_SIM_NO_REQUEST; // acknowledged with OK, waiting for its data phase
+static uint32_t spi_ones;                         // SWDIO high for this many cycles in a row
+static bool spi_busy;                             // a started data phase is on the wire
+static uint32_t spi_busy_request, spi_busy_data;
+static spi_sim_stats_t spi_stats;
+static uint32_t spi_abort_at;                     // request phase that raises DAP_TransferAbort, 0: none
+
+
+void SPI_Sim_Reset(void)
+{
+  spi_request = SPI_SIM_NO_REQUEST;
+  spi_ones = 0U;
+  spi_busy = false;
+  spi_abort_at = 0U;
+  memset(&spi_stats, 0, sizeof(spi_stats));
+}
+
+// `header` counts the request phases since SPI_Sim_Reset, from 1
+void SPI_Sim_AbortAt(uint32_t header)
+{
+  spi_abort_at = header;
+}
+
+void SPI_Sim_GetStats(spi_sim_stats_t *stats)
+{
+  *stats = spi_stats;
+}
+
+// the SPI or the pins are about to be used: nothing may be on the wire
+static void spi_check_idle(void)
+{
+  if (spi_busy) {
+    spi_stats.order_errors++;
+  }
+}
+
+void SPI_Sim_Switch(void)
+{
+  spi_check_idle();
+}
+
+// the request of an OK request phase, for its data phase
+static uint32_t spi_take_request(void)
+{
+  uint32_t request = spi_request;
+
+  spi_request = SPI_SIM_NO_REQUEST;
+  if (request == SPI_SIM_NO_REQUEST) {
+    spi_stats.misuse++;
+  }
+  return request;
+}
+
+
+void DAP_SPI_WriteBits(const uint8_t count, const uint8_t *buf)
+{
+  spi_check_idle();
+  for (uint32_t n = 0U; n < count; n++) {
+    if (buf[n / 8U] & (1U << (n % 8U))) {
+      // 50 cycles or more with SWDIO high is a line reset
+      if (++spi_ones == 50U) {
+        spi_stats.line_resets++;
+        SWD_Sim_LineReset();
+      }
+    } else {
+      spi_ones = 0U;
+    }
+  }
+}
+
+void DAP_SPI_ReadBits(const uint8_t count, uint8_t *buf)
+{
+  spi_check_idle();
+  memset(buf, 0, (count + 7U) / 8U);
+}
+
+// packetHeaderData: Start, APnDP, RnW, A2, A3, Parity, Stop, Park (LSB first)
+void DAP_SPI_Send_Header(const uint8_t packetHeaderData, uint8_t *ack, uint8_t TrnAfterACK)
+{
+  uint32_t request = (packetHeaderData >> 1) & 0x0FU; // A[3:2] RnW APnDP
+
+  (void)TrnAfterACK;
+
+  spi_check_idle();
+  spi_stats.headers++;
+  spi_ones = 0U;
+  if (spi_request != SPI_SIM_NO_REQUEST) {
+    spi_stats.misuse++; // the data phase of the previous request was skipped
+  }
+
+  *ack = SWD_Sim_Request(request);
+  spi_request = (*ack == DAP_TRANSFER_OK) ? request : SPI_SIM_NO_REQUEST;
+  if (spi_stats.headers == spi_abort_at) {
+    DAP_TransferAbort = 1U;
+  }
+}
+
+void DAP_SPI_Read_Data(uint32_t *resData, uint8_t *resParity)
+{
+  uint32_t request;
+  uint32_t val = 0U;
+
+  spi_check_idle();
+  request = spi_take_request();
+  spi_stats.reads++;
+  if (request != SPI_SIM_NO_REQUEST) {
+    SWD_Sim_Data(request, &val);
+  }
+  *resData = val;
+  *resParity = (uint8_t)__builtin_parity(val);
+}
+
+// put a write data phase on the wire, it reaches the model in DAP_SPI_Wait_Done
+static void spi_write_start(uint32_t data, uint8_t parity)
+{
+  spi_check_idle();
+  spi_busy_request = spi_take_request();
+  spi_busy_data = data;
+  spi_busy = true;
+
+  spi_stats.writes++;
+  if ((parity & 1U) != (uint32_t)__builtin_parity(data)) {
+    spi_stats.parity_errors++; // a real target would answer the next request with FAULT
+  }
+}
+
+void DAP_SPI_Write_Data_Start(uint32_t data, uint8_t parity)
+{
+  spi_write_start(data, parity);
+  spi_stats.starts++;
+}
+
+void DAP_SPI_Wait_Done()
+{
+  if (!spi_busy) {
+    spi_stats.order_errors++;
+    return;
+  }
+  spi_busy = false;
+  if (spi_busy_request != SPI_SIM_NO_REQUEST) {
+    SWD_Sim_Data(spi_busy_request, &spi_busy_data);
+  }
+}
+
+void DAP_SPI_Write_Data(uint32_t data, uint8_t parity)
+{
+  spi_write_start(data, parity);
+  DAP_SPI_Wait_Done();
+}
+
+void DAP_SPI_Generate_Cycle(uint8_t num)
+{
+  (void)num;
+  spi_check_idle();
+}
+
+void DAP_SPI_Fast_Cycle()
+{
+  spi_check_idle();
+}
+
+void DAP_SPI_Protocol_Error_Read()
+{
+  spi_check_idle();
+}
+
+void DAP_SPI_Protocol_Error_Write()
+{
+  spi_check_idle();
+}
@@ -0,0 +1,27 @@
+/*
+ * Host build: model of the SPI peripheral behind spi_op.h, see spi_sim.c.
+ */
+
+#ifndef __HOST_SPI_SIM_H__
+#define __HOST_SPI_SIM_H__
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t headers;       // request phases
+  uint32_t reads;         // read data phases
+  uint32_t writes;        // write data phases, DAP_SPI_Write_Data or DAP_SPI_Write_Data_Start
+  uint32_t parity_errors; // write data sent with a wrong parity bit
+  uint32_t misuse;        // data phase without an OK request phase before it
+  uint32_t line_resets;
+  uint32_t starts;        // data phases left on the wire by DAP_SPI_Write_Data_Start
+  uint32_t order_errors;  // SPI or pin switch used while a started data phase is on the wire,
+                          // or DAP_SPI_Wait_Done without one
+} spi_sim_stats_t;
+
+void SPI_Sim_Reset(void);
+void SPI_Sim_GetStats(spi_sim_stats_t *stats);
+void SPI_Sim_Switch(void);
+void SPI_Sim_AbortAt(uint32_t header);
+
+#endif
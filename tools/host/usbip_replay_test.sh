@@ -0,0 +1,20 @@
+#!/bin/sh
+# Run tools/usbip_replay.py against usbip_host, for ctest.
+# Fails if either fails, usbip_host on its own checks with -g.
+# usage: usbip_replay_test.sh usbip_host "usbip_host options" usbip_replay.py port [usbip_replay.py options]
+
+host=$1
+host_options=$2
+replay=$3
+port=$4
+shift 4
+
+"$host" -p "$port" -n 1 $host_options &
+pid=$!
+sleep 0.3
+
+python3 "$replay" 127.0.0.1 -p "$port" "$@"
+ret=$?
+
+wait $pid || ret=1
+exit $ret
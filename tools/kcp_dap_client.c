@@ -0,0 +1,314 @@
+/*
+ * DAP latency probe for the elaphureLink (TCP) and KCP (UDP) transports.
+ *
+ * Sends DAP_Info commands one at a time and prints the latency percentiles.
+ * Packet loss and delay can be injected on the KCP path to compare both
+ * transports on a lossy, distant link: every datagram, in both directions,
+ * is dropped with loss_percent or held back delay_ms. TCP only gets the
+ * delay, added once per direction to every command, its loss is left to the
+ * kernel (tc netem). kcp_vs_tcp.sh runs both paths and prints their p99.
+ *
+ * With -s, packets of the given size are used instead: every command is a
+ * DAP_TransferBlock reading DP IDCODE as many times as the response can hold,
+ * and the throughput is printed as well. The size is capped to the packet size
+ * the probe reports for the transport. A target (or USE_SWD_SIM) is needed for
+ * full responses.
+ *
+ * build: cc -O2 -I.. -o kcp_dap_client kcp_dap_client.c ../components/kcp/ikcp.c
+ * usage: kcp_dap_client [-t] [-n count] [-l loss_percent] [-d delay_ms] [-s packet_size] host [port]
+ *        -t  use elaphureLink over TCP instead of KCP
+ *
+ * compare: for s in 512 1400; do kcp_dap_client -s $s host; kcp_dap_client -t -s $s host; done
+ */
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "components/kcp/ikcp.h"
+
+#define EL_LINK_IDENTIFIER 0x8a656c70
+#define EL_COMMAND_HANDSHAKE 0x00000000
+#define EL_PROXY_VERSION 0x00000001
+
+#define TIMEOUT_MS 3000
+#define PACKET_SIZE_MAX 4096
+#define DELAYED_MAX 256
+
+static int loss_percent, delay_ms;
+
+/* datagrams held back by -d, in the order they are due */
+typedef struct delayed_t {
+	uint64_t due;
+	int in; /* received, for ikcp_input, or to be sent */
+	int len;
+	char buf[1500];
+} delayed_t;
+
+static delayed_t delayed[DELAYED_MAX];
+static unsigned delayed_head, delayed_num;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int dropped(void)
+{
+	return loss_percent && rand() % 100 < loss_percent;
+}
+
+static void delay_push(int in, const char *buf, int len)
+{
+	delayed_t *d;
+
+	if (delayed_num == DELAYED_MAX || len > (int)sizeof(d->buf))
+		return; /* a full link drops */
+	d = &delayed[(delayed_head + delayed_num++) % DELAYED_MAX];
+	d->due = now_us() + (uint64_t)delay_ms * 1000;
+	d->in = in;
+	d->len = len;
+	memcpy(d->buf, buf, len);
+}
+
+/* send or input what is due, returns the ms until the next one is */
+static int delay_run(int fd, ikcpcb *kcp)
+{
+	delayed_t *d;
+	uint64_t now = now_us();
+
+	while (delayed_num) {
+		d = &delayed[delayed_head];
+		if (d->due > now)
+			return (int)((d->due - now + 999) / 1000);
+		if (d->in)
+			ikcp_input(kcp, d->buf, d->len);
+		else
+			send(fd, d->buf, d->len, 0);
+		delayed_head = (delayed_head + 1) % DELAYED_MAX;
+		delayed_num--;
+	}
+	return 10;
+}
+
+static int udp_output(const char *buf, int len, ikcpcb *kcp, void *user)
+{
+	(void)kcp;
+
+	if (dropped())
+		return len;
+	if (delay_ms) {
+		delay_push(0, buf, len);
+		return len;
+	}
+	return send(*(int *)user, buf, len, 0);
+}
+
+typedef struct transport_t {
+	int fd;
+	ikcpcb *kcp;
+} transport_t;
+
+/* one request, one response of at least `expect` bytes */
+static int transact(transport_t *t, const uint8_t *req, int req_len, uint8_t *res, int res_size, int expect)
+{
+	uint64_t deadline = now_us() + TIMEOUT_MS * 1000;
+	uint8_t buf[1500];
+	int total = 0;
+	struct pollfd pfd = { .fd = t->fd, .events = POLLIN };
+	int ret;
+
+	if (t->kcp == NULL) {
+		if (delay_ms)
+			usleep(delay_ms * 1000);
+		if (send(t->fd, req, req_len, 0) != req_len)
+			return -1;
+		/* elaphureLink has no framing, a large response may arrive in several segments */
+		do {
+			ret = recv(t->fd, res + total, res_size - total, 0);
+			if (ret <= 0)
+				return total ? total : -1;
+			total += ret;
+		} while (total < expect && poll(&pfd, 1, 20) > 0);
+		if (delay_ms)
+			usleep(delay_ms * 1000);
+		return total;
+	}
+
+	ikcp_send(t->kcp, (const char *)req, req_len);
+	ikcp_flush(t->kcp);
+
+	while (now_us() < deadline) {
+		uint32_t current = (uint32_t)(now_us() / 1000);
+		uint32_t wait = ikcp_check(t->kcp, current) - current;
+		uint32_t due = (uint32_t)delay_run(t->fd, t->kcp);
+
+		if (wait > due)
+			wait = due;
+		if (poll(&pfd, 1, wait > 10 ? 10 : (int)wait) > 0) {
+			while ((ret = recv(t->fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+				if (dropped())
+					continue;
+				if (delay_ms)
+					delay_push(1, (const char *)buf, ret);
+				else
+					ikcp_input(t->kcp, (const char *)buf, ret);
+			}
+		}
+		delay_run(t->fd, t->kcp);
+		ikcp_update(t->kcp, (uint32_t)(now_us() / 1000));
+
+		ret = ikcp_recv(t->kcp, (char *)res, res_size);
+		if (ret > 0)
+			return ret;
+	}
+
+	return -1;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+	const char *host;
+	const char *port = "3240";
+	int count = 1000, use_tcp = 0, packet_size = 0, opt, i, ret;
+	struct addrinfo hints = { 0 }, *ai;
+	transport_t t = { 0 };
+	uint8_t req[8], res[PACKET_SIZE_MAX];
+	int req_len, words = 0;
+	uint64_t *lat, start, elapsed, bytes = 0;
+
+	while ((opt = getopt(argc, argv, "tn:l:d:s:")) != -1) {
+		switch (opt) {
+		case 't': use_tcp = 1; break;
+		case 'n': count = atoi(optarg); break;
+		case 'l': loss_percent = atoi(optarg); break;
+		case 'd': delay_ms = atoi(optarg); break;
+		case 's': packet_size = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-t] [-n count] [-l loss_percent] [-d delay_ms] [-s packet_size] host [port]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind >= argc || count <= 0 || packet_size < 0 || packet_size > PACKET_SIZE_MAX || delay_ms < 0) {
+		fprintf(stderr, "usage: %s [-t] [-n count] [-l loss_percent] [-d delay_ms] [-s packet_size] host [port]\n", argv[0]);
+		return 1;
+	}
+	host = argv[optind];
+	if (optind + 1 < argc)
+		port = argv[optind + 1];
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = use_tcp ? SOCK_STREAM : SOCK_DGRAM;
+	if (getaddrinfo(host, port, &hints, &ai) != 0) {
+		fprintf(stderr, "can not resolve %s\n", host);
+		return 1;
+	}
+	t.fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (t.fd < 0 || connect(t.fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+		perror("connect");
+		return 1;
+	}
+	freeaddrinfo(ai);
+
+	if (use_tcp) {
+		int on = 1;
+		setsockopt(t.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	} else {
+		srand((unsigned)now_us());
+		t.kcp = ikcp_create((IUINT32)rand(), &t.fd);
+		ikcp_setoutput(t.kcp, udp_output);
+		ikcp_nodelay(t.kcp, 1, 10, 2, 1);
+		ikcp_wndsize(t.kcp, 32, 32);
+	}
+
+	/* elaphureLink handshake */
+	uint32_t hs[3] = { htonl(EL_LINK_IDENTIFIER), htonl(EL_COMMAND_HANDSHAKE), htonl(EL_PROXY_VERSION) };
+	ret = transact(&t, (const uint8_t *)hs, sizeof(hs), res, sizeof(res), sizeof(hs));
+	if (ret != sizeof(hs)) {
+		fprintf(stderr, "handshake failed\n");
+		return 1;
+	}
+
+	if (packet_size) {
+		const uint8_t info_packet_size[] = { 0x00, 0xFF };
+		const uint8_t connect_swd[] = { 0x02, 0x01 };
+		int max_size;
+
+		ret = transact(&t, info_packet_size, sizeof(info_packet_size), res, sizeof(res), 4);
+		if (ret < 4 || res[0] != 0x00 || res[1] != 2) {
+			fprintf(stderr, "DAP_Info packet size failed\n");
+			return 1;
+		}
+		max_size = res[2] | (res[3] << 8);
+		if (packet_size > max_size) {
+			printf("probe reports %d byte packets, using %d instead of %d\n", max_size, max_size, packet_size);
+			packet_size = max_size;
+		}
+		transact(&t, connect_swd, sizeof(connect_swd), res, sizeof(res), 2);
+
+		/* DAP_TransferBlock: index 0, count, request DP read IDCODE */
+		words = (packet_size - 4) / 4;
+		req[0] = 0x06;
+		req[1] = 0x00;
+		req[2] = words & 0xFF;
+		req[3] = words >> 8;
+		req[4] = 0x02;
+		req_len = 5;
+	} else {
+		/* DAP_Info: CMSIS-DAP protocol version */
+		req[0] = 0x00;
+		req[1] = 0x04;
+		req_len = 2;
+	}
+
+	lat = calloc(count, sizeof(*lat));
+	elapsed = now_us();
+	for (i = 0; i < count; i++) {
+		start = now_us();
+		ret = transact(&t, req, req_len, res, sizeof(res), packet_size ? 4 + words * 4 : 1);
+		if (ret <= 0 || res[0] != req[0]) {
+			fprintf(stderr, "command %d failed\n", i);
+			return 1;
+		}
+		lat[i] = now_us() - start;
+		bytes += ret;
+	}
+	elapsed = now_us() - elapsed;
+
+	qsort(lat, count, sizeof(*lat), cmp_u64);
+	printf("%s, %d commands, %d%% loss, %d ms delay: p50 %llu us, p90 %llu us, p99 %llu us, max %llu us\n",
+	       use_tcp ? "tcp" : "kcp", count, use_tcp ? 0 : loss_percent, delay_ms,
+	       (unsigned long long)lat[count / 2], (unsigned long long)lat[count * 9 / 10],
+	       (unsigned long long)lat[count * 99 / 100], (unsigned long long)lat[count - 1]);
+	if (packet_size) {
+		printf("%d byte packets: %llu response bytes/s", packet_size,
+		       (unsigned long long)(bytes * 1000000 / (elapsed ? elapsed : 1)));
+		if (bytes < (uint64_t)count * (4 + words * 4))
+			printf(" (short responses, no target?)");
+		printf("\n");
+	}
+
+	free(lat);
+	if (t.kcp)
+		ikcp_release(t.kcp);
+	close(t.fd);
+	return 0;
+}
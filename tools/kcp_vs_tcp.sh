@@ -0,0 +1,21 @@
+#!/bin/sh
+# Run tools/kcp_dap_client.c over KCP and over elaphureLink/TCP with the same options
+# and print the p99 latency of each path. -l only reaches the KCP path, -d both,
+# see kcp_dap_client.c. For loss on both paths, use tc netem and no -l.
+# usage: kcp_vs_tcp.sh [kcp_dap_client options] host [port]
+#        KCP_DAP_CLIENT=path/to/kcp_dap_client if it is not in the current directory
+
+client=${KCP_DAP_CLIENT:-./kcp_dap_client}
+ret=0
+
+for path in kcp tcp; do
+	if [ $path = tcp ]; then
+		out=$("$client" -t "$@") || ret=1
+	else
+		out=$("$client" "$@") || ret=1
+	fi
+	p99=$(echo "$out" | sed -n 's/.*p99 \([0-9]*\) us.*/\1/p')
+	echo "$path p99: ${p99:-failed} us"
+done
+
+exit $ret
@@ -0,0 +1,173 @@
+/*
+ * Multithreaded stress test and benchmark of the lock-free stack behind memory_pool
+ * (components/memory_pool/memory_pool_stack.h).
+ *
+ * stress: threads take buffers, claim them in an owner table (a buffer handed out twice
+ * is caught there), scribble over them, check nobody else did, and give them back.
+ * At the end every buffer has to be on the stack exactly once.
+ * bench: get/put pairs per second against a mutex protected stack, which stands in for
+ * the FreeRTOS queue the pool used before.
+ *
+ * build: cc -O2 -pthread -I.. -o memory_pool_stress memory_pool_stress.c
+ *        or: cmake -S host -B build && cmake --build build
+ * usage: memory_pool_stress [seconds]
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "components/memory_pool/memory_pool_stack.h"
+
+#define BUFFER_NR 6
+#define BUFFER_SZ 256
+#define THREADS_MAX 8
+
+static uint8_t buffers[BUFFER_NR][BUFFER_SZ];
+static uint16_t next[BUFFER_NR];
+static mp_stack_t stack = { .next = next };
+static int owner[BUFFER_NR];
+static int stop;
+static int errors;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int locked_stack[BUFFER_NR], locked_top;
+
+static void *stress_thread(void *arg)
+{
+	int id = (int)(intptr_t)arg + 1, held[BUFFER_NR], n;
+	unsigned int seed = id;
+	uint64_t rounds = 0;
+
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		// take a few, sometimes more than there are
+		for (n = 0; n < 1 + rand_r(&seed) % 3; n++) {
+			int idx = mp_stack_pop(&stack), expected = 0;
+			if (idx < 0)
+				break;
+			if (!__atomic_compare_exchange_n(&owner[idx], &expected, id, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				printf("buffer %d handed to thread %d, owned by %d\n", idx, id, expected);
+				__atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+				held[n] = -1; // the owner gives it back
+				continue;
+			}
+			memset(buffers[idx], id, BUFFER_SZ);
+			held[n] = idx;
+		}
+
+		for (int i = 0; i < n; i++) {
+			int idx = held[i];
+			if (idx < 0)
+				continue;
+			for (int j = 0; j < BUFFER_SZ; j++) {
+				if (buffers[idx][j] != (uint8_t)id) {
+					printf("buffer %d written by someone else\n", idx);
+					__atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+					break;
+				}
+			}
+			__atomic_store_n(&owner[idx], 0, __ATOMIC_RELEASE);
+			mp_stack_push(&stack, idx);
+		}
+		rounds++;
+	}
+	return (void *)(uintptr_t)rounds;
+}
+
+static void *lock_free_thread(void *arg)
+{
+	uint64_t ops = 0;
+	int idx;
+
+	(void)arg;
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		idx = mp_stack_pop(&stack);
+		if (idx >= 0) {
+			mp_stack_push(&stack, idx);
+			ops++;
+		}
+	}
+	return (void *)(uintptr_t)ops;
+}
+
+static void *mutex_thread(void *arg)
+{
+	uint64_t ops = 0;
+	int idx;
+
+	(void)arg;
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&lock);
+		idx = locked_top > 0 ? locked_stack[--locked_top] : -1;
+		pthread_mutex_unlock(&lock);
+		if (idx >= 0) {
+			pthread_mutex_lock(&lock);
+			locked_stack[locked_top++] = idx;
+			pthread_mutex_unlock(&lock);
+			ops++;
+		}
+	}
+	return (void *)(uintptr_t)ops;
+}
+
+static uint64_t run(void *(*fn)(void *), int threads, double seconds)
+{
+	pthread_t tid[THREADS_MAX];
+	uint64_t total = 0;
+	void *ret;
+
+	__atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+	for (int i = 0; i < threads; i++)
+		pthread_create(&tid[i], NULL, fn, (void *)(intptr_t)i);
+	usleep(seconds * 1e6);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+	for (int i = 0; i < threads; i++) {
+		pthread_join(tid[i], &ret);
+		total += (uintptr_t)ret;
+	}
+	return total;
+}
+
+static int check_stack(void)
+{
+	int seen[BUFFER_NR] = { 0 }, idx, count = 0;
+
+	while ((idx = mp_stack_pop(&stack)) >= 0) {
+		if (seen[idx]++)
+			return -1;
+		count++;
+	}
+	for (int i = BUFFER_NR - 1; i >= 0; i--)
+		mp_stack_push(&stack, i);
+	return count == BUFFER_NR ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = argc > 1 ? atof(argv[1]) : 1;
+	uint64_t ops;
+
+	for (int i = BUFFER_NR - 1; i >= 0; i--)
+		mp_stack_push(&stack, i);
+	for (int i = 0; i < BUFFER_NR; i++)
+		locked_stack[locked_top++] = i;
+
+	ops = run(stress_thread, THREADS_MAX, seconds);
+	if (check_stack() != 0) {
+		printf("stack lost or duplicated buffers\n");
+		errors++;
+	}
+	printf("stress: %d threads, %llu rounds, %d errors\n", THREADS_MAX, (unsigned long long)ops, errors);
+
+	for (int threads = 1; threads <= 4; threads *= 2) {
+		uint64_t lock_free = run(lock_free_thread, threads, seconds / 2);
+		uint64_t mutex = run(mutex_thread, threads, seconds / 2);
+		printf("%d threads: lock-free %.1f M get/put per s, mutex %.1f M\n", threads,
+		       lock_free / (seconds / 2) / 1e6, mutex / (seconds / 2) / 1e6);
+	}
+	return errors != 0;
+}
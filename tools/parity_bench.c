@@ -0,0 +1,140 @@
+/*
+ * Microbenchmark of the SWD parity and request byte helpers, on the host.
+ *
+ * 32-bit data parity:
+ *   fold:    ParityEvenUint32 of dap_utility.h on targets without popcount (xor fold, 0x6996)
+ *   builtin: __builtin_parity, what ParityEvenUint32 uses with popcount (Zbb, POPCNT)
+ *   bytes:   four kParityByteTable lookups
+ *   loop:    bit by bit, as SWD_Transfer_GPIO accumulates it while clocking
+ * Request byte:
+ *   table:   SwdRequestByte, kSwdRequestByteTable
+ *   compute: start/stop/park bits, request << 1 and ParityEvenUint8 << 5, as SW_DP.c used to
+ *
+ * Every variant is first checked against the others (all request nibbles, the 32-bit
+ * inputs of the run), a mismatch fails the run. Then ns per call are printed. The host
+ * CPU is not an Xtensa, the numbers only compare the variants with each other.
+ *
+ * build: cmake -S host -B build && cmake --build build
+ * usage: parity_bench [-n iterations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "DAP_config.h"
+#include "cmsis-dap/include/dap_utility.h"
+
+#define INPUTS 4096
+
+static uint32_t inputs[INPUTS];
+static volatile uint32_t sink;
+
+static inline uint8_t parity_fold(uint32_t v)
+{
+	v ^= v >> 16;
+	v ^= v >> 8;
+	v ^= v >> 4;
+	v &= 0xf;
+	return (0x6996 >> v) & 1;
+}
+
+static inline uint8_t parity_builtin(uint32_t v)
+{
+	return __builtin_parity(v);
+}
+
+static inline uint8_t parity_bytes(uint32_t v)
+{
+	return kParityByteTable[v & 0xFF] ^ kParityByteTable[(v >> 8) & 0xFF] ^
+	       kParityByteTable[(v >> 16) & 0xFF] ^ kParityByteTable[v >> 24];
+}
+
+static inline uint8_t parity_loop(uint32_t v)
+{
+	uint32_t parity = 0;
+
+	for (int n = 32; n; n--) {
+		parity += v;
+		v >>= 1;
+	}
+	return parity & 1;
+}
+
+static inline uint8_t request_table(uint32_t request)
+{
+	return SwdRequestByte(request);
+}
+
+static inline uint8_t request_compute(uint32_t request)
+{
+	const uint8_t constantBits = 0x81U; /* Start Bit & Stop Bit & Park Bit */
+
+	return constantBits | (((uint8_t)(request & 0xFU)) << 1U) | (ParityEvenUint8(request & 0xFU) << 5U);
+}
+
+#define BENCH(name, fn, mask)                                                            \
+	do {                                                                             \
+		uint64_t t0 = host_time_ns();                                            \
+		uint32_t acc = 0;                                                        \
+		for (long i = 0; i < iterations; i++)                                    \
+			acc += fn(inputs[i % INPUTS] & (mask));                          \
+		sink = acc;                                                              \
+		printf("%-16s %6.2f ns\n", name, (double)(host_time_ns() - t0) / iterations); \
+	} while (0)
+
+int main(int argc, char **argv)
+{
+	long iterations = 100000000;
+	uint32_t x = 0x12345678;
+	int opt, errors = 0;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	inputs[0] = 0;
+	inputs[1] = 0xFFFFFFFF;
+	inputs[2] = 0x80000000;
+	for (int i = 3; i < INPUTS; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		inputs[i] = x;
+	}
+
+	for (int i = 0; i < INPUTS; i++) {
+		uint8_t p = parity_fold(inputs[i]);
+
+		if (ParityEvenUint32(inputs[i]) != p || parity_builtin(inputs[i]) != p ||
+		    parity_bytes(inputs[i]) != p || parity_loop(inputs[i]) != p) {
+			printf("parity of %08x differs\n", inputs[i]);
+			errors++;
+		}
+	}
+	for (uint32_t r = 0; r < 16; r++) {
+		if (request_table(r) != request_compute(r)) {
+			printf("request byte of %x: table %02x, computed %02x\n", r, request_table(r),
+			       request_compute(r));
+			errors++;
+		}
+	}
+	if (errors)
+		return 1;
+
+	BENCH("fold", parity_fold, 0xFFFFFFFF);
+	BENCH("builtin", parity_builtin, 0xFFFFFFFF);
+	BENCH("bytes", parity_bytes, 0xFFFFFFFF);
+	BENCH("loop", parity_loop, 0xFFFFFFFF);
+	BENCH("request table", request_table, 0xF);
+	BENCH("request compute", request_compute, 0xF);
+	return 0;
+}
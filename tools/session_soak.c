@@ -0,0 +1,244 @@
+/*
+ * Reconnect soak of the DAP proxy heap, on a host.
+ *
+ * A first-fit heap with coalescing stands in for the internal RAM heap of the chip.
+ * Every reconnect replays the allocations of one elaphureLink or websocket connection
+ * while the network stack allocates and frees buffers of its own around them, some of
+ * which outlive the connection, and now and then something is allocated for good
+ * (lazily initialized parts of the firmware). Two ways of getting the per-connection
+ * memory are compared:
+ *   churn: session task, pipeline and buffers allocated on connect and freed on disconnect,
+ *          like the proxy used to do
+ *   arena: the same objects allocated once at boot and reused, see dap_session_init
+ * For each, free heap and largest free block are printed after boot and once the soak is
+ * over and every client has disconnected, with the allocations that failed on the way.
+ * Sizes are those of the default proxy_server_conf.h: two session slots without PSRAM,
+ * three with PSRAM, where the pipeline buffers leave the internal heap.
+ *
+ * build: cc -O2 -o session_soak session_soak.c
+ *        cc -O2 -DSESSION_MAX=3 -DSPIRAM -o session_soak session_soak.c
+ *        or: cmake -S host -B build && cmake --build build
+ * usage: session_soak [reconnects]
+ *        exits with 1 if an allocation failed with the arena
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HEAP_SIZE   (160 * 1024)
+#define ALIGN       8
+#define HDR         8 /* block header: size | used */
+
+#ifndef SESSION_MAX
+#define SESSION_MAX 2
+#endif
+#define BG_MAX      32
+
+static uint8_t heap[HEAP_SIZE] __attribute__((aligned(ALIGN)));
+static uint32_t min_free;
+static uint32_t connect_failures, other_failures;
+
+#define BLOCK_SIZE(p) (*(uint32_t *)(p) & ~1u)
+#define BLOCK_USED(p) (*(uint32_t *)(p) & 1u)
+
+static void heap_init(void)
+{
+	*(uint32_t *)heap = HEAP_SIZE;
+	min_free = HEAP_SIZE;
+	connect_failures = other_failures = 0;
+}
+
+// merge the free blocks that follow `p`
+static void heap_merge(uint8_t *p)
+{
+	uint8_t *n;
+
+	while ((n = p + BLOCK_SIZE(p)) < heap + HEAP_SIZE && !BLOCK_USED(n))
+		*(uint32_t *)p = BLOCK_SIZE(p) + BLOCK_SIZE(n);
+}
+
+static void heap_stats(uint32_t *free_size, uint32_t *largest)
+{
+	*free_size = *largest = 0;
+	for (uint8_t *p = heap; p < heap + HEAP_SIZE; p += BLOCK_SIZE(p)) {
+		if (BLOCK_USED(p))
+			continue;
+		heap_merge(p);
+		*free_size += BLOCK_SIZE(p) - HDR;
+		if (BLOCK_SIZE(p) - HDR > *largest)
+			*largest = BLOCK_SIZE(p) - HDR;
+	}
+}
+
+static void *heap_malloc(uint32_t size)
+{
+	uint32_t need = (size + HDR + ALIGN - 1) & ~(ALIGN - 1), free_size, largest;
+
+	for (uint8_t *p = heap; p < heap + HEAP_SIZE; p += BLOCK_SIZE(p)) {
+		if (BLOCK_USED(p))
+			continue;
+		heap_merge(p);
+		if (BLOCK_SIZE(p) < need)
+			continue;
+		if (BLOCK_SIZE(p) - need >= HDR + ALIGN) {
+			*(uint32_t *)(p + need) = BLOCK_SIZE(p) - need;
+			*(uint32_t *)p = need;
+		}
+		*(uint32_t *)p |= 1;
+
+		heap_stats(&free_size, &largest);
+		if (free_size < min_free)
+			min_free = free_size;
+		return p + HDR;
+	}
+
+	return NULL;
+}
+
+static void heap_free(void *ptr)
+{
+	if (ptr)
+		*(uint32_t *)((uint8_t *)ptr - HDR) &= ~1u;
+}
+
+/*
+ * Per-connection objects, in the order a websocket connection took them.
+ * elaphureLink connections have no multi-command buffer.
+ */
+static const struct {
+	const char *name;
+	uint32_t size;
+	int spiram; /* goes to PSRAM when the chip has it */
+} conn_objects[] = {
+	{ "session task stack", 4096, 0 },
+	{ "session task tcb", 352, 0 },
+	{ "multi-command buffer", 5613, 0 },
+	{ "pipeline", 96, 0 },
+	{ "pipeline done", 80, 0 },
+	{ "pipeline free queue", 84, 0 },
+	{ "pipeline req queue", 85, 0 },
+	{ "pipeline slots", 4 * 1400, 1 },
+	{ "pipeline tx buffer", 2 * 1404, 1 },
+	{ "pipeline chain", 1400, 1 },
+	{ "pipeline task stack", 3072, 0 },
+	{ "pipeline task tcb", 352, 0 },
+};
+
+#ifdef SPIRAM
+#define IN_HEAP(i) (!conn_objects[i].spiram)
+#else
+#define IN_HEAP(i) 1
+#endif
+
+#define CONN_OBJECTS ((int)(sizeof(conn_objects) / sizeof(conn_objects[0])))
+
+/* buffers of the network stack and the web server: pbufs, pcbs, socket and http buffers */
+static struct {
+	void *ptr;
+	uint32_t until; /* reconnect in which it is freed */
+} bg[BG_MAX];
+
+static unsigned int seed;
+
+static void bg_tick(uint32_t now, int count)
+{
+	for (int i = 0; i < BG_MAX; i++) {
+		if (bg[i].ptr && bg[i].until <= now) {
+			heap_free(bg[i].ptr);
+			bg[i].ptr = NULL;
+		}
+	}
+	for (int i = 0; i < BG_MAX && count > 0; i++) {
+		if (bg[i].ptr)
+			continue;
+		// mostly short lived, now and then something that stays for a while (TIME_WAIT pcbs, caches)
+		uint32_t life = rand_r(&seed) % 16 == 0 ? 20 + rand_r(&seed) % 200 : rand_r(&seed) % 3;
+		bg[i].ptr = heap_malloc(64 + rand_r(&seed) % 1600);
+		bg[i].until = now + life;
+		if (bg[i].ptr == NULL)
+			other_failures++;
+		count--;
+	}
+}
+
+static void bg_free_all(void)
+{
+	for (int i = 0; i < BG_MAX; i++) {
+		heap_free(bg[i].ptr);
+		bg[i].ptr = NULL;
+	}
+}
+
+static uint32_t soak(const char *mode, int arena, int reconnects)
+{
+	void *objects[SESSION_MAX][CONN_OBJECTS] = { { 0 } };
+	uint32_t free_size, largest;
+
+	heap_init();
+	memset(bg, 0, sizeof(bg));
+	seed = 1;
+
+	// what the rest of the firmware holds for good
+	heap_malloc(40 * 1024);
+	heap_malloc(12 * 1024);
+
+	if (arena) {
+		for (int s = 0; s < SESSION_MAX; s++)
+			for (int i = 0; i < CONN_OBJECTS; i++)
+				if (IN_HEAP(i))
+					objects[s][i] = heap_malloc(conn_objects[i].size);
+	}
+
+	heap_stats(&free_size, &largest);
+	printf("%s after boot: free %u, largest block %u\n", mode, free_size, largest);
+
+	for (int n = 0; n < reconnects; n++) {
+		int s = n % SESSION_MAX, websocket = rand_r(&seed) & 1;
+
+		bg_tick(n, 4);
+		if (!arena) {
+			// the last connection of the slot goes away, the other slots stay connected
+			for (int i = 0; i < CONN_OBJECTS; i++) {
+				heap_free(objects[s][i]);
+				objects[s][i] = NULL;
+			}
+			for (int i = 0; i < CONN_OBJECTS; i++) {
+				if ((i == 2 && !websocket) || !IN_HEAP(i))
+					continue;
+				objects[s][i] = heap_malloc(conn_objects[i].size);
+				if (objects[s][i] == NULL)
+					connect_failures++;
+				if (i % 4 == 0)
+					bg_tick(n, 1); // the handshake and the first requests
+			}
+		}
+		bg_tick(n, 4);
+		if (n % 500 == 250 && heap_malloc(64 + rand_r(&seed) % 192) == NULL)
+			other_failures++;
+	}
+
+	// everybody gone
+	bg_free_all();
+	if (!arena) {
+		for (int s = 0; s < SESSION_MAX; s++)
+			for (int i = 0; i < CONN_OBJECTS; i++)
+				heap_free(objects[s][i]);
+	}
+
+	heap_stats(&free_size, &largest);
+	printf("%s after %d reconnects: free %u, largest block %u (%.0f%% fragmented), min free %u, "
+	       "%u failed connects, %u other failed allocations\n", mode, reconnects, free_size, largest,
+	       100.0 * (1 - (double)largest / free_size), min_free, connect_failures, other_failures);
+	return connect_failures + other_failures;
+}
+
+int main(int argc, char **argv)
+{
+	int reconnects = argc > 1 ? atoi(argv[1]) : 10000;
+
+	soak("churn", 0, reconnects);
+	// the arena has to come through without a single failed allocation
+	return soak("arena", 1, reconnects) ? 1 : 0;
+}
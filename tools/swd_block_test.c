@@ -0,0 +1,269 @@
+/*
+ * SWD_TransferBlock through SPI against per-word SWD_Transfer, on the host.
+ *
+ * SW_DP.c is built with USE_SWD_SIM 2: its SPI backend runs unchanged and host/spi_sim.c
+ * serves the SPI transfers from the target model of swd_sim.c. Every case writes a
+ * block of words into the simulated RAM and reads it back, once with SWD_TransferBlock
+ * (SWD_TransferBlock_SPI) and once word by word with SWD_Transfer (SWD_Transfer_SPI),
+ * each from a freshly reset target. Both must stop at the same word with the same ACK,
+ * read the same data and leave the target in the same state, and the block path must
+ * not skip a data phase nor send a wrong parity bit.
+ *
+ * spi_sim.c also checks the scheduling of the block write: every word is put on the
+ * wire with DAP_SPI_Write_Data_Start and the next one is prepared before DAP_SPI_Wait_Done,
+ * nothing else may touch the SPI or the pins in between. First the model itself is
+ * checked to catch a misordered sequence. Last, a DAP_TransferBlock command must stop
+ * streaming its block at the word where DAP_TransferAbort is raised.
+ *
+ * build: cmake -S host -B build && cmake --build build
+ * usage: swd_block_test
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "DAP_config.h"
+#include "cmsis-dap/include/DAP.h"
+#include "cmsis-dap/include/dap_utility.h"
+#include "cmsis-dap/include/spi_op.h"
+#include "cmsis-dap/include/spi_switch.h"
+#include "cmsis-dap/include/swd_sim.h"
+#include "spi_sim.h"
+
+#define WORDS_MAX 256
+
+/* request codes: A[3:2] RnW APnDP */
+#define DP_W_ABORT    0x00U
+#define DP_R_IDCODE   0x02U
+#define DP_W_CTRL     0x04U
+#define DP_W_SELECT   0x08U
+#define AP_W_CSW      0x01U
+#define AP_W_TAR      0x05U
+#define AP_W_DRW      0x0DU
+#define AP_R_DRW      0x0FU
+
+typedef struct {
+	const char *name;
+	uint32_t addr;
+	uint32_t words;
+	uint32_t wait_interval;
+	uint8_t idle_cycles;
+} test_case_t;
+
+typedef struct {
+	uint32_t write_num, read_num;
+	uint8_t write_ack, read_ack;
+	uint8_t rdata[WORDS_MAX * 4];
+	swd_sim_stats_t sim;
+	spi_sim_stats_t spi;
+} result_t;
+
+static const test_case_t cases[] = {
+	{ "64 words",            0x20000000U, 64,  0, 0 },
+	{ "256 words",           0x20000100U, 256, 0, 0 },
+	{ "1 word",              0x20000040U, 1,   0, 0 },
+	{ "WAIT every 7",        0x20000000U, 64,  7, 0 },
+	{ "WAIT on the first",   0x20000000U, 16,  1, 0 },
+	{ "runs out of RAM",     0x20000000U + SWD_SIM_RAM_SIZE - 32U, 16, 0, 0 },
+	{ "2 idle cycles",       0x20000000U, 64,  0, 2 },
+};
+
+static uint8_t dp_ap(uint32_t request, uint32_t value)
+{
+	return SWD_Transfer(request, &value);
+}
+
+static void target_setup(uint32_t addr)
+{
+	uint32_t val;
+
+	DAP_Setup();
+	SPI_Sim_Reset();
+	SWD_Sim_SetWaitInterval(0);
+	SWD_TransferSpeed = kTransfer_SPI;
+	DAP_Data.transfer.idle_cycles = 0U;
+
+	SWD_Transfer(DP_R_IDCODE, &val);
+	dp_ap(DP_W_ABORT, 0x1EU);
+	dp_ap(DP_W_SELECT, 0U);
+	dp_ap(DP_W_CTRL, 0x50000000U);
+	dp_ap(AP_W_CSW, 0x23000012U);  /* 32-bit, auto increment */
+	dp_ap(AP_W_TAR, addr);
+}
+
+static uint32_t per_word(uint32_t request, const uint8_t *wdata, uint8_t *rdata, uint32_t count, uint8_t *ack)
+{
+	uint32_t val, n;
+
+	*ack = DAP_TRANSFER_OK;
+	for (n = 0; n < count; n++) {
+		if (request & DAP_TRANSFER_RnW) {
+			*ack = SWD_Transfer(request, &val);
+			if (*ack != DAP_TRANSFER_OK)
+				break;
+			memcpy(rdata + 4 * n, &val, 4);
+		} else {
+			memcpy(&val, wdata + 4 * n, 4);
+			*ack = SWD_Transfer(request, &val);
+			if (*ack != DAP_TRANSFER_OK)
+				break;
+		}
+	}
+	return n;
+}
+
+static void run(const test_case_t *tc, int block, result_t *res)
+{
+	uint8_t wdata[WORDS_MAX * 4];
+
+	for (uint32_t i = 0; i < tc->words * 4; i++)
+		wdata[i] = (uint8_t)(i * 151U + tc->addr);
+	memset(res, 0, sizeof(*res));
+
+	target_setup(tc->addr);
+	SWD_Sim_SetWaitInterval(tc->wait_interval);
+	DAP_Data.transfer.idle_cycles = tc->idle_cycles;
+	if (block)
+		res->write_num = SWD_TransferBlock(AP_W_DRW, wdata, NULL, tc->words, &res->write_ack);
+	else
+		res->write_num = per_word(AP_W_DRW, wdata, NULL, tc->words, &res->write_ack);
+
+	/* read back from a clean target state, the RAM is kept */
+	SWD_Sim_SetWaitInterval(0);
+	dp_ap(DP_W_ABORT, 0x1EU);
+	dp_ap(AP_W_TAR, tc->addr);
+	SWD_Sim_SetWaitInterval(tc->wait_interval);
+	if (block)
+		res->read_num = SWD_TransferBlock(AP_R_DRW, NULL, res->rdata, tc->words, &res->read_ack);
+	else
+		res->read_num = per_word(AP_R_DRW, NULL, res->rdata, tc->words, &res->read_ack);
+
+	SWD_Sim_GetStats(&res->sim);
+	SPI_Sim_GetStats(&res->spi);
+}
+
+static int check(const test_case_t *tc)
+{
+	static result_t blk, word;
+	int errors = 0;
+
+	run(tc, 1, &blk);
+	run(tc, 0, &word);
+
+#define EXPECT_SAME(field)                                                               \
+	do {                                                                             \
+		if (blk.field != word.field) {                                           \
+			printf("  %s: block %u, per word %u\n", #field,                  \
+			       (unsigned)blk.field, (unsigned)word.field);                \
+			errors++;                                                        \
+		}                                                                        \
+	} while (0)
+
+	EXPECT_SAME(write_num);
+	EXPECT_SAME(write_ack);
+	EXPECT_SAME(read_num);
+	EXPECT_SAME(read_ack);
+	EXPECT_SAME(sim.transfers);
+	EXPECT_SAME(sim.waits);
+	EXPECT_SAME(sim.faults);
+	EXPECT_SAME(spi.headers);
+	EXPECT_SAME(spi.reads);
+	EXPECT_SAME(spi.writes);
+	if (memcmp(blk.rdata, word.rdata, blk.read_num * 4) != 0) {
+		printf("  read data differs\n");
+		errors++;
+	}
+	if (blk.spi.misuse || blk.spi.parity_errors) {
+		printf("  block: %u data phases out of place, %u parity errors\n",
+		       blk.spi.misuse, blk.spi.parity_errors);
+		errors++;
+	}
+	if (blk.spi.order_errors || word.spi.order_errors) {
+		printf("  SPI used while a data phase is on the wire: block %u, per word %u\n",
+		       blk.spi.order_errors, word.spi.order_errors);
+		errors++;
+	}
+	if (blk.spi.starts != blk.write_num || word.spi.starts != 0) {
+		printf("  %u of %u words written with Write_Data_Start, per word %u\n",
+		       blk.spi.starts, blk.write_num, word.spi.starts);
+		errors++;
+	}
+
+	printf("%-18s %s: wrote %u ack %u, read %u ack %u, %u SWD transfers\n", tc->name,
+	       errors ? "FAIL" : "ok", blk.write_num, blk.write_ack, blk.read_num, blk.read_ack,
+	       blk.sim.transfers);
+	return errors;
+}
+
+/* the model must notice what the block write is checked for */
+static int check_order_model(void)
+{
+	spi_sim_stats_t stats;
+	uint8_t ack;
+	int errors = 0;
+
+	target_setup(0x20000000U);
+	DAP_SPI_Send_Header(SwdRequestByte(AP_W_DRW), &ack, 1);
+	DAP_SPI_Write_Data_Start(0x12345678U, 0);
+	DAP_SPI_Send_Header(SwdRequestByte(AP_W_DRW), &ack, 1);  /* still on the wire */
+	DAP_SPI_Wait_Done();
+	DAP_SPI_Wait_Done();                                     /* nothing started */
+	DAP_SPI_Write_Data_Start(0x12345678U, 0);
+	DAP_SPI_Disable();                                       /* still on the wire */
+	DAP_SPI_Wait_Done();
+	SPI_Sim_GetStats(&stats);
+
+	if (stats.order_errors != 3 || stats.starts != 2) {
+		printf("  model: %u order errors, %u starts, expected 3 and 2\n", stats.order_errors,
+		       stats.starts);
+		errors++;
+	}
+	printf("%-18s %s\n", "SPI order model", errors ? "FAIL" : "ok");
+	return errors;
+}
+
+/* DAP_TransferAbort raised while the `at`th word of a 300 word block write is on the wire */
+static int check_abort(uint32_t at)
+{
+	static uint8_t request[5 + 300 * 4], response[4];
+	const uint32_t words = 300;
+	spi_sim_stats_t stats, before;
+	uint32_t count;
+	int errors = 0;
+
+	request[0] = ID_DAP_TransferBlock;
+	request[1] = 0;                                 /* DAP index */
+	request[2] = (uint8_t)words;
+	request[3] = (uint8_t)(words >> 8);
+	request[4] = AP_W_DRW;
+	for (uint32_t i = 0; i < words * 4; i++)
+		request[5 + i] = (uint8_t)i;
+
+	target_setup(0x20000000U);
+	DAP_Data.debug_port = DAP_PORT_SWD;
+	SPI_Sim_GetStats(&before);
+	SPI_Sim_AbortAt(before.headers + at);
+	DAP_ProcessCommand(request, response);
+	SPI_Sim_GetStats(&stats);
+
+	count = response[1] | (response[2] << 8);
+	if (count != at || response[3] != DAP_TRANSFER_OK || stats.headers - before.headers != at) {
+		printf("  abort at word %u: %u words written, ack %u, %u request phases\n", at, count,
+		       response[3], stats.headers - before.headers);
+		errors++;
+	}
+	printf("%-18s %s: %u of %u words\n", "abort mid-block", errors ? "FAIL" : "ok", count, words);
+	return errors;
+}
+
+int main(void)
+{
+	int errors = check_order_model();
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+		errors += check(&cases[i]);
+	errors += check_abort(100);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * USBIP server of the DAP proxy, on the host.
+ *
+ * usbip_server.c, DAP_handle.c (the request/response slot pipeline and DAP_Thread),
+ * usb_handle.c and the DAP engine run unchanged on Linux: FreeRTOS and lwIP are
+ * served by host/host_rtos.c and the POSIX sockets, the SWD wire by swd_sim.c.
+ * Any usbip client can attach, tools/usbip_replay.py or `usbip attach -r localhost -b 1-1`.
+ *
+ * After every connection it prints the DAP requests per second and the copies made
+ * by the DAP proxy itself: memcpy/memmove calls of usbip_server.c and DAP_handle.c,
+ * counted per DAP request, with the bytes they moved. recv() into the session buffer
+ * and sendmsg() out of it are the copies of the network stack and are not counted.
+ * The transmit aggregation counters follow: stage2 records per socket write and why
+ * each write was flushed. -g fails the run (exit 1) when fewer than min_records
+ * records per write were gathered, on average, for ctest. Last, how long the IN URBs
+ * waited for their response (DAP_STATS_WAIT_RESPONSE). -b serves the session from
+ * the first buffer_size bytes of its receive buffer only, so that more records reach
+ * its end and have to be carried over.
+ *
+ * build: cmake -S host -B build && cmake --build build
+ * usage: usbip_host [-p port] [-n connections] [-w wait_interval] [-g min_records] [-b buffer_size]
+ *        -n 0 serves until killed, -w makes the target answer WAIT every wait_interval transfers
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "DAP_config.h"
+#include "cmsis-dap/include/DAP.h"
+#include "cmsis-dap/include/dap_stats.h"
+#include "cmsis-dap/include/swd_sim.h"
+#include "components/dap_proxy/usbip_server.h"
+#include "components/dap_proxy/DAP_handle.h"
+#include "components/dap_proxy/dap_session.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+/* usbip_server.c and DAP_handle.c are built with memcpy/memmove renamed to these */
+static uint64_t copy_calls, copy_bytes;
+
+void *host_memcpy(void *dst, const void *src, size_t n)
+{
+	__atomic_add_fetch(&copy_calls, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&copy_bytes, n, __ATOMIC_RELAXED);
+	return memcpy(dst, src, n);
+}
+
+void *host_memmove(void *dst, const void *src, size_t n)
+{
+	__atomic_add_fetch(&copy_calls, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&copy_bytes, n, __ATOMIC_RELAXED);
+	return memmove(dst, src, n);
+}
+
+static int listen_on(int port)
+{
+	struct sockaddr_in addr = { 0 };
+	int on = 1;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* the usbip branch of tcp_session_serve */
+static void serve(int fd, uint8_t *buffer, uint32_t size)
+{
+	enum usbip_server_state_t state;
+	uint32_t header;
+	int ret, sz = 4;
+
+	while (sz > 0) {
+		ret = recv(fd, buffer + 4 - sz, sz, 0);
+		if (ret <= 0)
+			return;
+		sz -= ret;
+	}
+
+	header = ntohl(*(uint32_t *)buffer) & 0xFFFF;
+	if (header == 0x8005) {
+		state = WAIT_DEVLIST;
+	} else if (header == 0x8003) {
+		state = WAIT_IMPORT;
+	} else {
+		printf("not a usbip client\n");
+		return;
+	}
+	usbip_worker(fd, buffer, size, &state);
+}
+
+int main(int argc, char **argv)
+{
+	static uint8_t buffer[DAP_SESSION_BUFFER_SIZE];
+	dap_queue_stats_t queue;
+	usbip_tx_stats_t tx;
+	dap_stats_t stats;
+	dap_stats_hist_t *wait_response;
+	double gather, min_gather = 0;
+	int port = DAP_PROXY_PORT, connections = 0, wait = 0, size = sizeof(buffer);
+	int listen_fd, fd, opt, ret = 0;
+	int64_t start, elapsed;
+
+	while ((opt = getopt(argc, argv, "p:n:w:g:b:")) != -1) {
+		switch (opt) {
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'n':
+			connections = atoi(optarg);
+			break;
+		case 'w':
+			wait = atoi(optarg);
+			break;
+		case 'g':
+			min_gather = atof(optarg);
+			break;
+		case 'b':
+			size = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p port] [-n connections] [-w wait_interval] [-g min_records] [-b buffer_size]\n",
+			        argv[0]);
+			return 2;
+		}
+	}
+	if (size < 64 || size > (int)sizeof(buffer)) {
+		fprintf(stderr, "buffer size 64..%u\n", (unsigned)sizeof(buffer));
+		return 2;
+	}
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	DAP_Setup();
+	SWD_Sim_SetWaitInterval(wait);
+	if (dap_session_init() != 0) {
+		fprintf(stderr, "dap_session_init failed\n");
+		return 1;
+	}
+	xTaskCreate(DAP_Thread, "DAP_Task", 2048, NULL, 10, NULL);
+
+	listen_fd = listen_on(port);
+	if (listen_fd < 0) {
+		perror("listen");
+		return 1;
+	}
+	printf("usbip host: listening on port %d\n", port);
+
+	for (int i = 0; connections == 0 || i < connections; i++) {
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			perror("accept");
+			return 1;
+		}
+		opt = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+		__atomic_store_n(&copy_calls, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&copy_bytes, 0, __ATOMIC_RELAXED);
+		DAP_Stats_Reset();
+		start = esp_timer_get_time();
+		serve(fd, buffer, size);
+		elapsed = esp_timer_get_time() - start;
+		close(fd);
+
+		dap_queue_get_stats(&queue);
+		usbip_tx_get_stats(&tx);
+		printf("usbip host: %u requests in %.3f s, %.0f requests/s\n", queue.requests, elapsed / 1e6,
+		       elapsed ? queue.requests * 1e6 / elapsed : 0.0);
+		if (queue.requests)
+			printf("usbip host: %.2f copies, %.0f bytes copied per request\n",
+			       (double)copy_calls / queue.requests, (double)copy_bytes / queue.requests);
+
+		gather = tx.segments ? (double)tx.submits / tx.segments : 0;
+		printf("usbip host: %u records in %u writes, %.2f records and %u bytes per write, max %u\n",
+		       tx.submits, tx.segments, gather, tx.segments ? tx.bytes / tx.segments : 0, tx.max_segment);
+		printf("usbip host: flushed %u on size, %u on idle input, %u on deadline\n",
+		       tx.flush_size, tx.flush_idle, tx.flush_deadline);
+		DAP_Stats_Snapshot(&stats);
+		wait_response = &stats.event[DAP_STATS_WAIT_RESPONSE];
+		printf("usbip host: %u IN URBs waited %.0f us for their response, max %u us\n",
+		       wait_response->count, wait_response->count ? (double)wait_response->total / wait_response->count : 0.0,
+		       wait_response->max);
+		if (gather < min_gather) {
+			printf("usbip host: less than %.2f records per write\n", min_gather);
+			ret = 1;
+		}
+	}
+
+	close(listen_fd);
+	return ret;
+}
@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""
+USBIP protocol replay for the DAP endpoint.
+
+Imports the device, then keeps a deep queue of CMD_SUBMIT pairs on ep1: an
+OUT URB with a DAP command, then an IN URB for its response. Some of the IN
+URBs are unlinked at random right after they are submitted. The check is that
+every IN URB that completes carries the response of its own OUT URB, and
+that an URB reported as unlinked never completes. The command rate is printed
+at the end, tools/usbip_host.c serves the same protocol on a Linux host.
+
+With -f, the URBs are not sent one per write: what is queued before the next
+reply is awaited goes out in writes of a random 1 to max_fragment bytes, so
+the device sees records cut anywhere and several records in one segment.
+
+With -q, commands are sent in DAP_QueueCommands chains of that many packets:
+all but the last are queued, and their responses are held back by the probe
+until the last one ends the chain. A queued packet is answered as
+DAP_ExecuteCommands. The chain must not be longer than -d, as the responses
+of a chain are only sent once all of its packets are in.
+
+usage: usbip_replay.py host [-p 3240] [-n 5000] [-d 8] [-u 0.05] [-f max_fragment] [-q 0]
+"""
+
+import argparse
+import random
+import socket
+import struct
+import sys
+import time
+
+USBIP_VERSION = 0x0111
+OP_REQ_IMPORT = 0x8003
+
+CMD_SUBMIT = 1
+CMD_UNLINK = 2
+RET_SUBMIT = 3
+RET_UNLINK = 4
+
+DIR_OUT = 0
+DIR_IN = 1
+EP_DAP = 1
+
+ID_DAP_QueueCommands = 0x7E
+ID_DAP_ExecuteCommands = 0x7F
+
+HDR = struct.Struct(">IIIII")  # command, seqnum, devid, direction, ep
+
+# DAP commands whose response starts with their own command ID
+COMMANDS = [
+    bytes([0x00, 0x04]),                    # DAP_Info: protocol version
+    bytes([0x00, 0xFE]),                    # DAP_Info: packet count
+    bytes([0x01, 0x00, 0x00]),              # DAP_HostStatus
+    bytes([0x09, 0x01, 0x00]),              # DAP_Delay: 1 us, 0 would wrap PIN_DELAY_SLOW
+    bytes([0x7F, 0x01, 0x00, 0xFF]),        # DAP_ExecuteCommands: DAP_Info packet size
+]
+
+
+def recv_exact(sock, n):
+    buf = b""
+    while len(buf) < n:
+        chunk = sock.recv(n - len(buf))
+        if not chunk:
+            raise ConnectionError("connection closed")
+        buf += chunk
+    return buf
+
+
+class Client:
+    def __init__(self, host, port, packet_size, fragment=0):
+        self.sock = socket.create_connection((host, port), timeout=5)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.seqnum = 0
+        self.packet_size = packet_size
+        self.fragment = fragment
+        self.queued = bytearray()
+
+    def send(self, data):
+        if not self.fragment:
+            self.sock.sendall(data)
+            return
+        self.queued += data
+
+    def flush(self):
+        while self.queued:
+            n = random.randint(1, self.fragment)
+            self.sock.sendall(self.queued[:n])
+            del self.queued[:n]
+
+    def attach(self):
+        busid = b"1-1".ljust(32, b"\0")
+        self.sock.sendall(struct.pack(">HHI", USBIP_VERSION, OP_REQ_IMPORT, 0) + busid)
+        _, _, status = struct.unpack(">HHI", recv_exact(self.sock, 8))
+        if status != 0:
+            raise RuntimeError("import failed, status %d" % status)
+        recv_exact(self.sock, 312)  # usbip_usb_device
+
+    def submit(self, direction, data=b""):
+        self.seqnum += 1
+        length = len(data) if direction == DIR_OUT else self.packet_size
+        hdr = HDR.pack(CMD_SUBMIT, self.seqnum, 0x00010001, direction, EP_DAP)
+        hdr += struct.pack(">iiiii", 0, length, 0, 0, 0) + bytes(8)
+        self.send(hdr + data)
+        return self.seqnum
+
+    def unlink(self, target):
+        self.seqnum += 1
+        # ep 0 like Linux vhci, the seqnum alone names the URB
+        hdr = HDR.pack(CMD_UNLINK, self.seqnum, 0x00010001, DIR_OUT, 0)
+        self.send(hdr + struct.pack(">I", target) + bytes(24))
+        return self.seqnum
+
+    def receive(self):
+        self.flush()
+        command, seqnum, _, _, _ = HDR.unpack(recv_exact(self.sock, 20))
+        status, length = struct.unpack(">iI", recv_exact(self.sock, 8))
+        recv_exact(self.sock, 20)
+        if command == RET_SUBMIT:
+            # the device echoes the direction inverted, IN replies carry data
+            data = recv_exact(self.sock, length) if length else b""
+            return command, seqnum, status, data
+        if command == RET_UNLINK:
+            return command, seqnum, status, None
+        raise RuntimeError("unexpected command %d" % command)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("-p", "--port", type=int, default=3240)
+    parser.add_argument("-n", "--count", type=int, default=5000, help="DAP commands to send")
+    parser.add_argument("-d", "--depth", type=int, default=8, help="outstanding command/response pairs")
+    parser.add_argument("-u", "--unlink", type=float, default=0.05, help="probability to unlink an IN URB")
+    parser.add_argument("-q", "--queue", type=int, default=0, help="packets per DAP_QueueCommands chain")
+    parser.add_argument("-s", "--packet-size", type=int, default=512)
+    parser.add_argument("-f", "--fragment", type=int, default=0,
+                        help="send the queued URBs in random writes of 1 to FRAGMENT bytes")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+    if args.queue > args.depth:
+        parser.error("a chain of %d packets needs a depth of at least %d" % (args.queue, args.queue))
+
+    random.seed(args.seed)
+    client = Client(args.host, args.port, args.packet_size, args.fragment)
+    client.attach()
+
+    pending_out = set()
+    pending_in = {}   # IN seqnum -> expected start of the response
+    unlinks = {}      # UNLINK seqnum -> target seqnum
+    completed = set()
+    cancelled = set()
+    sent = answered = errors = 0
+
+    def handle_one():
+        nonlocal answered, errors
+        command, seqnum, status, data = client.receive()
+        if command == RET_UNLINK:
+            target = unlinks.pop(seqnum)
+            if status != 0:
+                if target in completed:
+                    print("URB %d reported unlinked after completion" % target, file=sys.stderr)
+                    errors += 1
+                cancelled.add(target)
+                pending_in.pop(target, None)
+            return
+        if seqnum in pending_out:
+            pending_out.discard(seqnum)
+            return
+        if seqnum in cancelled:
+            print("unlinked URB %d completed" % seqnum, file=sys.stderr)
+            errors += 1
+            return
+        expected = pending_in.pop(seqnum, None)
+        if expected is None:
+            print("unknown seqnum %d" % seqnum, file=sys.stderr)
+            errors += 1
+            return
+        completed.add(seqnum)
+        answered += 1
+        if status != 0 or not data or not data.startswith(expected):
+            print("URB %d: expected response %s, got %s" % (seqnum, expected.hex(), data[:4].hex()),
+                  file=sys.stderr)
+            errors += 1
+
+    start = time.monotonic()
+    while sent < args.count or pending_in or pending_out or unlinks:
+        if sent < args.count and len(pending_in) < args.depth:
+            cmd = COMMANDS[sent % len(COMMANDS)]
+            expected = cmd[:1]
+            if args.queue and sent % args.queue != args.queue - 1:
+                # queued as a batch of one, answered as DAP_ExecuteCommands
+                if cmd[0] == ID_DAP_ExecuteCommands:
+                    cmd = bytes([ID_DAP_QueueCommands]) + cmd[1:]
+                else:
+                    cmd = bytes([ID_DAP_QueueCommands, 0x01]) + cmd
+                expected = bytes([ID_DAP_ExecuteCommands, 0x01, cmd[2]])
+            pending_out.add(client.submit(DIR_OUT, cmd))
+            seq = client.submit(DIR_IN)
+            pending_in[seq] = expected
+            if random.random() < args.unlink:
+                unlinks[client.unlink(seq)] = seq
+            sent += 1
+            continue
+        handle_one()
+
+    elapsed = time.monotonic() - start
+    print("%d commands, %d answered, %d unlinked, %d errors" % (sent, answered, len(cancelled), errors))
+    print("%.3f s, %.0f commands/s" % (elapsed, sent / elapsed if elapsed else 0))
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""
+Websocket DAP benchmark: one command per frame against multi-command frames.
+
+Connects to the websocket DAP server on the DAP proxy port and runs the same
+DAP_Info / DAP_TransferBlock workload in two ways:
+  single  every command is a binary frame of its own, `-w` frames in flight
+  multi   `-k` length-prefixed commands are packed into one 0xFF frame
+Frames/s counts the frames sent by the client, bytes/s the DAP response bytes.
+A target (or USE_SWD_SIM) is needed for full TransferBlock responses.
+
+usage: ws_dap_bench.py host [-p 3240] [-n 5000] [-w 4] [-k 16] [--words 64]
+"""
+
+import argparse
+import base64
+import os
+import socket
+import struct
+import sys
+import time
+
+CO_DAP_MULTI = 0xFF  # ID_DAP_Invalid
+
+
+class WebSocket:
+    def __init__(self, host, port):
+        self.sock = socket.create_connection((host, port), timeout=5)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.rx = b""
+
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.sock.sendall(("GET / HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                           "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n" % (host, key)).encode())
+        while b"\r\n\r\n" not in self.rx:
+            self.fill()
+        header, self.rx = self.rx.split(b"\r\n\r\n", 1)
+        if b" 101 " not in header.split(b"\r\n")[0]:
+            raise RuntimeError("handshake failed: %r" % header)
+
+    def fill(self):
+        chunk = self.sock.recv(65536)
+        if not chunk:
+            raise ConnectionError("connection closed")
+        self.rx += chunk
+
+    def send(self, payload):
+        mask = os.urandom(4)
+        n = len(payload)
+        if n < 126:
+            hdr = struct.pack("!BB", 0x82, 0x80 | n)
+        elif n < 65536:
+            hdr = struct.pack("!BBH", 0x82, 0x80 | 126, n)
+        else:
+            hdr = struct.pack("!BBQ", 0x82, 0x80 | 127, n)
+        masked = bytes(b ^ mask[i & 3] for i, b in enumerate(payload))
+        self.sock.sendall(hdr + mask + masked)
+
+    def recv(self):
+        while True:
+            if len(self.rx) >= 2:
+                n = self.rx[1] & 0x7F
+                pos = 2
+                if n == 126 and len(self.rx) >= 4:
+                    n = struct.unpack_from("!H", self.rx, 2)[0]
+                    pos = 4
+                elif n == 127 and len(self.rx) >= 10:
+                    n = struct.unpack_from("!Q", self.rx, 2)[0]
+                    pos = 10
+                if n < 126 or pos > 2:
+                    if len(self.rx) >= pos + n:
+                        opcode = self.rx[0] & 0x0F
+                        payload = self.rx[pos:pos + n]
+                        self.rx = self.rx[pos + n:]
+                        if opcode == 0x02:
+                            return payload
+                        continue
+            self.fill()
+
+
+def workload(count, words):
+    info = bytes([0x00, 0xFF])  # DAP_Info: packet size
+    block = bytes([0x06, 0x00]) + struct.pack("<H", words) + bytes([0x0F])  # DAP_TransferBlock: read DRW
+    return [info if i % 8 == 0 else block for i in range(count)]
+
+
+def run_single(ws, cmds, window):
+    sent = done = frames = rx_bytes = 0
+    while done < len(cmds):
+        while sent < len(cmds) and sent - done < window:
+            ws.send(cmds[sent])
+            sent += 1
+            frames += 1
+        res = ws.recv()
+        if res[0] != cmds[done][0]:
+            raise RuntimeError("response 0x%02x to command 0x%02x" % (res[0], cmds[done][0]))
+        rx_bytes += len(res)
+        done += 1
+    return frames, rx_bytes
+
+
+def run_multi(ws, cmds, per_frame):
+    frames = rx_bytes = 0
+    for start in range(0, len(cmds), per_frame):
+        batch = cmds[start:start + per_frame]
+        ws.send(bytes([CO_DAP_MULTI]) + b"".join(struct.pack("<H", len(c)) + c for c in batch))
+        frames += 1
+
+        done = 0
+        while done < len(batch):
+            res = ws.recv()
+            if res[0] != CO_DAP_MULTI:
+                raise RuntimeError("not a multi-command response: 0x%02x" % res[0])
+            pos = 1
+            while pos + 2 <= len(res):
+                n = struct.unpack_from("<H", res, pos)[0]
+                if res[pos + 2] != batch[done][0]:
+                    raise RuntimeError("response 0x%02x to command 0x%02x" % (res[pos + 2], batch[done][0]))
+                rx_bytes += n
+                pos += 2 + n
+                done += 1
+    return frames, rx_bytes
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("-p", "--port", type=int, default=3240)
+    parser.add_argument("-n", "--count", type=int, default=5000, help="DAP commands per run")
+    parser.add_argument("-w", "--window", type=int, default=4, help="single frames in flight")
+    parser.add_argument("-k", "--per-frame", type=int, default=16, help="commands per multi-command frame")
+    parser.add_argument("--words", type=int, default=64, help="words per DAP_TransferBlock")
+    args = parser.parse_args()
+
+    cmds = workload(args.count, args.words)
+    for name, run, arg in (("single", run_single, args.window), ("multi", run_multi, args.per_frame)):
+        ws = WebSocket(args.host, args.port)
+        start = time.monotonic()
+        frames, rx_bytes = run(ws, cmds, arg)
+        elapsed = time.monotonic() - start
+        ws.sock.close()
+        print("%-6s %d commands in %d frames, %.2f s: %.0f frames/s, %.0f commands/s, %.0f bytes/s" %
+              (name, len(cmds), frames, elapsed, frames / elapsed, len(cmds) / elapsed, rx_bytes / elapsed))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,393 @@
+/*
+ * Fuzz and benchmark of the websocket frame parser (components/dap_proxy/co_ws_parser.c).
+ *
+ * The receive loop is the one of websocket_server.c: a 1500 byte buffer, frames parsed
+ * where they are, and only what the parser did not consume kept for the next read.
+ *  - round trip: random messages (7, 16 and 64-bit lengths, fragmented, masked or not, with
+ *    control frames between the fragments) are sent in random reads and reassembled,
+ *    some frames whole, the others streamed, and compared with what was sent; binary
+ *    messages starting with CO_DAP_MULTI must be told apart and taken whole, like
+ *    websocket_server.c does with multi-command frames
+ *  - mutation: the same streams with random bytes changed, the parser has to stay inside
+ *    the buffer (build with -fsanitize=address,undefined) and stop on protocol errors
+ *  - benchmark: bulk 1400 byte DAP frames in TCP segment sized reads, unmasked into a slot;
+ *    counts the bytes moved to the front of the buffer, against a per-frame move of the rest
+ *
+ * build: cc -O2 -I.. -o ws_parser_fuzz ws_parser_fuzz.c ../components/dap_proxy/co_ws_parser.c
+ *        or: cmake -S host -B build && cmake --build build
+ *        clang -g -fsanitize=fuzzer,address -DLIBFUZZER ... for a libFuzzer target
+ * usage: ws_parser_fuzz [iterations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "components/dap_proxy/co_mask.h"
+#include "components/dap_proxy/co_ws_parser.h"
+
+#define BUFFER_SIZE 1500
+#define CO_DAP_MULTI 0xFF // ID_DAP_Invalid, the first byte of a multi-command frame
+
+typedef struct {
+	uint8_t *data;
+	size_t len, size;
+} bytes_t;
+
+static void put(bytes_t *b, const void *data, size_t len)
+{
+	if (len == 0)
+		return;
+	if (b->len + len > b->size) {
+		b->size = (b->len + len) * 2;
+		b->data = realloc(b->data, b->size);
+	}
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+}
+
+static int same(const bytes_t *a, const bytes_t *b)
+{
+	return a->len == b->len && (a->len == 0 || memcmp(a->data, b->data, a->len) == 0);
+}
+
+static uint32_t rnd(uint32_t n)
+{
+	return n ? (uint32_t)rand() % n : 0;
+}
+
+static size_t random_length(void)
+{
+	switch (rnd(10)) {
+	case 0:
+		return 126 + rnd(65536 - 126); // 16-bit length
+	case 1:
+		return 65536 + rnd(100000);    // 64-bit length
+	case 2:
+		return 0;
+	default:
+		return rnd(126);
+	}
+}
+
+static void put_frame(bytes_t *out, uint8_t head, const uint8_t *payload, size_t len)
+{
+	uint8_t hdr[WS_HEADER_MAX_SIZE], key[4];
+	int masked = rnd(8) != 0;
+	size_t n = 2;
+
+	hdr[0] = head;
+	if (len < 126) {
+		hdr[1] = len;
+	} else if (len < 65536 && rnd(4)) {
+		hdr[1] = 126;
+		hdr[n++] = len >> 8;
+		hdr[n++] = len;
+	} else { // 64-bit, also for short ones now and then
+		hdr[1] = 127;
+		for (int i = 7; i >= 0; i--)
+			hdr[n++] = (uint64_t)len >> (8 * i);
+	}
+	if (masked) {
+		hdr[1] |= WS_MASK;
+		for (int i = 0; i < 4; i++)
+			key[i] = hdr[n++] = rand();
+	}
+	put(out, hdr, n);
+
+	for (size_t i = 0; i < len; i++) {
+		uint8_t c = payload[i] ^ (masked ? key[i & 3] : 0);
+		put(out, &c, 1);
+	}
+}
+
+// the stream, and what the receiver has to get out of it, data messages and control frames
+// apart: opcode byte, 32-bit length, payload. `multi` counts the multi-command frames.
+static void generate(bytes_t *stream, bytes_t *expect, bytes_t *expect_control, int messages, uint32_t *multi)
+{
+	static uint8_t payload[200000];
+
+	for (int m = 0; m < messages; m++) {
+		uint8_t opcode = rnd(2) ? WS_OPCODE_BINARY : WS_OPCODE_TEXT;
+		size_t len = random_length(), pos = 0;
+		int fragments = rnd(4) ? 1 : 2 + rnd(3);
+		int is_multi = opcode == WS_OPCODE_BINARY && rnd(8) == 0;
+		uint32_t len32;
+
+		if (is_multi) { // one frame the receive buffer can hold
+			len = 1 + rnd(BUFFER_SIZE);
+			fragments = 1;
+			(*multi)++;
+		}
+		len32 = len;
+		for (size_t i = 0; i < len; i++)
+			payload[i] = rand();
+		if (len > 0 && (is_multi || payload[0] == CO_DAP_MULTI))
+			payload[0] = is_multi ? CO_DAP_MULTI : 0;
+		put(expect, &opcode, 1);
+		put(expect, &len32, 4);
+		put(expect, payload, len);
+
+		for (int f = 0; f < fragments; f++) {
+			size_t n = f == fragments - 1 ? len - pos : rnd(len - pos + 1);
+
+			put_frame(stream, (f == fragments - 1 ? WS_FIN : 0) | (f == 0 ? opcode : WS_OPCODE_CONTINUTAION),
+			          payload + pos, n);
+			pos += n;
+
+			if (rnd(4) == 0) { // control frame
+				uint8_t control[125], ping = rnd(2) ? WS_OPCODE_PING : WS_OPCODE_PONG;
+				uint32_t clen = rnd(126);
+
+				for (size_t i = 0; i < clen; i++)
+					control[i] = rand();
+				put(expect_control, &ping, 1);
+				put(expect_control, &clen, 4);
+				put(expect_control, control, clen);
+				put_frame(stream, WS_FIN | ping, control, clen);
+			}
+		}
+	}
+}
+
+typedef struct {
+	bytes_t got;       // same layout as `expect`
+	bytes_t control;   // same layout as `expect_control`
+	bytes_t message;   // data message being reassembled
+	uint8_t opcode;
+	int whole;
+	uint32_t multi;    // multi-command frames taken whole
+	uint64_t moved;    // bytes moved to the front of the buffer
+	uint64_t old_moved; // bytes a move after every frame would have taken
+	uint32_t frames;
+} receiver_t;
+
+static void finish(bytes_t *out, uint8_t opcode, const uint8_t *data, size_t len)
+{
+	uint32_t len32 = len;
+
+	put(out, &opcode, 1);
+	put(out, &len32, 4);
+	put(out, data, len);
+}
+
+// 0 on success, -1 on protocol or delivery errors
+static int handle(receiver_t *r, co_ws_parser_t *p, co_ws_event_t *ev)
+{
+	co_ws_frame_t *f = &p->frame;
+	uint8_t tmp[125];
+
+	if (ev->type == CO_WS_FRAME) {
+		if (f->length > 0 && ev->len == 0)
+			return -1; // a frame comes with the start of its payload
+		if (!(f->opcode & 0x08)) {
+			if (f->first) {
+				r->opcode = f->message;
+				r->message.len = 0;
+			}
+			// multi-command frames are taken whole, the others if the receive buffer can hold them
+			if (f->first && f->message == WS_OPCODE_BINARY && ev->len > 0 &&
+			    (ev->data[0] ^ (uint8_t)ev->mask) == CO_DAP_MULTI) {
+				if (f->fin && f->length <= BUFFER_SIZE) {
+					f->whole = 1;
+					r->multi++;
+				}
+			} else if (f->length <= BUFFER_SIZE && rnd(2)) {
+				f->whole = 1;
+			}
+		}
+		r->whole = f->whole;
+		return 0;
+	}
+
+	if (r->whole && (!ev->last || ev->len != f->length))
+		return -1;
+
+	if (f->opcode & 0x08) {
+		co_mask_copy(tmp, ev->data, ev->len, ev->mask);
+		finish(&r->control, f->opcode, tmp, ev->len);
+	} else {
+		size_t at = r->message.len;
+
+		put(&r->message, ev->data, ev->len); // room for it
+		co_mask_copy(r->message.data + at, ev->data, ev->len, ev->mask);
+		if (ev->last && f->fin)
+			finish(&r->got, r->opcode, r->message.data, r->message.len);
+	}
+	if (ev->last)
+		r->frames++;
+	return 0;
+}
+
+/*
+ * Feed `stream` through the receive loop in reads of `min_read`..`max_read` bytes.
+ * Returns 0 when the whole stream was parsed, -1 on a protocol error.
+ */
+static int receive(receiver_t *r, const uint8_t *stream, size_t len, size_t min_read, size_t max_read,
+                   void (*sink)(receiver_t *, co_ws_parser_t *, co_ws_event_t *))
+{
+	static uint8_t buf[BUFFER_SIZE];
+	co_ws_parser_t parser;
+	co_ws_event_t ev;
+	size_t remaining = 0, sent = 0, pos, n, room, frame_end;
+
+	co_ws_parser_init(&parser);
+	while (sent < len || remaining > 0) {
+		room = BUFFER_SIZE - remaining;
+		if (room == 0 || sent == len)
+			return sent == len && remaining == 0 ? 0 : -1; // stuck: the buffer holds an unparsable rest
+		n = min_read + rnd(max_read - min_read + 1);
+		n = n < room ? n : room;
+		n = n < len - sent ? n : len - sent;
+		memcpy(buf + remaining, stream + sent, n);
+		sent += n;
+		remaining += n;
+
+		for (pos = 0;; pos += n) {
+			n = co_ws_parse(&parser, buf + pos, remaining - pos, &ev);
+			if (ev.type == CO_WS_NEED_MORE)
+				break;
+			if (ev.type == CO_WS_ERROR)
+				return -1;
+			if (ev.type == CO_WS_PAYLOAD && ev.last) {
+				frame_end = pos + n;
+				r->old_moved += remaining - frame_end;
+			}
+			if (sink) {
+				sink(r, &parser, &ev);
+			} else if (handle(r, &parser, &ev) != 0) {
+				return -1;
+			}
+		}
+
+		remaining -= pos;
+		if (pos > 0 && remaining > 0) {
+			memmove(buf, buf + pos, remaining);
+			r->moved += remaining;
+		}
+	}
+	return 0;
+}
+
+static void receiver_free(receiver_t *r)
+{
+	free(r->got.data);
+	free(r->control.data);
+	free(r->message.data);
+	memset(r, 0, sizeof(*r));
+}
+
+static int round_trip(int iterations)
+{
+	int errors = 0;
+
+	for (int i = 0; i < iterations; i++) {
+		bytes_t stream = { 0 }, expect = { 0 }, expect_control = { 0 };
+		receiver_t r = { 0 };
+		size_t max_read = 1 + rnd(3) * rnd(BUFFER_SIZE);
+		uint32_t multi = 0;
+
+		generate(&stream, &expect, &expect_control, 1 + rnd(20), &multi);
+		if (receive(&r, stream.data, stream.len, 1, max_read, NULL) != 0 || !same(&r.got, &expect) ||
+		    !same(&r.control, &expect_control) || r.multi != multi) {
+			printf("round trip %d: mismatch (reads up to %zu)\n", i, max_read);
+			errors++;
+		}
+		receiver_free(&r);
+		free(stream.data);
+		free(expect.data);
+		free(expect_control.data);
+	}
+	return errors;
+}
+
+static void mutate(int iterations)
+{
+	int failed = 0;
+
+	for (int i = 0; i < iterations; i++) {
+		bytes_t stream = { 0 }, expect = { 0 }, expect_control = { 0 };
+		receiver_t r = { 0 };
+		uint32_t multi = 0;
+
+		generate(&stream, &expect, &expect_control, 1 + rnd(8), &multi);
+		for (int k = 1 + rnd(8); k > 0; k--)
+			stream.data[rnd(stream.len)] = rand();
+		failed += receive(&r, stream.data, stream.len, 1, 1 + rnd(BUFFER_SIZE), NULL) != 0;
+		receiver_free(&r);
+		free(stream.data);
+		free(expect.data);
+		free(expect_control.data);
+	}
+	printf("mutation: %d streams, %d stopped on a protocol error\n", iterations, failed);
+}
+
+// the DAP path of websocket_server.c: every request unmasked into a pipeline slot
+static void dap_sink(receiver_t *r, co_ws_parser_t *p, co_ws_event_t *ev)
+{
+	static uint8_t slot[1400];
+	static size_t slot_len;
+
+	(void)p;
+	if (ev->type == CO_WS_FRAME) {
+		slot_len = 0;
+		return;
+	}
+	co_mask_copy(slot + slot_len, ev->data, ev->len, ev->mask);
+	slot_len += ev->len;
+	if (ev->last)
+		r->frames++;
+}
+
+static void bench(size_t read_size)
+{
+	bytes_t stream = { 0 };
+	receiver_t r = { 0 };
+	uint8_t request[1400];
+	struct timespec t0, t1;
+	double seconds;
+	int frames = 20000;
+
+	for (size_t i = 0; i < sizeof(request); i++)
+		request[i] = rand();
+	for (int i = 0; i < frames; i++)
+		put_frame(&stream, WS_FIN | WS_OPCODE_BINARY, request, sizeof(request));
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	receive(&r, stream.data, stream.len, read_size, read_size, dap_sink);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	printf("%zu byte reads: %u frames, %.0f MB/s, moved %.2f bytes per frame (per-frame move: %.0f)\n", read_size,
+	       r.frames, stream.len / seconds / 1e6, (double)r.moved / frames, (double)r.old_moved / frames);
+	receiver_free(&r);
+	free(stream.data);
+}
+
+#ifdef LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	receiver_t r = { 0 };
+
+	receive(&r, data, size, 1, BUFFER_SIZE, NULL);
+	receiver_free(&r);
+	return 0;
+}
+#else
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+	int errors;
+
+	srand(1);
+	errors = round_trip(iterations);
+	printf("round trip: %d streams, %d errors\n", iterations, errors);
+	mutate(iterations);
+
+	bench(536);
+	bench(1460);
+	return errors != 0;
+}
+#endif
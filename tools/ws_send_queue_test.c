@@ -0,0 +1,307 @@
+/*
+ * Host test of the websocket send queue (project_components/web_server/ws_send_queue.c)
+ * with httpd_ws_send_frame_async mocked by mock_send.
+ *
+ * order:     frames reach every client in the order they were queued
+ * shared:    a frame queued to several clients is released once, after the last send
+ * backlog:   a client that does not keep up is dropped and closed, the others are not
+ * heartbeat: an idle broadcast skips clients that had traffic since the last one
+ * threads:   producers queue to random clients while one writer sends, a slow client
+ *            sleeps in send, clients fail and get closed and reopened. Every frame must
+ *            be released exactly once and never be sent after its release.
+ *
+ * build: cc -O2 -g -pthread -I.. -o ws_send_queue_test ws_send_queue_test.c \
+ *           ../project_components/web_server/ws_send_queue.c
+ *        (add -fsanitize=thread or address to check the lock-free parts)
+ *        or: cmake -S host -B build && cmake --build build
+ * usage: ws_send_queue_test [seconds]
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "project_components/web_server/ws_send_queue.h"
+
+#define CLIENT_NR  6
+#define PRODUCERS  4
+#define FRAME_LIVE 0x5a5a5a5a
+#define FRAME_DEAD 0xdeaddead
+
+typedef struct test_frame_t {
+	wsq_frame_t frame;
+	uint32_t magic;
+	uint32_t producer;
+	uint32_t seq;
+} test_frame_t;
+
+static wsq_t q;
+static wsq_client_t clients[CLIENT_NR];
+static int errors;
+
+static uint32_t allocated, released, closes;
+static uint32_t last_seq[CLIENT_NR][PRODUCERS + 1];
+static uint32_t sent_to[CLIENT_NR];
+static int slow_fd = -1, failing_fd = -1;
+
+#define CHECK(cond, ...) do { \
+		if (!(cond)) { \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+			__atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED); \
+		} \
+	} while (0)
+
+static void frame_release(wsq_frame_t *frame)
+{
+	test_frame_t *f = (test_frame_t *)frame;
+
+	CHECK(f->magic == FRAME_LIVE, "frame released twice");
+	f->magic = FRAME_DEAD;
+	__atomic_add_fetch(&released, 1, __ATOMIC_RELAXED);
+	free(f);
+}
+
+static test_frame_t *frame_new(uint32_t producer, uint32_t seq)
+{
+	test_frame_t *f = malloc(sizeof(*f));
+
+	f->magic = FRAME_LIVE;
+	f->producer = producer;
+	f->seq = seq;
+	wsq_frame_init(&f->frame, 2, &f->seq, sizeof(f->seq), frame_release);
+	__atomic_add_fetch(&allocated, 1, __ATOMIC_RELAXED);
+	return f;
+}
+
+/* stands in for httpd_ws_send_frame_async, fd == client index */
+static int mock_send(void *hd, int fd, const wsq_frame_t *frame)
+{
+	const test_frame_t *f = (const test_frame_t *)frame;
+
+	(void)hd;
+	if (frame->release == NULL)
+		return 0; /* static frame */
+
+	CHECK(f->magic == FRAME_LIVE, "frame sent after its release");
+	CHECK(f->seq > last_seq[fd][f->producer] || f->seq == 0,
+	      "client %d: frame %u of producer %u after %u", fd, f->seq, f->producer, last_seq[fd][f->producer]);
+	last_seq[fd][f->producer] = f->seq;
+	sent_to[fd]++;
+
+	if (fd == __atomic_load_n(&slow_fd, __ATOMIC_RELAXED))
+		usleep(200);
+	if (fd == __atomic_load_n(&failing_fd, __ATOMIC_RELAXED))
+		return -1;
+	return 0;
+}
+
+static void mock_close(void *hd, int fd)
+{
+	(void)hd;
+	(void)fd;
+	__atomic_add_fetch(&closes, 1, __ATOMIC_RELAXED);
+}
+
+static const wsq_ops_t ops = {
+	.send = mock_send,
+	.close = mock_close,
+};
+
+static void reset(void)
+{
+	wsq_init(&q, clients, CLIENT_NR, &ops);
+	memset(&q.stats, 0, sizeof(q.stats));
+	memset(last_seq, 0, sizeof(last_seq));
+	memset(sent_to, 0, sizeof(sent_to));
+	allocated = released = closes = 0;
+	slow_fd = failing_fd = -1;
+}
+
+static void test_order(void)
+{
+	reset();
+	for (int i = 0; i < 3; i++)
+		wsq_open(&q, i, NULL, i);
+	for (uint32_t seq = 1; seq <= 5; seq++) {
+		for (int i = 0; i < 3; i++) {
+			test_frame_t *f = frame_new(0, seq);
+			CHECK(wsq_push(&q, i, &f->frame) == 0, "order: push failed");
+			wsq_frame_put(&f->frame);
+		}
+	}
+	wsq_drain(&q);
+	for (int i = 0; i < 3; i++)
+		CHECK(sent_to[i] == 5, "order: client %d got %u frames", i, sent_to[i]);
+	CHECK(released == allocated, "order: %u of %u frames released", released, allocated);
+}
+
+static void test_shared(void)
+{
+	test_frame_t *f;
+
+	reset();
+	for (int i = 0; i < 4; i++)
+		wsq_open(&q, i, NULL, i);
+	f = frame_new(0, 1);
+	CHECK(wsq_broadcast(&q, &f->frame, 0) == 4, "shared: not queued to all clients");
+	wsq_frame_put(&f->frame);
+	CHECK(released == 0, "shared: released before it was sent");
+	wsq_drain(&q);
+	CHECK(released == 1, "shared: released %u times", released);
+	for (int i = 0; i < 4; i++)
+		CHECK(sent_to[i] == 1, "shared: client %d got %u", i, sent_to[i]);
+}
+
+static void test_backlog(void)
+{
+	int refused = 0;
+	wsq_stats_t stats;
+
+	reset();
+	wsq_open(&q, 0, NULL, 0);
+	wsq_open(&q, 1, NULL, 1);
+	/* nobody drains while client 1 gets more than it can hold */
+	for (uint32_t seq = 1; seq <= WSQ_BACKLOG + 4; seq++) {
+		test_frame_t *f = frame_new(0, seq);
+		if (seq <= WSQ_BACKLOG / 2)
+			wsq_push(&q, 0, &f->frame);
+		if (wsq_push(&q, 1, &f->frame) != 0)
+			refused++;
+		wsq_frame_put(&f->frame);
+	}
+	CHECK(refused == 4, "backlog: %d frames refused", refused);
+	wsq_drain(&q);
+	wsq_get_stats(&q, &stats);
+	CHECK(closes == 1, "backlog: %u closes", closes);
+	CHECK(sent_to[0] == WSQ_BACKLOG / 2 && sent_to[1] == 0, "backlog: sent %u and %u", sent_to[0], sent_to[1]);
+	CHECK(stats.dropped_clients == 1 && stats.clients == 1, "backlog: %u dropped, %u open",
+	      stats.dropped_clients, stats.clients);
+	CHECK(stats.high_water == WSQ_BACKLOG, "backlog: high water %u", stats.high_water);
+	CHECK(released == allocated, "backlog: %u of %u frames released", released, allocated);
+	CHECK(wsq_open(&q, 1, NULL, 1) == 0, "backlog: slot not reusable");
+}
+
+static void test_heartbeat(void)
+{
+	static wsq_frame_t heartbeat = { .type = 1 };
+	test_frame_t *f;
+
+	reset();
+	for (int i = 0; i < 3; i++)
+		wsq_open(&q, i, NULL, i);
+	f = frame_new(0, 1);
+	wsq_push(&q, 1, &f->frame);
+	wsq_frame_put(&f->frame);
+	wsq_drain(&q);
+
+	CHECK(wsq_broadcast(&q, &heartbeat, 1) == 2, "heartbeat: client with traffic not skipped");
+	wsq_drain(&q);
+	CHECK(wsq_broadcast(&q, &heartbeat, 1) == 3, "heartbeat: idle clients not all reached");
+	wsq_drain(&q);
+}
+
+static int stop;
+
+static void *producer_thread(void *arg)
+{
+	uint32_t id = (uint32_t)(uintptr_t)arg, seq = 0;
+	unsigned int seed = id;
+
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		test_frame_t *f = frame_new(id, ++seq);
+		if (rand_r(&seed) % 8 == 0) {
+			wsq_broadcast(&q, &f->frame, 0);
+		} else {
+			wsq_push(&q, rand_r(&seed) % CLIENT_NR, &f->frame);
+		}
+		wsq_frame_put(&f->frame);
+		usleep(rand_r(&seed) % 64 == 0 ? 500 : 20);
+	}
+	return NULL;
+}
+
+static void *writer_thread(void *arg)
+{
+	(void)arg;
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		if (wsq_drain(&q) == 0)
+			usleep(50);
+	}
+	while (wsq_drain(&q)) {
+	}
+	return NULL;
+}
+
+static void test_threads(double seconds)
+{
+	pthread_t producers[PRODUCERS], writer;
+	unsigned int seed = 1;
+	wsq_stats_t stats;
+
+	reset();
+	for (int i = 0; i < CLIENT_NR; i++)
+		wsq_open(&q, i, NULL, i);
+	slow_fd = 1;
+
+	__atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+	pthread_create(&writer, NULL, writer_thread, NULL);
+	for (int i = 0; i < PRODUCERS; i++)
+		pthread_create(&producers[i], NULL, producer_thread, (void *)(uintptr_t)(i + 1));
+
+	/* clients come and go, one of them fails its sends for a while */
+	for (int ms = 0; ms < seconds * 1000; ms += 5) {
+		int idx = rand_r(&seed) % CLIENT_NR;
+		switch (rand_r(&seed) % 4) {
+		case 0:
+			wsq_close(&q, idx);
+			break;
+		case 1:
+			wsq_close_after_flush(&q, idx);
+			break;
+		case 2:
+			__atomic_store_n(&failing_fd, rand_r(&seed) % 2 ? idx : -1, __ATOMIC_RELAXED);
+			break;
+		default:
+			/* a new client of the slot, frames keep their order across it */
+			wsq_open(&q, idx, NULL, idx);
+			break;
+		}
+		usleep(5000);
+	}
+
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+	for (int i = 0; i < PRODUCERS; i++)
+		pthread_join(producers[i], NULL);
+	pthread_join(writer, NULL);
+
+	for (int i = 0; i < CLIENT_NR; i++)
+		wsq_close(&q, i);
+	while (wsq_drain(&q)) {
+	}
+
+	wsq_get_stats(&q, &stats);
+	printf("threads: %u frames, %u queued, %u sent, %u dropped (%.1f%%), %u clients dropped, "
+	       "%u closes, depth high water %u\n", allocated, stats.queued, stats.sent, stats.dropped,
+	       stats.queued ? 100.0 * stats.dropped / (stats.queued + stats.dropped) : 0.0,
+	       stats.dropped_clients, closes, stats.high_water);
+	CHECK(released == allocated, "threads: %u of %u frames released", released, allocated);
+	CHECK(stats.depth == 0 && stats.clients == 0, "threads: %u frames, %u clients left", stats.depth, stats.clients);
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = argc > 1 ? atof(argv[1]) : 1;
+
+	test_order();
+	test_shared();
+	test_backlog();
+	test_heartbeat();
+	test_threads(seconds);
+
+	printf("%s, %d errors\n", errors ? "FAIL" : "ok", errors);
+	return errors != 0;
+}
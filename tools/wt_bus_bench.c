@@ -0,0 +1,356 @@
+/*
+ * Host test and benchmark of the event bus (project_components/wt_bus/wt_bus.c) with the
+ * websocket fan-out of uri_ws.c: one bus subscriber queues each message to every client
+ * whose topics match, through the send queue (project_components/web_server/ws_send_queue.c),
+ * with httpd_ws_send_frame_async mocked. malloc stands in for the memory pool.
+ *
+ * threads: publishers publish on random topics while a writer sends, clients change their
+ *          topics, and a second subscriber comes and goes. Every message must be freed
+ *          exactly once, and never be sent or delivered after that.
+ * bench:   cost of fanning one message out to 1..16 clients, publish and send side,
+ *          shared (the bus) against a copy of the message per client.
+ *
+ * build: cc -O2 -g -pthread -I.. -I../project_components/wt_common -o wt_bus_bench wt_bus_bench.c \
+ *           ../project_components/wt_bus/wt_bus.c ../project_components/web_server/ws_send_queue.c
+ *        (add -fsanitize=thread or address to check the lock-free parts)
+ *        or: cmake -S host -B build && cmake --build build
+ * usage: wt_bus_bench [seconds]
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "project_components/wt_bus/wt_bus.h"
+#include "project_components/web_server/ws_send_queue.h"
+
+#define CLIENT_MAX 16
+#define PUBLISHERS 3
+#define MSG_LIVE   0x5a5a5a5a
+#define MSG_DEAD   0xdeaddead
+
+/* a pool buffer: the message, then a tag the test checks */
+typedef struct test_msg_t {
+	uint32_t magic;
+	uint32_t pad;
+	wt_bin_data_internal_t msg;
+} test_msg_t;
+
+static wt_bus_t bus;
+static wsq_t q;
+static wsq_client_t clients[CLIENT_MAX];
+static uint32_t topics[CLIENT_MAX][WT_BUS_FILTER_MAX];
+static int client_num;
+static int check_topics;
+static int errors;
+
+static uint32_t allocated, freed, sent, side_calls;
+
+#define CHECK(cond, ...) do { \
+		if (!(cond)) { \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+			__atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED); \
+		} \
+	} while (0)
+
+#define TO_TEST_MSG(m) ((test_msg_t *)((uint8_t *)(m) - offsetof(test_msg_t, msg)))
+
+static void msg_free(void *ptr)
+{
+	test_msg_t *t = TO_TEST_MSG(ptr);
+
+	CHECK(t->magic == MSG_LIVE, "message freed twice");
+	t->magic = MSG_DEAD;
+	__atomic_add_fetch(&freed, 1, __ATOMIC_RELAXED);
+	free(t);
+}
+
+static wt_bin_data_internal_t *msg_new(uint8_t module_id, uint8_t sub_id, uint16_t len)
+{
+	test_msg_t *t = malloc(sizeof(test_msg_t) + len);
+
+	t->magic = MSG_LIVE;
+	wt_bus_msg_init(&t->msg, WT_DATA_EVENT, module_id, sub_id, len);
+	memset(t->msg.data.payload, sub_id, len);
+	__atomic_add_fetch(&allocated, 1, __ATOMIC_RELAXED);
+	return &t->msg;
+}
+
+/* stands in for httpd_ws_send_frame_async, fd == client index */
+static int mock_send(void *hd, int fd, const wsq_frame_t *frame)
+{
+	const wt_bin_data_t *data = (const wt_bin_data_t *)frame->payload;
+
+	(void)hd;
+	if (frame->release == NULL)
+		return 0;
+	CHECK(TO_TEST_MSG((uint8_t *)data - offsetof(wt_bin_data_internal_t, data))->magic == MSG_LIVE,
+	      "message sent after it was freed");
+	CHECK(!check_topics || wt_bus_match(topics[fd], data->hdr.module_id, data->hdr.sub_id),
+	      "client %d got topic %d/%d", fd, data->hdr.module_id, data->hdr.sub_id);
+	__atomic_add_fetch(&sent, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static const wsq_ops_t ops = {
+	.send = mock_send,
+};
+
+/* the websocket subscriber, as in uri_ws.c */
+static void ws_bus_release(wsq_frame_t *frame)
+{
+	wt_bus_msg_put(&bus, (wt_bin_data_internal_t *)frame);
+}
+
+static int ws_bus_match(void *arg, int idx)
+{
+	const wt_bin_data_hdr_t *hdr = arg;
+	return wt_bus_match(topics[idx], hdr->module_id, hdr->sub_id);
+}
+
+static void ws_on_bus_msg(void *arg, wt_bin_data_internal_t *msg)
+{
+	wsq_frame_t *frame = (wsq_frame_t *)&msg->ws_frame_slot;
+
+	(void)arg;
+	wt_bus_msg_get(msg);
+	wsq_frame_init(frame, 2, &msg->data, sizeof(wt_bin_data_hdr_t) + msg->data_len, ws_bus_release);
+	wsq_multicast(&q, frame, ws_bus_match, &msg->data.hdr);
+	wsq_frame_put(frame);
+}
+
+/* another subscriber in the firmware, reads the message in place */
+static void side_on_msg(void *arg, wt_bin_data_internal_t *msg)
+{
+	(void)arg;
+	CHECK(TO_TEST_MSG(msg)->magic == MSG_LIVE, "message delivered after it was freed");
+	CHECK(msg->data.hdr.module_id == 1, "side subscriber got module %d", msg->data.hdr.module_id);
+	__atomic_add_fetch(&side_calls, 1, __ATOMIC_RELAXED);
+}
+
+static void setup(int clients_open)
+{
+	static const uint32_t any = WT_BUS_FILTER(WT_BUS_ANY, WT_BUS_ANY);
+
+	wt_bus_init(&bus, msg_free);
+	wsq_init(&q, clients, CLIENT_MAX, &ops);
+	memset(&q.stats, 0, sizeof(q.stats));
+	memset(topics, 0, sizeof(topics));
+	client_num = clients_open;
+	for (int i = 0; i < clients_open; i++)
+		wsq_open(&q, i, NULL, i);
+	wt_bus_set_filters(&bus, wt_bus_subscribe(&bus, ws_on_bus_msg, NULL), &any, 1);
+	allocated = freed = sent = side_calls = 0;
+}
+
+static void test_topics(void)
+{
+	setup(4);
+	check_topics = 1;
+	topics[0][0] = WT_BUS_FILTER(WT_BUS_ANY, WT_BUS_ANY);
+	topics[1][0] = WT_BUS_FILTER(1, WT_BUS_ANY);
+	topics[2][0] = WT_BUS_FILTER(1, 3);
+	topics[2][1] = WT_BUS_FILTER(4, 1);
+	/* client 3 subscribed to nothing */
+
+	CHECK(wt_bus_publish(&bus, msg_new(1, 3, 8)) == 1, "topics: not published");
+	wt_bus_publish(&bus, msg_new(1, 2, 8));
+	wt_bus_publish(&bus, msg_new(4, 1, 8));
+	wt_bus_publish(&bus, msg_new(0, 1, 8));
+	CHECK(freed == 0, "topics: freed before it was sent");
+	wsq_drain(&q);
+
+	/* 3 + 2 + 2 + 1 */
+	CHECK(sent == 8, "topics: %u frames sent", sent);
+	CHECK(freed == allocated, "topics: %u of %u messages freed", freed, allocated);
+	check_topics = 0;
+}
+
+static void test_no_client(void)
+{
+	wt_bus_stats_t stats;
+	int side;
+
+	setup(0);
+	side = wt_bus_subscribe(&bus, side_on_msg, NULL);
+	wt_bus_unsubscribe(&bus, 0);
+	CHECK(!wt_bus_wanted(&bus, 1, 1), "no client: unfiltered subscriber wants messages");
+	wt_bus_set_filters(&bus, side, (uint32_t[]){ WT_BUS_FILTER(1, WT_BUS_ANY) }, 1);
+	CHECK(wt_bus_wanted(&bus, 1, 1) && !wt_bus_wanted(&bus, 2, 1), "no client: filter not applied");
+
+	CHECK(wt_bus_publish(&bus, msg_new(2, 1, 8)) == 0, "no client: unmatched message delivered");
+	CHECK(wt_bus_publish(&bus, msg_new(1, 1, 8)) == 1, "no client: message not delivered");
+	wt_bus_get_stats(&bus, &stats);
+	CHECK(stats.published == 2 && stats.unmatched == 1 && stats.delivered == 1,
+	      "no client: stats %u %u %u", stats.published, stats.delivered, stats.unmatched);
+	CHECK(freed == allocated, "no client: %u of %u messages freed", freed, allocated);
+}
+
+static int stop;
+
+static void *publisher_thread(void *arg)
+{
+	unsigned int seed = (unsigned int)(uintptr_t)arg;
+
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		wt_bus_publish(&bus, msg_new(rand_r(&seed) % 3, rand_r(&seed) % 4, 16 + rand_r(&seed) % 200));
+		usleep(20);
+	}
+	return NULL;
+}
+
+static void *writer_thread(void *arg)
+{
+	(void)arg;
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		if (wsq_drain(&q) == 0)
+			usleep(50);
+	}
+	return NULL;
+}
+
+static void test_threads(double seconds)
+{
+	pthread_t publishers[PUBLISHERS], writer;
+	unsigned int seed = 7;
+	int side = -1;
+	wsq_stats_t stats;
+
+	setup(8);
+	__atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+	pthread_create(&writer, NULL, writer_thread, NULL);
+	for (int i = 0; i < PUBLISHERS; i++)
+		pthread_create(&publishers[i], NULL, publisher_thread, (void *)(uintptr_t)(i + 1));
+
+	for (int ms = 0; ms < seconds * 1000; ms += 2) {
+		int idx = rand_r(&seed) % client_num;
+		uint32_t filter = rand_r(&seed) % 4 ? WT_BUS_FILTER(rand_r(&seed) % 3, WT_BUS_ANY) : 0;
+
+		/* a client changes its topics, a publish in flight may still send it one of the old */
+		__atomic_store_n(&topics[idx][0], filter, __ATOMIC_RELAXED);
+
+		if (side < 0) {
+			side = wt_bus_subscribe(&bus, side_on_msg, NULL);
+			wt_bus_set_filters(&bus, side, (uint32_t[]){ WT_BUS_FILTER(1, WT_BUS_ANY) }, 1);
+		} else if (rand_r(&seed) % 2) {
+			wt_bus_unsubscribe(&bus, side);
+			side = -1;
+		}
+		usleep(2000);
+	}
+
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+	for (int i = 0; i < PUBLISHERS; i++)
+		pthread_join(publishers[i], NULL);
+	pthread_join(writer, NULL);
+	while (wsq_drain(&q)) {
+	}
+
+	wsq_get_stats(&q, &stats);
+	printf("threads: %u messages, %u frames sent, %u dropped, %u side deliveries\n",
+	       allocated, stats.sent, stats.dropped, side_calls);
+	CHECK(freed == allocated, "threads: %u of %u messages freed", freed, allocated);
+}
+
+/*
+ * bench
+ * */
+
+static void copy_release(wsq_frame_t *frame)
+{
+	msg_free(frame);
+}
+
+/* what a fan-out without sharing does: one message per client */
+static void publish_copies(const wt_bin_data_internal_t *src)
+{
+	for (int i = 0; i < client_num; i++) {
+		test_msg_t *t;
+		wsq_frame_t *frame;
+
+		if (!wt_bus_match(topics[i], src->data.hdr.module_id, src->data.hdr.sub_id))
+			continue;
+		t = malloc(sizeof(test_msg_t) + src->data_len);
+		t->magic = MSG_LIVE;
+		memcpy(&t->msg, src, sizeof(*src) + src->data_len);
+		__atomic_add_fetch(&allocated, 1, __ATOMIC_RELAXED);
+		frame = (wsq_frame_t *)&t->msg.ws_frame_slot;
+		wsq_frame_init(frame, 2, &t->msg.data, sizeof(wt_bin_data_hdr_t) + src->data_len, copy_release);
+		wsq_push(&q, i, frame);
+		wsq_frame_put(frame);
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench(int clients_open, uint16_t len, int copies, int rounds, double *pub_ns, double *send_ns)
+{
+	const int batch = WSQ_BACKLOG / 2;
+	double pub = 0, send = 0, t;
+	wt_bin_data_internal_t *msg;
+
+	setup(clients_open);
+	for (int i = 0; i < clients_open; i++)
+		topics[i][0] = WT_BUS_FILTER(1, WT_BUS_ANY);
+
+	for (int r = 0; r < rounds; r += batch) {
+		t = now_ns();
+		for (int i = 0; i < batch; i++) {
+			/* both build the event once, in a buffer of their own */
+			msg = msg_new(1, 1, len);
+			if (copies) {
+				publish_copies(msg);
+				msg_free(msg);
+			} else {
+				wt_bus_publish(&bus, msg);
+			}
+		}
+		pub += now_ns() - t;
+
+		t = now_ns();
+		wsq_drain(&q);
+		send += now_ns() - t;
+	}
+
+	CHECK(freed == allocated, "bench: %u of %u messages freed", freed, allocated);
+	*pub_ns = pub / rounds;
+	*send_ns = send / rounds;
+}
+
+int main(int argc, char **argv)
+{
+	static const uint16_t lens[] = { 64, 1024 };
+	double seconds = argc > 1 ? atof(argv[1]) : 1;
+	int rounds = 200000;
+
+	test_topics();
+	test_no_client();
+	test_threads(seconds);
+	printf("%s, %d errors\n\n", errors ? "FAIL" : "ok", errors);
+
+	printf("fan-out per message in ns, publish + send side\n");
+	printf("%8s %8s %24s %24s\n", "payload", "clients", "shared", "copy per client");
+	for (int l = 0; l < 2; l++) {
+		for (int n = 1; n <= CLIENT_MAX; n *= 2) {
+			double shared_pub, shared_send, copy_pub, copy_send;
+
+			bench(n, lens[l], 0, rounds, &shared_pub, &shared_send);
+			bench(n, lens[l], 1, rounds, &copy_pub, &copy_send);
+			printf("%8u %8d %9.0f + %5.0f = %5.0f %9.0f + %5.0f = %5.0f\n", lens[l], n,
+			       shared_pub, shared_send, shared_pub + shared_send,
+			       copy_pub, copy_send, copy_pub + copy_send);
+		}
+	}
+	return errors != 0;
+}